@@ -8,7 +8,9 @@
 #include <sys/stat.h>
 #endif
 
+#include <algorithm>
 #include <array>
+#include <optional>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -120,7 +122,33 @@ bool filter_manager::FilenameFiltered(std::vector<CFilter> const& filters, std::
 	return false;
 }
 
-static bool StringMatch(std::wstring const& subject, CFilterCondition const& condition, bool matchCase)
+namespace {
+// Lowercases the subject only once, and only if needed
+class subject final
+{
+public:
+	explicit subject(std::wstring const& value)
+		: value_(value)
+	{}
+
+	std::wstring const& value() const { return value_; }
+
+	std::wstring const& lower() const
+	{
+		if (!lowered_) {
+			lower_ = fz::str_tolower(value_);
+			lowered_ = true;
+		}
+		return lower_;
+	}
+
+private:
+	std::wstring const& value_;
+	mutable std::wstring lower_;
+	mutable bool lowered_{};
+};
+
+bool StringMatch(subject const& s, CFilterCondition const& condition, bool matchCase)
 {
 	bool match = false;
 
@@ -128,24 +156,24 @@ static bool StringMatch(std::wstring const& subject, CFilterCondition const& con
 	{
 	case 0:
 		if (matchCase) {
-			if (subject.find(condition.strValue) != std::wstring::npos) {
+			if (s.value().find(condition.strValue) != std::wstring::npos) {
 				match = true;
 			}
 		}
 		else {
-			if (fz::str_tolower(subject).find(condition.lowerValue) != std::wstring::npos) {
+			if (s.lower().find(condition.lowerValue) != std::wstring::npos) {
 				match = true;
 			}
 		}
 		break;
 	case 1:
 		if (matchCase) {
-			if (subject == condition.strValue) {
+			if (s.value() == condition.strValue) {
 				match = true;
 			}
 		}
 		else {
-			if (fz::str_tolower(subject) == condition.lowerValue) {
+			if (s.lower() == condition.lowerValue) {
 				match = true;
 			}
 		}
@@ -153,36 +181,36 @@ static bool StringMatch(std::wstring const& subject, CFilterCondition const& con
 	case 2:
 		{
 			if (matchCase) {
-				match = fz::starts_with(subject, condition.strValue);
+				match = fz::starts_with(s.value(), condition.strValue);
 			}
 			else {
-				match = fz::starts_with(fz::str_tolower(subject), condition.lowerValue);
+				match = fz::starts_with(s.lower(), condition.lowerValue);
 			}
 		}
 		break;
 	case 3:
 		{
 			if (matchCase) {
-				match = fz::ends_with(subject, condition.strValue);
+				match = fz::ends_with(s.value(), condition.strValue);
 			}
 			else {
-				match = fz::ends_with(fz::str_tolower(subject), condition.lowerValue);
+				match = fz::ends_with(s.lower(), condition.lowerValue);
 			}
 		}
 		break;
 	case 4:
-		if (condition.pRegEx && regex_ns::regex_search(subject, *std::static_pointer_cast<regex_ns::wregex>(condition.pRegEx))) {
+		if (condition.pRegEx && regex_ns::regex_search(s.value(), *std::static_pointer_cast<regex_ns::wregex>(condition.pRegEx))) {
 			match = true;
 		}
 		break;
 	case 5:
 		if (matchCase) {
-			if (subject.find(condition.strValue) == std::wstring::npos) {
+			if (s.value().find(condition.strValue) == std::wstring::npos) {
 				match = true;
 			}
 		}
 		else {
-			if (fz::str_tolower(subject).find(condition.lowerValue) == std::wstring::npos) {
+			if (s.lower().find(condition.lowerValue) == std::wstring::npos) {
 				match = true;
 			}
 		}
@@ -192,193 +220,525 @@ static bool StringMatch(std::wstring const& subject, CFilterCondition const& con
 	return match;
 }
 
-bool filter_manager::FilenameFilteredByFilter(CFilter const& filter, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date)
+enum class condition_result
 {
-	if (dir && !filter.filterDirs) {
-		return false;
-	}
-	else if (!dir && !filter.filterFiles) {
-		return false;
-	}
+	match,
+	no_match,
+	skip // Condition does not apply to the entry
+};
 
-	for (auto const& condition : filter.filters) {
-		bool match = false;
+condition_result MatchCondition(CFilterCondition const& condition, bool matchCase, subject const& name, subject const& path, int64_t size, int attributes, fz::datetime const& date)
+{
+	bool match = false;
 
-		switch (condition.type)
+	switch (condition.type)
+	{
+	case filter_name:
+		match = StringMatch(name, condition, matchCase);
+		break;
+	case filter_path:
+		match = StringMatch(path, condition, matchCase);
+		break;
+	case filter_size:
+		if (size == -1) {
+			return condition_result::skip;
+		}
+		switch (condition.condition)
 		{
-		case filter_name:
-			match = StringMatch(name, condition, filter.matchCase);
+		case 0:
+			if (size > condition.value) {
+				match = true;
+			}
 			break;
-		case filter_path:
-			match = StringMatch(path, condition, filter.matchCase);
+		case 1:
+			if (size == condition.value) {
+				match = true;
+			}
 			break;
-		case filter_size:
-			if (size == -1) {
-				continue;
+		case 2:
+			if (size != condition.value) {
+				match = true;
 			}
+			break;
+		case 3:
+			if (size < condition.value) {
+				match = true;
+			}
+			break;
+		}
+		break;
+	case filter_attributes:
+#ifndef FZ_WINDOWS
+		return condition_result::skip;
+#else
+		if (!attributes) {
+			return condition_result::skip;
+		}
+
+		{
+			int flag = 0;
 			switch (condition.condition)
 			{
 			case 0:
-				if (size > condition.value) {
-					match = true;
-				}
+				flag = FILE_ATTRIBUTE_ARCHIVE;
 				break;
 			case 1:
-				if (size == condition.value) {
-					match = true;
-				}
+				flag = FILE_ATTRIBUTE_COMPRESSED;
 				break;
 			case 2:
-				if (size != condition.value) {
-					match = true;
-				}
+				flag = FILE_ATTRIBUTE_ENCRYPTED;
 				break;
 			case 3:
-				if (size < condition.value) {
-					match = true;
-				}
+				flag = FILE_ATTRIBUTE_HIDDEN;
+				break;
+			case 4:
+				flag = FILE_ATTRIBUTE_READONLY;
+				break;
+			case 5:
+				flag = FILE_ATTRIBUTE_SYSTEM;
 				break;
 			}
-			break;
-		case filter_attributes:
-#ifndef FZ_WINDOWS
-			continue;
-#else
-			if (!attributes) {
-				continue;
-			}
-
-			{
-				int flag = 0;
-				switch (condition.condition)
-				{
-				case 0:
-					flag = FILE_ATTRIBUTE_ARCHIVE;
-					break;
-				case 1:
-					flag = FILE_ATTRIBUTE_COMPRESSED;
-					break;
-				case 2:
-					flag = FILE_ATTRIBUTE_ENCRYPTED;
-					break;
-				case 3:
-					flag = FILE_ATTRIBUTE_HIDDEN;
-					break;
-				case 4:
-					flag = FILE_ATTRIBUTE_READONLY;
-					break;
-				case 5:
-					flag = FILE_ATTRIBUTE_SYSTEM;
-					break;
-				}
 
-				int set = (flag & attributes) ? 1 : 0;
-				if (set == condition.value) {
-					match = true;
-				}
+			int set = (flag & attributes) ? 1 : 0;
+			if (set == condition.value) {
+				match = true;
 			}
+		}
 #endif //FZ_WINDOWS
-			break;
-		case filter_permissions:
+		break;
+	case filter_permissions:
 #ifdef FZ_WINDOWS
-			continue;
+		return condition_result::skip;
 #else
-			if (attributes == -1) {
-				continue;
-			}
+		if (attributes == -1) {
+			return condition_result::skip;
+		}
 
+		{
+			int flag = 0;
+			switch (condition.condition)
 			{
-				int flag = 0;
-				switch (condition.condition)
-				{
-				case 0:
-					flag = S_IRUSR;
-					break;
-				case 1:
-					flag = S_IWUSR;
-					break;
-				case 2:
-					flag = S_IXUSR;
-					break;
-				case 3:
-					flag = S_IRGRP;
-					break;
-				case 4:
-					flag = S_IWGRP;
-					break;
-				case 5:
-					flag = S_IXGRP;
-					break;
-				case 6:
-					flag = S_IROTH;
-					break;
-				case 7:
-					flag = S_IWOTH;
-					break;
-				case 8:
-					flag = S_IXOTH;
-					break;
-				}
+			case 0:
+				flag = S_IRUSR;
+				break;
+			case 1:
+				flag = S_IWUSR;
+				break;
+			case 2:
+				flag = S_IXUSR;
+				break;
+			case 3:
+				flag = S_IRGRP;
+				break;
+			case 4:
+				flag = S_IWGRP;
+				break;
+			case 5:
+				flag = S_IXGRP;
+				break;
+			case 6:
+				flag = S_IROTH;
+				break;
+			case 7:
+				flag = S_IWOTH;
+				break;
+			case 8:
+				flag = S_IXOTH;
+				break;
+			}
 
-				int set = (flag & attributes) ? 1 : 0;
-				if (set == condition.value) {
-					match = true;
-				}
+			int set = (flag & attributes) ? 1 : 0;
+			if (set == condition.value) {
+				match = true;
 			}
+		}
 #endif //FZ_WINDOWS
-			break;
-		case filter_date:
-			if (!date.empty()) {
-				int cmp = date.compare(condition.date);
-				switch (condition.condition)
-				{
-				case 0: // Before
-					match = cmp < 0;
-					break;
-				case 1: // Equals
-					match = cmp == 0;
-					break;
-				case 2: // Not equals
-					match = cmp != 0;
-					break;
-				case 3: // After
-					match = cmp > 0;
-					break;
-				}
+		break;
+	case filter_date:
+		if (!date.empty()) {
+			int cmp = date.compare(condition.date);
+			switch (condition.condition)
+			{
+			case 0: // Before
+				match = cmp < 0;
+				break;
+			case 1: // Equals
+				match = cmp == 0;
+				break;
+			case 2: // Not equals
+				match = cmp != 0;
+				break;
+			case 3: // After
+				match = cmp > 0;
+				break;
 			}
-			break;
-		default:
-			break;
 		}
-		if (match) {
-			if (filter.matchType == CFilter::any) {
+		break;
+	default:
+		break;
+	}
+
+	return match ? condition_result::match : condition_result::no_match;
+}
+
+// Match decides on a single condition
+template<typename Conditions, typename Match>
+bool MatchFilter(Conditions const& conditions, CFilter::t_matchType matchType, Match && match)
+{
+	for (auto const& condition : conditions) {
+		auto const result = match(condition);
+		if (result == condition_result::skip) {
+			continue;
+		}
+		if (result == condition_result::match) {
+			if (matchType == CFilter::any) {
 				return true;
 			}
-			else if (filter.matchType == CFilter::none) {
+			else if (matchType == CFilter::none) {
 				return false;
 			}
 		}
 		else {
-			if (filter.matchType == CFilter::all) {
+			if (matchType == CFilter::all) {
 				return false;
 			}
-			else if (filter.matchType == CFilter::not_all) {
+			else if (matchType == CFilter::not_all) {
 				return true;
 			}
 		}
 	}
 
-	if (filter.matchType == CFilter::not_all) {
+	if (matchType == CFilter::not_all) {
 		return false;
 	}
 
-	if (filter.matchType != CFilter::any || filter.filters.empty()) {
+	if (matchType != CFilter::any || conditions.empty()) {
 		return true;
 	}
 
 	return false;
 }
 
+// Relative cost of evaluating a condition
+int ConditionCost(CFilterCondition const& condition)
+{
+	switch (condition.type) {
+	case filter_name:
+	case filter_path:
+		return condition.condition == 4 ? 2 : 1;
+	default:
+		return 0;
+	}
+}
+}
+
+bool filter_manager::FilenameFilteredByFilter(CFilter const& filter, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date)
+{
+	if (dir && !filter.filterDirs) {
+		return false;
+	}
+	else if (!dir && !filter.filterFiles) {
+		return false;
+	}
+
+	subject const n(name);
+	subject const p(path);
+	return MatchFilter(filter.filters, filter.matchType, [&](CFilterCondition const& condition) {
+		return MatchCondition(condition, filter.matchCase, n, p, size, attributes, date);
+	});
+}
+
+// An Aho-Corasick automaton for each subject and case sensitivity. Scanning
+// a subject once finds all occurrences of all literals, from which the
+// contains, equals, begins with and ends with conditions get decided.
+struct compiled_filters::literal_matcher final
+{
+	enum group {
+		name,
+		name_lower,
+		path,
+		path_lower,
+		group_count
+	};
+
+	// What has been found of a pattern in its subject
+	enum hit : unsigned char {
+		found = 0x1,
+		at_start = 0x2,
+		at_end = 0x4,
+		whole = 0x8
+	};
+
+	class automaton final
+	{
+	public:
+		bool empty() const { return nodes_.size() == 1; }
+
+		// Returns the pattern of the literal, the given new one unless
+		// the literal has been added before
+		int add(std::wstring const& literal, int pattern)
+		{
+			int state = 0;
+			for (auto const c : literal) {
+				int next = find_edge(state, c);
+				if (next < 0) {
+					next = static_cast<int>(nodes_.size());
+					auto & edges = nodes_[state].next;
+					auto const it = std::lower_bound(edges.begin(), edges.end(), c, [](auto const& e, wchar_t ch) { return e.first < ch; });
+					edges.emplace(it, c, next);
+					nodes_.emplace_back();
+				}
+				state = next;
+			}
+			if (nodes_[state].output < 0) {
+				nodes_[state].output = pattern;
+			}
+			return nodes_[state].output;
+		}
+
+		// Sets up the failure links, breadth-first
+		void build()
+		{
+			root_.fill(-1);
+			for (auto const& edge : nodes_[0].next) {
+				if (static_cast<size_t>(edge.first) < root_.size()) {
+					root_[edge.first] = edge.second;
+				}
+			}
+
+			std::vector<int> queue;
+			for (auto const& edge : nodes_[0].next) {
+				queue.push_back(edge.second);
+			}
+			for (size_t i = 0; i < queue.size(); ++i) {
+				int const state = queue[i];
+				for (auto const& edge : nodes_[state].next) {
+					int fail = nodes_[state].fail;
+					int next = step(fail, edge.first);
+					while (next < 0 && fail) {
+						fail = nodes_[fail].fail;
+						next = step(fail, edge.first);
+					}
+
+					node & child = nodes_[edge.second];
+					child.fail = next < 0 ? 0 : next;
+					child.dict = nodes_[child.fail].output >= 0 ? child.fail : nodes_[child.fail].dict;
+					queue.push_back(edge.second);
+				}
+			}
+		}
+
+		void scan(std::wstring const& s, std::vector<size_t> const& lengths, std::vector<unsigned char> & hits) const
+		{
+			int state = 0;
+			for (size_t i = 0; i < s.size(); ++i) {
+				int next = step(state, s[i]);
+				while (next < 0 && state) {
+					state = nodes_[state].fail;
+					next = step(state, s[i]);
+				}
+				state = next < 0 ? 0 : next;
+
+				for (int n = nodes_[state].output >= 0 ? state : nodes_[state].dict; n >= 0; n = nodes_[n].dict) {
+					int const pattern = nodes_[n].output;
+					size_t const end = i + 1;
+					unsigned char h = found;
+					if (end == lengths[pattern]) {
+						h |= at_start;
+					}
+					if (end == s.size()) {
+						h |= at_end;
+						if (end == lengths[pattern]) {
+							h |= whole;
+						}
+					}
+					hits[pattern] |= h;
+				}
+			}
+		}
+
+	private:
+		int step(int state, wchar_t c) const
+		{
+			// Most characters lead back to the root, look those up directly
+			if (!state && static_cast<size_t>(c) < root_.size()) {
+				return root_[c];
+			}
+			return find_edge(state, c);
+		}
+
+		int find_edge(int state, wchar_t c) const
+		{
+			auto const& edges = nodes_[state].next;
+			auto const it = std::lower_bound(edges.begin(), edges.end(), c, [](auto const& e, wchar_t ch) { return e.first < ch; });
+			return (it != edges.end() && it->first == c) ? it->second : -1;
+		}
+
+		struct node final
+		{
+			std::vector<std::pair<wchar_t, int>> next; // Sorted by character
+			int fail{};
+			int output{-1}; // Pattern ending here
+			int dict{-1}; // Nearest node along the failure links with an output
+		};
+
+		std::vector<node> nodes_{1};
+		std::array<int, 128> root_{};
+	};
+
+	// Returns the pattern to look up, or -1 if the condition isn't literal
+	int add(CFilterCondition const& condition, bool matchCase)
+	{
+		if ((condition.type != filter_name && condition.type != filter_path) ||
+			condition.condition == 4 || condition.condition > 5)
+		{
+			return -1;
+		}
+
+		int g = condition.type == filter_name ? name : path;
+		if (!matchCase) {
+			++g;
+		}
+		std::wstring const& literal = matchCase ? condition.strValue : condition.lowerValue;
+		if (literal.empty()) {
+			return -1;
+		}
+
+		int const pattern = automata[g].add(literal, static_cast<int>(lengths.size()));
+		if (pattern == static_cast<int>(lengths.size())) {
+			lengths.push_back(literal.size());
+			groups.push_back(static_cast<group>(g));
+		}
+		return pattern;
+	}
+
+	void build()
+	{
+		for (auto & a : automata) {
+			a.build();
+		}
+	}
+
+	bool empty() const { return lengths.empty(); }
+
+	// Decides on a literal condition from what has been found of its pattern
+	static bool matches(int condition, unsigned char h)
+	{
+		switch (condition) {
+		case 0:
+			return h & found;
+		case 1:
+			return h & whole;
+		case 2:
+			return h & at_start;
+		case 3:
+			return h & at_end;
+		case 5:
+			return !(h & found);
+		default:
+			return false;
+		}
+	}
+
+	// The findings for a single entry, each subject is scanned on first use
+	class state final
+	{
+	public:
+		state(literal_matcher const& matcher, subject const& name, subject const& path)
+			: matcher_(matcher)
+			, name_(name)
+			, path_(path)
+			, hits_(matcher.lengths.size())
+		{}
+
+		unsigned char get(int pattern)
+		{
+			group const g = matcher_.groups[pattern];
+			if (!scanned_[g]) {
+				scanned_[g] = true;
+				subject const& s = (g == name || g == name_lower) ? name_ : path_;
+				matcher_.automata[g].scan((g == name || g == path) ? s.value() : s.lower(), matcher_.lengths, hits_);
+			}
+			return hits_[pattern];
+		}
+
+	private:
+		literal_matcher const& matcher_;
+		subject const& name_;
+		subject const& path_;
+		std::vector<unsigned char> hits_;
+		bool scanned_[group_count]{};
+	};
+
+	automaton automata[group_count];
+	std::vector<size_t> lengths; // By pattern
+	std::vector<group> groups; // By pattern
+};
+
+compiled_filters::compiled_filters(std::vector<CFilter> const& filters)
+{
+	auto literals = std::make_shared<literal_matcher>();
+
+	filters_.reserve(filters.size());
+	for (auto const& filter : filters) {
+		if (!filter.filterFiles && !filter.filterDirs) {
+			continue;
+		}
+
+		compiled_filter f;
+		f.conditions.reserve(filter.filters.size());
+		for (auto const& condition : filter.filters) {
+			f.conditions.push_back({condition, literals->add(condition, filter.matchCase)});
+		}
+		f.matchType = filter.matchType;
+		f.matchCase = filter.matchCase;
+		f.filterFiles = filter.filterFiles;
+		f.filterDirs = filter.filterDirs;
+
+		// The outcome does not depend on the order of the conditions, so
+		// evaluate the cheap ones first, they often decide on their own.
+		std::stable_sort(f.conditions.begin(), f.conditions.end(), [](compiled_condition const& lhs, compiled_condition const& rhs) {
+			return ConditionCost(lhs.condition) < ConditionCost(rhs.condition);
+		});
+		filters_.emplace_back(std::move(f));
+	}
+
+	if (!literals->empty()) {
+		literals->build();
+		literals_ = std::move(literals);
+	}
+}
+
+bool compiled_filters::filtered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const
+{
+	// Shared by all filters, so that each subject gets lowercased and
+	// scanned for literals at most once
+	subject const n(name);
+	subject const p(path);
+	std::optional<literal_matcher::state> literals;
+
+	for (auto const& filter : filters_) {
+		if (dir ? !filter.filterDirs : !filter.filterFiles) {
+			continue;
+		}
+
+		bool const match = MatchFilter(filter.conditions, filter.matchType, [&](compiled_condition const& c) {
+			if (c.literal >= 0) {
+				if (!literals) {
+					literals.emplace(*literals_, n, p);
+				}
+				return literal_matcher::matches(c.condition.condition, literals->get(c.literal)) ? condition_result::match : condition_result::no_match;
+			}
+			return MatchCondition(c.condition, filter.matchCase, n, p, size, attributes, date);
+		});
+		if (match) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool load_filter(pugi::xml_node& element, CFilter& filter)
 {
 	filter.name = GetTextElement(element, "Name").substr(0, 255);
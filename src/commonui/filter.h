@@ -94,6 +94,43 @@ public:
 	static bool FilenameFilteredByFilter(CFilter const& filter, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date);
 };
 
+// A set of filters prepared for matching many entries against them.
+// Gives the same results as filter_manager::FilenameFiltered.
+class FZCUI_PUBLIC_SYMBOL compiled_filters final
+{
+public:
+	compiled_filters() = default;
+	explicit compiled_filters(std::vector<CFilter> const& filters);
+
+	bool empty() const { return filters_.empty(); }
+
+	// Note: Under non-windows, attributes are permissions
+	bool filtered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const;
+
+private:
+	// The literal name and path conditions of all filters, matched in a
+	// single pass over each subject. See filter.cpp.
+	struct literal_matcher;
+
+	struct compiled_condition final
+	{
+		CFilterCondition condition;
+		int literal{-1}; // Pattern in the literal matcher, if matched through it
+	};
+
+	struct compiled_filter final
+	{
+		std::vector<compiled_condition> conditions; // Cheapest first
+		CFilter::t_matchType matchType{CFilter::all};
+		bool matchCase{};
+		bool filterFiles{};
+		bool filterDirs{};
+	};
+
+	std::vector<compiled_filter> filters_;
+	std::shared_ptr<literal_matcher const> literals_;
+};
+
 typedef std::pair<std::vector<CFilter>, std::vector<CFilter>> ActiveFilters;
 
 struct FZCUI_PUBLIC_SYMBOL filter_data final {
@@ -2,6 +2,12 @@
 
 #include <libfilezilla/local_filesys.hpp>
 
+namespace {
+// Directories are enumerated concurrently, which mostly helps with
+// network file systems where each directory read waits on the server.
+size_t const walker_count = 8;
+}
+
 local_recursive_operation::local_recursive_operation()
 {}
 
@@ -60,9 +66,14 @@ bool local_recursive_operation::do_start_recursive_operation(OperationMode mode,
 	m_processedFiles = 0;
 	m_processedDirectories = 0;
 
+	pending_dirs_.clear();
+	emitted_dirs_ = 0;
+	emitting_ = false;
+
 	m_operationMode = mode;
 
 	m_filters = filters;
+	filters_ = std::make_shared<compiled_filters const>(filters.first);
 	m_ignoreLinks = ignore_links;
 
 	if (pool_) {
@@ -90,6 +101,8 @@ void local_recursive_operation::StopRecursiveOperation()
 		m_processedFiles = 0;
 		m_processedDirectories = 0;
 
+		// Wake up idle walkers so that they notice the cancellation
+		cond_.notify_all();
 	}
 
 	thread_.join();
@@ -113,7 +126,7 @@ void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, lis
 
 			CServerPath remoteSub = d.remotePath;
 			if (!remoteSub.empty()) {
-				if (m_operationMode == recursive_transfer) {
+				if (m_operationMode == recursive_transfer || m_operationMode == recursive_list) {
 					// Non-flatten case
 					remoteSub.AddSegment(entry.name);
 				}
@@ -132,95 +145,172 @@ void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, lis
 	}
 }
 
-void local_recursive_operation::thread_entry()
+bool local_recursive_operation::take_dir(fz::scoped_lock& l, local_recursion_root::new_dir& dir, uint64_t& seq)
 {
-	{
-		fz::scoped_lock l(mutex_);
+	while (!recursion_roots_.empty()) {
+		auto& root = recursion_roots_.front();
+		if (!root.m_dirsToVisit.empty()) {
+			dir = std::move(root.m_dirsToVisit.front());
+			root.m_dirsToVisit.pop_front();
+
+			seq = emitted_dirs_ + pending_dirs_.size();
+			pending_dirs_.emplace_back();
+			pending_dirs_.back().recurse = dir.recurse;
+			return true;
+		}
 
-		// Make copy, as it is used in the unlocked section
-		auto filters = m_filters.first;
+		if (!pending_dirs_.empty()) {
+			// Directories still being enumerated may add subdirectories to this root
+			cond_.wait(l);
+			continue;
+		}
 
-		while (!recursion_roots_.empty()) {
-			listing d;
-			bool recurse{true};
+		recursion_roots_.pop_front();
+	}
 
-			{
-				auto& root = recursion_roots_.front();
-				if (root.m_dirsToVisit.empty()) {
-					recursion_roots_.pop_front();
-					continue;
-				}
+	return false;
+}
 
-				auto const& dir = root.m_dirsToVisit.front();
-				d.localPath = dir.localPath;
-				d.remotePath = dir.remotePath;
-				recurse = dir.recurse;
+void local_recursive_operation::add_listing(fz::scoped_lock& l, uint64_t seq, listing&& d)
+{
+	pending_dirs_[seq - emitted_dirs_].listings.emplace_back(std::move(d));
+	emit_listings(l);
+}
 
-				root.m_dirsToVisit.pop_front();
-			}
+void local_recursive_operation::finish_dir(fz::scoped_lock& l, uint64_t seq)
+{
+	pending_dirs_[seq - emitted_dirs_].done = true;
+	emit_listings(l);
+}
+
+void local_recursive_operation::emit_listings(fz::scoped_lock& l)
+{
+	// EnqueueEnumeratedListing unlocks the mutex, another walker finishing
+	// a directory in the meantime leaves the emitting to the current one.
+	if (emitting_) {
+		return;
+	}
+	emitting_ = true;
+
+	while (!pending_dirs_.empty() && !recursion_roots_.empty()) {
+		auto& front = pending_dirs_.front();
+		if (!front.listings.empty()) {
+			listing d = std::move(front.listings.front());
+			front.listings.pop_front();
+			EnqueueEnumeratedListing(l, std::move(d), front.recurse);
+			cond_.notify_all();
+		}
+		else if (front.done) {
+			pending_dirs_.pop_front();
+			++emitted_dirs_;
+			cond_.notify_all();
+		}
+		else {
+			break;
+		}
+	}
+
+	emitting_ = false;
+}
+
+void local_recursive_operation::walk()
+{
+	fz::scoped_lock l(mutex_);
 
-			// Do the slow part without holding mutex
-			l.unlock();
-
-			bool sentPartial = false;
-			fz::local_filesys fs;
-			fz::native_string localPath = fz::to_native(d.localPath.GetPath());
-
-			if (fs.begin_find_files(localPath)) {
-				listing::entry entry;
-				bool isLink{};
-				fz::native_string name;
-				fz::local_filesys::type t{};
-				while (fs.get_next_file(name, isLink, t, &entry.size, &entry.time, &entry.attributes)) {
-					if (isLink && m_ignoreLinks) {
-						continue;
+	// Make copy, as it is used in the unlocked section
+	auto const filters = filters_;
+
+	local_recursion_root::new_dir dir;
+	uint64_t seq{};
+	while (take_dir(l, dir, seq)) {
+		listing d;
+		d.localPath = dir.localPath;
+		d.remotePath = dir.remotePath;
+
+		// Do the slow part without holding mutex
+		l.unlock();
+
+		bool sentPartial = false;
+		fz::local_filesys fs;
+		fz::native_string localPath = fz::to_native(d.localPath.GetPath());
+
+		if (fs.begin_find_files(localPath)) {
+			listing::entry entry;
+			bool isLink{};
+			fz::native_string name;
+			fz::local_filesys::type t{};
+			while (fs.get_next_file(name, isLink, t, &entry.size, &entry.time, &entry.attributes)) {
+				if (isLink && m_ignoreLinks) {
+					continue;
+				}
+				entry.name = fz::to_wstring(name);
+
+				if (!filters->filtered(entry.name, d.localPath.GetPath(), t == fz::local_filesys::dir, entry.size, entry.attributes, entry.time)) {
+					if (t == fz::local_filesys::dir) {
+						d.dirs.emplace_back(std::move(entry));
+					}
+					else {
+						d.files.emplace_back(std::move(entry));
 					}
-					entry.name = fz::to_wstring(name);
 
-					if (!filter_manager::FilenameFiltered(filters, entry.name, d.localPath.GetPath(), t == fz::local_filesys::dir, entry.size, entry.attributes, entry.time)) {
-						if (t == fz::local_filesys::dir) {
-							d.dirs.emplace_back(std::move(entry));
-						}
-						else {
-							d.files.emplace_back(std::move(entry));
-						}
+					// If having queued 5k items, hand off to main thread.
+					if (d.files.size() + d.dirs.size() >= 5000) {
+						sentPartial = true;
+
+						listing next;
+						next.localPath = d.localPath;
+						next.remotePath = d.remotePath;
 
-						// If having queued 5k items, hand off to main thread.
-						if (d.files.size() + d.dirs.size() >= 5000) {
-							sentPartial = true;
-
-							listing next;
-							next.localPath = d.localPath;
-							next.remotePath = d.remotePath;
-
-							l.lock();
-							// Check for cancellation
-							if (recursion_roots_.empty()) {
-								l.unlock();
-								break;
-							}
-							EnqueueEnumeratedListing(l, std::move(d), recurse);
+						l.lock();
+						// Check for cancellation
+						if (recursion_roots_.empty()) {
 							l.unlock();
-							d = next;
+							break;
 						}
+						add_listing(l, seq, std::move(d));
+						l.unlock();
+						d = next;
 					}
 				}
 			}
+		}
+
+		l.lock();
+		// Check for cancellation
+		if (recursion_roots_.empty()) {
+			break;
+		}
+		if (!sentPartial || !d.files.empty() || !d.dirs.empty()) {
+			add_listing(l, seq, std::move(d));
+		}
+		finish_dir(l, seq);
+	}
+}
 
-			l.lock();
-			// Check for cancellation
-			if (recursion_roots_.empty()) {
+void local_recursive_operation::thread_entry()
+{
+	std::vector<fz::async_task> walkers;
+	if (pool_) {
+		for (size_t i = 1; i < walker_count; ++i) {
+			auto walker = pool_->spawn([this] { walk(); });
+			if (!walker) {
 				break;
 			}
-			if (!sentPartial || !d.files.empty() || !d.dirs.empty()) {
-				EnqueueEnumeratedListing(l, std::move(d), recurse);
-			}
+			walkers.emplace_back(std::move(walker));
 		}
+	}
+
+	walk();
+
+	for (auto & walker : walkers) {
+		walker.join();
+	}
 
+	{
+		fz::scoped_lock l(mutex_);
 		listing d;
 		m_listedDirectories.emplace_back(std::move(d));
 	}
 
 	on_listed_directory();
 }
-
@@ -11,7 +11,9 @@
 #include <libfilezilla/thread_pool.hpp>
 #include <libfilezilla/time.hpp>
 
+#include <condition_variable>
 #include <deque>
+#include <memory>
 #include <set>
 #include <string>
 
@@ -84,6 +86,13 @@ protected:
 protected:
 	void EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d, bool recurse);
 
+	// Run concurrently by several walkers, each enumerating one directory at a time
+	void walk();
+	bool take_dir(fz::scoped_lock& l, local_recursion_root::new_dir& dir, uint64_t& seq);
+	void add_listing(fz::scoped_lock& l, uint64_t seq, listing&& d);
+	void finish_dir(fz::scoped_lock& l, uint64_t seq);
+	void emit_listings(fz::scoped_lock& l);
+
 	std::deque<local_recursion_root> recursion_roots_;
 
 	fz::mutex mutex_;
@@ -92,7 +101,26 @@ protected:
 	std::deque<listing> m_listedDirectories;
 	bool m_ignoreLinks{};
 
+	// The local filters, shared by the walkers
+	std::shared_ptr<compiled_filters const> filters_;
+
 	fz::async_task thread_;
+
+	// Directories being enumerated, in the order they have been taken from
+	// the recursion root. Their listings are passed on strictly in this order,
+	// so the result is the same as with a single walker.
+	struct pending_dir final
+	{
+		std::deque<listing> listings;
+		bool recurse{true};
+		bool done{};
+	};
+	std::deque<pending_dir> pending_dirs_;
+	uint64_t emitted_dirs_{};
+	bool emitting_{};
+
+	// Signalled when there are new directories to visit or pending ones got passed on
+	std::condition_variable_any cond_;
 };
 
 #endif
@@ -73,6 +73,7 @@ void remote_recursive_operation::start_recursive_operation(OperationMode mode, A
 void remote_recursive_operation::do_start_recursive_operation(OperationMode, ActiveFilters const& filters)
 {
 	m_filters = filters;
+	filters_ = compiled_filters(filters.second);
 	NextOperation();
 }
 
@@ -93,7 +94,15 @@ bool remote_recursive_operation::NextOperation()
 				continue;
 			}
 
-			process_command(std::make_unique<CListCommand>(dirToVisit.parent, dirToVisit.subdir, dirToVisit.link ? LIST_FLAG_LINK : 0));
+			if (prefetch_ && !dirToVisit.link && !dirToVisit.subdir.empty()) {
+				// No need to list it ahead anymore
+				CServerPath path = dirToVisit.parent;
+				if (path.AddSegment(dirToVisit.subdir)) {
+					prefetchListed_.insert(path);
+				}
+			}
+
+			process_command(std::make_unique<CListCommand>(dirToVisit.parent, dirToVisit.subdir, dirToVisit.link ? LIST_FLAG_LINK : LIST_FLAG_RECURSIVE));
 			return true;
 		}
 
@@ -140,6 +149,7 @@ void remote_recursive_operation::process_entries(recursion_root& root, CDirector
 	, recursion_root::new_dir const& dir, std::wstring const& remotePath)
 {
 	std::vector<std::wstring> filesToDelete;
+	bool prefetch{};
 	bool const restricted = static_cast<bool>(dir.restricted);
 
 	for (size_t i = pDirectoryListing->size(); i > 0; --i) {
@@ -150,7 +160,7 @@ void remote_recursive_operation::process_entries(recursion_root& root, CDirector
 				continue;
 			}
 		}
-		else if (filter_manager::FilenameFiltered(m_filters.second, entry.name, remotePath, entry.is_dir(), entry.size, 0, entry.time)) {
+		else if (filters_.filtered(entry.name, remotePath, entry.is_dir(), entry.size, 0, entry.time)) {
 			continue;
 		}
 
@@ -174,6 +184,9 @@ void remote_recursive_operation::process_entries(recursion_root& root, CDirector
 					dirToVisit.link = 1;
 					dirToVisit.recurse = false;
 				}
+				else {
+					prefetch |= AddPrefetch(pDirectoryListing->path, entry.name);
+				}
 				root.m_dirsToVisit.push_front(dirToVisit);
 			}
 		}
@@ -211,6 +224,10 @@ void remote_recursive_operation::process_entries(recursion_root& root, CDirector
 	if (m_operationMode == recursive_delete && !filesToDelete.empty()) {
 		process_command(std::make_unique<CDeleteCommand>(pDirectoryListing->path, std::move(filesToDelete)));
 	}
+
+	if (prefetch) {
+		prefetch_available();
+	}
 }
 
 void remote_recursive_operation::ProcessDirectoryListing(CDirectoryListing const* pDirectoryListing)
@@ -289,6 +306,79 @@ void remote_recursive_operation::StopRecursiveOperation()
 	}
 	recursion_roots_.clear();
 	chmodData_.reset();
+
+	prefetch_ = false;
+	prefetchDirs_.clear();
+	prefetchKnown_.clear();
+	prefetchListed_.clear();
+}
+
+void remote_recursive_operation::EnablePrefetch(bool enable)
+{
+	// Changing permissions may affect which directories can be listed
+	prefetch_ = enable && m_operationMode != recursive_chmod;
+}
+
+bool remote_recursive_operation::AddPrefetch(CServerPath const& parent, std::wstring const& subdir)
+{
+	if (!prefetch_) {
+		return false;
+	}
+
+	prefetch_dir dir;
+	dir.path = parent;
+	if (!dir.path.AddSegment(subdir) || !prefetchKnown_.insert(dir.path).second) {
+		return false;
+	}
+	dir.parent = parent;
+	dir.subdir = subdir;
+
+	// Same depth-first order as the walk itself, so that the listings
+	// are ready by the time the walk gets there.
+	prefetchDirs_.push_front(std::move(dir));
+	return true;
+}
+
+bool remote_recursive_operation::NextPrefetch(CServerPath& parent, std::wstring& subdir)
+{
+	while (!prefetchDirs_.empty()) {
+		prefetch_dir dir = std::move(prefetchDirs_.front());
+		prefetchDirs_.pop_front();
+
+		if (prefetchListed_.insert(dir.path).second) {
+			parent = std::move(dir.parent);
+			subdir = std::move(dir.subdir);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void remote_recursive_operation::ProcessPrefetchedListing(CDirectoryListing const& listing)
+{
+	if (!prefetch_ || m_operationMode == recursive_none || listing.failed()) {
+		return;
+	}
+
+	std::wstring const remotePath = listing.path.GetPath();
+
+	bool added{};
+	for (size_t i = listing.size(); i > 0; --i) {
+		CDirentry const& entry = listing[i - 1];
+		if (!entry.is_dir() || entry.is_link()) {
+			continue;
+		}
+		if (filters_.filtered(entry.name, remotePath, true, entry.size, 0, entry.time)) {
+			continue;
+		}
+
+		added |= AddPrefetch(listing.path, entry.name);
+	}
+
+	if (added) {
+		prefetch_available();
+	}
 }
 
 void remote_recursive_operation::ListingFailed(int error)
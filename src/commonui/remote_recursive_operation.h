@@ -109,6 +109,20 @@ protected:
 	// Processes the directory listing in case of a recursive operation
 	void ProcessDirectoryListing(CDirectoryListing const* pDirectoryListing);
 
+	// Directories can be listed ahead of the walk on additional connections.
+	// Their listings end up in the directory cache, from where the walk
+	// picks them up without waiting for the server.
+	void EnablePrefetch(bool enable);
+
+	// Returns the next directory to be listed ahead of the walk
+	bool NextPrefetch(CServerPath& parent, std::wstring& subdir);
+
+	// Call with each listing obtained ahead of the walk, queues its subdirectories
+	void ProcessPrefetchedListing(CDirectoryListing const& listing);
+
+	// Called whenever there are new directories to list ahead of the walk
+	virtual void prefetch_available() {}
+
 protected:
 	void process_entries(recursion_root& root, const CDirectoryListing* pDirectoryListing
 		, recursion_root::new_dir const& dir, std::wstring const& remotePath);
@@ -118,6 +132,22 @@ protected:
 
 	std::deque<recursion_root> recursion_roots_;
 
+	// The remote filters, prepared for matching
+	compiled_filters filters_;
+
+	bool AddPrefetch(CServerPath const& parent, std::wstring const& subdir);
+
+	struct prefetch_dir final
+	{
+		CServerPath parent;
+		std::wstring subdir;
+		CServerPath path;
+	};
+	bool prefetch_{};
+	std::deque<prefetch_dir> prefetchDirs_;
+	std::set<CServerPath> prefetchKnown_;
+	std::set<CServerPath> prefetchListed_;
+
 	// Needed for recursive_chmod
 	std::unique_ptr<ChmodData> chmodData_;
 };
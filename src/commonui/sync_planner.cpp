@@ -0,0 +1,210 @@
+#include "sync_planner.h"
+#include "misc.h"
+
+#include <algorithm>
+
+sync_planner::sync_planner(CServerPath const& remoteRoot, ActiveFilters const& filters, fz::duration const& threshold)
+	: remoteRoot_(remoteRoot)
+	, remoteFilters_(filters.second)
+	, threshold_(threshold)
+{
+}
+
+void sync_planner::add_local(local_recursive_operation::listing const& listing)
+{
+	if (listing.remotePath.empty()) {
+		return;
+	}
+
+	// Large directories arrive in several parts
+	auto it = local_.find(listing.remotePath);
+	if (it == local_.end()) {
+		local_.emplace(listing.remotePath, listing);
+	}
+	else {
+		auto & existing = it->second;
+		existing.files.insert(existing.files.end(), listing.files.cbegin(), listing.files.cend());
+		existing.dirs.insert(existing.dirs.end(), listing.dirs.cbegin(), listing.dirs.cend());
+	}
+}
+
+void sync_planner::add_remote(CDirectoryListing const& listing)
+{
+	if (listing.failed() || listing.path.empty()) {
+		return;
+	}
+	if (listing.path != remoteRoot_ && !listing.path.IsSubdirOf(remoteRoot_, false)) {
+		return;
+	}
+
+	remote_[listing.path] = listing;
+}
+
+namespace {
+enum class remote_state
+{
+	listed,
+	absent,
+	unknown
+};
+
+struct local_entry final
+{
+	local_recursive_operation::listing::entry const* entry;
+	bool dir;
+};
+}
+
+sync_plan sync_planner::plan() const
+{
+	sync_plan plan;
+
+	auto stateOf = [this](CServerPath const& path) {
+		return remote_.find(path) != remote_.end() ? remote_state::listed : remote_state::unknown;
+	};
+
+	std::vector<std::pair<CServerPath, remote_state>> dirs;
+	dirs.emplace_back(remoteRoot_, stateOf(remoteRoot_));
+
+	std::vector<local_entry> localEntries;
+	std::vector<size_t> remoteEntries;
+	while (!dirs.empty()) {
+		CServerPath const path = std::move(dirs.back().first);
+		remote_state const state = dirs.back().second;
+		dirs.pop_back();
+
+		auto const localIt = local_.find(path);
+		if (localIt == local_.end()) {
+			// Not listed locally, e.g. unreadable
+			continue;
+		}
+		if (state == remote_state::unknown) {
+			plan.unknown.push_back(path);
+			continue;
+		}
+
+		auto const& local = localIt->second;
+
+		local_recursive_operation::listing upload;
+		upload.localPath = local.localPath;
+		upload.remotePath = path;
+
+		auto addUpload = [&](local_recursive_operation::listing::entry const& entry) {
+			upload.files.push_back(entry);
+			++plan.upload_files;
+			if (entry.size > 0) {
+				plan.upload_bytes += entry.size;
+			}
+		};
+
+		auto addDir = [&](std::wstring const& name, remote_state childState) {
+			CServerPath child = path;
+			if (child.AddSegment(name)) {
+				dirs.emplace_back(std::move(child), childState);
+			}
+		};
+
+		if (state == remote_state::absent) {
+			for (auto const& entry : local.files) {
+				addUpload(entry);
+			}
+			for (auto const& entry : local.dirs) {
+				addDir(entry.name, remote_state::absent);
+			}
+			// Empty directories get created by the queue
+			if (!upload.files.empty() || local.dirs.empty()) {
+				plan.uploads.emplace_back(std::move(upload));
+			}
+			continue;
+		}
+
+		CDirectoryListing const& remote = remote_.find(path)->second;
+
+		// Merge both sides by name
+		localEntries.clear();
+		localEntries.reserve(local.files.size() + local.dirs.size());
+		for (auto const& entry : local.files) {
+			localEntries.push_back({&entry, false});
+		}
+		for (auto const& entry : local.dirs) {
+			localEntries.push_back({&entry, true});
+		}
+		std::sort(localEntries.begin(), localEntries.end(), [](local_entry const& lhs, local_entry const& rhs) {
+			return lhs.entry->name < rhs.entry->name;
+		});
+
+		remoteEntries.resize(remote.size());
+		for (size_t i = 0; i < remoteEntries.size(); ++i) {
+			remoteEntries[i] = i;
+		}
+		std::sort(remoteEntries.begin(), remoteEntries.end(), [&remote](size_t lhs, size_t rhs) {
+			return remote[lhs].name < remote[rhs].name;
+		});
+
+		std::wstring const remotePath = path.GetPath();
+		auto remoteOnly = [&](CDirentry const& entry) {
+			if (!remoteFilters_.filtered(entry.name, remotePath, entry.is_dir(), entry.size, 0, entry.time)) {
+				plan.remote_only.push_back({path, entry.name, entry.is_dir()});
+			}
+		};
+
+		size_t l{};
+		size_t r{};
+		while (l < localEntries.size() || r < remoteEntries.size()) {
+			int cmp;
+			if (l == localEntries.size()) {
+				cmp = 1;
+			}
+			else if (r == remoteEntries.size()) {
+				cmp = -1;
+			}
+			else {
+				cmp = localEntries[l].entry->name.compare(remote[remoteEntries[r]].name);
+			}
+
+			if (cmp < 0) {
+				auto const& entry = localEntries[l++];
+				if (entry.dir) {
+					addDir(entry.entry->name, remote_state::absent);
+				}
+				else {
+					addUpload(*entry.entry);
+				}
+			}
+			else if (cmp > 0) {
+				remoteOnly(remote[remoteEntries[r++]]);
+			}
+			else {
+				auto const& entry = localEntries[l++];
+				CDirentry const& remoteEntry = remote[remoteEntries[r++]];
+				if (entry.dir != remoteEntry.is_dir()) {
+					plan.conflicts.push_back({path, remoteEntry.name, remoteEntry.is_dir()});
+				}
+				else if (entry.dir && remoteEntry.is_link()) {
+					plan.links.push_back({path, remoteEntry.name, true});
+				}
+				else if (entry.dir) {
+					CServerPath child = path;
+					if (child.AddSegment(remoteEntry.name)) {
+						dirs.emplace_back(child, stateOf(child));
+					}
+				}
+				else {
+					bool differs = remoteEntry.size >= 0 && entry.entry->size != remoteEntry.size;
+					if (!differs && !entry.entry->time.empty() && !remoteEntry.time.empty()) {
+						differs = CompareWithThreshold(entry.entry->time, remoteEntry.time, threshold_) > 0;
+					}
+					if (differs) {
+						addUpload(*entry.entry);
+					}
+				}
+			}
+		}
+
+		if (!upload.files.empty()) {
+			plan.uploads.emplace_back(std::move(upload));
+		}
+	}
+
+	return plan;
+}
@@ -0,0 +1,76 @@
+#ifndef FILEZILLA_COMMONUI_SYNC_PLANNER_HEADER
+#define FILEZILLA_COMMONUI_SYNC_PLANNER_HEADER
+
+#include "../include/directorylisting.h"
+#include "../include/serverpath.h"
+
+#include "filter.h"
+#include "local_recursive_operation.h"
+#include "visibility.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// The transfers needed to make a remote directory tree mirror a local one
+class FZCUI_PUBLIC_SYMBOL sync_plan final
+{
+public:
+	// One entry per directory with files to upload, or per missing empty directory.
+	// Can be passed as-is to CQueueView::QueueFiles.
+	std::vector<local_recursive_operation::listing> uploads;
+
+	int64_t upload_files{};
+	int64_t upload_bytes{};
+
+	class remote_entry final
+	{
+	public:
+		CServerPath path;
+		std::wstring name;
+		bool dir{};
+	};
+
+	// Present on the server but not locally. Not acted upon.
+	std::vector<remote_entry> remote_only;
+
+	// Name is a file on one side and a directory on the other
+	std::vector<remote_entry> conflicts;
+
+	// Local directories that are symbolic links on the server. Not descended
+	// into, the link target may lie anywhere and gets listed under its own path.
+	std::vector<remote_entry> links;
+
+	// Directories that exist on the server but have not been listed
+	std::vector<CServerPath> unknown;
+};
+
+// Merges a local and a remote directory tree into a sync_plan.
+//
+// Listings can be added in any order and as they arrive, the local ones from a
+// local_recursive_operation whose recursion root maps the local root onto the
+// remote root, the remote ones from a remote_recursive_operation or the cache.
+// Directories are matched by remote path, entries within a directory by name.
+//
+// A local file gets uploaded if it does not exist on the server, if the sizes
+// differ, or if it is newer than the remote one by more than the threshold.
+class FZCUI_PUBLIC_SYMBOL sync_planner final
+{
+public:
+	sync_planner(CServerPath const& remoteRoot, ActiveFilters const& filters, fz::duration const& threshold);
+
+	void add_local(local_recursive_operation::listing const& listing);
+	void add_remote(CDirectoryListing const& listing);
+
+	sync_plan plan() const;
+
+private:
+	CServerPath remoteRoot_;
+	compiled_filters remoteFilters_;
+	fz::duration threshold_;
+
+	std::map<CServerPath, local_recursive_operation::listing> local_;
+	std::map<CServerPath, CDirectoryListing> remote_;
+};
+
+#endif
@@ -590,11 +590,16 @@ bool CXmlFile::ParseData(uint8_t const* data, size_t len)
 }
 
 bool CXmlFile::IsFromFutureVersion() const
+{
+	return ::IsFromFutureVersion(m_element);
+}
+
+bool IsFromFutureVersion(pugi::xml_node root)
 {
 	auto const ownVer = GetFileZillaVersion();
-	if (!m_element || ownVer.empty()) {
+	if (!root || ownVer.empty()) {
 		return false;
 	}
-	std::wstring const version = GetTextAttribute(m_element, "version");
+	std::wstring const version = GetTextAttribute(root, "version");
 	return ConvertToVersionNumber(ownVer.c_str()) < ConvertToVersionNumber(version.c_str());
 }
@@ -40,6 +40,10 @@ public:
 	bool Save(bool updateMetadata = true);
 
 	bool IsFromFutureVersion() const;
+
+	// Sets version and platform in root element
+	void UpdateMetadata();
+
 protected:
 	std::wstring GetRedirectedName() const;
 
@@ -47,9 +51,6 @@ protected:
 	// Returns 0 on error.
 	bool GetXmlFile(std::wstring const& file);
 
-	// Sets version and platform in root element
-	void UpdateMetadata();
-
 	// Save the XML document to the given file
 	bool SaveXmlFile();
 
@@ -66,4 +67,7 @@ protected:
 // Function to retrieve CServer objects from the XML
 bool FZCUI_PUBLIC_SYMBOL GetServer(pugi::xml_node node, Site& site);
 
+// Whether the given root element has been written by a newer version
+bool FZCUI_PUBLIC_SYMBOL IsFromFutureVersion(pugi::xml_node root);
+
 #endif
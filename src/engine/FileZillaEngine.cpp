@@ -43,7 +43,13 @@ CTransferStatus CFileZillaEngine::GetTransferStatus(bool &changed)
 
 int CFileZillaEngine::CacheLookup(const CServerPath& path, CDirectoryListing& listing)
 {
-	return impl_->CacheLookup(path, listing);
+	bool outdated{};
+	return impl_->CacheLookup(path, listing, outdated);
+}
+
+int CFileZillaEngine::CacheLookup(CServerPath const& path, CDirectoryListing& listing, bool& outdated)
+{
+	return impl_->CacheLookup(path, listing, outdated);
 }
 
 int CFileZillaEngine::Cancel()
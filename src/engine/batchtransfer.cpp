@@ -0,0 +1,55 @@
+#include "filezilla.h"
+
+#include "batchtransfer.h"
+#include "engineprivate.h"
+
+enum batchTransferStates
+{
+	batchtransfer_init = 0,
+	batchtransfer_waittransfer
+};
+
+int BatchTransferOpData::Send()
+{
+	size_t const next = replies_.size();
+	if (next >= transfers_.size()) {
+		return failed_ ? FZ_REPLY_ERROR : FZ_REPLY_OK;
+	}
+
+	if (!next) {
+		log(logmsg::debug_info, L"Transferring %u files in %s", transfers_.size(), transfers_.front().GetRemotePath().GetPath());
+	}
+
+	opState = batchtransfer_waittransfer;
+	engine_.AddNotification(std::make_unique<CBatchTransferNotification>(std::vector<int>(replies_), false));
+	controlSocket_.FileTransfer(transfers_[next]);
+	return FZ_REPLY_CONTINUE;
+}
+
+int BatchTransferOpData::SubcommandResult(int prevResult, COpData const&)
+{
+	if (opState != batchtransfer_waittransfer) {
+		log(logmsg::debug_warning, L"Unknown opState in BatchTransferOpData::SubcommandResult()");
+		return FZ_REPLY_INTERNALERROR;
+	}
+
+	// Only errors not affecting the connection end up here, carry on with the next file
+	replies_.push_back(prevResult);
+	if (prevResult != FZ_REPLY_OK) {
+		failed_ = true;
+	}
+
+	return FZ_REPLY_CONTINUE;
+}
+
+int BatchTransferOpData::Reset(int result)
+{
+	// Fatal errors of a transfer end the whole batch, attribute them to the transfer that caused them
+	if (result != FZ_REPLY_OK && opState == batchtransfer_waittransfer && replies_.size() < transfers_.size()) {
+		replies_.push_back(result);
+	}
+
+	engine_.AddNotification(std::make_unique<CBatchTransferNotification>(std::move(replies_), true));
+
+	return result;
+}
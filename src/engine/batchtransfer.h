@@ -0,0 +1,39 @@
+#ifndef FILEZILLA_ENGINE_BATCHTRANSFER_HEADER
+#define FILEZILLA_ENGINE_BATCHTRANSFER_HEADER
+
+#include "controlsocket.h"
+
+// Runs the transfers of a CBatchTransferCommand one after another as
+// subcommands of a single operation. Through the shared directory the
+// transfers after the first one find the working directory and the
+// remote listing already in place.
+//
+// The commands of the transfers are not pipelined. With the listing in
+// place, each FTP transfer only sends PASV or EPSV and the transfer command,
+// plus MFMT if preserving timestamps. Each needs the reply to the one before:
+// the passive reply carries the data port, a failing transfer has to be
+// attributed to its file before the next one starts, and MFMT needs the
+// completed file. Only the MFMT round trip could overlap with the next file,
+// but servers aren't required to accept pipelined commands.
+class BatchTransferOpData final : public COpData, public CProtocolOpData<CControlSocket>
+{
+public:
+	BatchTransferOpData(CControlSocket & controlSocket, CBatchTransferCommand const& command)
+		: COpData(Command::batch_transfer, L"BatchTransferOpData")
+		, CProtocolOpData(controlSocket)
+		, transfers_(command.GetTransfers())
+	{
+	}
+
+	virtual int Send() override;
+	virtual int ParseResponse() override { return FZ_REPLY_INTERNALERROR; }
+	virtual int SubcommandResult(int prevResult, COpData const& previousOperation) override;
+	virtual int Reset(int result) override;
+
+private:
+	std::vector<CFileTransferCommand> const transfers_;
+	std::vector<int> replies_;
+	bool failed_{};
+};
+
+#endif
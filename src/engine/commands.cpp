@@ -90,6 +90,29 @@ bool CFileTransferCommand::valid() const
 	return true;
 }
 
+CBatchTransferCommand::CBatchTransferCommand(std::vector<CFileTransferCommand> && transfers)
+	: transfers_(std::move(transfers))
+{
+}
+
+bool CBatchTransferCommand::valid() const
+{
+	if (transfers_.empty()) {
+		return false;
+	}
+
+	for (auto const& transfer : transfers_) {
+		if (!transfer.valid()) {
+			return false;
+		}
+		if (transfer.Download() != transfers_.front().Download() || transfer.GetRemotePath() != transfers_.front().GetRemotePath()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 CRawCommand::CRawCommand(std::wstring const& command)
 {
 	m_command = command;
@@ -149,3 +172,17 @@ bool CChmodCommand::valid() const
 {
 	return !GetPath().empty() && !GetFile().empty() && !GetPermission().empty();
 }
+
+CCopyCommand::CCopyCommand(CServerPath const& fromPath, std::wstring const& fromFile,
+						   CServerPath const& toPath, std::wstring const& toFile)
+	: m_fromPath(fromPath)
+	, m_toPath(toPath)
+	, m_fromFile(fromFile)
+	, m_toFile(toFile)
+{}
+
+bool CCopyCommand::valid() const
+{
+	return !GetFromPath().empty() && !GetToPath().empty() && !GetFromFile().empty() && !GetToFile().empty() &&
+		(GetFromPath() != GetToPath() || GetFromFile() != GetToFile());
+}
@@ -1,5 +1,6 @@
 #include "filezilla.h"
 #include "activity_logger_layer.h"
+#include "batchtransfer.h"
 #include "controlsocket.h"
 #include "directorycache.h"
 #include "engineprivate.h"
@@ -139,6 +140,22 @@ int CControlSocket::ResetOperation(int nErrorCode)
 
 		log(logmsg::debug_verbose, L"%s::Reset(%d) in state %d", oldOperation->name_, nErrorCode, oldOperation->opState);
 		nErrorCode = oldOperation->Reset(nErrorCode);
+
+		// Transfers also run as subcommands of batch transfers, finish them before
+		// the result gets passed on to the parent operation.
+		if (oldOperation->opId == Command::transfer) {
+			auto & data = static_cast<CFileTransferOpData &>(*oldOperation);
+			if (!data.download() && data.transferInitiated_) {
+				if (!currentServer_) {
+					log(logmsg::debug_warning, L"currentServer_ is empty");
+				}
+				else {
+					UpdateCache(data, data.remotePath_, data.remoteFile_, (nErrorCode == FZ_REPLY_OK) ? data.localFileSize_ : -1);
+				}
+			}
+			LogTransferResultMessage(nErrorCode, &data);
+			engine_.transfer_status_.Reset();
+		}
 	}
 	if (!operations_.empty()) {
 		if (nErrorCode == FZ_REPLY_OK ||
@@ -197,18 +214,7 @@ int CControlSocket::ResetOperation(int nErrorCode)
 			}
 			break;
 		case Command::transfer:
-			{
-				auto & data = static_cast<CFileTransferOpData &>(*oldOperation);
-				if (!data.download() && data.transferInitiated_) {
-					if (!currentServer_) {
-						log(logmsg::debug_warning, L"currentServer_ is empty");
-					}
-					else {
-						UpdateCache(data, data.remotePath_, data.remoteFile_, (nErrorCode == FZ_REPLY_OK) ? data.localFileSize_ : -1);
-					}
-				}
-				LogTransferResultMessage(nErrorCode, &data);
-			}
+			// Already handled above
 			break;
 		default:
 			if ((nErrorCode & FZ_REPLY_CANCELED) == FZ_REPLY_CANCELED) {
@@ -1128,6 +1134,16 @@ void CControlSocket::Chmod(CChmodCommand const&)
 	Push(std::make_unique<CNotSupportedOpData>());
 }
 
+void CControlSocket::Copy(CCopyCommand const&)
+{
+	Push(std::make_unique<CNotSupportedOpData>());
+}
+
+void CControlSocket::BatchTransfer(CBatchTransferCommand const& command)
+{
+	Push(std::make_unique<BatchTransferOpData>(*this, command));
+}
+
 void CControlSocket::Lookup(CServerPath const& path, std::wstring const& file, CDirentry * entry)
 {
 	Push(std::make_unique<LookupOpData>(*this, path, file, entry));
@@ -1151,13 +1167,13 @@ void CControlSocket::RecordActivity(activity_logger::_direction direction, uint6
 	engine_.activity_logger_.record(direction, amount);
 }
 
-void CControlSocket::SendDirectoryListingNotification(CServerPath const& path, bool failed)
+void CControlSocket::SendDirectoryListingNotification(CServerPath const& path, bool failed, std::shared_ptr<CDirectoryListingDelta const> const& delta)
 {
 	if (!currentServer_) {
 		return;
 	}
 
-	engine_.AddNotification(std::make_unique<CDirectoryListingNotification>(path, operations_.size() == 1 && operations_.back()->opId == Command::list, failed));
+	engine_.AddNotification(std::make_unique<CDirectoryListingNotification>(path, operations_.size() == 1 && operations_.back()->opId == Command::list, failed, delta));
 }
 
 void CControlSocket::CallSetAsyncRequestReply(CAsyncRequestNotification *pNotification)
@@ -218,6 +218,8 @@ public:
 	virtual void Mkdir(CServerPath const& path, transfer_flags const& flags);
 	virtual void Rename(CRenameCommand const& command);
 	virtual void Chmod(CChmodCommand const& command);
+	virtual void Copy(CCopyCommand const& command);
+	void BatchTransfer(CBatchTransferCommand const& command);
 	void Sleep(fz::duration const& delay);
 
 	Command GetCurrentCommandId() const;
@@ -284,7 +286,7 @@ protected:
 	friend class CProtocolOpData<CControlSocket>;
 
 	virtual bool SetAsyncRequestReply(CAsyncRequestNotification *pNotification) = 0;
-	void SendDirectoryListingNotification(CServerPath const& path, bool failed);
+	void SendDirectoryListingNotification(CServerPath const& path, bool failed, std::shared_ptr<CDirectoryListingDelta const> const& delta = nullptr);
 
 	fz::duration GetInferredTimezoneOffset() const;
 
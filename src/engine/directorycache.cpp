@@ -2,6 +2,7 @@
 #include "directorycache.h"
 
 #include <assert.h>
+#include <unordered_set>
 
 CDirectoryCache::CDirectoryCache()
 {
@@ -26,32 +27,43 @@ CDirectoryCache::~CDirectoryCache()
 #endif
 }
 
-void CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& server)
+std::shared_ptr<CDirectoryListingDelta const> CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& server)
 {
-	fz::scoped_lock lock(mutex_);
+	CDirectoryListing previous;
+	{
+		fz::scoped_lock lock(mutex_);
 
-	tServerIter sit = CreateServerEntry(server);
-	assert(sit != m_serverList.end());
+		tServerIter sit = CreateServerEntry(server);
+		assert(sit != m_serverList.end());
 
-	m_totalFileCount += listing.size();
+		m_totalFileCount += listing.size();
+
+		tCacheIter cit;
+		bool unused;
+		if (!Lookup(cit, sit, listing.path, true, unused)) {
+			cit = sit->cacheList.emplace_hint(cit, listing);
+
+			UpdateLru(sit, cit);
+
+			Prune();
+
+			return nullptr;
+		}
 
-	tCacheIter cit;
-	bool unused;
-	if (Lookup(cit, sit, listing.path, true, unused)) {
 		auto & entry = const_cast<CCacheEntry&>(*cit);
 		entry.modificationTime = fz::monotonic_clock::now();
 
 		m_totalFileCount -= cit->listing.size();
+		previous = std::move(entry.listing);
 		entry.listing = listing;
-
-		return;
 	}
 
-	cit = sit->cacheList.emplace_hint(cit, listing);
-
-	UpdateLru(sit, cit);
-
-	Prune();
+	// The entries are shared, so the old listing is cheap to keep
+	// and the delta can be computed without holding the lock.
+	if (previous.failed() || listing.failed()) {
+		return nullptr;
+	}
+	return std::make_shared<CDirectoryListingDelta const>(previous, listing);
 }
 
 bool CDirectoryCache::Lookup(CDirectoryListing &listing, CServer const& server, const CServerPath &path, bool allowUnsureEntries, bool& is_outdated)
@@ -447,6 +459,62 @@ bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path,
 	return true;
 }
 
+bool CDirectoryCache::RemoveFiles(CServer const& server, CServerPath const& path, std::vector<std::wstring> const& filenames)
+{
+	if (filenames.size() == 1) {
+		return RemoveFile(server, path, filenames.front());
+	}
+
+	fz::scoped_lock lock(mutex_);
+
+	tServerIter sit = GetServerEntry(server);
+	if (sit == m_serverList.end()) {
+		return false;
+	}
+
+	std::unordered_set<std::wstring> const names(filenames.cbegin(), filenames.cend());
+
+	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
+		auto & entry = const_cast<CCacheEntry&>(*iter);
+		if (!path.equal_nocase(entry.listing.path)) {
+			continue;
+		}
+
+		UpdateLru(sit, iter);
+
+		std::vector<size_t> remove;
+		std::unordered_set<std::wstring> matched;
+		for (size_t i = 0; i < entry.listing.size(); ++i) {
+			auto const& name = entry.listing[i].name;
+			if (names.find(name) != names.cend()) {
+				remove.push_back(i);
+				matched.insert(name);
+			}
+		}
+
+		if (matched.size() != names.size()) {
+			// Same as in RemoveFile, files not matching case might still be gone
+			std::unordered_set<std::wstring> unmatched;
+			for (auto const& name : names) {
+				if (matched.find(name) == matched.cend()) {
+					unmatched.insert(fz::str_tolower(name));
+				}
+			}
+			for (size_t i = 0; i < entry.listing.size(); ++i) {
+				if (unmatched.find(fz::str_tolower(entry.listing[i].name)) != unmatched.cend()) {
+					entry.listing.get(i).flags |= CDirentry::flag_unsure;
+				}
+			}
+			entry.listing.m_flags |= CDirectoryListing::unsure_invalid;
+		}
+
+		m_totalFileCount -= entry.listing.RemoveEntries(std::move(remove)); // This does set m_hasUnsureEntries
+		entry.modificationTime = fz::monotonic_clock::now();
+	}
+
+	return true;
+}
+
 void CDirectoryCache::InvalidateServer(CServer const& server)
 {
 	fz::scoped_lock lock(mutex_);
@@ -19,6 +19,7 @@ version.
 #include <libfilezilla/mutex.hpp>
 
 #include <list>
+#include <memory>
 #include <set>
 
 enum class LookupFlags
@@ -87,7 +88,8 @@ public:
 
 	std::vector<std::tuple<LookupResults, CDirentry>> LookupFiles(CServer const& server, CServerPath const& path, std::vector<std::wstring> const& filenames, LookupFlags flags);
 
-	void Store(CDirectoryListing const& listing, CServer const& server);
+	// Returns the changes to the previously cached listing of the directory, if any
+	std::shared_ptr<CDirectoryListingDelta const> Store(CDirectoryListing const& listing, CServer const& server);
 	bool GetChangeTime(fz::monotonic_clock& time, CServer const& server, CServerPath const& path);
 	bool Lookup(CDirectoryListing &listing, CServer const&server, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated);
 	bool DoesExist(CServer const& server, CServerPath const& path, int &hasUnsureEntries, bool &is_outdated);
@@ -95,6 +97,7 @@ public:
 	bool InvalidateFile(CServer const& server, CServerPath const& path, std::wstring const& filename);
 	bool UpdateFile(CServer const& server, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type = file, int64_t size = -1, std::wstring const& ownerGroup = std::wstring{});
 	bool RemoveFile(CServer const& server, CServerPath const& path, std::wstring const& filename);
+	bool RemoveFiles(CServer const& server, CServerPath const& path, std::vector<std::wstring> const& filenames);
 	void InvalidateServer(CServer const& server);
 	void RemoveDir(CServer const& server, CServerPath const& path, std::wstring const& filename, CServerPath const& target);
 	void Rename(CServer const& server, CServerPath const& pathFrom, std::wstring const& fileFrom, CServerPath const& pathTo, std::wstring const& fileTo);
@@ -3,6 +3,8 @@
 #include <libfilezilla/format.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <cwctype>
 
 void CDirentry::clear()
 {
@@ -55,6 +57,164 @@ bool CDirentry::operator==(const CDirentry &op) const
 	return true;
 }
 
+// Open-addressing hash tables over the entry names, one for exact and one
+// for case-folded names. Each slot holds the full hash and the entry index,
+// names are only compared when the hashes match. Slots are filled in entry
+// order and never removed, so with linear probing the first match found
+// is the one with the lowest index.
+class CDirectoryListingIndex final
+{
+public:
+	typedef std::vector<fz::shared_value<CDirentry>> entries_t;
+
+	explicit CDirectoryListingIndex(entries_t const& entries);
+
+	size_t find_case(entries_t const& entries, std::wstring_view const& name) const;
+	size_t find_nocase(entries_t const& entries, std::wstring_view const& name) const;
+
+private:
+	struct slot final
+	{
+		size_t hash{};
+		size_t index{std::wstring::npos};
+	};
+
+	static size_t hash_case(std::wstring_view const& name);
+	static size_t hash_nocase(std::wstring_view const& name);
+	static bool equal_nocase(std::wstring_view const& lhs, std::wstring_view const& rhs);
+
+	void insert(std::vector<slot>& slots, size_t hash, size_t index);
+
+	std::vector<slot> case_;
+	std::vector<slot> nocase_;
+	size_t mask_{};
+};
+
+namespace {
+size_t constexpr fnv_offset = sizeof(size_t) == 8 ? static_cast<size_t>(14695981039346656037ull) : 2166136261u;
+size_t constexpr fnv_prime = sizeof(size_t) == 8 ? static_cast<size_t>(1099511628211ull) : 16777619u;
+
+wchar_t fold(wchar_t c)
+{
+	return static_cast<wchar_t>(std::towlower(static_cast<std::wint_t>(c)));
+}
+}
+
+CDirectoryListingIndex::CDirectoryListingIndex(entries_t const& entries)
+{
+	// At most half full
+	size_t capacity = 16;
+	while (capacity < entries.size() * 2) {
+		capacity *= 2;
+	}
+	mask_ = capacity - 1;
+	case_.resize(capacity);
+	nocase_.resize(capacity);
+
+	for (size_t i = 0; i < entries.size(); ++i) {
+		std::wstring const& name = entries[i]->name;
+		insert(case_, hash_case(name), i);
+		insert(nocase_, hash_nocase(name), i);
+	}
+}
+
+void CDirectoryListingIndex::insert(std::vector<slot>& slots, size_t hash, size_t index)
+{
+	size_t pos = hash & mask_;
+	while (slots[pos].index != std::wstring::npos) {
+		pos = (pos + 1) & mask_;
+	}
+	slots[pos].hash = hash;
+	slots[pos].index = index;
+}
+
+size_t CDirectoryListingIndex::hash_case(std::wstring_view const& name)
+{
+	size_t hash = fnv_offset;
+	for (wchar_t const c : name) {
+		hash = (hash ^ static_cast<size_t>(c)) * fnv_prime;
+	}
+	return hash;
+}
+
+size_t CDirectoryListingIndex::hash_nocase(std::wstring_view const& name)
+{
+	size_t hash = fnv_offset;
+	for (wchar_t const c : name) {
+		hash = (hash ^ static_cast<size_t>(fold(c))) * fnv_prime;
+	}
+	return hash;
+}
+
+bool CDirectoryListingIndex::equal_nocase(std::wstring_view const& lhs, std::wstring_view const& rhs)
+{
+	if (lhs.size() != rhs.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < lhs.size(); ++i) {
+		if (lhs[i] != rhs[i] && fold(lhs[i]) != fold(rhs[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t CDirectoryListingIndex::find_case(entries_t const& entries, std::wstring_view const& name) const
+{
+	size_t const hash = hash_case(name);
+	for (size_t pos = hash & mask_; case_[pos].index != std::wstring::npos; pos = (pos + 1) & mask_) {
+		slot const& s = case_[pos];
+		if (s.hash == hash && entries[s.index]->name == name) {
+			return s.index;
+		}
+	}
+	return std::wstring::npos;
+}
+
+size_t CDirectoryListingIndex::find_nocase(entries_t const& entries, std::wstring_view const& name) const
+{
+	size_t const hash = hash_nocase(name);
+	for (size_t pos = hash & mask_; nocase_[pos].index != std::wstring::npos; pos = (pos + 1) & mask_) {
+		slot const& s = nocase_[pos];
+		if (s.hash == hash && equal_nocase(entries[s.index]->name, name)) {
+			return s.index;
+		}
+	}
+	return std::wstring::npos;
+}
+
+CDirectoryListing::CDirectoryListing(CDirectoryListing const& listing)
+	: path(listing.path)
+	, m_firstListTime(listing.m_firstListTime)
+	, m_entries(listing.m_entries)
+	, m_index(std::atomic_load(&listing.m_index))
+	, m_flags(listing.m_flags)
+{
+}
+
+CDirectoryListing& CDirectoryListing::operator=(CDirectoryListing const& listing)
+{
+	if (this != &listing) {
+		path = listing.path;
+		m_firstListTime = listing.m_firstListTime;
+		m_entries = listing.m_entries;
+		m_index = std::atomic_load(&listing.m_index);
+		m_flags = listing.m_flags;
+	}
+	return *this;
+}
+
+std::shared_ptr<CDirectoryListingIndex const> CDirectoryListing::find_index() const
+{
+	auto index = std::atomic_load(&m_index);
+	if (!index) {
+		// Concurrent readers might each build one, all of them are equivalent
+		index = std::make_shared<CDirectoryListingIndex const>(*m_entries);
+		std::atomic_store(&m_index, index);
+	}
+	return index;
+}
+
 const CDirentry& CDirectoryListing::operator[](size_t index) const
 {
 	return *(*m_entries)[index];
@@ -86,8 +246,7 @@ void CDirectoryListing::Assign(std::vector<fz::shared_value<CDirentry>> && entri
 		}
 	}
 
-	m_searchmap_case.clear();
-	m_searchmap_nocase.clear();
+	ClearFindMap();
 }
 
 bool CDirectoryListing::RemoveEntry(size_t index)
@@ -96,8 +255,7 @@ bool CDirectoryListing::RemoveEntry(size_t index)
 		return false;
 	}
 
-	m_searchmap_case.clear();
-	m_searchmap_nocase.clear();
+	ClearFindMap();
 
 	std::vector<fz::shared_value<CDirentry> >& entries = m_entries.get();
 	std::vector<fz::shared_value<CDirentry> >::iterator iter = entries.begin() + index;
@@ -112,107 +270,125 @@ bool CDirectoryListing::RemoveEntry(size_t index)
 	return true;
 }
 
-void CDirectoryListing::GetFilenames(std::vector<std::wstring> &names) const
+size_t CDirectoryListing::RemoveEntries(std::vector<size_t> indexes)
 {
-	names.reserve(size());
-	for (size_t i = 0; i < size(); ++i) {
-		names.push_back((*m_entries)[i]->name);
+	std::sort(indexes.begin(), indexes.end());
+	indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+	while (!indexes.empty() && indexes.back() >= size()) {
+		indexes.pop_back();
 	}
-}
-
-size_t CDirectoryListing::FindFile_CmpCase(std::wstring const& name) const
-{
-	if (!m_entries || m_entries->empty()) {
-		return std::string::npos;
+	if (indexes.empty()) {
+		return 0;
 	}
 
-	if (!m_searchmap_case) {
-		m_searchmap_case.get();
-	}
+	ClearFindMap();
 
-	// Search map
-	auto iter = m_searchmap_case->find(name);
-	if (iter != m_searchmap_case->end()) {
-		return iter->second;
-	}
+	std::vector<fz::shared_value<CDirentry> >& entries = m_entries.get();
 
-	size_t i = m_searchmap_case->size();
-	if (i == m_entries->size()) {
-		return std::string::npos;
+	size_t out = indexes.front();
+	auto next = indexes.cbegin();
+	for (size_t i = out; i < entries.size(); ++i) {
+		if (next != indexes.cend() && *next == i) {
+			if (entries[i]->is_dir()) {
+				m_flags |= CDirectoryListing::unsure_dir_removed;
+			}
+			else {
+				m_flags |= CDirectoryListing::unsure_file_removed;
+			}
+			++next;
+		}
+		else {
+			if (out != i) {
+				entries[out] = std::move(entries[i]);
+			}
+			++out;
+		}
 	}
+	entries.resize(out);
 
-	auto & searchmap_case = m_searchmap_case.get();
-
-	// Build map if not yet complete
-	std::vector<fz::shared_value<CDirentry> >::const_iterator entry_iter = m_entries->begin() + i;
-	for (; entry_iter != m_entries->end(); ++entry_iter, ++i) {
-		std::wstring const& entry_name = (*entry_iter)->name;
-		searchmap_case.emplace(entry_name, i);
+	return indexes.size();
+}
 
-		if (entry_name == name) {
-			return i;
-		}
+void CDirectoryListing::GetFilenames(std::vector<std::wstring> &names) const
+{
+	names.reserve(size());
+	for (size_t i = 0; i < size(); ++i) {
+		names.push_back((*m_entries)[i]->name);
 	}
-
-	// Map is complete, item not in it
-	return std::string::npos;
 }
 
-size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring const& name) const
+size_t CDirectoryListing::FindFile_CmpCase(std::wstring_view const& name) const
 {
 	if (!m_entries || m_entries->empty()) {
 		return std::string::npos;
 	}
 
-	if (!m_searchmap_nocase) {
-		m_searchmap_nocase.get();
-	}
-
-	std::wstring lwr = fz::str_tolower(name);
-
-	// Search map
-	auto iter = m_searchmap_nocase->find(lwr);
-	if (iter != m_searchmap_nocase->end()) {
-		return iter->second;
-	}
+	return find_index()->find_case(*m_entries, name);
+}
 
-	size_t i = m_searchmap_nocase->size();
-	if (i == m_entries->size()) {
+size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring_view const& name) const
+{
+	if (!m_entries || m_entries->empty()) {
 		return std::string::npos;
 	}
 
-	auto& searchmap_nocase = m_searchmap_nocase.get();
-
-	// Build map if not yet complete
-	std::vector<fz::shared_value<CDirentry> >::const_iterator entry_iter = m_entries->begin() + i;
-	for (; entry_iter != m_entries->end(); ++entry_iter, ++i) {
-		std::wstring entry_lrw = fz::str_tolower((*entry_iter)->name);
-		searchmap_nocase.emplace(entry_lrw, i);
-
-		if (entry_lrw == lwr) {
-			return i;
-		}
-	}
-
-	// Map is complete, item not in it
-	return std::string::npos;
+	return find_index()->find_nocase(*m_entries, name);
 }
 
 void CDirectoryListing::ClearFindMap()
 {
-	if (!m_searchmap_case) {
-		return;
-	}
-
-	m_searchmap_case.clear();
-	m_searchmap_nocase.clear();
+	m_index.reset();
 }
 
 void CDirectoryListing::Append(CDirentry&& entry)
 {
+	ClearFindMap();
 	m_entries.get().emplace_back(entry);
 }
 
+CDirectoryListingDelta::CDirectoryListingDelta(CDirectoryListing const& from, CDirectoryListing const& to)
+	: from_time(from.m_firstListTime)
+{
+	// Refreshed listings mostly list the entries in the same order as before,
+	// so the entries are compared in step. Names are only looked up once
+	// they are out of step. Past the end of the old listing, a name can only
+	// match an old entry that has been skipped.
+	std::vector<bool> kept(from.size());
+	size_t next{};
+	bool skipped{};
+	size_t last{};
+	for (size_t i = 0; i < to.size(); ++i) {
+		CDirentry const& entry = to[i];
+
+		size_t j = next;
+		if (j >= from.size() || kept[j] || from[j].name != entry.name) {
+			j = (next < from.size() || skipped) ? from.FindFile_CmpCase(entry.name) : std::wstring::npos;
+			if (j == std::wstring::npos || kept[j]) {
+				added.push_back(i);
+				continue;
+			}
+			skipped = true;
+		}
+
+		if (!added.empty() || j < last) {
+			ordered = false;
+		}
+		kept[j] = true;
+		last = j;
+		next = j + 1;
+
+		if (!(from[j] == entry)) {
+			changed.push_back(i);
+		}
+	}
+
+	for (size_t j = 0; j < kept.size(); ++j) {
+		if (!kept[j]) {
+			removed.push_back(j);
+		}
+	}
+}
+
 bool CheckInclusion(const CDirectoryListing& listing1, const CDirectoryListing& listing2)
 {
 	// Check if listing2 is contained within listing1
@@ -429,6 +429,8 @@ public:
 		return token.operator bool();
 	}
 
+	std::wstring const& GetText() const { return line_; }
+
 	CLine *Concat(CLine const* pLine) const
 	{
 		std::wstring n;
@@ -703,8 +705,20 @@ bool CDirectoryListingParser::ParseData(bool partial)
 	bool error = false;
 	CLine *pLine = GetLine(partial, error);
 	while (pLine) {
+		if (recursive_ && ParseSectionHeader(*pLine)) {
+			delete m_prevLine;
+			m_prevLine = nullptr;
+			delete pLine;
+			pLine = GetLine(partial, error);
+			continue;
+		}
+
 		bool res = ParseLine(*pLine, m_server.GetType(), false);
 		if (!res) {
+			if (recursive_ && !pLine->GetText().empty() && pLine->GetText().back() == ':') {
+				// Section header of a directory not seen before
+				ambiguous_ = true;
+			}
 			if (m_prevLine) {
 				CLine* pConcatenatedLine = m_prevLine->Concat(pLine);
 				res = ParseLine(*pConcatenatedLine, m_server.GetType(), true);
@@ -763,6 +777,110 @@ CDirectoryListing CDirectoryListingParser::Parse(const CServerPath &path)
 	return listing;
 }
 
+void CDirectoryListingParser::SetRecursive(CServerPath const& path)
+{
+	recursive_ = true;
+	recursivePrefix_ = path.GetPath();
+	if (recursivePrefix_.empty() || recursivePrefix_.back() != '/') {
+		recursivePrefix_ += '/';
+	}
+}
+
+bool CDirectoryListingParser::ParseSectionHeader(CLine const& line)
+{
+	std::wstring const& text = line.GetText();
+	if (text.size() < 2 || text.back() != ':') {
+		return false;
+	}
+
+	// Servers either use paths relative to the listed directory or absolute paths
+	std::wstring path = text.substr(0, text.size() - 1);
+	if (path == L"." || path + L"/" == recursivePrefix_ || path == recursivePrefix_) {
+		path.clear();
+	}
+	else if (fz::starts_with(path, std::wstring(L"./"))) {
+		path = path.substr(2);
+	}
+	else if (fz::starts_with(path, recursivePrefix_)) {
+		path = path.substr(recursivePrefix_.size());
+	}
+
+	if (path.empty()) {
+		// Some servers start with a header for the listed directory itself
+		return sections_.empty() && entries_.empty() && m_fileList.empty();
+	}
+
+	if (!expectedSections_.erase(path)) {
+		return false;
+	}
+
+	FinishSection();
+	section_ = std::move(path);
+
+	return true;
+}
+
+void CDirectoryListingParser::FinishSection()
+{
+	if (!m_fileList.empty()) {
+		// Plain names, directories cannot be told apart from files
+		ambiguous_ = true;
+		m_fileList.clear();
+	}
+	m_fileListOnly = true;
+
+	for (auto const& entry : entries_) {
+		if (entry->is_dir() && !entry->is_link()) {
+			expectedSections_.insert(section_.empty() ? entry->name : (section_ + L"/" + entry->name));
+		}
+	}
+
+	recursiveEntries_ += entries_.size();
+	if (recursiveEntries_ > limit_) {
+		truncated_ = true;
+	}
+
+	sections_.push_back({section_, std::move(entries_)});
+	entries_.clear();
+}
+
+RecursiveListingResult CDirectoryListingParser::ParseRecursive(CServerPath const& path, std::vector<CDirectoryListing>& listings)
+{
+	listings.clear();
+
+	if (!ParseData(false)) {
+		return RecursiveListingResult::ambiguous;
+	}
+	FinishSection();
+
+	// Subdirectories past the limit are left out, which does not say anything about the server
+	if (truncated_) {
+		return RecursiveListingResult::truncated;
+	}
+
+	if (ambiguous_ || !expectedSections_.empty()) {
+		return RecursiveListingResult::ambiguous;
+	}
+
+	auto const now = fz::monotonic_clock::now();
+	for (auto & s : sections_) {
+		CDirectoryListing listing;
+		listing.path = path;
+		listing.m_firstListTime = now;
+		for (auto const& segment : fz::strtok(s.path, L'/')) {
+			if (!listing.path.AddSegment(segment)) {
+				listings.clear();
+				return RecursiveListingResult::ambiguous;
+			}
+		}
+		listing.Assign(std::move(s.entries));
+		listings.emplace_back(std::move(listing));
+	}
+	sections_.clear();
+
+	return RecursiveListingResult::ok;
+}
+
 bool CDirectoryListingParser::ParseLine(CLine &line, ServerType const serverType, bool concatenated, CDirentry const* override)
 {
 	fz::shared_value<CDirentry> refEntry;
@@ -2987,6 +3105,12 @@ void CDirectoryListingParser::Reset()
 	m_fileListOnly = true;
 	m_maybeMultilineVms = false;
 	truncated_ = false;
+
+	sections_.clear();
+	section_.clear();
+	expectedSections_.clear();
+	recursiveEntries_ = 0;
+	ambiguous_ = false;
 }
 
 bool CDirectoryListingParser::ParseAsZVM(CLine &line, CDirentry &entry)
@@ -30,12 +30,18 @@
  * Lines not containing a recognized format (e.g. a part of a multiline
  * entry) are rememberd and if the next line cannot be parsed either, they
  * get concatenated to be parsed again (and discarded if not recognized).
+ *
+ * In recursive mode, the output of "LIST -R" is split into the listings of
+ * the individual directories at the "dir:" section headers, just like the
+ * output of "ls -R". A header is only accepted if it names a subdirectory
+ * found in an earlier section.
  */
 
 #include "../include/directorylisting.h"
 #include "../include/server.h"
 
 #include <deque>
+#include <set>
 #include <vector>
 
 class CLine;
@@ -52,6 +58,13 @@ namespace listingEncoding
 	};
 }
 
+enum class RecursiveListingResult
+{
+	ok,
+	truncated, // More entries than the listing item limit
+	ambiguous // Cannot be split unambiguously
+};
+
 
 class FZC_PUBLIC_SYMBOL CDirectoryListingParser final
 {
@@ -64,6 +77,15 @@ public:
 
 	CDirectoryListing Parse(const CServerPath &path);
 
+	// Enables recursive mode, path is the directory being listed.
+	void SetRecursive(CServerPath const& path);
+
+	// Gets the listings of the directory and of all its subdirectories.
+	// Fails as ambiguous if the output cannot be split unambiguously, e.g. if
+	// the server did not in fact list recursively or left out some of the
+	// directories. An empty directory yields a single, empty listing.
+	RecursiveListingResult ParseRecursive(CServerPath const& path, std::vector<CDirectoryListing>& listings);
+
 	bool AddData(char *pData, int len);
 	bool AddLine(std::wstring && line, std::wstring && name, fz::datetime const& time);
 
@@ -71,6 +93,9 @@ public:
 
 	void SetTimezoneOffset(fz::duration const& span) { m_timezoneOffset = span; }
 
+	// Overrides the limit taken from the directory listing item limit option
+	void SetItemLimit(size_t limit) { limit_ = limit; }
+
 	void SetServer(const CServer& server) { m_server = server; };
 
 protected:
@@ -80,6 +105,9 @@ protected:
 
 	bool ParseLine(CLine &line, ServerType const serverType, bool concatenated, CDirentry const* override = nullptr);
 
+	bool ParseSectionHeader(CLine const& line);
+	void FinishSection();
+
 	bool ParseAsUnix(CLine &line, CDirentry &entry, bool expect_date);
 	bool ParseAsDos(CLine &line, CDirentry &entry);
 	bool ParseAsEplf(CLine &line, CDirentry &entry);
@@ -152,6 +180,20 @@ protected:
 
 	size_t limit_{size_t(-1)};
 	bool truncated_{};
+
+	// Recursive mode
+	struct section final
+	{
+		std::wstring path; // Relative to the listed directory
+		std::vector<fz::shared_value<CDirentry>> entries;
+	};
+	bool recursive_{};
+	std::wstring recursivePrefix_;
+	std::vector<section> sections_;
+	std::wstring section_;
+	std::set<std::wstring> expectedSections_;
+	size_t recursiveEntries_{};
+	bool ambiguous_{};
 };
 
 #endif
@@ -65,6 +65,8 @@ unsigned int register_engine_options()
 		{ "FTP Proxy login sequence", L"", option_flags::normal },
 		{ "SFTP keyfiles", L"", option_flags::platform },
 		{ "SFTP compression", false, option_flags::normal },
+		{ "SFTP compression level", 6, option_flags::numeric_clamp, 1, 9 },
+		{ "SFTP verify transfers", false, option_flags::normal },
 		{ "Proxy type", 0, option_flags::normal, 0, 3 },
 		{ "Proxy host", L"", option_flags::normal },
 		{ "Proxy port", 0, option_flags::normal, 1, 65535 },
@@ -357,6 +357,14 @@ int CFileZillaEnginePrivate::List(CListCommand const& command)
 					path = command.GetPath();
 					path.ChangePath(command.GetSubDir());
 				}
+				else if ((flags & LIST_FLAG_RECURSIVE) && !(flags & LIST_FLAG_LINK)) {
+					// Listings of subdirectories obtained through a recursive listing
+					// of a parent are stored under their unresolved path.
+					path = command.GetPath();
+					if (!path.AddSegment(command.GetSubDir())) {
+						path.clear();
+					}
+				}
 			}
 			if (!path.empty()) {
 				CDirectoryListing listing;
@@ -436,6 +444,18 @@ int CFileZillaEnginePrivate::Chmod(CChmodCommand const& command)
 	return FZ_REPLY_CONTINUE;
 }
 
+int CFileZillaEnginePrivate::Copy(CCopyCommand const& command)
+{
+	controlSocket_->Copy(command);
+	return FZ_REPLY_CONTINUE;
+}
+
+int CFileZillaEnginePrivate::BatchTransfer(CBatchTransferCommand const& command)
+{
+	controlSocket_->BatchTransfer(command);
+	return FZ_REPLY_CONTINUE;
+}
+
 void CFileZillaEnginePrivate::RegisterFailedLoginAttempt(const CServer& server, bool critical)
 {
 	fz::scoped_lock lock(global_mutex_);
@@ -667,6 +687,12 @@ void CFileZillaEnginePrivate::OnCommandEvent()
 			case Command::chmod:
 				res = Chmod(static_cast<CChmodCommand const&>(command));
 				break;
+			case Command::copy:
+				res = Copy(static_cast<CCopyCommand const&>(command));
+				break;
+			case Command::batch_transfer:
+				res = BatchTransfer(static_cast<CBatchTransferCommand const&>(command));
+				break;
 			case Command::httprequest:
 				{
 					auto * http_socket = dynamic_cast<CHttpControlSocket*>(controlSocket_.get());
@@ -810,7 +836,7 @@ CTransferStatus CFileZillaEnginePrivate::GetTransferStatus(bool &changed)
 	return transfer_status_.Get(changed);
 }
 
-int CFileZillaEnginePrivate::CacheLookup(const CServerPath& path, CDirectoryListing& listing)
+int CFileZillaEnginePrivate::CacheLookup(const CServerPath& path, CDirectoryListing& listing, bool& outdated)
 {
 	// TODO: Possible optimization: Atomically get current server. The cache has its own mutex.
 	fz::scoped_lock lock(mutex_);
@@ -823,8 +849,8 @@ int CFileZillaEnginePrivate::CacheLookup(const CServerPath& path, CDirectoryList
 		return FZ_REPLY_INTERNALERROR;
 	}
 
-	bool is_outdated = false;
-	if (!directory_cache_.Lookup(listing, controlSocket_->GetCurrentServer(), path, true, is_outdated)) {
+	outdated = false;
+	if (!directory_cache_.Lookup(listing, controlSocket_->GetCurrentServer(), path, true, outdated)) {
 		return FZ_REPLY_ERROR;
 	}
 
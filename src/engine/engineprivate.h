@@ -74,7 +74,7 @@ public:
 
 	CTransferStatus GetTransferStatus(bool &changed);
 
-	int CacheLookup(CServerPath const& path, CDirectoryListing& listing);
+	int CacheLookup(CServerPath const& path, CDirectoryListing& listing, bool& outdated);
 
 	// Add new pending notification
 	void AddNotification(fz::scoped_lock& lock, std::unique_ptr<CNotification> && notification);
@@ -135,6 +135,8 @@ protected:
 	int Mkdir(CMkdirCommand const& command);
 	int Rename(CRenameCommand const& command);
 	int Chmod(CChmodCommand const& command);
+	int Copy(CCopyCommand const& command);
+	int BatchTransfer(CBatchTransferCommand const& command);
 
 	void DoCancel();
 
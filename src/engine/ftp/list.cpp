@@ -102,7 +102,17 @@ int CFtpListOpData::Send()
 		engine_.transfer_status_.Init(-1, 0, true);
 
 		opState = list_waittransfer;
-		if (CServerCapabilities::GetCapability(currentServer_, mlsd_command) == yes) {
+		recursive_ = CanListRecursively();
+		if (recursive_) {
+			listing_parser_->SetRecursive(currentPath_);
+			if (options_.get_int(OPTION_VIEW_HIDDEN_FILES)) {
+				controlSocket_.Transfer(L"LIST -aR", this);
+			}
+			else {
+				controlSocket_.Transfer(L"LIST -R", this);
+			}
+		}
+		else if (CServerCapabilities::GetCapability(currentServer_, mlsd_command) == yes) {
 			controlSocket_.Transfer(L"MLSD", this);
 		}
 		else {
@@ -189,9 +199,9 @@ int CFtpListOpData::ParseResponse()
 		CServerCapabilities::SetCapability(currentServer_, inferred_timezone_offset, no);
 	}
 
-	engine_.GetDirectoryCache().Store(directoryListing_, currentServer_);
+	auto const delta = engine_.GetDirectoryCache().Store(directoryListing_, currentServer_);
 
-	controlSocket_.SendDirectoryListingNotification(currentPath_, false);
+	controlSocket_.SendDirectoryListingNotification(currentPath_, false, delta);
 
 	return FZ_REPLY_OK;
 }
@@ -223,6 +233,19 @@ int CFtpListOpData::SubcommandResult(int prevResult, COpData const&)
 		return FZ_REPLY_CONTINUE;
 	}
 	else if (opState == list_waittransfer) {
+		if (recursive_) {
+			if (prevResult == FZ_REPLY_OK) {
+				return ProcessRecursiveListing();
+			}
+			if (transferEndReason == TransferEndReason::transfer_command_failure_immediate ||
+				transferEndReason == TransferEndReason::transfer_command_failure)
+			{
+				log(logmsg::debug_info, L"Server does not seem to support LIST -R");
+				CServerCapabilities::SetCapability(currentServer_, list_recursive_support, no);
+				return FallbackFromRecursive();
+			}
+		}
+
 		if (prevResult == FZ_REPLY_OK) {
 			CDirectoryListing listing = listing_parser_->Parse(currentPath_);
 
@@ -263,9 +286,9 @@ int CFtpListOpData::SubcommandResult(int prevResult, COpData const&)
 				return res;
 			}
 
-			engine_.GetDirectoryCache().Store(listing, currentServer_);
+			auto const delta = engine_.GetDirectoryCache().Store(listing, currentServer_);
 
-			controlSocket_.SendDirectoryListingNotification(currentPath_, false);
+			controlSocket_.SendDirectoryListingNotification(currentPath_, false, delta);
 
 			return FZ_REPLY_OK;
 		}
@@ -311,9 +334,9 @@ int CFtpListOpData::SubcommandResult(int prevResult, COpData const&)
 					return res;
 				}
 
-				engine_.GetDirectoryCache().Store(listing, currentServer_);
+				auto const delta = engine_.GetDirectoryCache().Store(listing, currentServer_);
 
-				controlSocket_.SendDirectoryListingNotification(currentPath_, false);
+				controlSocket_.SendDirectoryListingNotification(currentPath_, false, delta);
 
 				return FZ_REPLY_OK;
 			}
@@ -332,9 +355,9 @@ int CFtpListOpData::SubcommandResult(int prevResult, COpData const&)
 							return res;
 						}
 
-						engine_.GetDirectoryCache().Store(directoryListing_, currentServer_);
+						auto const delta = engine_.GetDirectoryCache().Store(directoryListing_, currentServer_);
 
-						controlSocket_.SendDirectoryListingNotification(currentPath_, false);
+						controlSocket_.SendDirectoryListingNotification(currentPath_, false, delta);
 
 						return FZ_REPLY_OK;
 					}
@@ -375,3 +398,80 @@ int CFtpListOpData::CheckTimezoneDetection(CDirectoryListing& listing)
 
 	return FZ_REPLY_OK;
 }
+
+bool CFtpListOpData::CanListRecursively() const
+{
+	if (!(flags_ & LIST_FLAG_RECURSIVE) || currentPath_.GetType() != UNIX) {
+		return false;
+	}
+
+	if (CServerCapabilities::GetCapability(currentServer_, list_recursive_support) == no) {
+		return false;
+	}
+
+	// The offset only gets applied to the listing of the directory itself
+	if (CServerCapabilities::GetCapability(currentServer_, inferred_timezone_offset) == unknown) {
+		return false;
+	}
+
+	if (options_.get_int(OPTION_VIEW_HIDDEN_FILES) && CServerCapabilities::GetCapability(currentServer_, list_hidden_support) != yes) {
+		return false;
+	}
+
+	return true;
+}
+
+int CFtpListOpData::ProcessRecursiveListing()
+{
+	std::vector<CDirectoryListing> listings;
+	auto const res = listing_parser_->ParseRecursive(currentPath_, listings);
+	if (res == RecursiveListingResult::truncated) {
+		log(logmsg::debug_info, L"Recursive listing exceeds the item limit, listing directories individually.");
+		return FallbackFromRecursive();
+	}
+	if (res != RecursiveListingResult::ok) {
+		// Could be a server ignoring the -R, or one limiting the output.
+		// Once a server has been seen to support it, blame the directory instead.
+		log(logmsg::debug_info, L"Recursive listing cannot be split unambiguously, listing directories individually.");
+		if (CServerCapabilities::GetCapability(currentServer_, list_recursive_support) != yes) {
+			CServerCapabilities::SetCapability(currentServer_, list_recursive_support, no);
+		}
+		return FallbackFromRecursive();
+	}
+
+	// Without subdirectories the output is the same whether or not the server understood the -R
+	if (listings.size() > 1 && CServerCapabilities::GetCapability(currentServer_, list_recursive_support) == unknown) {
+		log(logmsg::debug_info, L"Server seems to support LIST -R");
+		CServerCapabilities::SetCapability(currentServer_, list_recursive_support, yes);
+	}
+
+	controlSocket_.SetAlive();
+
+	std::shared_ptr<CDirectoryListingDelta const> delta;
+	for (auto const& listing : listings) {
+		auto listingDelta = engine_.GetDirectoryCache().Store(listing, currentServer_);
+		if (listing.path == currentPath_) {
+			delta = std::move(listingDelta);
+		}
+	}
+
+	controlSocket_.SendDirectoryListingNotification(currentPath_, false, delta);
+
+	return FZ_REPLY_OK;
+}
+
+int CFtpListOpData::FallbackFromRecursive()
+{
+	// Start over with a plain listing, the cache lookup in list_waitlock
+	// is repeated, but the lock is kept. The flag has to go as well, else
+	// Send would pick LIST -R again whenever the capability still allows it.
+	flags_ &= ~LIST_FLAG_RECURSIVE;
+	recursive_ = false;
+	transferEndReason = TransferEndReason::successful;
+	tranferCommandSent = false;
+	controlSocket_.m_pTransferSocket.reset();
+	listing_parser_.reset();
+
+	opState = list_waitlock;
+	return FZ_REPLY_CONTINUE;
+}
@@ -27,6 +27,10 @@ public:
 private:
 	int CheckTimezoneDetection(CDirectoryListing& listing);
 
+	bool CanListRecursively() const;
+	int ProcessRecursiveListing();
+	int FallbackFromRecursive();
+
 	CServerPath path_;
 	std::wstring subDir_;
 	bool fallback_to_current_{};
@@ -44,6 +48,8 @@ private:
 	bool viewHiddenCheck_{};
 	bool viewHidden_{}; // Uses LIST -a command
 
+	bool recursive_{}; // Uses LIST -R command
+
 	// Listing index for list_mdtm
 	size_t mdtm_index_{};
 
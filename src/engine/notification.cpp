@@ -1,7 +1,7 @@
 #include "filezilla.h"
 
-CDirectoryListingNotification::CDirectoryListingNotification(CServerPath const& path, bool const primary, bool const failed)
-	: primary_(primary), m_failed(failed), m_path(path)
+CDirectoryListingNotification::CDirectoryListingNotification(CServerPath const& path, bool const primary, bool const failed, std::shared_ptr<CDirectoryListingDelta const> const& delta)
+	: primary_(primary), m_failed(failed), m_path(path), delta_(delta)
 {
 }
 
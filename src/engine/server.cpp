@@ -655,6 +655,11 @@ bool CServer::ProtocolHasFeature(ServerProtocol const protocol, ProtocolFeature
 			return true;
 		}
 		break;
+	case ProtocolFeature::ServerSideCopy:
+		if (protocol == SFTP) {
+			return true;
+		}
+		break;
 	}
 	return false;
 }
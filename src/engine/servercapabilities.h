@@ -32,6 +32,7 @@ enum capabilityNames
 	mode_z_support,
 	tvfs_support, // Trivial virtual file store (RFC 3659)
 	list_hidden_support, // LIST -a command
+	list_recursive_support, // LIST -R command
 	rest_stream, // supports REST+STOR in addition to APPE
 	epsv_command,
 
@@ -46,7 +47,11 @@ enum capabilityNames
 	auth_tls_command,
 	auth_ssl_command,
 
-	tls_resumption
+	tls_resumption,
+
+	// SFTP-protocol specific
+	sftp_check_file, // check-file extension, server-side hashing
+	sftp_copy // copy-file or copy-data extension, server-side copy
 };
 
 class CCapabilities final
@@ -71,6 +71,8 @@ int CSftpConnectOpData::Send()
 			std::vector<fz::native_string> args = { fzT("-v") };
 			if (options_.get_int(OPTION_SFTP_COMPRESSION)) {
 				args.push_back(fzT("-C"));
+				args.push_back(fzT("-Z"));
+				args.push_back(fz::to_native(std::to_wstring(options_.get_int(OPTION_SFTP_COMPRESSION_LEVEL))));
 			}
 
 			controlSocket_.process_ = std::make_unique<fz::process>(engine_.GetThreadPool(), controlSocket_);
@@ -0,0 +1,73 @@
+#include "../filezilla.h"
+
+#include "../directorycache.h"
+#include "../servercapabilities.h"
+#include "copy.h"
+
+enum copyStates
+{
+	copy_init,
+	copy_waitcwd,
+	copy_copy
+};
+
+int CSftpCopyOpData::Send()
+{
+	switch (opState)
+	{
+	case copy_init:
+		if (CServerCapabilities::GetCapability(currentServer_, sftp_copy) != yes) {
+			log(logmsg::error, _("The server does not support copying files"));
+			return FZ_REPLY_NOTSUPPORTED;
+		}
+
+		log(logmsg::status, _("Copying '%s' to '%s'"), command_.GetFromPath().FormatFilename(command_.GetFromFile()), command_.GetToPath().FormatFilename(command_.GetToFile()));
+		controlSocket_.ChangeDir(command_.GetFromPath());
+		opState = copy_waitcwd;
+		return FZ_REPLY_CONTINUE;
+	case copy_copy:
+	{
+		engine_.GetDirectoryCache().InvalidateFile(currentServer_, command_.GetToPath(), command_.GetToFile());
+
+		std::wstring fromQuoted = controlSocket_.QuoteFilename(command_.GetFromPath().FormatFilename(command_.GetFromFile(), !useAbsolute_));
+		std::wstring toQuoted = controlSocket_.QuoteFilename(command_.GetToPath().FormatFilename(command_.GetToFile(), !useAbsolute_ && command_.GetFromPath() == command_.GetToPath()));
+
+		return controlSocket_.SendCommand(L"cp " + fromQuoted + L" " + toQuoted);
+	}
+	default:
+		log(logmsg::debug_warning, L"unknown op state: %d", opState);
+		break;
+	}
+
+	return FZ_REPLY_INTERNALERROR;
+}
+
+int CSftpCopyOpData::ParseResponse()
+{
+	if (controlSocket_.result_ != FZ_REPLY_OK) {
+		return controlSocket_.result_;
+	}
+
+	int64_t size = -1;
+	CDirentry entry;
+	bool dirDidExist{};
+	bool matchedCase{};
+	if (engine_.GetDirectoryCache().LookupFile(entry, currentServer_, command_.GetFromPath(), command_.GetFromFile(), dirDidExist, matchedCase) && matchedCase) {
+		size = entry.size;
+	}
+	engine_.GetDirectoryCache().UpdateFile(currentServer_, command_.GetToPath(), command_.GetToFile(), true, CDirectoryCache::file, size);
+
+	controlSocket_.SendDirectoryListingNotification(command_.GetToPath(), false);
+
+	return FZ_REPLY_OK;
+}
+
+int CSftpCopyOpData::SubcommandResult(int prevResult, COpData const&)
+{
+	if (prevResult != FZ_REPLY_OK) {
+		useAbsolute_ = true;
+	}
+
+	opState = copy_copy;
+	return FZ_REPLY_CONTINUE;
+}
@@ -0,0 +1,23 @@
+#ifndef FILEZILLA_ENGINE_SFTP_COPY_HEADER
+#define FILEZILLA_ENGINE_SFTP_COPY_HEADER
+
+#include "sftpcontrolsocket.h"
+
+class CSftpCopyOpData final : public COpData, public CSftpOpData
+{
+public:
+	CSftpCopyOpData(CSftpControlSocket & controlSocket, CCopyCommand const& command)
+		: COpData(Command::copy, L"CSftpCopyOpData")
+		, CSftpOpData(controlSocket)
+		, command_(command)
+	{}
+
+	virtual int Send() override;
+	virtual int ParseResponse() override;
+	virtual int SubcommandResult(int, COpData const&) override;
+
+	CCopyCommand command_;
+	bool useAbsolute_{};
+};
+
+#endif
@@ -3,38 +3,72 @@
 #include "delete.h"
 #include "../directorycache.h"
 
+namespace {
+// Limits the length of the command line sent to fzsftp
+size_t const max_batch_files = 256;
+size_t const max_batch_chars = 64 * 1024;
+}
+
 int CSftpDeleteOpData::Send()
 {
-	std::wstring const& file = files_.back();
-	if (file.empty()) {
-		log(logmsg::debug_info, L"Empty filename");
+	if (path_.empty()) {
+		log(logmsg::debug_info, L"Empty path");
 		return FZ_REPLY_INTERNALERROR;
 	}
 
-	std::wstring filename = path_.FormatFilename(file);
-	if (filename.empty()) {
-		log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
-		return FZ_REPLY_ERROR;
-	}
-
 	if (time_.empty()) {
 		time_ = fz::datetime::now();
 	}
 
-	engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
+	// Delete the files in batches, each needing only one command to fzsftp
+	// which keeps multiple removal requests in flight.
+	std::wstring cmd = L"mrm " + controlSocket_.QuoteFilename(path_.GetPath());
+
+	batch_.clear();
+	deleted_.clear();
+	while (!files_.empty() && batch_.size() < max_batch_files && cmd.size() < max_batch_chars) {
+		std::wstring const& file = files_.back();
+		if (file.empty()) {
+			log(logmsg::debug_info, L"Empty filename");
+			return FZ_REPLY_INTERNALERROR;
+		}
+
+		std::wstring filename = path_.FormatFilename(file);
+		if (filename.empty()) {
+			log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
+			return FZ_REPLY_ERROR;
+		}
+
+		engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
 
-	return controlSocket_.SendCommand(L"rm " + controlSocket_.QuoteFilename(filename));
+		cmd += L" " + controlSocket_.QuoteFilename(file);
+		batch_.push_back(std::move(files_.back()));
+		files_.pop_back();
+	}
+
+	return controlSocket_.SendCommand(cmd);
+}
+
+void CSftpDeleteOpData::OnItemResult(size_t index, bool success)
+{
+	if (index >= batch_.size()) {
+		log(logmsg::debug_warning, L"Item result for invalid index %d", index);
+		return;
+	}
+
+	if (success) {
+		deleted_.push_back(batch_[index]);
+	}
 }
 
 int CSftpDeleteOpData::ParseResponse()
 {
-	if (controlSocket_.result_ != FZ_REPLY_OK) {
+	if (controlSocket_.result_ != FZ_REPLY_OK || deleted_.size() != batch_.size()) {
 		deleteFailed_ = true;
 	}
-	else {
-		std::wstring const& file = files_.back();
 
-		engine_.GetDirectoryCache().RemoveFile(currentServer_, path_, file);
+	if (!deleted_.empty()) {
+		engine_.GetDirectoryCache().RemoveFiles(currentServer_, path_, deleted_);
 
 		auto const now = fz::datetime::now();
 		if (!time_.empty() && (now - time_).get_seconds() >= 1) {
@@ -47,7 +81,8 @@ int CSftpDeleteOpData::ParseResponse()
 		}
 	}
 
-	files_.pop_back();
+	batch_.clear();
+	deleted_.clear();
 
 	if (!files_.empty()) {
 		return FZ_REPLY_CONTINUE;
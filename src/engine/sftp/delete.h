@@ -16,9 +16,16 @@ public:
 	virtual int SubcommandResult(int prevResult, COpData const&) override;
 	virtual int Reset(int result) override;
 
+	// Result of a single file of the current batch, by index into batch_
+	void OnItemResult(size_t index, bool success);
+
 	CServerPath path_;
 	std::vector<std::wstring> files_;
 
+	// Files sent in the current mrm command and the ones of those that got deleted
+	std::vector<std::wstring> batch_;
+	std::vector<std::wstring> deleted_;
+
 	// Set to fz::datetime::Now initially and after
 	// sending an updated listing to the UI.
 	fz::datetime time_;
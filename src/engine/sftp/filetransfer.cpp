@@ -1,10 +1,12 @@
 #include "../filezilla.h"
 
 #include "../directorycache.h"
+#include "../servercapabilities.h"
 #include "filetransfer.h"
 
 #include "../../include/engine_options.h"
 
+#include <libfilezilla/encode.hpp>
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/process.hpp>
 
@@ -17,6 +19,7 @@ enum filetransferStates
 	filetransfer_waitlist,
 	filetransfer_mtime,
 	filetransfer_transfer,
+	filetransfer_verify,
 	filetransfer_chmtime
 };
 
@@ -93,6 +96,10 @@ int CSftpFileTransferOpData::Send()
 			cmd += remoteFile;
 			logstr += controlSocket_.QuoteFilename(remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_));
 		}
+		if (!resume_ && options_.get_int(OPTION_SFTP_VERIFY_TRANSFERS) && CServerCapabilities::GetCapability(currentServer_, sftp_check_file) == yes) {
+			hash_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::sha256);
+		}
+
 		engine_.transfer_status_.SetStartTime();
 		transferInitiated_ = true;
 		controlSocket_.SetWait(true);
@@ -104,6 +111,10 @@ int CSftpFileTransferOpData::Send()
 		std::wstring quotedFilename = controlSocket_.QuoteFilename(remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_));
 		return controlSocket_.SendCommand(L"mtime " + quotedFilename);
 	}
+	else if (opState == filetransfer_verify) {
+		std::wstring quotedFilename = controlSocket_.QuoteFilename(remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_));
+		return controlSocket_.SendCommand(L"chkfile sha256 " + quotedFilename);
+	}
 	else if (opState == filetransfer_chmtime) {
 		assert(!localFileTime_.empty());
 		if (download()) {
@@ -129,22 +140,35 @@ int CSftpFileTransferOpData::ParseResponse()
 {
 	if (opState == filetransfer_transfer) {
 		writer_.reset();
-		if (controlSocket_.result_ == FZ_REPLY_OK && options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
-			if (download()) {
-				if (!remoteFileTime_.empty()) {
-					if (!writer_factory_->set_mtime(remoteFileTime_)) {
-						log(logmsg::debug_warning, L"Could not set modification time");
-					}
-				}
+		if (controlSocket_.result_ != FZ_REPLY_OK) {
+			return controlSocket_.result_;
+		}
+		if (hash_) {
+			opState = filetransfer_verify;
+			return FZ_REPLY_CONTINUE;
+		}
+		return TransferDone();
+	}
+	else if (opState == filetransfer_verify) {
+		if (controlSocket_.result_ != FZ_REPLY_OK) {
+			log(logmsg::status, _("Could not verify the transferred file, the server failed to compute its checksum."));
+		}
+		else {
+			std::wstring const response = fz::str_tolower_ascii(controlSocket_.response_);
+			auto const tokens = fz::strtok_view(response, ' ');
+			if (tokens.size() != 2 || tokens[0] != L"sha256") {
+				log(logmsg::debug_warning, L"Unexpected checksum reply: %s", controlSocket_.response_);
+			}
+			else if (tokens[1] != fz::hex_encode<std::wstring>(hash_->digest())) {
+				log(logmsg::error, _("Checksum mismatch, the transferred file differs from the file on the server."));
+				return FZ_REPLY_ERROR;
 			}
 			else {
-				if (!localFileTime_.empty()) {
-					opState = filetransfer_chmtime;
-					return FZ_REPLY_CONTINUE;
-				}
+				log(logmsg::status, _("File integrity verified using SHA-256 checksum"));
 			}
 		}
-		return controlSocket_.result_;
+		hash_.reset();
+		return TransferDone();
 	}
 	else if (opState == filetransfer_mtime) {
 		if (controlSocket_.result_ == FZ_REPLY_OK && !controlSocket_.response_.empty()) {
@@ -188,6 +212,26 @@ int CSftpFileTransferOpData::ParseResponse()
 	return FZ_REPLY_INTERNALERROR;
 }
 
+int CSftpFileTransferOpData::TransferDone()
+{
+	if (options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
+		if (download()) {
+			if (!remoteFileTime_.empty()) {
+				if (!writer_factory_->set_mtime(remoteFileTime_)) {
+					log(logmsg::debug_warning, L"Could not set modification time");
+				}
+			}
+		}
+		else {
+			if (!localFileTime_.empty()) {
+				opState = filetransfer_chmtime;
+				return FZ_REPLY_CONTINUE;
+			}
+		}
+	}
+	return FZ_REPLY_OK;
+}
+
 int CSftpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 {
 	if (opState == filetransfer_waitcwd) {
@@ -331,6 +375,10 @@ void CSftpFileTransferOpData::OnOpenRequested(uint64_t offset)
 		}
 	}
 	else {
+		if (offset) {
+			// Only whole files can be verified
+			hash_.reset();
+		}
 		reader_ = reader_factory_->open(*controlSocket_.buffer_pool_, offset, fz::aio_base::nosize, controlSocket_.max_buffer_count());
 		if (!reader_) {
 			controlSocket_.AddToSendBuffer("--\n");
@@ -367,6 +415,9 @@ void CSftpFileTransferOpData::OnNextBufferRequested(uint64_t processed)
 			return;
 		}
 		if (buffer_->size()) {
+			if (hash_) {
+				hash_->update(buffer_->get(), buffer_->size());
+			}
 			controlSocket_.AddToSendBuffer(fz::sprintf("-%d %d\n", buffer_->get() - base_address_, buffer_->size()));
 		}
 		else {
@@ -374,6 +425,9 @@ void CSftpFileTransferOpData::OnNextBufferRequested(uint64_t processed)
 		}
 	}
 	else if (writer_) {
+		if (hash_ && processed) {
+			hash_->update(buffer_->get(), processed);
+		}
 		buffer_->resize(processed);
 		auto r = writer_->add_buffer(std::move(buffer_), *this);
 		if (r == fz::aio_result::ok) {
@@ -400,6 +454,9 @@ void CSftpFileTransferOpData::OnNextBufferRequested(uint64_t processed)
 void CSftpFileTransferOpData::OnFinalizeRequested(uint64_t lastWrite)
 {
 	finalizing_ = true;
+	if (hash_ && lastWrite) {
+		hash_->update(buffer_->get(), lastWrite);
+	}
 	buffer_->resize(lastWrite);
 	auto r = writer_->add_buffer(std::move(buffer_), *this);
 	if (r == fz::aio_result::ok) {
@@ -3,6 +3,8 @@
 
 #include "sftpcontrolsocket.h"
 
+#include <libfilezilla/hash.hpp>
+
 class CSftpFileTransferOpData final : public CFileTransferOpData, public CSftpOpData, public fz::event_handler
 {
 public:
@@ -27,12 +29,19 @@ private:
 	virtual void operator()(fz::event_base const& ev) override;
 	void OnBufferAvailability(fz::aio_waitable const* w);
 
+	// Post-transfer steps common to verified and unverified transfers
+	int TransferDone();
+
 	std::unique_ptr<fz::reader_base> reader_;
 	std::unique_ptr<fz::writer_base> writer_;
 	bool finalizing_{};
 
 	uint8_t const* base_address_{};
 	fz::buffer_lease buffer_;
+
+	// Hash of the transferred data, compared against the server-side
+	// hash of the remote file after the transfer.
+	std::unique_ptr<fz::hash_accumulator> hash_;
 };
 
 #endif
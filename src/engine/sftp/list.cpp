@@ -81,8 +81,8 @@ int CSftpListOpData::ParseResponse()
 		}
 
 		directoryListing_ = listing_parser_->Parse(currentPath_);
-		engine_.GetDirectoryCache().Store(directoryListing_, currentServer_);
-		controlSocket_.SendDirectoryListingNotification(currentPath_, false);
+		auto const delta = engine_.GetDirectoryCache().Store(directoryListing_, currentServer_);
+		controlSocket_.SendDirectoryListingNotification(currentPath_, false, delta);
 
 		return FZ_REPLY_OK;
 	}
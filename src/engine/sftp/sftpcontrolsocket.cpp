@@ -2,6 +2,7 @@
 
 #include "chmod.h"
 #include "connect.h"
+#include "copy.h"
 #include "cwd.h"
 #include "delete.h"
 #include "event.h"
@@ -281,6 +282,31 @@ void CSftpControlSocket::OnSftpEvent(sftp_message const& message)
 			data.OnFinalizeRequested(fz::to_integral<uint64_t>(message.text[0]));
 		}
 		break;
+	case sftpEvent::item_result:
+		if (!operations_.empty() && operations_.back()->opId == Command::del) {
+			auto tokens = fz::strtok_view(message.text[0], ' ');
+			if (tokens.size() == 2) {
+				auto & data = static_cast<CSftpDeleteOpData&>(*operations_.back());
+				data.OnItemResult(fz::to_integral<size_t>(tokens[0], size_t(-1)), tokens[1] == L"1");
+			}
+		}
+		break;
+	case sftpEvent::extensions:
+		{
+			bool checkFile{};
+			bool copy{};
+			for (auto const& extension : fz::strtok_view(message.text[0], ' ')) {
+				if (extension == L"check-file") {
+					checkFile = true;
+				}
+				else if (extension == L"copy") {
+					copy = true;
+				}
+			}
+			CServerCapabilities::SetCapability(currentServer_, sftp_check_file, checkFile ? yes : no);
+			CServerCapabilities::SetCapability(currentServer_, sftp_copy, copy ? yes : no);
+		}
+		break;
 	default:
 		log(logmsg::debug_warning, L"Message type %d not handled", message.type);
 		break;
@@ -574,6 +600,11 @@ void CSftpControlSocket::Chmod(CChmodCommand const& command)
 	Push(std::make_unique<CSftpChmodOpData>(*this, command));
 }
 
+void CSftpControlSocket::Copy(CCopyCommand const& command)
+{
+	Push(std::make_unique<CSftpCopyOpData>(*this, command));
+}
+
 void CSftpControlSocket::Rename(CRenameCommand const& command)
 {
 	Push(std::make_unique<CSftpRenameOpData>(*this, command));
@@ -25,6 +25,7 @@ public:
 	virtual void Mkdir(CServerPath const& path, transfer_flags const& flags = {}) override;
 	virtual void Rename(CRenameCommand const& command) override;
 	virtual void Chmod(CChmodCommand const& command) override;
+	virtual void Copy(CCopyCommand const& command) override;
 	virtual void Cancel() override;
 
 	virtual bool SetAsyncRequestReply(CAsyncRequestNotification *pNotification) override;
@@ -70,6 +71,7 @@ protected:
 	friend class CSftpChangeDirOpData;
 	friend class CSftpChmodOpData;
 	friend class CSftpConnectOpData;
+	friend class CSftpCopyOpData;
 	friend class CSftpDeleteOpData;
 	friend class CSftpFileTransferOpData;
 	friend class CSftpListOpData;
@@ -78,8 +78,8 @@ int CStorjListOpData::ParseResponse()
 		listing.m_firstListTime = fz::monotonic_clock::now();
 		listing.Assign(std::move(entries_));
 
-		engine_.GetDirectoryCache().Store(listing, currentServer_);
-		controlSocket_.SendDirectoryListingNotification(listing.path, false);
+		auto const delta = engine_.GetDirectoryCache().Store(listing, currentServer_);
+		controlSocket_.SendDirectoryListingNotification(listing.path, false, delta);
 
 		currentPath_ = path_;
 		return FZ_REPLY_OK;
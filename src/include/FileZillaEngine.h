@@ -54,6 +54,10 @@ public:
 
 	int CacheLookup(CServerPath const& path, CDirectoryListing& listing);
 
+	// As above, also tells whether the cached listing is older than the cache
+	// lifetime and should be refreshed before being relied upon.
+	int CacheLookup(CServerPath const& path, CDirectoryListing& listing, bool& outdated);
+
 private:
 	std::unique_ptr<CFileZillaEnginePrivate> impl_;
 };
@@ -27,6 +27,8 @@ enum class Command
 	chmod,
 	raw,
 	httprequest, // Only used by HTTP protocol
+	copy, // Server-side copy, only supported by SFTP if the server supports it
+	batch_transfer,
 
 	// Only used internally
 	sleep,
@@ -133,6 +135,7 @@ typedef CBasicCommand<Command::disconnect> CDisconnectCommand;
 #define LIST_FLAG_FALLBACK_CURRENT 4
 #define LIST_FLAG_LINK 8
 #define LIST_FLAG_CLEARCACHE 16
+#define LIST_FLAG_RECURSIVE 32
 class FZC_PUBLIC_SYMBOL CListCommand final : public CCommandHelper<CListCommand, Command::list>
 {
 	// Without a given directory, the current directory will be listed.
@@ -152,6 +155,11 @@ class FZC_PUBLIC_SYMBOL CListCommand final : public CCommandHelper<CListCommand,
 	// LIST_FLAG_LINK is used for symlink discovery. There's unfortunately
 	// no sane way to distinguish between symlinks to files and symlinks to
 	// directories.
+	//
+	// If LIST_FLAG_RECURSIVE is set, the listings of all subdirectories are
+	// retrieved as well and put into the cache if the server supports it.
+	// Subdirectories with a cached listing are then looked up without
+	// changing into them first.
 public:
 	explicit CListCommand(int flags = 0);
 	explicit CListCommand(CServerPath path, std::wstring const& subDir = std::wstring(), int flags = 0);
@@ -248,6 +256,23 @@ protected:
 	transfer_flags const flags_;
 };
 
+// Transfers several files in the same direction from or to the same remote
+// directory as a single operation. The outcome of each individual transfer
+// is reported in a CBatchTransferNotification prior to the nId_operation
+// notification. The operation succeeds only if all transfers succeed.
+class FZC_PUBLIC_SYMBOL CBatchTransferCommand final : public CCommandHelper<CBatchTransferCommand, Command::batch_transfer>
+{
+public:
+	explicit CBatchTransferCommand(std::vector<CFileTransferCommand> && transfers);
+
+	std::vector<CFileTransferCommand> const& GetTransfers() const { return transfers_; }
+
+	bool valid() const;
+
+protected:
+	std::vector<CFileTransferCommand> const transfers_;
+};
+
 class FZC_PUBLIC_SYMBOL CHttpRequestCommand final : public CCommandHelper<CHttpRequestCommand, Command::httprequest>
 {
 public:
@@ -369,4 +394,25 @@ protected:
 	std::wstring const m_permission;
 };
 
+// Copies a file on the server without transferring its data to the client
+class FZC_PUBLIC_SYMBOL CCopyCommand final : public CCommandHelper<CCopyCommand, Command::copy>
+{
+public:
+	CCopyCommand(CServerPath const& fromPath, std::wstring const& fromFile,
+				 CServerPath const& toPath, std::wstring const& toFile);
+
+	CServerPath GetFromPath() const { return m_fromPath; }
+	CServerPath GetToPath() const { return m_toPath; }
+	std::wstring GetFromFile() const { return m_fromFile; }
+	std::wstring GetToFile() const { return m_toFile; }
+
+	bool valid() const;
+
+protected:
+	CServerPath const m_fromPath;
+	CServerPath const m_toPath;
+	std::wstring const m_fromFile;
+	std::wstring const m_toFile;
+};
+
 #endif
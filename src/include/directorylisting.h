@@ -7,7 +7,8 @@
 #include <libfilezilla/shared.hpp>
 #include <libfilezilla/time.hpp>
 
-#include <unordered_map>
+#include <memory>
+#include <vector>
 
 class FZC_PUBLIC_SYMBOL CDirentry
 {
@@ -70,16 +71,18 @@ public:
 	bool operator==(const CDirentry &op) const;
 };
 
+class CDirectoryListingIndex;
+
 class FZC_PUBLIC_SYMBOL CDirectoryListing final
 {
 public:
 	typedef CDirentry value_type;
 
 	CDirectoryListing() = default;
-	CDirectoryListing(CDirectoryListing const& listing) = default;
+	CDirectoryListing(CDirectoryListing const& listing);
 	CDirectoryListing(CDirectoryListing && listing) noexcept = default;
 
-	CDirectoryListing& operator=(CDirectoryListing const&) = default;
+	CDirectoryListing& operator=(CDirectoryListing const&);
 	CDirectoryListing& operator=(CDirectoryListing &&) noexcept = default;
 
 	CDirentry const& operator[](size_t index) const;
@@ -92,8 +95,10 @@ public:
 
 	void Append(CDirentry&& entry);
 
-	size_t FindFile_CmpCase(std::wstring const& name) const;
-	size_t FindFile_CmpNoCase(std::wstring const& name) const;
+	// Both return the lowest index of an entry with the given name.
+	// Safe to call from several threads at once.
+	size_t FindFile_CmpCase(std::wstring_view const& name) const;
+	size_t FindFile_CmpNoCase(std::wstring_view const& name) const;
 
 	void ClearFindMap();
 
@@ -140,19 +145,47 @@ public:
 
 	bool RemoveEntry(size_t index);
 
+	// Removes all the entries at the given indexes in a single pass.
+	// Returns the number of removed entries.
+	size_t RemoveEntries(std::vector<size_t> indexes);
+
 	void GetFilenames(std::vector<std::wstring> &names) const;
 
 protected:
 
 	fz::shared_optional<std::vector<fz::shared_value<CDirentry>>> m_entries;
 
-	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_case;
-	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_nocase;
+	// Lookup index over the names, built on first lookup and immutable
+	// afterwards. Copies of the listing share it until either of them changes
+	// its entries. Const member functions only access it atomically.
+	std::shared_ptr<CDirectoryListingIndex const> find_index() const;
+	mutable std::shared_ptr<CDirectoryListingIndex const> m_index;
 
 public:
 	int m_flags{};
 };
 
+// Differences between two listings of the same directory, entries are matched by name
+class FZC_PUBLIC_SYMBOL CDirectoryListingDelta final
+{
+public:
+	CDirectoryListingDelta() = default;
+	CDirectoryListingDelta(CDirectoryListing const& from, CDirectoryListing const& to);
+
+	bool empty() const { return added.empty() && removed.empty() && changed.empty(); }
+
+	// m_firstListTime of the listing the delta starts from
+	fz::monotonic_clock from_time;
+
+	std::vector<size_t> added; // Indexes in the new listing
+	std::vector<size_t> removed; // Indexes in the old listing
+	std::vector<size_t> changed; // Indexes in the new listing
+
+	// Set if the entries in both listings keep their order
+	// and all added entries come after them.
+	bool ordered{true};
+};
+
 // Checks if listing2 is a subset of listing1. Compares only filenames.
 bool FZC_PUBLIC_SYMBOL CheckInclusion(CDirectoryListing const& listing1, CDirectoryListing const& listing2);
 
@@ -60,6 +60,8 @@ enum engineOptions : unsigned int
 
 	OPTION_SFTP_KEYFILES,
 	OPTION_SFTP_COMPRESSION,
+	OPTION_SFTP_COMPRESSION_LEVEL,	// 1-9, only used if fzsftp was built with the system zlib
+	OPTION_SFTP_VERIFY_TRANSFERS,	// Compare hashes after transfers if the server supports check-file
 
 	OPTION_PROXY_TYPE,
 	OPTION_PROXY_HOST,
@@ -37,7 +37,8 @@ enum NotificationId : unsigned int
 	nId_local_dir_created, // local directory has been created
 	nId_serverchange,      // With some protocols, actual server identity isn't known until after logon
 	nId_persistent_state,  // See PersistentStateNotification
-	nId_ftp_tls_resumption
+	nId_ftp_tls_resumption,
+	nId_batch_transfer     // outcome of the individual transfers of a CBatchTransferCommand
 };
 
 // Async request IDs
@@ -121,18 +122,23 @@ public:
 // Primary notifications are those resulting from a CListCommand, other ones
 // can happen spontaneously through other actions.
 class CDirectoryListing;
+class CDirectoryListingDelta;
 class FZC_PUBLIC_SYMBOL CDirectoryListingNotification final : public CNotificationHelper<nId_listing>
 {
 public:
-	explicit CDirectoryListingNotification(CServerPath const& path, bool const primary, bool const failed = false);
+	explicit CDirectoryListingNotification(CServerPath const& path, bool const primary, bool const failed = false, std::shared_ptr<CDirectoryListingDelta const> const& delta = nullptr);
 	bool Primary() const { return primary_; }
 	bool Failed() const { return m_failed; }
 	const CServerPath GetPath() const { return m_path; }
 
+	// If the listing replaced a cached one, the changes to it
+	std::shared_ptr<CDirectoryListingDelta const> const& Delta() const { return delta_; }
+
 protected:
 	bool const primary_{};
 	bool m_failed{};
 	CServerPath m_path;
+	std::shared_ptr<CDirectoryListingDelta const> delta_;
 };
 
 class FZC_PUBLIC_SYMBOL CAsyncRequestNotification : public CNotificationHelper<nId_asyncrequest>
@@ -399,4 +405,23 @@ public:
 	std::string persistent_state_;
 };
 
+// Sent each time a transfer of a CBatchTransferCommand starts and once the
+// command ends, prior to its nId_operation notification.
+// Holds the reply code of each transfer that has finished so far, in the order
+// the transfers have been given in the command. Unless finished_ is set, the
+// transfer at index replies_.size() is the one that has just been started.
+class FZC_PUBLIC_SYMBOL CBatchTransferNotification final : public CNotificationHelper<nId_batch_transfer>
+{
+public:
+	CBatchTransferNotification() = default;
+
+	CBatchTransferNotification(std::vector<int> && replies, bool finished)
+		: replies_(std::move(replies))
+		, finished_(finished)
+	{}
+
+	std::vector<int> replies_;
+	bool finished_{};
+};
+
 #endif
@@ -111,7 +111,8 @@ enum class ProtocolFeature
 	ProExclusive,
 	ListVersions,
 	DownloadVersion,
-	DeleteVersion
+	DeleteVersion,
+	ServerSideCopy // Only available if the server supports it
 };
 
 enum class CaseSensitivity
@@ -4,6 +4,7 @@
 
 #include "view.h"
 #include "LocalListView.h"
+#include "Mainfrm.h"
 #include "queue.h"
 #include "filezillaapp.h"
 #include "filter_manager.h"
@@ -27,11 +28,15 @@
 #include "timeformatting.h"
 
 #include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/mutex.hpp>
 #include <libfilezilla/process.hpp>
 #include <libfilezilla/recursive_remove.hpp>
 
 #include <wx/menu.h>
 
+#include <atomic>
+#include <iterator>
+
 using namespace std::literals;
 
 class CLocalListViewDropTarget final : public CFileDropTarget<wxListCtrlEx>
@@ -251,6 +256,156 @@ protected:
 	CLocalListView *m_pLocalListView{};
 };
 
+// Enumerates a local directory on the thread pool. The entries, with their
+// sort keys already built, get handed to the list in batches so that large
+// or slow directories neither block the GUI nor show up all at once.
+//
+// Everything the worker touches lives in a shared state. Destroying a
+// loader that is still running only tells the worker to stop, the task
+// itself is left to the main frame to be joined on shutdown. That way a
+// worker stuck on an unresponsive network drive cannot freeze the GUI.
+class CLocalDirLoader final
+{
+public:
+	CLocalDirLoader(CLocalListView& view, fz::thread_pool& pool, CLocalPath const& dir, NameSortMode nameSortMode)
+		: mainFrame_(view.m_state.GetMainFrame())
+		, state_(std::make_shared<state>(view, dir, nameSortMode))
+	{
+		task_ = pool.spawn([s = state_] { entry(*s); });
+		if (!task_) {
+			fz::scoped_lock l(state_->mutex_);
+			state_->result_ = fz::result{fz::result::other};
+			state_->done_ = true;
+		}
+	}
+
+	~CLocalDirLoader()
+	{
+		fz::scoped_lock l(state_->mutex_);
+		state_->stop_ = true;
+		if (!state_->done_) {
+			l.unlock();
+			mainFrame_.AddStoppedTask(std::move(task_));
+		}
+	}
+
+	// Returns true if the enumeration has finished within the timeout
+	bool wait(fz::duration const& timeout)
+	{
+		fz::scoped_lock l(state_->mutex_);
+		if (!state_->done_) {
+			state_->cond_.wait(l, timeout);
+		}
+		return state_->done_;
+	}
+
+	// Moves the entries found so far into entries.
+	// Returns true once all entries have been taken.
+	bool take(std::vector<CLocalFileData>& entries)
+	{
+		fz::scoped_lock l(state_->mutex_);
+		state_->notified_ = false;
+		entries = std::move(state_->entries_);
+		state_->entries_.clear();
+		return state_->done_;
+	}
+
+	// Only meaningful once take has returned true
+	fz::result result() const { return state_->result_; }
+	bool encoding_error() const { return state_->encodingError_; }
+
+private:
+	struct state final
+	{
+		state(CLocalListView& view, CLocalPath const& dir, NameSortMode nameSortMode)
+			: view_(view)
+			, dir_(dir)
+			, nameSortMode_(nameSortMode)
+		{}
+
+		// Only to be used while holding the mutex and not stopped
+		CLocalListView& view_;
+		CLocalPath const dir_;
+		NameSortMode const nameSortMode_;
+
+		fz::mutex mutex_;
+		fz::condition cond_;
+		std::vector<CLocalFileData> entries_;
+		fz::result result_{};
+		bool encodingError_{};
+		bool done_{};
+		bool notified_{};
+
+		std::atomic<bool> stop_{};
+	};
+
+	static void entry(state& s)
+	{
+		fz::local_filesys local_filesys;
+		fz::result result = local_filesys.begin_find_files(fz::to_native(s.dir_.GetPath()), false);
+
+		std::vector<CLocalFileData> batch;
+		bool encodingError{};
+		if (result) {
+			fz::monotonic_clock last = fz::monotonic_clock::now();
+
+			CLocalFileData data;
+			bool wasLink{};
+			fz::local_filesys::type t{};
+			fz::native_string name;
+			while (!s.stop_ && local_filesys.get_next_file(name, wasLink, t, &data.size, &data.time, &data.attributes)) {
+				data.name = fz::to_wstring(name);
+				data.dir = t == fz::local_filesys::dir;
+				if (name.empty() || data.name.empty()) {
+					encodingError = true;
+					continue;
+				}
+
+				data.sortKey = CFileListCtrlSortBase::MakeSortKey(data.name, s.nameSortMode_);
+				data.sortKeyMode = s.nameSortMode_;
+				batch.push_back(data);
+
+				if (batch.size() >= 5000 || (fz::monotonic_clock::now() - last) >= fz::duration::from_milliseconds(200)) {
+					deliver(s, batch, false, result, encodingError);
+					last = fz::monotonic_clock::now();
+				}
+			}
+		}
+
+		deliver(s, batch, true, result, encodingError);
+	}
+
+	static void deliver(state& s, std::vector<CLocalFileData>& batch, bool done, fz::result const& result, bool encodingError)
+	{
+		fz::scoped_lock l(s.mutex_);
+		if (s.entries_.empty()) {
+			s.entries_.swap(batch);
+		}
+		else {
+			std::move(batch.begin(), batch.end(), std::back_inserter(s.entries_));
+		}
+		batch.clear();
+
+		if (done) {
+			s.result_ = result;
+			s.encodingError_ = encodingError;
+			s.done_ = true;
+			s.cond_.signal(l);
+		}
+
+		// The loader sets stop_ under the mutex before going away, so the
+		// view is still alive here.
+		if (!s.notified_ && !s.stop_) {
+			s.notified_ = true;
+			s.view_.CallAfter([&view = s.view_] { view.OnDirLoaded(); });
+		}
+	}
+
+	CMainFrame& mainFrame_;
+	std::shared_ptr<state> state_;
+	fz::async_task task_;
+};
+
 BEGIN_EVENT_TABLE(CLocalListView, CFileListCtrl<CLocalFileData>)
 	EVT_LIST_ITEM_ACTIVATED(wxID_ANY, CLocalListView::OnItemActivated)
 	EVT_CONTEXT_MENU(CLocalListView::OnContextMenu)
@@ -313,6 +468,8 @@ CLocalListView::~CLocalListView()
 	wxString str = wxString::Format(_T("%d %d"), m_sortDirection, m_sortColumn);
 	options_.set(OPTION_LOCALFILELIST_SORTORDER, str.ToStdWstring());
 
+	loader_.reset();
+
 #ifdef __WXMSW__
 	volumeEnumeratorThread_.reset();
 #endif
@@ -322,6 +479,10 @@ bool CLocalListView::DisplayDir(CLocalPath const& dirname)
 {
 	CancelLabelEdit();
 
+	// Abandon any directory still being read
+	loader_.reset();
+	pendingRefresh_.clear();
+
 	std::wstring focused;
 	int focusedItem = -1;
 	std::vector<std::wstring> selectedNames;
@@ -354,8 +515,6 @@ bool CLocalListView::DisplayDir(CLocalPath const& dirname)
 		m_pFilelistStatusBar->UnselectAll();
 	}
 
-	const int oldItemCount = m_indexMapping.size();
-
 	m_fileData.clear();
 	m_indexMapping.clear();
 
@@ -390,75 +549,130 @@ bool CLocalListView::DisplayDir(CLocalPath const& dirname)
 #ifdef __WXMSW__
 regular_dir:
 #endif
-		CStateFilterManager const& filter = m_state.GetStateFilterManager();
-		fz::local_filesys local_filesys;
+		SetInfoText(wxString());
+		if (m_pFilelistStatusBar) {
+			m_pFilelistStatusBar->SetDirectoryContents(0, 0, 0, 0, 0);
+		}
+		if (IsComparing()) {
+			m_originalIndexMapping.clear();
+		}
 
-		auto result = local_filesys.begin_find_files(fz::to_native(m_dir.GetPath()), false);
-		if (!result) {
+		pendingSelection_.names = std::move(selectedNames);
+		pendingSelection_.focused = std::move(focused);
+		pendingSelection_.focusedItem = focusedItem;
+		pendingSelection_.ensureVisible = ensureVisible;
 
-			if (result.error_ == fz::result::noperm) {
-				SetInfoText(_("You do not have permission to list this directory"));
-			}
-			else {
-				SetInfoText(_("Could not list directory contents"));
-			}
+		loader_ = std::make_unique<CLocalDirLoader>(*this, m_state.pool_, m_dir, GetNameSortMode());
 
-			SetItemCount(1);
-			if (m_pFilelistStatusBar) {
-				m_pFilelistStatusBar->SetDirectoryContents(0, 0, 0, 0, 0);
-			}
+		// Most directories are read in an instant, show those in one go like before
+		if (loader_->wait(fz::duration::from_milliseconds(100))) {
+			return OnDirLoaded();
+		}
 
-			return false;
+		if (GetItemCount() != static_cast<int>(m_indexMapping.size())) {
+			SetItemCount(m_indexMapping.size());
 		}
+		RefreshListOnly();
 
-		SetInfoText(wxString());
+		return true;
+	}
 
-		int64_t totalSize{};
-		int unknown_sizes = 0;
-		int totalFileCount = 0;
-		int totalDirCount = 0;
-		int hidden = 0;
+	FinishDisplayDir(selectedNames, std::move(focused), focusedItem, ensureVisible, false);
 
-		int num = m_fileData.size();
-		CLocalFileData data;
-		bool wasLink{};
-		fz::local_filesys::type t{};
-		fz::native_string name;
-		while (local_filesys.get_next_file(name, wasLink, t, &data.size, &data.time, &data.attributes)) {
-			data.name = fz::to_wstring(name);
-			data.dir = t == fz::local_filesys::dir;
-			if (name.empty() || data.name.empty()) {
-				wxGetApp().DisplayEncodingWarning();
-				continue;
-			}
+	return true;
+}
 
-			m_fileData.push_back(data);
-			if (!filter.FilenameFiltered(data.name, m_dir.GetPath(), data.dir, data.size, true, data.attributes, data.time)) {
+bool CLocalListView::OnDirLoaded()
+{
+	if (!loader_) {
+		return false;
+	}
+
+	std::vector<CLocalFileData> entries;
+	bool const done = loader_->take(entries);
+
+	if (!entries.empty()) {
+		AddLoadedEntries(entries);
+	}
+
+	if (!done) {
+		RefreshListOnly(false);
+		return true;
+	}
+
+	fz::result const result = loader_->result();
+	if (loader_->encoding_error()) {
+		wxGetApp().DisplayEncodingWarning();
+	}
+	loader_.reset();
+
+	if (!result) {
+		if (result.error_ == fz::result::noperm) {
+			SetInfoText(_("You do not have permission to list this directory"));
+		}
+		else {
+			SetInfoText(_("Could not list directory contents"));
+		}
+
+		SetItemCount(1);
+		if (m_pFilelistStatusBar) {
+			m_pFilelistStatusBar->SetDirectoryContents(0, 0, 0, 0, 0);
+		}
+
+		return false;
+	}
+
+	// Entries arrived in order, no need to sort again
+	FinishDisplayDir(pendingSelection_.names, std::move(pendingSelection_.focused), pendingSelection_.focusedItem, pendingSelection_.ensureVisible, true);
+	pendingSelection_ = pending_selection();
+
+	// Files that changed while the directory was being read
+	auto refresh = std::move(pendingRefresh_);
+	pendingRefresh_.clear();
+	for (auto const& file : refresh) {
+		RefreshFile(file);
+	}
+
+	return true;
+}
+
+void CLocalListView::AddLoadedEntries(std::vector<CLocalFileData>& entries)
+{
+	CStateFilterManager const& filter = m_state.GetStateFilterManager();
+	std::wstring const& path = m_dir.GetPath();
+
+	std::vector<unsigned int> added;
+	added.reserve(entries.size());
+	for (auto& data : entries) {
+		unsigned int const index = m_fileData.size();
+		bool const filtered = filter.FilenameFiltered(data.name, path, data.dir, data.size, true, data.attributes, data.time);
+		if (!filtered) {
+			if (m_pFilelistStatusBar) {
 				if (data.dir) {
-					++totalDirCount;
+					m_pFilelistStatusBar->AddDirectory();
 				}
 				else {
-					if (data.size != -1) {
-						totalSize += data.size;
-					}
-					else {
-						++unknown_sizes;
-					}
-					++totalFileCount;
+					m_pFilelistStatusBar->AddFile(data.size);
 				}
-				m_indexMapping.push_back(num);
 			}
-			else {
-				++hidden;
-			}
-			++num;
+			added.push_back(index);
 		}
+		m_fileData.push_back(std::move(data));
+	}
 
-		if (m_pFilelistStatusBar) {
-			m_pFilelistStatusBar->SetDirectoryContents(totalFileCount, totalDirCount, totalSize, unknown_sizes, hidden);
-		}
+	std::vector<int> added_indexes;
+	MergeAddedItems(m_indexMapping, m_hasParent ? 1 : 0, added, SortPredicate(GetSortComparisonObject()), GetSelectedItemCount() ? &added_indexes : nullptr);
+
+	SetItemCount(m_indexMapping.size());
+	UpdateSelections_ItemsAdded(added_indexes);
+
+	if (m_pFilelistStatusBar) {
+		m_pFilelistStatusBar->SetHidden(m_fileData.size() - m_indexMapping.size());
 	}
+}
 
+void CLocalListView::FinishDisplayDir(std::vector<std::wstring> const& selectedNames, std::wstring focused, int focusedItem, bool ensureVisible, bool sorted)
+{
 	if (m_dropTarget != -1) {
 		CLocalFileData* data = GetData(m_dropTarget);
 		if (!data || !data->dir) {
@@ -468,11 +682,13 @@ regular_dir:
 	}
 
 	const int count = m_indexMapping.size();
-	if (oldItemCount != count) {
+	if (GetItemCount() != count) {
 		SetItemCount(count);
 	}
 
-	SortList(-1, -1, false);
+	if (!sorted) {
+		SortList(-1, -1, false);
+	}
 
 	if (IsComparing()) {
 		m_originalIndexMapping.clear();
@@ -482,8 +698,6 @@ regular_dir:
 	ReselectItems(selectedNames, std::move(focused), focusedItem, ensureVisible);
 
 	RefreshListOnly();
-
-	return true;
 }
 
 // See comment to OnGetItemText
@@ -1516,6 +1730,12 @@ void CLocalListView::OnBeginDrag(wxListEvent&)
 
 void CLocalListView::RefreshFile(std::wstring const& file)
 {
+	if (loader_) {
+		// The entry might still be on its way from the loader
+		pendingRefresh_.push_back(file);
+		return;
+	}
+
 	CLocalFileData data;
 
 	bool wasLink;
@@ -1707,8 +1927,6 @@ void CLocalListView::StartComparison()
 		m_indexMapping.clear();
 	}
 
-	m_comparisonIndex = -1;
-
 	if (m_fileData.empty() || m_fileData.back().comparison_flags != fill) {
 		CLocalFileData data;
 		data.dir = false;
@@ -1720,25 +1938,20 @@ void CLocalListView::StartComparison()
 	}
 }
 
-bool CLocalListView::get_next_file(std::wstring_view & name, std::wstring &, bool& dir, int64_t& size, fz::datetime& date)
+void CLocalListView::get_comparison_entries(NameSortMode mode, std::vector<comparison_entry> & entries)
 {
-	if (++m_comparisonIndex >= (int)m_originalIndexMapping.size()) {
-		return false;
-	}
-
-	const unsigned int index = m_originalIndexMapping[m_comparisonIndex];
-	if (index >= m_fileData.size()) {
-		return false;
+	entries.resize(m_originalIndexMapping.size());
+	for (size_t i = 0; i < entries.size(); ++i) {
+		unsigned int const index = m_originalIndexMapping[i];
+		CLocalFileData const& data = m_fileData[index];
+
+		auto & entry = entries[i];
+		entry.key = ComparisonKey(index, data.name, mode);
+		entry.dir = data.dir;
+		entry.parent = data.name == L"..";
+		entry.size = data.size;
+		entry.date = data.time;
 	}
-
-	CLocalFileData const& data = m_fileData[index];
-
-	name = data.name;
-	dir = data.dir;
-	size = data.size;
-	date = data.time;
-
-	return true;
 }
 
 void CLocalListView::FinishComparison()
@@ -1759,7 +1972,8 @@ void CLocalListView::FinishComparison()
 
 bool CLocalListView::CanStartComparison()
 {
-	return true;
+	// Compared once the directory has been read
+	return !loader_;
 }
 
 wxString CLocalListView::GetItemText(int item, unsigned int column)
@@ -1781,7 +1995,7 @@ wxString CLocalListView::GetItemText(int item, unsigned int column)
 			return wxString();
 		}
 		else {
-			return CSizeFormat::Format(data->size);
+			return FormatSize(m_indexMapping[item], data->size);
 		}
 	}
 	else if (column == 2) {
@@ -1800,7 +2014,7 @@ wxString CLocalListView::GetItemText(int item, unsigned int column)
 		return data->fileType;
 	}
 	else if (column == 3) {
-		return CTimeFormat::Format(data->time);
+		return FormatTime(m_indexMapping[item], data->time);
 	}
 	return wxString();
 }
@@ -6,6 +6,7 @@
 
 class CInfoText;
 class CQueueView;
+class CLocalDirLoader;
 class CLocalListViewDropTarget;
 #ifdef __WXMSW__
 class CVolumeDescriptionEnumeratorThread;
@@ -29,6 +30,7 @@ public:
 
 class CLocalListView final : public CFileListCtrl<CLocalFileData>, CStateEventHandler
 {
+	friend class CLocalDirLoader;
 	friend class CLocalListViewDropTarget;
 	friend class CLocalListViewSortType;
 
@@ -41,6 +43,25 @@ protected:
 	bool DisplayDir(CLocalPath const& dirname);
 	void ApplyCurrentFilter();
 
+	// Regular directories are read on the thread pool, the entries get
+	// merged into the list as they arrive.
+	bool OnDirLoaded();
+	void AddLoadedEntries(std::vector<CLocalFileData>& entries);
+	void FinishDisplayDir(std::vector<std::wstring> const& selectedNames, std::wstring focused, int focusedItem, bool ensureVisible, bool sorted);
+
+	std::unique_ptr<CLocalDirLoader> loader_;
+
+	// Restored once the directory has been read
+	struct pending_selection final
+	{
+		std::vector<std::wstring> names;
+		std::wstring focused;
+		int focusedItem{-1};
+		bool ensureVisible{};
+	};
+	pending_selection pendingSelection_;
+	std::vector<std::wstring> pendingRefresh_;
+
 	// Declared const due to design error in wxWidgets.
 	// Won't be fixed since a fix would break backwards compatibility
 	// Both functions use a const_cast<CLocalListView *>(this) and modify
@@ -64,7 +85,7 @@ protected:
 public:
 	virtual bool CanStartComparison();
 	virtual void StartComparison();
-	virtual bool get_next_file(std::wstring_view & name, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) override;
+	virtual void get_comparison_entries(NameSortMode mode, std::vector<comparison_entry> & entries) override;
 	virtual void FinishComparison();
 
 	virtual bool ItemIsDir(int index) const;
@@ -551,6 +551,9 @@ CMainFrame::~CMainFrame()
 
 	CContextManager::Get()->DestroyAllStates();
 	async_request_queue_.reset();
+
+	// All local list views are gone, wait for the loaders they left behind
+	stoppedTasks_.clear();
 #if FZ_MANUALUPDATECHECK
 	delete m_pUpdater;
 #endif
@@ -933,6 +936,13 @@ void CMainFrame::OnMenuHandler(wxCommandEvent &event)
 		CManualTransfer dlg(options_, m_pQueueView);
 		dlg.Run(this, pState);
 	}
+	else if (id == XRCID("ID_MENU_TRANSFER_SYNCHRONIZE")) {
+		CState* pState = CContextManager::Get()->GetCurrentContext();
+		if (!pState || !m_pQueueView || !pState->GetSyncOperation()->Start(this, m_pQueueView)) {
+			wxBell();
+			return;
+		}
+	}
 	else if (id == XRCID("ID_BOOKMARK_ADD") || id == XRCID("ID_BOOKMARK_MANAGE")) {
 		CState* pState = CContextManager::Get()->GetCurrentContext();
 		if (!pState) {
@@ -1039,6 +1049,13 @@ void CMainFrame::OnMenuHandler(wxCommandEvent &event)
 	}
 }
 
+void CMainFrame::AddStoppedTask(fz::async_task && task)
+{
+	if (task) {
+		stoppedTasks_.emplace_back(std::move(task));
+	}
+}
+
 void CMainFrame::OnEngineEvent(CFileZillaEngine* engine)
 {
 	const std::vector<CState*> *pStates = CContextManager::Get()->GetAllStates();
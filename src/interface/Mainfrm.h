@@ -14,7 +14,10 @@
 
 #include "../commonui/updater.h"
 
+#include <libfilezilla/thread_pool.hpp>
+
 #include <list>
+#include <vector>
 
 class CAsyncRequestQueue;
 class CContextControl;
@@ -43,6 +46,7 @@ public:
 	virtual ~CMainFrame();
 
 	CStatusView* GetStatusView() { return m_pStatusView; }
+	CAsyncRequestQueue* GetAsyncRequestQueue() { return async_request_queue_.get(); }
 	CQueueView* GetQueue() { return m_pQueueView; }
 	CQuickconnectBar* GetQuickconnectBar() { return m_pQuickconnectBar; }
 	COptions& GetOptions() { return options_; }
@@ -69,6 +73,11 @@ public:
 	CFileZillaEngineContext& GetEngineContext() { return m_engineContext; }
 	void OnEngineEvent(CFileZillaEngine* engine);
 
+	// Takes tasks that have been told to stop but might not have returned
+	// yet, e.g. as they are blocked on a slow network drive. They get joined
+	// on shutdown, before the thread pool goes away.
+	void AddStoppedTask(fz::async_task && task);
+
 private:
 	void UpdateLayout();
 	void FixTabOrder();
@@ -84,6 +93,7 @@ private:
 	COptions & options_;
 
 	CFileZillaEngineContext m_engineContext;
+	std::vector<fz::async_task> stoppedTasks_;
 
 	CStatusBar* m_pStatusBar{};
 	CMenuBar* m_pMenuBar{};
@@ -115,7 +115,9 @@ static unsigned int register_interface_options()
 		{ "Drag and Drop disabled", false, option_flags::normal },
 		{ "Disable update footer", false, option_flags::normal },
 		{ "Tab data", L"", option_flags::normal | option_flags::sensitive_data, option_type::xml },
-		{ "Highest shown overlay id", 0, option_flags::normal }
+		{ "Highest shown overlay id", 0, option_flags::normal },
+		{ "Small file slots", 0, option_flags::numeric_clamp, 0, 9 },
+		{ "Recursive listing connections", 0, option_flags::numeric_clamp, 0, 9 }
 	});
 	return value;
 }
@@ -86,6 +86,8 @@ enum interfaceOptions : unsigned int
 	OPTION_DISABLE_UPDATE_FOOTER,
 	OPTION_TAB_DATA,
 	OPTION_SHOWN_OVERLAY,
+	OPTION_SMALLFILE_SLOTS,
+	OPTION_RECURSIVE_LIST_CONNECTIONS,
 
 	// Has to be last element
 	OPTIONS_NUM
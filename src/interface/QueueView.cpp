@@ -21,6 +21,7 @@
 #include "remote_recursive_operation.h"
 #include "dragdropmanager.h"
 #include "drop_target_ex.h"
+#include "xml_stream.h"
 
 #include "../commonui/cert_store.h"
 #include "../commonui/ipcmutex.h"
@@ -47,6 +48,46 @@
 
 using namespace std::literals;
 
+namespace {
+// Servers keep at most this many files in memory, further files are deferred to the queue storage
+unsigned int const materialize_window = 20000;
+
+// Deferred files are materialized in pages once fewer than refill_threshold files are left
+size_t const materialize_page = 10000;
+unsigned int const refill_threshold = 2500;
+
+// Imported items are committed to the view in batches
+size_t const import_batch = 5000;
+
+// Small files are sent to the engine in batches, saving the per-file overhead
+// of a separate command
+int64_t const batch_max_file_size = 256 * 1024;
+size_t const batch_max_files = 50;
+
+bool BatchSupported(ServerProtocol protocol)
+{
+	switch (protocol) {
+	case FTP:
+	case FTPS:
+	case FTPES:
+	case INSECURE_FTP:
+	case SFTP:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Plain files of known small size with nothing special to take care of
+bool CanBatch(CFileItem const& item)
+{
+	return item.GetType() == QueueItemType::File && item.m_edit == CEditHandler::none &&
+		item.GetSize() >= 0 && item.GetSize() <= batch_max_file_size && !item.GetExtraData() &&
+		item.m_onetime_action == CFileExistsNotification::unknown && !item.m_errorCount &&
+		!item.made_progress() && !item.pending_remove();
+}
+}
+
 class CQueueViewDropTarget final : public CFileDropTarget<wxListCtrlEx>
 {
 public:
@@ -214,7 +255,6 @@ END_EVENT_TABLE()
 
 CQueueView::CQueueView(CQueue* parent, int index, CMainFrame* pMainFrame, CAsyncRequestQueue *pAsyncRequestQueue, cert_store & certStore)
 	: CQueueViewBase(parent, pMainFrame->GetOptions(), index, _("Queued files"))
-	, COptionChangeEventHandler(this)
 	, m_pMainFrame(pMainFrame)
 	, m_pAsyncRequestQueue(pAsyncRequestQueue)
 	, cert_store_(certStore)
@@ -241,6 +281,7 @@ CQueueView::CQueueView(CQueue* parent, int index, CMainFrame* pMainFrame, CAsync
 	options_.watch(OPTION_NUMTRANSFERS, this);
 	options_.watch(OPTION_CONCURRENTDOWNLOADLIMIT, this);
 	options_.watch(OPTION_CONCURRENTUPLOADLIMIT, this);
+	options_.watch(OPTION_SMALLFILE_SLOTS, this);
 
 	CContextManager::Get()->RegisterHandler(this, STATECHANGE_REWRITE_CREDENTIALS, false);
 	CContextManager::Get()->RegisterHandler(this, STATECHANGE_QUITNOW, false);
@@ -253,6 +294,7 @@ CQueueView::CQueueView(CQueue* parent, int index, CMainFrame* pMainFrame, CAsync
 #endif
 
 	m_resize_timer.SetOwner(this);
+	m_queue_commit_timer.SetOwner(this);
 }
 
 CQueueView::~CQueueView()
@@ -261,6 +303,7 @@ CQueueView::~CQueueView()
 	DeleteEngines();
 
 	m_resize_timer.Stop();
+	m_queue_commit_timer.Stop();
 }
 
 bool CQueueView::QueueFile(bool const queueOnly, bool const download,
@@ -495,13 +538,27 @@ void CQueueView::ProcessNotification(t_EngineData *pEngineData, std::unique_ptr<
 				if (status && status.madeProgress && !status.list &&
 					pEngineData->pItem->GetType() == QueueItemType::File)
 				{
-					CFileItem* pItem = (CFileItem*)pEngineData->pItem;
-					pItem->set_made_progress(true);
+					pEngineData->GetCurrentItem()->set_made_progress(true);
 				}
 				pEngineData->pStatusLineCtrl->SetTransferStatus(status);
 			}
 		}
 		break;
+	case nId_batch_transfer:
+		if (pEngineData->active) {
+			auto & notification = static_cast<CBatchTransferNotification&>(*pNotification);
+			if (notification.finished_) {
+				pEngineData->batchReplies = std::move(notification.replies_);
+			}
+			else if (notification.replies_.size() != pEngineData->batchIndex) {
+				// The previous file is done, its status belongs to it and not to the next one
+				if (pEngineData->pStatusLineCtrl) {
+					pEngineData->pStatusLineCtrl->ClearTransferStatus();
+				}
+				pEngineData->batchIndex = notification.replies_.size();
+			}
+		}
+		break;
 	case nId_local_dir_created:
 		{
 			auto const& localDirCreatedNotification = static_cast<CLocalDirCreatedNotification const&>(*pNotification);
@@ -532,6 +589,7 @@ void CQueueView::ProcessNotification(t_EngineData *pEngineData, std::unique_ptr<
 			PersistentStateNotification& notification = static_cast<PersistentStateNotification&>(*pNotification);
 			CFileItem & fileItem = *pEngineData->pItem;
 			fileItem.set_persistent_state(std::move(notification.persistent_state_));
+			StoreItemChange(fileItem);
 		}
 		break;
 	}
@@ -560,6 +618,9 @@ bool CQueueView::CanStartTransfer(CServerItem const & server_item, t_EngineData
 
 		if (browsingSite.server == site.server) {
 			++active_count;
+			if (pState->GetRemoteRecursiveOperation()) {
+				active_count += pState->GetRemoteRecursiveOperation()->GetListingHelperCount();
+			}
 			browsingStateOnSameServer = pState;
 			break;
 		}
@@ -643,16 +704,44 @@ bool CQueueView::TryStartNextTransfer()
 		t_EngineData* pEngineData;
 	} bestMatch;
 
+	bool const immediateOnly = m_activeMode == 1;
+
+	// Keep some transfers busy with small files and the others with large files,
+	// so that neither latency nor bandwidth is left unused.
+	TransferSize preferredSize = TransferSize::any;
+	int const smallSlots = std::min(options_.get_int(OPTION_SMALLFILE_SLOTS), options_.get_int(OPTION_NUMTRANSFERS) - 1);
+	if (smallSlots > 0) {
+		preferredSize = (m_activeCountSmall < smallSlots) ? TransferSize::small : TransferSize::large;
+	}
+
 	// Find inactive file. Check all servers for
 	// the file with the highest priority
 	for (auto const& currentServerItem : m_serverList) {
 		t_EngineData* pEngineData = 0;
 
-		if (!CanStartTransfer(*currentServerItem, pEngineData)) {
+		bool canStart = false;
+		if (currentServerItem->GetDeferredCount() && currentServerItem->GetChildrenCount(false) < refill_threshold) {
+			if (!CanStartTransfer(*currentServerItem, pEngineData)) {
+				continue;
+			}
+			canStart = true;
+			if (!MaterializeDeferredItems(*currentServerItem, materialize_page)) {
+				DropDeferredItems(*currentServerItem);
+			}
+		}
+
+		// Looking at the idle items is cheap, only check the engines if this server
+		// has a better candidate than what has already been found.
+		int const priority = currentServerItem->GetIdlePriority(immediateOnly, wantedDirection);
+		if (priority < 0 || (bestMatch.fileItem && priority <= static_cast<int>(bestMatch.fileItem->GetPriority()))) {
+			continue;
+		}
+
+		if (!canStart && !CanStartTransfer(*currentServerItem, pEngineData)) {
 			continue;
 		}
 
-		CFileItem* newFileItem = currentServerItem->GetIdleChild(m_activeMode == 1, wantedDirection);
+		CFileItem* newFileItem = currentServerItem->GetIdleChild(immediateOnly, wantedDirection, preferredSize);
 
 		while (newFileItem && newFileItem->Download() && newFileItem->GetType() == QueueItemType::Folder) {
 			CLocalPath localPath(newFileItem->GetLocalPath());
@@ -670,7 +759,7 @@ bool CQueueView::TryStartNextTransfer()
 
 				return true;
 			}
-			newFileItem = currentServerItem->GetIdleChild(m_activeMode == 1, wantedDirection);
+			newFileItem = currentServerItem->GetIdleChild(immediateOnly, wantedDirection, preferredSize);
 		}
 
 		if (!newFileItem) {
@@ -705,6 +794,20 @@ bool CQueueView::TryStartNextTransfer()
 	// Now we have both inactive engine and file.
 	// Assign the file to the engine.
 
+	CFileItem & fileItem = *bestMatch.fileItem;
+	if (CanBatch(fileItem) && BatchSupported(bestMatch.serverItem->GetSite().server.GetProtocol())) {
+		pEngineData->batch = bestMatch.serverItem->GetIdleSiblings(fileItem, batch_max_files - 1, [&fileItem](CFileItem const& item) {
+			return CanBatch(item) && item.GetRemotePath() == fileItem.GetRemotePath() &&
+				(item.flags() - queue_flags::mask) == (fileItem.flags() - queue_flags::mask) &&
+				item.m_defaultFileExistsAction == fileItem.m_defaultFileExistsAction;
+		});
+		for (auto * item : pEngineData->batch) {
+			item->SetBatchActive();
+			item->m_pEngineData = pEngineData;
+			item->SetStatusMessage(CFileItem::Status::transferring);
+		}
+	}
+
 	bestMatch.fileItem->SetActive(true);
 
 	pEngineData->pItem = bestMatch.fileItem;
@@ -720,6 +823,10 @@ bool CQueueView::TryStartNextTransfer()
 	else {
 		m_activeCountUp++;
 	}
+	pEngineData->smallFile = bestMatch.fileItem->IsSmall();
+	if (pEngineData->smallFile) {
+		m_activeCountSmall++;
+	}
 
 	Site const oldSite = pEngineData->lastSite;
 	pEngineData->lastSite = bestMatch.serverItem->GetSite();
@@ -877,6 +984,15 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 			ResetEngine(*pEngineData, ResetReason::reset);
 			return;
 		}
+		if (!pEngineData->batch.empty()) {
+			// The engine's own item is the first of the batch, the others are
+			// done with and get retried on their own if they failed.
+			if (!pEngineData->batchReplies.empty()) {
+				int const itemReply = pEngineData->batchReplies.front();
+				replyCode = (itemReply == FZ_REPLY_OK) ? FZ_REPLY_OK : (itemReply | (replyCode & FZ_REPLY_DISCONNECTED));
+			}
+			FinishBatch(*pEngineData);
+		}
 		if (replyCode == FZ_REPLY_OK) {
 			ResetEngine(*pEngineData, ResetReason::success);
 			return;
@@ -970,6 +1086,99 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 	SendNextCommand(*pEngineData);
 }
 
+void CQueueView::FinishBatch(t_EngineData& data)
+{
+	auto const batch = std::move(data.batch);
+	auto const replies = std::move(data.batchReplies);
+	data.batch.clear();
+	data.batchReplies.clear();
+	data.batchIndex = 0;
+
+	for (size_t i = 0; i < batch.size(); ++i) {
+		CFileItem* const pFileItem = batch[i];
+
+		// The first reply belongs to the engine's own item
+		int const reply = (i + 1 < replies.size()) ? replies[i + 1] : -1;
+
+		ResetReason reason = ResetReason::reset;
+		if (pFileItem->pending_remove()) {
+			reason = ResetReason::remove;
+		}
+		else if (reply == FZ_REPLY_OK) {
+			reason = ResetReason::success;
+			if (pFileItem->Download()) {
+				for (auto *pState : *CContextManager::Get()->GetAllStates()) {
+					pState->RefreshLocalFile(pFileItem->GetLocalPath().GetPath() + pFileItem->GetLocalFile());
+				}
+			}
+		}
+
+		wxASSERT(pFileItem->IsActive());
+		pFileItem->SetActive(false);
+		pFileItem->m_pEngineData = nullptr;
+
+		if (reason == ResetReason::reset && reply != -1 && (reply & FZ_REPLY_CANCELED) != FZ_REPLY_CANCELED) {
+			// Failed files are retried on their own, with the usual error handling
+			++pFileItem->m_errorCount;
+			StoreItemChange(*pFileItem);
+		}
+		FinishItem(pFileItem, reason);
+	}
+}
+
+void CQueueView::FinishItem(CFileItem* item, ResetReason reason)
+{
+	if (reason == ResetReason::reset) {
+		if (!item->queued()) {
+			static_cast<CServerItem*>(item->GetTopLevelItem())->QueueImmediateFile(item);
+		}
+		if (item->GetType() == QueueItemType::File || item->GetType() == QueueItemType::Folder) {
+			item->SetStatusMessage(CFileItem::Status::none);
+		}
+	}
+	else if (reason == ResetReason::failure) {
+		if (item->GetType() == QueueItemType::File || item->GetType() == QueueItemType::Folder) {
+			Site const site = ((CServerItem*)item->GetTopLevelItem())->GetSite();
+
+			RemoveItem(item, false);
+
+			CQueueViewFailed* pQueueViewFailed = m_pQueue->GetQueueView_Failed();
+			CServerItem* pNewServerItem = pQueueViewFailed->CreateServerItem(site);
+			item->SetParent(pNewServerItem);
+			item->UpdateTime();
+			pQueueViewFailed->InsertItem(pNewServerItem, item);
+			pQueueViewFailed->CommitChanges();
+		}
+	}
+	else if (reason == ResetReason::success) {
+		if (item->GetType() == QueueItemType::File || item->GetType() == QueueItemType::Folder) {
+			CQueueViewSuccessful* pQueueViewSuccessful = m_pQueue->GetQueueView_Successful();
+			if (pQueueViewSuccessful->AutoClear()) {
+				RemoveItem(item, true);
+			}
+			else {
+				Site const site = ((CServerItem*)item->GetTopLevelItem())->GetSite();
+
+				RemoveItem(item, false);
+
+				CServerItem* pNewServerItem = pQueueViewSuccessful->CreateServerItem(site);
+				item->clear_persistent_state();
+				item->UpdateTime();
+				item->SetParent(pNewServerItem);
+				item->SetStatusMessage(CFileItem::Status::none);
+				pQueueViewSuccessful->InsertItem(pNewServerItem, item);
+				pQueueViewSuccessful->CommitChanges();
+			}
+		}
+		else {
+			RemoveItem(item, true);
+		}
+	}
+	else if (reason != ResetReason::retry) {
+		RemoveItem(item, true);
+	}
+}
+
 void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 {
 	if (!data.active) {
@@ -978,6 +1187,10 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 
 	m_waitStatusLineUpdate = true;
 
+	if (!data.batch.empty()) {
+		FinishBatch(data);
+	}
+
 	if (data.pItem) {
 		CServerItem* pServerItem = static_cast<CServerItem*>(data.pItem->GetTopLevelItem());
 		if (pServerItem) {
@@ -1048,56 +1261,15 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 				m_activeCountUp--;
 			}
 		}
-
-		if (reason == ResetReason::reset) {
-			if (!data.pItem->queued()) {
-				static_cast<CServerItem*>(data.pItem->GetTopLevelItem())->QueueImmediateFile(data.pItem);
-			}
-			if (data.pItem->GetType() == QueueItemType::File || data.pItem->GetType() == QueueItemType::Folder) {
-				static_cast<CFileItem*>(data.pItem)->SetStatusMessage(CFileItem::Status::none);
-			}
-		}
-		else if (reason == ResetReason::failure) {
-			if (data.pItem->GetType() == QueueItemType::File || data.pItem->GetType() == QueueItemType::Folder) {
-				Site const site = ((CServerItem*)data.pItem->GetTopLevelItem())->GetSite();
-
-				RemoveItem(data.pItem, false);
-
-				CQueueViewFailed* pQueueViewFailed = m_pQueue->GetQueueView_Failed();
-				CServerItem* pNewServerItem = pQueueViewFailed->CreateServerItem(site);
-				data.pItem->SetParent(pNewServerItem);
-				data.pItem->UpdateTime();
-				pQueueViewFailed->InsertItem(pNewServerItem, data.pItem);
-				pQueueViewFailed->CommitChanges();
+		if (data.smallFile) {
+			wxASSERT(m_activeCountSmall > 0);
+			if (m_activeCountSmall > 0) {
+				m_activeCountSmall--;
 			}
+			data.smallFile = false;
 		}
-		else if (reason == ResetReason::success) {
-			if (data.pItem->GetType() == QueueItemType::File || data.pItem->GetType() == QueueItemType::Folder) {
-				CQueueViewSuccessful* pQueueViewSuccessful = m_pQueue->GetQueueView_Successful();
-				if (pQueueViewSuccessful->AutoClear()) {
-					RemoveItem(data.pItem, true);
-				}
-				else {
-					Site const site = ((CServerItem*)data.pItem->GetTopLevelItem())->GetSite();
-
-					RemoveItem(data.pItem, false);
 
-					CServerItem* pNewServerItem = pQueueViewSuccessful->CreateServerItem(site);
-					static_cast<CFileItem&>(*data.pItem).clear_persistent_state();
-					data.pItem->UpdateTime();
-					data.pItem->SetParent(pNewServerItem);
-					data.pItem->SetStatusMessage(CFileItem::Status::none);
-					pQueueViewSuccessful->InsertItem(pNewServerItem, data.pItem);
-					pQueueViewSuccessful->CommitChanges();
-				}
-			}
-			else {
-				RemoveItem(data.pItem, true);
-			}
-		}
-		else if (reason != ResetReason::retry) {
-			RemoveItem(data.pItem, true);
-		}
+		FinishItem(data.pItem, reason);
 		data.pItem = 0;
 	}
 	wxASSERT(m_activeCount > 0);
@@ -1152,8 +1324,33 @@ bool CQueueView::RemoveItem(CQueueItem* item, bool destroy, bool updateItemCount
 		}
 	}
 
+	// Don't let the server item vanish while it still has deferred files
+	if (item->GetType() != QueueItemType::Server) {
+		auto & serverItem = static_cast<CServerItem&>(*item->GetTopLevelItem());
+		if (serverItem.GetDeferredCount() && serverItem.GetChildrenCount(false) <= 1) {
+			if (!MaterializeDeferredItems(serverItem, materialize_page)) {
+				DropDeferredItems(serverItem);
+			}
+		}
+	}
+
+	// Items that aren't destroyed move on to the other queue views, they are no longer stored
+	int64_t const storageId = item->GetStorageId();
+	int64_t const serverStorageId = item->GetTopLevelItem()->GetStorageId();
+	item->SetStorageId(0);
+
 	bool didRemoveParent = CQueueViewBase::RemoveItem(item, destroy, updateItemCount, updateSelections, forward);
 
+	if (m_queue_storage.JournalEnabled()) {
+		if (didRemoveParent) {
+			m_queue_storage.RemoveServer(serverStorageId);
+		}
+		else {
+			m_queue_storage.RemoveFile(storageId);
+		}
+		ScheduleQueueCommit();
+	}
+
 	UpdateStatusLinePositions();
 
 	return didRemoveParent;
@@ -1260,24 +1457,37 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 			fileItem->SetStatusMessage(CFileItem::Status::transferring);
 			RefreshItem(engineData.pItem);
 
-			std::wstring extraFlags;
-			std::string persistentState;
-			auto extraData = fileItem->GetExtraData();
-			if (extraData) {
-				extraFlags = extraData->extraFlags_;
-				persistentState = extraData->persistentState_;
-			}
+			auto makeCommand = [this](CFileItem const& item) {
+				std::wstring extraFlags;
+				std::string persistentState;
+				auto extraData = item.GetExtraData();
+				if (extraData) {
+					extraFlags = extraData->extraFlags_;
+					persistentState = extraData->persistentState_;
+				}
+
+				if (!item.Download()) {
+					return CFileTransferCommand(fz::file_reader_factory(item.GetLocalPath().GetPath() + item.GetLocalFile(), m_pMainFrame->GetEngineContext().GetThreadPool()),
+						item.GetRemotePath(), item.GetRemoteFile(), item.flags(), extraFlags, persistentState);
+				}
+				else {
+					return CFileTransferCommand(fz::file_writer_factory(item.GetLocalPath().GetPath() + item.GetLocalFile(), m_pMainFrame->GetEngineContext().GetThreadPool()),
+						item.GetRemotePath(), item.GetRemoteFile(), item.flags(), extraFlags, persistentState);
+				}
+			};
 
 			int res;
-			if (!fileItem->Download()) {
-				auto cmd = CFileTransferCommand(fz::file_reader_factory(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile(), m_pMainFrame->GetEngineContext().GetThreadPool()),
-					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags(), extraFlags, persistentState);
-				res = engineData.pEngine->Execute(cmd);
+			if (engineData.batch.empty()) {
+				res = engineData.pEngine->Execute(makeCommand(*fileItem));
 			}
 			else {
-				auto cmd = CFileTransferCommand(fz::file_writer_factory(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile(), m_pMainFrame->GetEngineContext().GetThreadPool()),
-					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags(), extraFlags, persistentState);
-				res = engineData.pEngine->Execute(cmd);
+				std::vector<CFileTransferCommand> transfers;
+				transfers.reserve(engineData.batch.size() + 1);
+				transfers.push_back(makeCommand(*fileItem));
+				for (auto const* item : engineData.batch) {
+					transfers.push_back(makeCommand(*item));
+				}
+				res = engineData.pEngine->Execute(CBatchTransferCommand(std::move(transfers)));
 			}
 
 			wxASSERT((res & FZ_REPLY_BUSY) != FZ_REPLY_BUSY);
@@ -1285,6 +1495,11 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 				return;
 			}
 
+			if (!engineData.batch.empty()) {
+				// Batch did not run, its other files go back to the queue
+				FinishBatch(engineData);
+			}
+
 			if (res == FZ_REPLY_OK) {
 				ResetEngine(engineData, ResetReason::success);
 				return;
@@ -1329,12 +1544,22 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 	}
 }
 
+int CQueueView::GetActiveTransferCount(Site const& site)
+{
+	CServerItem const* pServerItem = GetServerItem(site);
+	return pServerItem ? pServerItem->m_activeCount : 0;
+}
+
 bool CQueueView::SetActive(bool active)
 {
 	if (!active) {
 		m_activeMode = 0;
 		for (auto const& serverItem : m_serverList) {
 			serverItem->QueueImmediateFiles();
+			if (serverItem->GetDeferredCount()) {
+				m_queue_storage.QueueFiles(serverItem->GetStorageId(), serverItem->GetStorageCursor());
+				ScheduleQueueCommit();
+			}
 		}
 
 		const std::vector<CState*> *pStates = CContextManager::Get()->GetAllStates();
@@ -1487,6 +1712,7 @@ bool CQueueView::IncreaseErrorCount(t_EngineData& engineData)
 {
 	++engineData.pItem->m_errorCount;
 	if (engineData.pItem->m_errorCount <= options_.get_int(OPTION_RECONNECTCOUNT)) {
+		StoreItemChange(*engineData.pItem);
 		return true;
 	}
 
@@ -1569,12 +1795,62 @@ void CQueueView::SaveQueue(bool silent)
 	// just as extra precaution. Better 'save' than sorry.
 	CInterProcessMutex mutex(MUTEX_QUEUE);
 
-	if (!m_queue_storage.SaveQueue(m_serverList) && !silent) {
+	m_queue_commit_timer.Stop();
+
+	bool ret;
+	if (m_queue_storage.JournalEnabled()) {
+		// All changes have been journaled already, only the last batch needs committing.
+		// Should the journal have failed along the way, write the entire queue instead.
+		ret = m_queue_storage.Commit() && m_queue_storage.JournalIntact();
+		m_queue_storage.EnableJournal(false);
+		if (!ret) {
+			// Deferred items only exist in storage, read them back before
+			// replacing it. Should that fail, storage is left as it is.
+			bool complete = true;
+			for (auto * serverItem : m_serverList) {
+				if (!MaterializeDeferredItems(*serverItem, 0)) {
+					complete = false;
+				}
+			}
+			if (complete) {
+				ret = m_queue_storage.SaveQueue(m_serverList, true);
+			}
+		}
+	}
+	else {
+		ret = m_queue_storage.SaveQueue(m_serverList);
+	}
+
+	if (!ret && !silent) {
 		wxString msg = wxString::Format(_("An error occurred saving the transfer queue to \"%s\".\nSome queue items might not have been saved."), m_queue_storage.GetDatabaseFilename());
 		wxMessageBoxEx(msg, _("Error saving queue"), wxICON_ERROR);
 	}
 }
 
+void CQueueView::StoreItemChange(CQueueItem & item)
+{
+	if (!m_queue_storage.JournalEnabled()) {
+		return;
+	}
+
+	if (item.GetType() == QueueItemType::Server) {
+		for (unsigned int i = 0; i < item.GetChildrenCount(false); ++i) {
+			StoreItemChange(*item.GetChild(i, false));
+		}
+	}
+	else if (item.GetType() == QueueItemType::File || item.GetType() == QueueItemType::Folder) {
+		m_queue_storage.UpdateFile(static_cast<CFileItem&>(item));
+		ScheduleQueueCommit();
+	}
+}
+
+void CQueueView::ScheduleQueueCommit()
+{
+	if (m_queue_storage.HasPendingChanges() && !m_queue_commit_timer.IsRunning()) {
+		m_queue_commit_timer.Start(2000, true);
+	}
+}
+
 void CQueueView::LoadQueue()
 {
 	wxGetApp().AddStartupProfileRecord("CQueueView::LoadQueue"sv);
@@ -1582,12 +1858,32 @@ void CQueueView::LoadQueue()
 	// to the same file or one is reading while the other one writes.
 	CInterProcessMutex mutex(MUTEX_QUEUE);
 
+	bool const kiosk = options_.get_int(OPTION_DEFAULT_KIOSKMODE) == 2;
+
+	// The first instance takes ownership of the stored queue and from then
+	// on journals all changes to it. Further instances start out empty and
+	// add their queue to the storage when closed.
+	int owner = -1;
+	if (!kiosk) {
+		m_queue_journal_mutex = std::make_unique<CInterProcessMutex>(MUTEX_QUEUE_JOURNAL, false);
+		owner = m_queue_journal_mutex->TryLock();
+	}
+	m_queue_storage.EnableJournal(owner == 1);
+
 	bool error = false;
 
-	if (!m_queue_storage.BeginTransaction()) {
+	if (!owner) {
+		// Queue is owned by another instance
+	}
+	else if (!m_queue_storage.BeginTransaction()) {
 		error = true;
 	}
 	else {
+		// Stored items are kept, only drop paths no longer in use before they get cached
+		if (m_queue_storage.JournalEnabled() && !m_queue_storage.PrunePaths()) {
+			error = true;
+		}
+
 		Site site;
 		int64_t const first_id = m_queue_storage.GetServer(site, true);
 		auto id = first_id;
@@ -1595,30 +1891,88 @@ void CQueueView::LoadQueue()
 			m_insertionStart = -1;
 			m_insertionCount = 0;
 			CServerItem *pServerItem = CreateServerItem(site);
+			if (!pServerItem->GetStorageId()) {
+				pServerItem->SetStorageId(id);
+			}
 
-			CFileItem* fileItem = 0;
-			int64_t fileId;
-			for (fileId = m_queue_storage.GetFile(&fileItem, id); fileItem; fileId = m_queue_storage.GetFile(&fileItem, 0)) {
-				fileItem->SetParent(pServerItem);
-				fileItem->SetPriority(fileItem->GetPriority());
-				InsertItem(pServerItem, fileItem);
+			// If the same server has been stored more than once, its files
+			// get stored anew under the first one.
+			bool const merged = pServerItem->GetStorageId() != id;
+
+			if (m_queue_storage.JournalEnabled()) {
+				// Only the first page of files is loaded, the rest stays deferred in storage
+				std::vector<CFileItem*> files;
+				int64_t const last = m_queue_storage.GetFiles(files, id, 0, merged ? 0 : materialize_page, false);
+				if (last < 0) {
+					error = true;
+				}
+				for (auto * fileItem : files) {
+					fileItem->SetParent(pServerItem);
+					fileItem->SetPriority(fileItem->GetPriority());
+					if (merged) {
+						fileItem->SetStorageId(0);
+					}
+					InsertItem(pServerItem, fileItem);
+				}
+
+				if (!merged && last > 0) {
+					pServerItem->SetStorageCursor(last);
+
+					int64_t count{};
+					int64_t size{};
+					int64_t unknownSizes{};
+					if (!m_queue_storage.GetFileStats(id, last, count, size, unknownSizes)) {
+						error = true;
+					}
+					else if (count > 0) {
+						AddInsertion(GetItemIndex(pServerItem) + pServerItem->GetChildrenCount(true) + 1, static_cast<unsigned int>(count));
+						m_itemCount += static_cast<int>(count);
+						pServerItem->AddDeferred(count, size, unknownSizes);
+						m_fileCount += static_cast<int>(count);
+						m_fileCountChanged = true;
+						m_totalQueueSize += size;
+						m_filesWithUnknownSize += static_cast<int>(unknownSizes);
+					}
+				}
 			}
-			if (fileId < 0) {
-				error = true;
+			else {
+				CFileItem* fileItem = 0;
+				int64_t fileId;
+				for (fileId = m_queue_storage.GetFile(&fileItem, id); fileItem; fileId = m_queue_storage.GetFile(&fileItem, 0)) {
+					fileItem->SetParent(pServerItem);
+					fileItem->SetPriority(fileItem->GetPriority());
+					InsertItem(pServerItem, fileItem);
+				}
+				if (fileId < 0) {
+					error = true;
+				}
 			}
 
-			if (!pServerItem->GetChild(0)) {
+			if (!pServerItem->GetChild(0) && !pServerItem->GetDeferredCount()) {
 				m_itemCount--;
 				m_serverList.pop_back();
 				delete pServerItem;
+				m_queue_storage.RemoveServer(id);
+			}
+			else if (merged) {
+				m_queue_storage.RemoveServer(id);
 			}
 		}
 		if (id < 0) {
 			error = true;
 		}
 
-		if (error || first_id > 0) {
-			if (options_.get_int(OPTION_DEFAULT_KIOSKMODE) != 2) {
+		if (first_id > 0 && m_queue_storage.JournalEnabled()) {
+			// Loaded items stay stored, no need to rewrite them. Deferred items
+			// only exist in storage, so it must not be cleared even on error.
+			if (!m_queue_storage.EndTransaction()) {
+				error = true;
+			}
+		}
+		else if (error || first_id > 0) {
+			// Without a usable journal, the queue gets written in full on exit
+			m_queue_storage.EnableJournal(false);
+			if (!kiosk) {
 				if (!m_queue_storage.Clear()) {
 					error = true;
 				}
@@ -1633,8 +1987,8 @@ void CQueueView::LoadQueue()
 			}
 		}
 		else {
-			// Queue was already empty. No need to commit
-			if (!m_queue_storage.EndTransaction(true)) {
+			// Queue was already empty. No need to commit unless paths were pruned
+			if (!m_queue_storage.EndTransaction(!m_queue_storage.JournalEnabled())) {
 				error = true;
 			}
 		}
@@ -1650,135 +2004,196 @@ void CQueueView::LoadQueue()
 	}
 }
 
-void CQueueView::ImportQueue(pugi::xml_node element, bool updateSelections)
+bool CQueueView::ImportFile(CServerItem & serverItem, pugi::xml_node file, CLocalPath & previousLocalPath, CServerPath & previousRemotePath)
 {
-	auto xServer = element.child("Server");
-	while (xServer) {
-		Site site;
-		if (GetServer(xServer, site)) {
-			m_insertionStart = -1;
-			m_insertionCount = 0;
-			CServerItem *pServerItem = CreateServerItem(site);
+	std::wstring localFile = GetTextElement(file, "LocalFile");
+	std::wstring remoteFile = GetTextElement(file, "RemoteFile");
+	std::wstring safeRemotePath = GetTextElement(file, "RemotePath");
 
-			CLocalPath previousLocalPath;
-			CServerPath previousRemotePath;
+	transfer_flags flags = queue_flags::queued | static_cast<transfer_flags>(GetTextElementInt(file, "Flags"));
+	bool const old_download = GetTextElementInt(file, "Download") != 0;
+	if (old_download) {
+		flags |= transfer_flags::download;
+	}
+	int64_t size = GetTextElementInt(file, "Size", -1);
+	unsigned char errorCount = static_cast<unsigned char>(GetTextElementInt(file, "ErrorCount"));
+	unsigned int priority = GetTextElementInt(file, "Priority", static_cast<unsigned int>(QueuePriority::normal));
 
-			for (auto file = xServer.child("File"); file; file = file.next_sibling("File")) {
-				std::wstring localFile = GetTextElement(file, "LocalFile");
-				std::wstring remoteFile = GetTextElement(file, "RemoteFile");
-				std::wstring safeRemotePath = GetTextElement(file, "RemotePath");
+	int old_dataType = GetTextElementInt(file, "DataType", -1);
+	if (!old_dataType && serverItem.GetSite().server.HasFeature(ProtocolFeature::DataTypeConcept)) {
+		flags |= ftp_transfer_flags::ascii;
+	}
+	int overwrite_action = GetTextElementInt(file, "OverwriteAction", CFileExistsNotification::unknown);
 
-				transfer_flags flags = queue_flags::queued | static_cast<transfer_flags>(GetTextElementInt(file, "Flags"));
-				bool const old_download = GetTextElementInt(file, "Download") != 0;
-				if (old_download) {
-					flags |= transfer_flags::download;
-				}
-				int64_t size = GetTextElementInt(file, "Size", -1);
-				unsigned char errorCount = static_cast<unsigned char>(GetTextElementInt(file, "ErrorCount"));
-				unsigned int priority = GetTextElementInt(file, "Priority", static_cast<unsigned int>(QueuePriority::normal));
+	std::wstring extraFlags = GetTextElement(file, "ExtraFlags");
 
-				int old_dataType = GetTextElementInt(file, "DataType", -1);
-				if (!old_dataType && site.server.HasFeature(ProtocolFeature::DataTypeConcept)) {
-					flags |= ftp_transfer_flags::ascii;
-				}
-				int overwrite_action = GetTextElementInt(file, "OverwriteAction", CFileExistsNotification::unknown);
+	CServerPath remotePath;
+	if (localFile.empty() || remoteFile.empty() || !remotePath.SetSafePath(safeRemotePath) ||
+		size < -1 || priority >= static_cast<int>(QueuePriority::count))
+	{
+		return false;
+	}
 
-				std::wstring extraFlags = GetTextElement(file, "ExtraFlags");
+	std::wstring localFileName;
+	CLocalPath localPath(localFile, &localFileName);
 
-				CServerPath remotePath;
-				if (!localFile.empty() && !remoteFile.empty() && remotePath.SetSafePath(safeRemotePath) &&
-					size >= -1 && priority < static_cast<int>(QueuePriority::count))
-				{
-					std::wstring localFileName;
-					CLocalPath localPath(localFile, &localFileName);
+	if (localFileName.empty()) {
+		return false;
+	}
 
-					if (localFileName.empty()) {
-						continue;
-					}
+	// CServerPath and CLocalPath are reference counted.
+	// Save some memory here by re-using the old copy
+	if (localPath != previousLocalPath) {
+		previousLocalPath = localPath;
+	}
+	if (previousRemotePath != remotePath) {
+		previousRemotePath = remotePath;
+	}
 
-					// CServerPath and CLocalPath are reference counted.
-					// Save some memory here by re-using the old copy
-					if (localPath != previousLocalPath) {
-						previousLocalPath = localPath;
-					}
-					if (previousRemotePath != remotePath) {
-						previousRemotePath = remotePath;
-					}
+	CFileItem* fileItem = new CFileItem(&serverItem, flags,
+		(flags & transfer_flags::download) ? remoteFile : localFileName,
+		(remoteFile != localFileName) ? ((flags & transfer_flags::download) ? localFileName : remoteFile) : std::wstring(),
+		previousLocalPath, previousRemotePath, size, extraFlags);
+	fileItem->SetPriorityRaw(QueuePriority(priority));
+	fileItem->m_errorCount = errorCount;
+	if (overwrite_action > 0 && overwrite_action < CFileExistsNotification::ACTION_COUNT) {
+		fileItem->m_defaultFileExistsAction = (CFileExistsNotification::OverwriteAction)overwrite_action;
+	}
+	InsertItem(&serverItem, fileItem);
 
-					CFileItem* fileItem = new CFileItem(pServerItem, flags,
-						(flags & transfer_flags::download) ? remoteFile : localFileName,
-						(remoteFile != localFileName) ? ((flags & transfer_flags::download) ? localFileName : remoteFile) : std::wstring(),
-						previousLocalPath, previousRemotePath, size, extraFlags);
-					fileItem->SetPriorityRaw(QueuePriority(priority));
-					fileItem->m_errorCount = errorCount;
-					InsertItem(pServerItem, fileItem);
+	return true;
+}
 
-					if (overwrite_action > 0 && overwrite_action < CFileExistsNotification::ACTION_COUNT) {
-						fileItem->m_defaultFileExistsAction = (CFileExistsNotification::OverwriteAction)overwrite_action;
-					}
-				}
-			}
-			for (auto folder = xServer.child("Folder"); folder; folder = folder.next_sibling("Folder")) {
-				CFolderItem* folderItem;
+bool CQueueView::ImportFolder(CServerItem & serverItem, pugi::xml_node folder)
+{
+	CFolderItem* folderItem;
 
-				transfer_flags flags = queue_flags::queued | static_cast<transfer_flags>(GetTextElementInt(folder, "Flags"));
-				bool const old_download = GetTextElementInt(folder, "Download") != 0;
-				if (old_download) {
-					flags |= transfer_flags::download;
-				}
-				if (flags & transfer_flags::download) {
-					std::wstring localFile = GetTextElement(folder, "LocalFile");
-					CLocalPath localPath(localFile);
-					if (localPath.empty()) {
-						continue;
-					}
-					folderItem = new CFolderItem(pServerItem, true, localPath);
-				}
-				else {
-					std::wstring remoteFile = GetTextElement(folder, "RemoteFile");
-					std::wstring safeRemotePath = GetTextElement(folder, "RemotePath");
-					if (safeRemotePath.empty()) {
-						continue;
-					}
+	transfer_flags flags = queue_flags::queued | static_cast<transfer_flags>(GetTextElementInt(folder, "Flags"));
+	bool const old_download = GetTextElementInt(folder, "Download") != 0;
+	if (old_download) {
+		flags |= transfer_flags::download;
+	}
+	if (flags & transfer_flags::download) {
+		std::wstring localFile = GetTextElement(folder, "LocalFile");
+		CLocalPath localPath(localFile);
+		if (localPath.empty()) {
+			return false;
+		}
+		folderItem = new CFolderItem(&serverItem, true, localPath);
+	}
+	else {
+		std::wstring remoteFile = GetTextElement(folder, "RemoteFile");
+		std::wstring safeRemotePath = GetTextElement(folder, "RemotePath");
+		if (safeRemotePath.empty()) {
+			return false;
+		}
 
-					CServerPath remotePath;
-					if (!remotePath.SetSafePath(safeRemotePath)) {
-						continue;
-					}
-					folderItem = new CFolderItem(pServerItem, true, remotePath, remoteFile);
-				}
+		CServerPath remotePath;
+		if (!remotePath.SetSafePath(safeRemotePath)) {
+			return false;
+		}
+		folderItem = new CFolderItem(&serverItem, true, remotePath, remoteFile);
+	}
 
-				unsigned int priority = GetTextElementInt(folder, "Priority", static_cast<int>(QueuePriority::normal));
-				if (priority >= static_cast<int>(QueuePriority::count)) {
-					delete folderItem;
-					continue;
-				}
-				folderItem->SetPriority(QueuePriority(priority));
+	unsigned int priority = GetTextElementInt(folder, "Priority", static_cast<int>(QueuePriority::normal));
+	if (priority >= static_cast<int>(QueuePriority::count)) {
+		delete folderItem;
+		return false;
+	}
+	folderItem->SetPriority(QueuePriority(priority));
 
-				InsertItem(pServerItem, folderItem);
-			}
+	InsertItem(&serverItem, folderItem);
 
-			if (!pServerItem->GetChild(0)) {
+	return true;
+}
+
+bool CQueueView::ImportQueue(xml_stream_reader & reader)
+{
+	wxProgressDialog progress(_("Importing queue"), _("Adding files to the queue..."), 1000, m_pMainFrame,
+		wxPD_CAN_ABORT | wxPD_AUTO_HIDE | wxPD_APP_MODAL | wxPD_ELAPSED_TIME);
+
+	// The details of a server come before its files. They are collected
+	// until the first file shows up.
+	pugi::xml_document serverDocument;
+	pugi::xml_node serverNode = serverDocument.append_child("Server");
+	CServerItem* pServerItem{};
+	bool invalidServer{};
+
+	CLocalPath previousLocalPath;
+	CServerPath previousRemotePath;
+
+	size_t imported{};
+	bool canceled{};
+
+	auto const finishServer = [&]() {
+		if (pServerItem) {
+			if (!pServerItem->GetChild(0) && !pServerItem->GetDeferredCount()) {
+				m_insertionStart = -1;
+				m_insertionCount = 0;
 				m_itemCount--;
 				m_serverList.pop_back();
 				delete pServerItem;
 			}
-			else if (updateSelections) {
+			else {
 				CommitChanges();
 			}
 		}
 
-		xServer = xServer.next_sibling("Server");
-	}
+		pServerItem = nullptr;
+		invalidServer = false;
+		serverDocument.reset();
+		serverNode = serverDocument.append_child("Server");
+	};
 
-	if (!updateSelections) {
-		m_insertionStart = -1;
-		m_insertionCount = 0;
-		CommitChanges();
-	}
-	else {
-		RefreshListOnly();
+	auto const onElement = [&](pugi::xml_node element) {
+		bool const file = !strcmp(element.name(), "File");
+		if (!file && strcmp(element.name(), "Folder")) {
+			if (!pServerItem) {
+				serverNode.append_copy(element);
+			}
+			return true;
+		}
+
+		if (!pServerItem) {
+			if (invalidServer) {
+				return true;
+			}
+
+			Site site;
+			if (!GetServer(serverNode, site)) {
+				invalidServer = true;
+				return true;
+			}
+			m_insertionStart = -1;
+			m_insertionCount = 0;
+			pServerItem = CreateServerItem(site);
+		}
+
+		bool const inserted = file ? ImportFile(*pServerItem, element, previousLocalPath, previousRemotePath) : ImportFolder(*pServerItem, element);
+		if (inserted && !(++imported % import_batch)) {
+			// Insert the items in batches to keep selections and the item count up to date cheaply
+			CommitChanges();
+
+			int const pos = reader.size() > 0 ? static_cast<int>(reader.position() * 1000 / reader.size()) : 0;
+			if (!progress.Update(std::min(pos, 999))) {
+				canceled = true;
+				return false;
+			}
+		}
+		return true;
+	};
+
+	bool const res = reader.read({"FileZilla3", "Queue", "Server"}, false, onElement, [&]() {
+		finishServer();
+		return true;
+	});
+	if (!res || canceled) {
+		finishServer();
 	}
+
+	RefreshListOnly();
+
+	return res;
 }
 
 void CQueueView::OnPostScroll()
@@ -1944,14 +2359,40 @@ void CQueueView::RemoveAll()
 	std::vector<CServerItem*> newServerList;
 	m_itemCount = 0;
 	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if ((*iter)->TryRemoveAll()) {
+		CServerItem & serverItem = **iter;
+
+		std::vector<int64_t> storedChildren;
+		if (m_queue_storage.JournalEnabled()) {
+			for (unsigned int i = 0; i < serverItem.GetChildrenCount(false); ++i) {
+				storedChildren.push_back(serverItem.GetChild(i, false)->GetStorageId());
+			}
+		}
+
+		if (serverItem.TryRemoveAll()) {
+			m_queue_storage.RemoveServer(serverItem.GetStorageId());
 			delete *iter;
 		}
 		else {
+			// Only the few active items remain
+			std::vector<int64_t> kept;
+			for (unsigned int i = 0; i < serverItem.GetChildrenCount(false); ++i) {
+				kept.push_back(serverItem.GetChild(i, false)->GetStorageId());
+			}
+			for (auto const id : storedChildren) {
+				if (std::find(kept.cbegin(), kept.cend(), id) == kept.cend()) {
+					m_queue_storage.RemoveFile(id);
+				}
+			}
+			if (serverItem.GetDeferredCount()) {
+				m_queue_storage.RemoveFiles(serverItem.GetStorageId(), serverItem.GetStorageCursor());
+				serverItem.ClearDeferred();
+			}
+
 			newServerList.push_back(*iter);
-			m_itemCount += 1 + (*iter)->GetChildrenCount(true);
+			m_itemCount += 1 + serverItem.GetChildrenCount(true);
 		}
 	}
+	ScheduleQueueCommit();
 
 	SaveSetItemCount(m_itemCount);
 
@@ -2000,7 +2441,7 @@ void CQueueView::OnRemoveSelected(wxCommandEvent&)
 
 		if (pItem->GetType() == QueueItemType::Server) {
 			// Server selected. Don't process individual files, continue with the next server
-			skipTo = item + pItem->GetChildrenCount(true);
+			skipTo = item + pItem->GetChildrenCount(true) + static_cast<long>(static_cast<CServerItem*>(pItem)->GetDeferredCount());
 		}
 	}
 
@@ -2088,6 +2529,8 @@ bool CQueueView::StopItem(CFileItem* item)
 
 bool CQueueView::StopItem(CServerItem* pServerItem, bool updateSelections)
 {
+	DropDeferredItems(*pServerItem, updateSelections);
+
 	std::vector<CQueueItem*> const items = pServerItem->GetChildren();
 	int const removedAtFront = pServerItem->GetRemovedAtFront();
 
@@ -2122,8 +2565,13 @@ bool CQueueView::StopItem(CServerItem* pServerItem, bool updateSelections)
 
 void CQueueView::SetDefaultFileExistsAction(CFileExistsNotification::OverwriteAction action, const TransferDirection direction)
 {
-	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter)
+	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
 		(*iter)->SetDefaultFileExistsAction(action, direction);
+		StoreItemChange(**iter);
+		if ((*iter)->GetDeferredCount()) {
+			m_queue_storage.SetFilesDefaultFileExistsAction((*iter)->GetStorageId(), (*iter)->GetStorageCursor(), action, direction);
+		}
+	}
 }
 
 void CQueueView::OnSetDefaultFileExistsAction(wxCommandEvent &)
@@ -2242,15 +2690,22 @@ void CQueueView::OnSetDefaultFileExistsAction(wxCommandEvent &)
 				CServerItem *pServerItem = (CServerItem*)pItem;
 				if (has_download) {
 					pServerItem->SetDefaultFileExistsAction(downloadAction, TransferDirection::download);
+					if (pServerItem->GetDeferredCount()) {
+						m_queue_storage.SetFilesDefaultFileExistsAction(pServerItem->GetStorageId(), pServerItem->GetStorageCursor(), downloadAction, TransferDirection::download);
+					}
 				}
 				if (has_upload) {
 					pServerItem->SetDefaultFileExistsAction(uploadAction, TransferDirection::upload);
+					if (pServerItem->GetDeferredCount()) {
+						m_queue_storage.SetFilesDefaultFileExistsAction(pServerItem->GetStorageId(), pServerItem->GetStorageCursor(), uploadAction, TransferDirection::upload);
+					}
 				}
 			}
 			break;
 		default:
 			break;
 		}
+		StoreItemChange(*pItem);
 	}
 }
 
@@ -2441,6 +2896,7 @@ void CQueueView::UpdateItemSize(CFileItem* pItem, int64_t size)
 	}
 
 	pItem->SetSize(size);
+	StoreItemChange(*pItem);
 
 	DisplayQueueSize();
 }
@@ -2490,9 +2946,25 @@ void CQueueView::AdvanceQueue(bool refresh)
 }
 
 void CQueueView::InsertItem(CServerItem* pServerItem, CQueueItem* pItem)
+{
+	if (!DeferItem(*pServerItem, *pItem)) {
+		DoInsertItem(pServerItem, pItem);
+	}
+}
+
+void CQueueView::DoInsertItem(CServerItem* pServerItem, CQueueItem* pItem)
 {
 	CQueueViewBase::InsertItem(pServerItem, pItem);
 
+	if (m_queue_storage.JournalEnabled() && (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder)) {
+		m_queue_storage.AddServer(*pServerItem);
+		m_queue_storage.AddFile(static_cast<CFileItem&>(*pItem), pServerItem->GetStorageId());
+		if (pItem->GetStorageId() > pServerItem->GetStorageCursor()) {
+			pServerItem->SetStorageCursor(pItem->GetStorageId());
+		}
+		ScheduleQueueCommit();
+	}
+
 	if (pItem->GetType() == QueueItemType::File) {
 		CFileItem* pFileItem = (CFileItem*)pItem;
 
@@ -2513,6 +2985,211 @@ void CQueueView::CommitChanges()
 	DisplayQueueSize();
 }
 
+bool CQueueView::DeferItem(CServerItem & serverItem, CQueueItem & item)
+{
+	if (!m_queue_storage.JournalEnabled()) {
+		return false;
+	}
+	if (item.GetType() != QueueItemType::File && item.GetType() != QueueItemType::Folder) {
+		return false;
+	}
+	if (!serverItem.GetDeferredCount() && serverItem.GetChildrenCount(false) < materialize_window) {
+		return false;
+	}
+
+	auto & fileItem = static_cast<CFileItem&>(item);
+	if (fileItem.m_edit != CEditHandler::none) {
+		return false;
+	}
+
+	if (!m_queue_storage.AddServer(serverItem) || !m_queue_storage.AddFile(fileItem, serverItem.GetStorageId()) || fileItem.GetStorageId() <= 0) {
+		return false;
+	}
+	ScheduleQueueCommit();
+
+	// The row goes after those of all other files of the server
+	AddInsertion(GetItemIndex(&serverItem) + serverItem.GetChildrenCount(true) + static_cast<int>(serverItem.GetDeferredCount()) + 1);
+	++m_itemCount;
+
+	// Same accounting as for materialized items
+	int64_t const size = item.GetType() == QueueItemType::File ? fileItem.GetSize() : 0;
+	if (size < 0) {
+		serverItem.AddDeferred(1, 0, 1);
+		++m_filesWithUnknownSize;
+	}
+	else {
+		serverItem.AddDeferred(1, size, 0);
+		m_totalQueueSize += size;
+	}
+	++m_fileCount;
+	m_fileCountChanged = true;
+
+	delete &item;
+
+	return true;
+}
+
+bool CQueueView::MaterializeDeferredItems(CServerItem & serverItem, size_t limit)
+{
+	if (!serverItem.GetDeferredCount()) {
+		return true;
+	}
+
+	// The rows of the deferred files are already there, the materialized
+	// files take them over in storage order. Totals stay the same.
+	std::vector<CFileItem*> items;
+	int64_t const last = m_queue_storage.GetFiles(items, serverItem.GetStorageId(), serverItem.GetStorageCursor(), limit, true);
+	for (auto * fileItem : items) {
+		int64_t const size = fileItem->GetType() == QueueItemType::File ? fileItem->GetSize() : 0;
+		if (size < 0) {
+			serverItem.RemoveDeferred(1, 0, 1);
+		}
+		else {
+			serverItem.RemoveDeferred(1, size, 0);
+		}
+
+		fileItem->SetParent(&serverItem);
+		serverItem.AddChild(fileItem);
+	}
+
+	if (last < 0) {
+		if (!items.empty()) {
+			serverItem.SetStorageCursor(items.back()->GetStorageId());
+		}
+		return false;
+	}
+	if (last > 0) {
+		serverItem.SetStorageCursor(last);
+	}
+
+	// Storage has nothing more to offer, yet files are left
+	if ((!last || !limit) && serverItem.GetDeferredCount()) {
+		return false;
+	}
+
+	return true;
+}
+
+void CQueueView::DropDeferredItems(CServerItem & serverItem, bool updateSelections)
+{
+	int64_t const count = serverItem.GetDeferredCount();
+	if (!count) {
+		return;
+	}
+
+	m_queue_storage.RemoveFiles(serverItem.GetStorageId(), serverItem.GetStorageCursor());
+	ScheduleQueueCommit();
+
+	if (updateSelections) {
+		UpdateSelections_ItemRangeRemoved(GetItemIndex(&serverItem) + serverItem.GetChildrenCount(true) + 1, static_cast<int>(count));
+	}
+	m_itemCount -= static_cast<int>(count);
+	SaveSetItemCount(m_itemCount);
+
+	serverItem.ClearDeferred();
+	CalculateQueueSize();
+}
+
+void CQueueView::DropLostDeferredItems()
+{
+	m_lostDeferredItems = false;
+
+	for (auto * serverItem : m_serverList) {
+		if (!MaterializeDeferredItems(*serverItem, materialize_page)) {
+			DropDeferredItems(*serverItem);
+		}
+	}
+
+	RefreshListOnly();
+}
+
+CQueueItem* CQueueView::GetDeferredItem(CServerItem & serverItem, unsigned int index)
+{
+	// Storage order is row order, materialize pages until the row is reached
+	while (index >= serverItem.GetChildrenCount(true)) {
+		if (!serverItem.GetDeferredCount()) {
+			return nullptr;
+		}
+		if (!MaterializeDeferredItems(serverItem, materialize_page)) {
+			// Might be painting right now, don't remove rows yet
+			if (!m_lostDeferredItems) {
+				m_lostDeferredItems = true;
+				CallAfter(&CQueueView::DropLostDeferredItems);
+			}
+			return nullptr;
+		}
+	}
+
+	return serverItem.GetChild(index);
+}
+
+void CQueueView::DeferTail(CServerItem & serverItem)
+{
+	if (!m_queue_storage.JournalEnabled() || serverItem.GetStorageId() <= 0) {
+		return;
+	}
+
+	// Only idle files at the end can go back to storage
+	auto const& children = serverItem.GetChildren();
+	size_t const offset = static_cast<size_t>(serverItem.GetRemovedAtFront());
+	unsigned int const count = serverItem.GetChildrenCount(false);
+	unsigned int first = count;
+	while (first > materialize_window) {
+		auto const& fileItem = static_cast<CFileItem const&>(*children[offset + first - 1]);
+		if (fileItem.IsActive() || fileItem.m_edit != CEditHandler::none || fileItem.GetStorageId() <= 0) {
+			break;
+		}
+		--first;
+	}
+	if (first == count) {
+		return;
+	}
+
+	// Stored anew, so that they come after all other files in storage in their current order
+	for (auto * item : serverItem.DetachTail(first)) {
+		auto & fileItem = static_cast<CFileItem&>(*item);
+		m_queue_storage.RemoveFile(fileItem.GetStorageId());
+		fileItem.SetStorageId(0);
+		if (!m_queue_storage.AddFile(fileItem, serverItem.GetStorageId()) || fileItem.GetStorageId() <= 0) {
+			// Keep it in memory instead, the rows don't change either way
+			serverItem.AddChild(&fileItem);
+			continue;
+		}
+
+		int64_t const size = fileItem.GetType() == QueueItemType::File ? fileItem.GetSize() : 0;
+		if (size < 0) {
+			serverItem.AddDeferred(1, 0, 1);
+		}
+		else {
+			serverItem.AddDeferred(1, size, 0);
+		}
+		delete &fileItem;
+	}
+	ScheduleQueueCommit();
+}
+
+void CQueueView::WriteServerItems(xml_stream_writer & writer, CServerItem const& serverItem, unsigned int depth) const
+{
+	CQueueViewBase::WriteServerItems(writer, serverItem, depth);
+
+	// Deferred items are exported straight from storage, a page at a time
+	int64_t after = serverItem.GetStorageCursor();
+	while (serverItem.GetDeferredCount() && after >= 0) {
+		std::vector<CFileItem*> items;
+		after = m_queue_storage.GetFiles(items, serverItem.GetStorageId(), after, materialize_page, false);
+		for (auto * fileItem : items) {
+			pugi::xml_document document;
+			pugi::xml_node node = document;
+			fileItem->SaveItem(node);
+			writer.write_element(document.first_child(), depth);
+			delete fileItem;
+		}
+		if (!after) {
+			break;
+		}
+	}
+}
+
 void CQueueView::OnTimer(wxTimerEvent& event)
 {
 	const int id = event.GetId();
@@ -2531,6 +3208,11 @@ void CQueueView::OnTimer(wxTimerEvent& event)
 		return;
 	}
 
+	if (id == m_queue_commit_timer.GetId()) {
+		m_queue_storage.Commit();
+		return;
+	}
+
 	for (auto & pData : m_engineData) {
 		if (pData->m_idleDisconnectTimer && !pData->m_idleDisconnectTimer->IsRunning()) {
 			delete pData->m_idleDisconnectTimer;
@@ -2604,6 +3286,13 @@ void CQueueView::OnSetPriority(wxCommandEvent& event)
 		}
 
 		pItem->SetPriority(priority);
+		StoreItemChange(*pItem);
+		if (pItem->GetType() == QueueItemType::Server) {
+			auto const& serverItem = static_cast<CServerItem const&>(*pItem);
+			if (serverItem.GetDeferredCount()) {
+				m_queue_storage.SetFilesPriority(serverItem.GetStorageId(), serverItem.GetStorageCursor(), priority);
+			}
+		}
 	}
 
 	RefreshListOnly();
@@ -2954,7 +3643,7 @@ void CQueueView::RenameFileInTransfer(CFileZillaEngine *pEngine, std::wstring co
 		return;
 	}
 
-	CFileItem* pFile = (CFileItem*)pEngineData->pItem;
+	CFileItem* pFile = pEngineData->GetCurrentItem();
 	if (local) {
 		wxFileName fn(pFile->GetLocalPath().GetPath(), pFile->GetLocalFile());
 		fn.SetFullName(newName);
@@ -2964,6 +3653,7 @@ void CQueueView::RenameFileInTransfer(CFileZillaEngine *pEngine, std::wstring co
 	else {
 		pFile->SetTargetFile(newName);
 	}
+	StoreItemChange(*pFile);
 
 	RefreshItem(pFile);
 }
@@ -3034,9 +3724,13 @@ WXLRESULT CQueueView::MSWWindowProc(WXUINT nMsg, WXWPARAM wParam, WXLPARAM lPara
 }
 #endif
 
-void CQueueView::OnOptionsChanged(watched_options const&)
+void CQueueView::OnOptionsChanged(watched_options const& options)
 {
-	if (m_activeMode) {
+	CQueueViewBase::OnOptionsChanged(options);
+
+	if (m_activeMode && (options.test(OPTION_NUMTRANSFERS) || options.test(OPTION_CONCURRENTDOWNLOADLIMIT) ||
+		options.test(OPTION_CONCURRENTUPLOADLIMIT) || options.test(OPTION_SMALLFILE_SLOTS)))
+	{
 		AdvanceQueue();
 	}
 }
@@ -3091,8 +3785,10 @@ void CQueueView::OnStateChange(CState*, t_statechange_notifications notification
 			}
 
 			protect((*it)->GetCredentials());
+			m_queue_storage.RewriteServer(**it);
 			++it;
 		}
+		ScheduleQueueCommit();
 	}
 	else if (notification == STATECHANGE_QUITNOW) {
 		if (m_quit != 2) {
@@ -3108,7 +3804,12 @@ void CQueueView::OnColumnClicked(wxListEvent &event)
 	bool const reverse = wxGetKeyState(WXK_SHIFT);
 
 	for (auto * serverItem : m_serverList) {
+		// Deferred files get sorted as well, then those beyond the window are deferred again
+		if (!MaterializeDeferredItems(*serverItem, 0)) {
+			DropDeferredItems(*serverItem);
+		}
 		serverItem->Sort(col, reverse);
+		DeferTail(*serverItem);
 	}
 
 	RefreshListOnly();
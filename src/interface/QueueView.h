@@ -36,6 +36,7 @@ enum type {
 };
 }
 
+class CInterProcessMutex;
 class CStatusLineCtrl;
 class CFileItem;
 struct t_EngineData final
@@ -46,6 +47,8 @@ struct t_EngineData final
 		, transient()
 		, state(t_EngineData::none)
 		, pItem()
+		, smallFile()
+		, batchIndex()
 		, pStatusLineCtrl()
 		, m_idleDisconnectTimer()
 	{
@@ -77,6 +80,27 @@ struct t_EngineData final
 	} state;
 
 	CFileItem* pItem;
+
+	// Whether pItem counts towards the transfers reserved for small files
+	bool smallFile;
+
+	// Small files transferred along with pItem in a single batch command,
+	// and the reply codes of the batch, starting with the one for pItem.
+	std::vector<CFileItem*> batch;
+	std::vector<int> batchReplies;
+
+	// Index of the batch member currently being transferred, 0 being pItem
+	size_t batchIndex;
+
+	// The file currently being transferred, pItem unless batching
+	CFileItem* GetCurrentItem() const
+	{
+		if (batchIndex && batchIndex <= batch.size()) {
+			return batch[batchIndex - 1];
+		}
+		return pItem;
+	}
+
 	Site lastSite;
 	CStatusLineCtrl* pStatusLineCtrl;
 	wxTimer* m_idleDisconnectTimer;
@@ -86,6 +110,7 @@ class CMainFrame;
 class CStatusLineCtrl;
 class CAsyncRequestQueue;
 class CQueue;
+class xml_stream_reader;
 #if WITH_LIBDBUS
 class CDesktopNotification;
 #elif defined(__WXGTK__) || defined(__WXMSW__)
@@ -109,7 +134,7 @@ private:
 };
 
 class CQueueView final : public CQueueViewBase,
-	public COptionChangeEventHandler, public CGlobalStateEventHandler, public CExclusiveHandler
+	public CGlobalStateEventHandler, public CExclusiveHandler
 {
 	friend class CQueueViewDropTarget;
 	friend class CQueueViewFailed;
@@ -133,6 +158,9 @@ public:
 
 	bool empty() const;
 	int IsActive() const { return m_activeMode; }
+
+	// Number of transfers currently using a connection to the site
+	int GetActiveTransferCount(Site const& site);
 	bool SetActive(bool active = true);
 	bool Quit(bool force = false);
 
@@ -144,8 +172,13 @@ public:
 	void RemoveAll();
 
 	void LoadQueue();
-	void ImportQueue(pugi::xml_node element, bool updateSelections);
 
+	// Reads the queue of an exported file one item at a time.
+	// Returns false if the file could not be read.
+	bool ImportQueue(xml_stream_reader & reader);
+
+	// Once a server has many files, further files are only kept in the
+	// queue storage and the item gets deleted.
 	virtual void InsertItem(CServerItem* pServerItem, CQueueItem* pItem) override;
 
 	virtual void CommitChanges() override;
@@ -186,6 +219,12 @@ protected:
 	};
 
 	void ResetEngine(t_EngineData& data, const ResetReason reason);
+
+	// Moves an item which is no longer active according to the reason
+	void FinishItem(CFileItem* item, ResetReason reason);
+
+	// Releases the files transferred along with the engine's item
+	void FinishBatch(t_EngineData& data);
 	void DeleteEngines();
 
 	virtual bool RemoveItem(CQueueItem* item, bool destroy, bool updateItemCount = true, bool updateSelections = true, bool forward = true) override;
@@ -202,6 +241,39 @@ protected:
 	void DisplayQueueSize();
 	void SaveQueue(bool silent = false);
 
+	// Journal changes of queue items to the queue storage
+	void StoreItemChange(CQueueItem & item);
+	void ScheduleQueueCommit();
+
+	// Only a window of each server's files is kept in memory, the rest
+	// stays deferred in the queue storage until needed.
+	// Deferred files have rows in the list nonetheless, they get materialized
+	// once displayed or otherwise accessed through their row.
+	void DoInsertItem(CServerItem* pServerItem, CQueueItem* pItem);
+	bool DeferItem(CServerItem & serverItem, CQueueItem & item);
+
+	// Materializes up to limit deferred files, 0 for all of them. Returns
+	// false if storage could not be read or does not hold the remaining
+	// deferred files anymore.
+	bool MaterializeDeferredItems(CServerItem & serverItem, size_t limit);
+
+	// Removes the deferred files and their rows
+	void DropDeferredItems(CServerItem & serverItem, bool updateSelections = true);
+	void DropLostDeferredItems();
+	bool m_lostDeferredItems{};
+
+	// Defers the files beyond the window again, e.g. after sorting
+	void DeferTail(CServerItem & serverItem);
+
+	virtual CQueueItem* GetDeferredItem(CServerItem & serverItem, unsigned int index) override;
+
+	// Also writes the deferred files, straight from storage
+	virtual void WriteServerItems(xml_stream_writer & writer, CServerItem const& serverItem, unsigned int depth) const override;
+
+	// Create and insert the queue item for an imported element
+	bool ImportFile(CServerItem & serverItem, pugi::xml_node file, CLocalPath & previousLocalPath, CServerPath & previousRemotePath);
+	bool ImportFolder(CServerItem & serverItem, pugi::xml_node folder);
+
 	bool IsActionAfter(ActionAfterState::type);
 	void ActionAfter(bool warned = false);
 #if defined(__WXMSW__) || defined(__WXMAC__)
@@ -239,6 +311,7 @@ protected:
 	int m_activeCount{};
 	int m_activeCountDown{};
 	int m_activeCountUp{};
+	int m_activeCountSmall{};
 	int m_activeMode{}; // 0 inactive, 1 only immediate transfers, 2 all
 	int m_quit{};
 
@@ -278,6 +351,8 @@ protected:
 #endif
 
 	CQueueStorage m_queue_storage;
+	std::unique_ptr<CInterProcessMutex> m_queue_journal_mutex;
+	wxTimer m_queue_commit_timer;
 
 	void OnEngineEvent(CFileZillaEngine* engine);
 
@@ -303,6 +303,7 @@ BEGIN_EVENT_TABLE(CRemoteListView, CFileListCtrl<CGenericFileData>)
 	EVT_MENU(XRCID("ID_NEW_FILE"), CRemoteListView::OnMenuNewfile)
 	EVT_MENU(XRCID("ID_DELETE"), CRemoteListView::OnMenuDelete)
 	EVT_MENU(XRCID("ID_RENAME"), CRemoteListView::OnMenuRename)
+	EVT_MENU(XRCID("ID_DUPLICATE"), CRemoteListView::OnMenuDuplicate)
 	EVT_MENU(XRCID("ID_CHMOD"), CRemoteListView::OnMenuChmod)
 	EVT_KEY_DOWN(CRemoteListView::OnKeyDown)
 	EVT_SIZE(CRemoteListView::OnSize)
@@ -427,14 +428,8 @@ void CRemoteListView::UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryLis
 	CGenericFileData last = m_fileData.back();
 	m_fileData.pop_back();
 
-	bool const has_selections = GetSelectedItemCount() != 0;
-
-	std::vector<int> added_indexes;
-	if (has_selections) {
-		added_indexes.reserve(to_add);
-	}
-
-	auto& compare = GetSortComparisonObject();
+	std::vector<unsigned int> added;
+	added.reserve(to_add);
 	for (size_t i = pDirectoryListing->size() - to_add; i < pDirectoryListing->size(); ++i) {
 		CDirentry const& entry = (*pDirectoryListing)[i];
 		CGenericFileData data;
@@ -461,26 +456,12 @@ void CRemoteListView::UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryLis
 			}
 		}
 
-		// Find correct position in index mapping
-		std::vector<unsigned int>::iterator start = m_indexMapping.begin();
-		if (m_hasParent) {
-			++start;
-		}
-		std::vector<unsigned int>::iterator insertPos = std::lower_bound(start, m_indexMapping.end(), i, SortPredicate(compare));
-
-		const int added_index = insertPos - m_indexMapping.begin();
-		m_indexMapping.insert(insertPos, i);
-
-		// Remember inserted index
-		if (has_selections) {
-			auto const added_indexes_insert_pos = std::lower_bound(added_indexes.begin(), added_indexes.end(), added_index);
-			for (auto index = added_indexes_insert_pos; index != added_indexes.end(); ++index) {
-				++(*index);
-			}
-			added_indexes.insert(added_indexes_insert_pos, added_index);
-		}
+		added.push_back(i);
 	}
 
+	std::vector<int> added_indexes;
+	MergeAddedItems(m_indexMapping, m_hasParent ? 1 : 0, added, SortPredicate(GetSortComparisonObject()), GetSelectedItemCount() ? &added_indexes : nullptr);
+
 	m_fileData.push_back(last);
 
 	SetItemCount(m_indexMapping.size());
@@ -527,97 +508,74 @@ void CRemoteListView::UpdateDirectoryListing_Removed(std::shared_ptr<CDirectoryL
 		wxASSERT(removedItems.size() == countRemoved);
 	}
 
-	std::list<int> selectedItems;
-
-	// Number of items left to remove
-	unsigned int toRemove = countRemoved;
-
-	std::list<int> removedIndexes;
-
-	const int size = m_indexMapping.size();
-	for (int i = size - 1; i >= 0; --i) {
-		bool removed = false;
-
-		unsigned int& index = m_indexMapping[i];
-
-		// j is the offset the index has to be adjusted
-		int j = 0;
-		for (auto iter = removedItems.cbegin(); iter != removedItems.cend(); ++iter, ++j) {
-			if (*iter > index) {
-				break;
+	// New listing index for each old one, -1 for the removed items.
+	// The parent directory item comes after the listing.
+	std::vector<int> newIndexes(m_pDirectoryListing->size() + 1);
+	{
+		auto removed = removedItems.cbegin();
+		int offset = 0;
+		for (size_t i = 0; i < newIndexes.size(); ++i) {
+			if (removed != removedItems.cend() && *removed == i) {
+				newIndexes[i] = -1;
+				++removed;
+				++offset;
 			}
-
-			if (*iter == index) {
-				removedIndexes.push_back(i);
-				removed = true;
-				--toRemove;
-				break;
+			else {
+				newIndexes[i] = static_cast<int>(i) - offset;
 			}
 		}
+	}
+
+	// Compact the index mapping in a single pass, selections move along with their items
+	size_t const size = m_indexMapping.size();
+	size_t kept = 0;
+	for (size_t i = 0; i < size; ++i) {
+		unsigned int const index = m_indexMapping[i];
 
-		// Get old selection
-		bool isSelected = GetItemState(i, wxLIST_STATE_SELECTED) != 0;
+		bool const isSelected = GetItemState(i, wxLIST_STATE_SELECTED) != 0;
 
-		// Update statusbar info
-		if (removed && m_pFilelistStatusBar) {
-			const CDirentry& oldEntry = (*m_pDirectoryListing)[index];
-			if (isSelected) {
+		if (newIndexes[index] == -1) {
+			// Update statusbar info
+			if (m_pFilelistStatusBar) {
+				const CDirentry& oldEntry = (*m_pDirectoryListing)[index];
+				if (isSelected) {
+					if (oldEntry.is_dir()) {
+						m_pFilelistStatusBar->UnselectDirectory();
+					}
+					else {
+						m_pFilelistStatusBar->UnselectFile(oldEntry.size);
+					}
+				}
 				if (oldEntry.is_dir()) {
-					m_pFilelistStatusBar->UnselectDirectory();
+					m_pFilelistStatusBar->RemoveDirectory();
 				}
 				else {
-					m_pFilelistStatusBar->UnselectFile(oldEntry.size);
+					m_pFilelistStatusBar->RemoveFile(oldEntry.size);
 				}
 			}
-			if (oldEntry.is_dir()) {
-				m_pFilelistStatusBar->RemoveDirectory();
-			}
-			else {
-				m_pFilelistStatusBar->RemoveFile(oldEntry.size);
-			}
-		}
-
-		// Update index
-		index -= j;
-
-		// Update selections
-		bool needSelection;
-		if (selectedItems.empty()) {
-			needSelection = false;
-		}
-		else if (selectedItems.front() == i) {
-			needSelection = true;
-			selectedItems.pop_front();
-		}
-		else {
-			needSelection = false;
+			continue;
 		}
 
-		if (isSelected) {
-			if (!needSelection && (toRemove || removed)) {
-				SetSelection(i, false);
-			}
-
-			if (!removed) {
-				selectedItems.push_back(i - toRemove);
-			}
+		if (kept != i && isSelected != (GetItemState(kept, wxLIST_STATE_SELECTED) != 0)) {
+			SetSelection(kept, isSelected);
 		}
-		else if (needSelection) {
-			SetSelection(i, true);
+		m_indexMapping[kept++] = newIndexes[index];
+	}
+	for (size_t i = kept; i < size; ++i) {
+		if (GetItemState(i, wxLIST_STATE_SELECTED)) {
+			SetSelection(i, false);
 		}
 	}
+	m_indexMapping.resize(kept);
 
 	// Erase file data
-	for (auto iter = removedItems.crbegin(); iter != removedItems.crend(); ++iter) {
-		m_fileData.erase(m_fileData.begin() + *iter);
-	}
-
-	// Erase indexes
-	wxASSERT(!toRemove);
-	wxASSERT(removedIndexes.size() == countRemoved);
-	for (auto const& removedIndex : removedIndexes) {
-		m_indexMapping.erase(m_indexMapping.begin() + removedIndex);
+	wxASSERT(m_fileData.size() == newIndexes.size());
+	for (size_t i = 0; i < newIndexes.size(); ++i) {
+		if (newIndexes[i] != -1 && static_cast<size_t>(newIndexes[i]) != i) {
+			m_fileData[newIndexes[i]] = std::move(m_fileData[i]);
+		}
 	}
+	m_fileData.resize(m_fileData.size() - removedItems.size());
 
 	wxASSERT(m_indexMapping.size() == pDirectoryListing->size() + 1);
 
@@ -663,8 +621,6 @@ bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing>
 
 		m_pDirectoryListing = pDirectoryListing;
 		UpdateSortComparisonObject();
-
-		// We don't have to do anything
 		return true;
 	}
 
@@ -682,6 +638,43 @@ bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing>
 	return true;
 }
 
+bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, CDirectoryListingDelta const& delta)
+{
+	if (delta.from_time != m_pDirectoryListing->m_firstListTime || !delta.ordered) {
+		return false;
+	}
+
+	if (pDirectoryListing->size() + delta.removed.size() != m_pDirectoryListing->size() + delta.added.size()) {
+		return false;
+	}
+
+	if (!delta.changed.empty()) {
+		// Sizes or dates may have changed, affecting sort order, filters and the status bar
+		return false;
+	}
+
+	if (!delta.added.empty()) {
+		if (!delta.removed.empty()) {
+			return false;
+		}
+
+		// Since the order is unchanged, all new entries come after the existing ones
+		UpdateDirectoryListing_Added(pDirectoryListing);
+		return true;
+	}
+
+	if (!delta.removed.empty()) {
+		UpdateDirectoryListing_Removed(pDirectoryListing);
+		return true;
+	}
+
+	// Nothing has changed, the new listing can simply take the place of the old one
+	m_pDirectoryListing = pDirectoryListing;
+	UpdateSortComparisonObject();
+
+	return true;
+}
+
 void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
 {
 	CancelLabelEdit();
@@ -693,13 +686,19 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	else if (m_pDirectoryListing->path != pDirectoryListing->path) {
 		reset = true;
 	}
-	else if (m_pDirectoryListing->m_firstListTime == pDirectoryListing->m_firstListTime && !IsComparing()
-		&& m_pDirectoryListing->size() > 200)
-	{
+	else if (!IsComparing() && m_pDirectoryListing->size() > 200) {
 		// Updated directory listing. Check if we can use process it in a different,
 		// more efficient way.
 		// Makes only sense for big listings though.
-		if (UpdateDirectoryListing(pDirectoryListing)) {
+		bool updated{};
+		if (m_pDirectoryListing->m_firstListTime == pDirectoryListing->m_firstListTime) {
+			updated = UpdateDirectoryListing(pDirectoryListing);
+		}
+		else if (m_state.GetRemoteDirDelta() && m_state.GetRemoteDir() == pDirectoryListing) {
+			// Refreshed listing, the engine has told what changed
+			updated = UpdateDirectoryListing(pDirectoryListing, *m_state.GetRemoteDirDelta());
+		}
+		if (updated) {
 			wxASSERT(GetItemCount() == (int)m_indexMapping.size());
 			wxASSERT(GetItemCount() <= (int)m_fileData.size());
 			wxASSERT(GetItemCount() == (int)m_fileData.size() || CFilterManager::HasActiveFilters());
@@ -1061,6 +1060,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 	menu.AppendSeparator();
 	menu.Append(XRCID("ID_DELETE"), _("D&elete"), _("Delete selected files and directories"));
 	menu.Append(XRCID("ID_RENAME"), _("&Rename"), _("Rename selected files and directories"));
+	menu.Append(XRCID("ID_DUPLICATE"), _("D&uplicate..."), _("Copy the selected file on the server"));
 	menu.Append(XRCID("ID_GETURL"), _("C&opy URL(s) to clipboard"), _("Copy the URLs of the selected items to clipboard."));
 	menu.Append(XRCID("ID_GETURL_PASSWORD"), _("C&opy URL(s) with password to clipboard"), _("Copy the URLs of the selected items to clipboard, including password."));
 	menu.Append(XRCID("ID_CHMOD"), _("&File permissions..."), _("Change the file permissions."));
@@ -1093,6 +1093,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 		menu.Enable(XRCID("ID_MKDIR_CHGDIR"), false);
 		menu.Enable(XRCID("ID_DELETE"), false);
 		menu.Enable(XRCID("ID_RENAME"), false);
+		menu.Enable(XRCID("ID_DUPLICATE"), false);
 		menu.Enable(XRCID("ID_CHMOD"), false);
 		menu.Enable(XRCID("ID_EDIT"), false);
 		menu.Enable(XRCID("ID_GETURL"), false);
@@ -1106,6 +1107,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 		menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
 		menu.Enable(XRCID("ID_DELETE"), false);
 		menu.Enable(XRCID("ID_RENAME"), false);
+		menu.Enable(XRCID("ID_DUPLICATE"), false);
 		menu.Enable(XRCID("ID_CHMOD"), false);
 		menu.Enable(XRCID("ID_EDIT"), false);
 		menu.Enable(XRCID("ID_GETURL"), false);
@@ -1114,6 +1116,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 	else {
 		if ((GetItemCount() && GetItemState(0, wxLIST_STATE_SELECTED))) {
 			menu.Enable(XRCID("ID_RENAME"), false);
+			menu.Enable(XRCID("ID_DUPLICATE"), false);
 			menu.Enable(XRCID("ID_CHMOD"), false);
 			menu.Enable(XRCID("ID_EDIT"), false);
 			menu.Enable(XRCID("ID_GETURL"), false);
@@ -1150,6 +1153,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 			menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
 			menu.Enable(XRCID("ID_DELETE"), false);
 			menu.Enable(XRCID("ID_RENAME"), false);
+			menu.Enable(XRCID("ID_DUPLICATE"), false);
 			menu.Enable(XRCID("ID_CHMOD"), false);
 			menu.Enable(XRCID("ID_EDIT"), false);
 			menu.Enable(XRCID("ID_GETURL"), false);
@@ -1158,6 +1162,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 		else {
 			if (selectedDir) {
 				menu.Enable(XRCID("ID_EDIT"), false);
+				menu.Enable(XRCID("ID_DUPLICATE"), false);
 				if (!CServer::ProtocolHasFeature(m_state.GetSite().server.GetProtocol(), ProtocolFeature::DirectoryRename)) {
 					menu.Enable(XRCID("ID_RENAME"), false);
 				}
@@ -1170,6 +1175,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 					menu.Delete(XRCID("ID_ENTER"));
 				}
 				menu.Enable(XRCID("ID_RENAME"), false);
+				menu.Enable(XRCID("ID_DUPLICATE"), false);
 			}
 
 			if (!m_state.GetLocalDir().IsWriteable()) {
@@ -1181,6 +1187,10 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 
 	menu.Delete(XRCID(wxGetKeyState(WXK_SHIFT) ? "ID_GETURL" : "ID_GETURL_PASSWORD"));
 
+	if (!CServer::ProtocolHasFeature(m_state.GetSite().server.GetProtocol(), ProtocolFeature::ServerSideCopy)) {
+		menu.Delete(XRCID("ID_DUPLICATE"));
+	}
+
 	PopupMenu(&menu);
 }
 
@@ -2398,8 +2408,6 @@ void CRemoteListView::StartComparison()
 		m_indexMapping.clear();
 	}
 
-	m_comparisonIndex = -1;
-
 	if (m_fileData.empty() || m_fileData.back().comparison_flags != fill) {
 		CGenericFileData data;
 		data.icon = -1;
@@ -2408,32 +2416,27 @@ void CRemoteListView::StartComparison()
 	}
 }
 
-bool CRemoteListView::get_next_file(std::wstring_view & name, std::wstring &, bool& dir, int64_t& size, fz::datetime& date)
+void CRemoteListView::get_comparison_entries(NameSortMode mode, std::vector<comparison_entry> & entries)
 {
-	if (++m_comparisonIndex >= (int)m_originalIndexMapping.size()) {
-		return false;
-	}
+	entries.resize(m_originalIndexMapping.size());
+	for (size_t i = 0; i < entries.size(); ++i) {
+		unsigned int const index = m_originalIndexMapping[i];
+
+		auto & entry = entries[i];
+		if (index == m_pDirectoryListing->size()) {
+			entry.key = ComparisonKey(index, L"..", mode);
+			entry.dir = true;
+			entry.parent = true;
+			continue;
+		}
 
-	const unsigned int index = m_originalIndexMapping[m_comparisonIndex];
-	if (index >= m_fileData.size()) {
-		return false;
-	}
+		CDirentry const& direntry = (*m_pDirectoryListing)[index];
 
-	if (index == m_pDirectoryListing->size()) {
-		name = _T("..");
-		dir = true;
-		size = -1;
-		return true;
+		entry.key = ComparisonKey(index, direntry.name, mode);
+		entry.dir = direntry.is_dir();
+		entry.size = direntry.size;
+		entry.date = direntry.time;
 	}
-
-	CDirentry const& entry = (*m_pDirectoryListing)[index];
-
-	name = entry.name;
-	dir = entry.is_dir();
-	size = entry.size;
-	date = entry.time;
-
-	return true;
 }
 
 void CRemoteListView::FinishComparison()
@@ -2509,7 +2512,7 @@ wxString CRemoteListView::GetItemText(int item, unsigned int column)
 			return wxString();
 		}
 		else {
-			return CSizeFormat::Format(entry.size);
+			return FormatSize(index, entry.size);
 		}
 	}
 	else if (column == 2) {
@@ -2528,7 +2531,7 @@ wxString CRemoteListView::GetItemText(int item, unsigned int column)
 	}
 	else if (column == 3) {
 		const CDirentry& entry = (*m_pDirectoryListing)[index];
-		return CTimeFormat::Format(entry.time);
+		return FormatTime(index, entry.time);
 	}
 	else if (column == 4) {
 		return *(*m_pDirectoryListing)[index].permissions;
@@ -2541,7 +2544,7 @@ wxString CRemoteListView::GetItemText(int item, unsigned int column)
 
 void CRemoteListView::UpdateSortComparisonObject()
 {
-	CFileListCtrlSort<CDirectoryListing>::DirSortMode dirSortMode = GetDirSortMode();
+	CFileListCtrlSortBase::DirSortMode dirSortMode = GetDirSortMode();
 	NameSortMode nameSortMode = GetNameSortMode();
 
 	static CDirectoryListing const empty;
@@ -2742,6 +2745,67 @@ void CRemoteListView::OnNavigationEvent(bool forward)
 	}
 }
 
+void CRemoteListView::OnMenuDuplicate(wxCommandEvent&)
+{
+	if (!m_state.IsRemoteIdle() || !m_pDirectoryListing) {
+		wxBell();
+		return;
+	}
+
+	int item = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+	if (item <= 0 || GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED) != -1) {
+		wxBell();
+		return;
+	}
+
+	int index = GetItemIndex(item);
+	if (index == -1 || m_fileData[index].comparison_flags == fill) {
+		wxBell();
+		return;
+	}
+
+	CDirentry const& entry = (*m_pDirectoryListing)[index];
+	if (entry.is_dir()) {
+		wxBell();
+		return;
+	}
+
+	CInputDialog dlg;
+	if (!dlg.Create(this, _("Duplicate file"), _("Please enter the name of the copy:"))) {
+		return;
+	}
+
+	// Suggest a name with the extension kept intact
+	std::wstring suggestion = entry.name;
+	size_t const dot = suggestion.rfind('.');
+	if (dot != std::wstring::npos && dot) {
+		suggestion.insert(dot, L" - Copy");
+	}
+	else {
+		suggestion += L" - Copy";
+	}
+	dlg.SetValue(suggestion);
+
+	if (dlg.ShowModal() != wxID_OK) {
+		return;
+	}
+
+	std::wstring const newFileName = dlg.GetValue().ToStdWstring();
+	if (newFileName.empty() || newFileName == entry.name) {
+		wxBell();
+		return;
+	}
+
+	for (size_t i = 0; i < m_pDirectoryListing->size(); ++i) {
+		if (newFileName == (*m_pDirectoryListing)[i].name) {
+			wxMessageBoxEx(_("Target filename already exists!"));
+			return;
+		}
+	}
+
+	m_state.m_pCommandQueue->ProcessCommand(new CCopyCommand(m_pDirectoryListing->path, entry.name, m_pDirectoryListing->path, newFileName));
+}
+
 void CRemoteListView::OnMenuNewfile(wxCommandEvent&)
 {
 	if (!m_state.IsRemoteIdle() || !m_pDirectoryListing) {
@@ -21,7 +21,7 @@ public:
 
 	virtual bool CanStartComparison();
 	virtual void StartComparison();
-	virtual bool get_next_file(std::wstring_view & name, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) override;
+	virtual void get_comparison_entries(NameSortMode mode, std::vector<comparison_entry> & entries) override;
 	virtual void FinishComparison();
 	virtual void OnExitComparisonMode();
 
@@ -58,6 +58,7 @@ protected:
 	void ApplyCurrentFilter();
 	void SetDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 	bool UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
+	bool UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, CDirectoryListingDelta const& delta);
 	void UpdateDirectoryListing_Removed(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 	void UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 
@@ -113,6 +114,7 @@ protected:
 	void OnMenuMkdirChgDir(wxCommandEvent&);
 	void OnMenuDelete(wxCommandEvent&);
 	void OnMenuRename(wxCommandEvent&);
+	void OnMenuDuplicate(wxCommandEvent&);
 	void OnKeyDown(wxKeyEvent& event);
 	void OnMenuChmod(wxCommandEvent& event);
 	void OnSize(wxSizeEvent& event);
@@ -309,7 +309,7 @@ void CCommandQueue::ProcessDirectoryListing(CDirectoryListingNotification const&
 		}
 	}
 	else {
-		m_state.SetRemoteDir(pListing, listingNotification.Primary());
+		m_state.SetRemoteDir(pListing, listingNotification.Primary(), listingNotification.Delta());
 	}
 
 	if (pListing && !listingNotification.Failed() && m_state.GetSite()) {
@@ -3,6 +3,7 @@
 #include "filezillaapp.h"
 #include "xmlfunctions.h"
 #include "queue.h"
+#include "xml_stream.h"
 #include "xrc_helper.h"
 
 #include "../commonui/ipcmutex.h"
@@ -59,54 +60,51 @@ void CExportDialog::Run()
 		return;
 	}
 
-	CXmlFile xml(dlg.GetPath().ToStdWstring());
-
-	auto exportRoot = xml.CreateEmpty();
-
-	if (sitemanager) {
-		CInterProcessMutex mutex(MUTEX_SITEMANAGER);
-
-		CXmlFile file(wxGetApp().GetSettingsFile(_T("sitemanager")));
-		auto document = file.Load();
-		if (document) {
-			auto element = document.child("Servers");
-			if (element) {
-				exportRoot.append_copy(element);
+	// The queue can be large, so the file is written element by element
+	StreamWithErrorDialog(dlg.GetPath().ToStdWstring(), [&](xml_stream_writer & writer) {
+		if (sitemanager) {
+			CInterProcessMutex mutex(MUTEX_SITEMANAGER);
+
+			CXmlFile file(wxGetApp().GetSettingsFile(_T("sitemanager")));
+			auto document = file.Load();
+			if (document) {
+				auto element = document.child("Servers");
+				if (element) {
+					writer.write_element(element, 1);
+				}
 			}
 		}
-	}
-	if (settings) {
-		COptions::Get()->Save();
-		CInterProcessMutex mutex(MUTEX_OPTIONS);
-		CXmlFile file(wxGetApp().GetSettingsFile(_T("filezilla")));
-		auto document = file.Load();
-		if (document) {
-			auto element = document.child("Settings");
-			if (element) {
-				exportRoot.append_copy(element);
+		if (settings) {
+			COptions::Get()->Save();
+			CInterProcessMutex mutex(MUTEX_OPTIONS);
+			CXmlFile file(wxGetApp().GetSettingsFile(_T("filezilla")));
+			auto document = file.Load();
+			if (document) {
+				auto element = document.child("Settings");
+				if (element) {
+					writer.write_element(element, 1);
+				}
 			}
 		}
-	}
 
-	if (queue) {
-		m_pQueueView->WriteToFile(exportRoot);
-	}
+		if (queue) {
+			m_pQueueView->WriteToFile(writer, 1);
+		}
 
-	if (filters) {
-		CInterProcessMutex mutex(MUTEX_FILTERS);
-		CXmlFile file(wxGetApp().GetSettingsFile(_T("filters")));
-		auto document = file.Load();
-		if (document) {
-			auto element = document.child("Filters");
-			if (element) {
-				exportRoot.append_copy(element);
-			}
-			element = document.child("Sets");
-			if (element) {
-				exportRoot.append_copy(element);
+		if (filters) {
+			CInterProcessMutex mutex(MUTEX_FILTERS);
+			CXmlFile file(wxGetApp().GetSettingsFile(_T("filters")));
+			auto document = file.Load();
+			if (document) {
+				auto element = document.child("Filters");
+				if (element) {
+					writer.write_element(element, 1);
+				}
+				element = document.child("Sets");
+				if (element) {
+					writer.write_element(element, 1);
+				}
 			}
 		}
-	}
-
-	SaveWithErrorDialog(xml);
+	});
 }
@@ -8,7 +8,9 @@
 #include "conditionaldialog.h"
 #include <algorithm>
 #include "filelist_statusbar.h"
+#include "sizeformatting.h"
 #include "themeprovider.h"
+#include "timeformatting.h"
 
 #ifndef __WXMSW__
 #include <wx/mimetype.h>
@@ -254,6 +256,7 @@ static gboolean gtk_button_release_event(GtkWidget*, void *gdk_event, CGtkEventC
 template<class CFileData> CFileListCtrl<CFileData>::CFileListCtrl(wxWindow* pParent, CQueueView* pQueue, COptionsBase & options, bool border)
 	: wxListCtrlEx(pParent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxTAB_TRAVERSAL | wxLC_VIRTUAL | wxLC_REPORT | wxLC_EDIT_LABELS | (border ? wxBORDER_SUNKEN : wxNO_BORDER))
 	, CComparableListing(this)
+	, COptionChangeEventHandler(this)
 	, m_pQueue(pQueue)
 	, options_(options)
 {
@@ -293,6 +296,34 @@ template<class CFileData> CFileListCtrl<CFileData>::CFileListCtrl(wxWindow* pPar
 		evt.Skip();
 	});
 #endif
+
+	options_.watch(OPTION_SIZE_FORMAT, this);
+	options_.watch(OPTION_SIZE_USETHOUSANDSEP, this);
+	options_.watch(OPTION_SIZE_DECIMALPLACES, this);
+	options_.watch(OPTION_DATE_FORMAT, this);
+	options_.watch(OPTION_TIME_FORMAT, this);
+}
+
+template<class CFileData> CFileListCtrl<CFileData>::~CFileListCtrl()
+{
+	options_.unwatch_all(this);
+}
+
+template<class CFileData> wxString const& CFileListCtrl<CFileData>::FormatSize(size_t index, int64_t size)
+{
+	return sizeTexts_.get(index, size, [](int64_t size) { return CSizeFormat::Format(size); });
+}
+
+template<class CFileData> wxString const& CFileListCtrl<CFileData>::FormatTime(size_t index, fz::datetime const& time)
+{
+	return timeTexts_.get(index, time, [](fz::datetime const& time) { return CTimeFormat::Format(time); });
+}
+
+template<class CFileData> void CFileListCtrl<CFileData>::OnOptionsChanged(watched_options const&)
+{
+	sizeTexts_.clear();
+	timeTexts_.clear();
+	Refresh(false);
 }
 
 template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=-1*/, int direction /*=-1*/, bool updateSelections /*=true*/)
@@ -691,17 +722,41 @@ template<class CFileData> void CFileListCtrl<CFileData>::OnExitComparisonMode()
 	RefreshListOnly();
 }
 
-template<class CFileData> void CFileListCtrl<CFileData>::CompareAddFile(t_fileEntryFlags flags)
+template<class CFileData> void CFileListCtrl<CFileData>::SetComparisonResult(std::vector<t_fileEntryFlags> const& flags)
 {
-	if (flags == fill) {
-		m_indexMapping.push_back(m_fileData.size() - 1);
-		return;
-	}
+	m_indexMapping.clear();
+	m_indexMapping.reserve(flags.size());
 
-	int index = m_originalIndexMapping[m_comparisonIndex];
-	m_fileData[index].comparison_flags = flags;
+	unsigned int const fillIndex = m_fileData.size() - 1;
+	size_t next{};
+	for (auto const flag : flags) {
+		if (flag == fill) {
+			m_indexMapping.push_back(fillIndex);
+			continue;
+		}
 
-	m_indexMapping.push_back(index);
+		if (next >= m_originalIndexMapping.size()) {
+			break;
+		}
+		unsigned int const index = m_originalIndexMapping[next++];
+		if (flag == hidden) {
+			m_fileData[index].comparison_flags = normal;
+		}
+		else {
+			m_fileData[index].comparison_flags = flag;
+			m_indexMapping.push_back(index);
+		}
+	}
+}
+
+template<class CFileData> std::wstring_view CFileListCtrl<CFileData>::ComparisonKey(unsigned int index, std::wstring_view const& name, NameSortMode mode)
+{
+	auto & data = m_fileData[index];
+	if (data.sortKey.empty() || data.sortKeyMode != mode) {
+		data.sortKey = CFileListCtrlSortBase::MakeSortKey(name, mode);
+		data.sortKeyMode = mode;
+	}
+	return data.sortKey;
 }
 
 template<class CFileData> void CFileListCtrl<CFileData>::ComparisonRememberSelections()
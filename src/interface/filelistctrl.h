@@ -4,7 +4,10 @@
 #include "listctrlex.h"
 #include "systemimagelist.h"
 #include "listingcomparison.h"
+#include "option_change_event_handler.h"
+#include "text_cache.h"
 
+#include <algorithm>
 #include <cstring>
 #include <deque>
 #include <memory>
@@ -22,6 +25,11 @@ public:
 	std::wstring fileType;
 	int icon{-2};
 
+	// Collation key of the name, see CFileListCtrlSortBase::MakeSortKey.
+	// Built on first use and only valid for the name sort mode it was built for.
+	std::wstring sortKey;
+	NameSortMode sortKeyMode{NameSortMode::case_sensitive};
+
 	// t_fileEntryFlags is defined in listingcomparison.h as it will be used for
 	// both local and remote listings
 	CComparableListing::t_fileEntryFlags comparison_flags{CComparableListing::normal};
@@ -69,9 +77,17 @@ public:
 
 	static int CmpNoCase(std::wstring_view const& str1, std::wstring_view const& str2)
 	{
-		int cmp = fz::stricmp(str1, str2);
-		if (cmp) {
-			return cmp;
+		// Folds the same way as MakeSortKey, so that both yield the same order
+		size_t const len = std::min(str1.size(), str2.size());
+		for (size_t i = 0; i < len; ++i) {
+			wchar_t const c1 = static_cast<wchar_t>(wxTolower(str1[i]));
+			wchar_t const c2 = static_cast<wchar_t>(wxTolower(str2[i]));
+			if (c1 != c2) {
+				return (c1 < c2) ? -1 : 1;
+			}
+		}
+		if (str1.size() != str2.size()) {
+			return (str1.size() < str2.size()) ? -1 : 1;
 		}
 		return str1.compare(str2);
 	}
@@ -139,6 +155,75 @@ public:
 		return res;         //same length, compare first different digit in the sequence*/
 	}
 
+	// Returns a key for the name such that comparing the keys of two names
+	// with std::wstring::compare orders them like the comparison function of
+	// the mode, with names considered equal by CmpNoCase or CmpNatural ordered
+	// by CmpCase. In case-sensitive mode, the key is the name itself.
+	// Sorting large listings that way only folds and parses each name once
+	// instead of in every comparison.
+	//
+	// Like CmpNatural, leading zeroes of otherwise equal numbers only decide
+	// after the character following the number. If a name ends right after
+	// a number, CmpNatural lets the zeroes decide before that, which is not
+	// transitive. The keys then sort the name ending there first.
+	static std::wstring MakeSortKey(std::wstring_view const& name, NameSortMode mode)
+	{
+		if (mode == NameSortMode::case_sensitive) {
+			return std::wstring(name);
+		}
+
+		std::wstring key;
+		key.reserve(name.size() * 2 + 1);
+		if (mode == NameSortMode::natural) {
+			size_t i = 0;
+			while (i < name.size()) {
+				if (!wxIsdigit(name[i])) {
+					key += static_cast<wchar_t>(wxTolower(name[i++]));
+					continue;
+				}
+
+				// A number becomes a digit placeholder, the count of its
+				// significant digits, the digits, the character following
+				// the number and the count of leading zeroes.
+				size_t zeroes = 0;
+				for (; name[i] == '0' && i + 1 < name.size() && wxIsdigit(name[i + 1]); ++i) {
+					++zeroes;
+				}
+				size_t end = i;
+				while (end < name.size() && wxIsdigit(name[end])) {
+					++end;
+				}
+				key += '0';
+				key += static_cast<wchar_t>(1 + end - i);
+				key += name.substr(i, end - i);
+				if (end < name.size()) {
+					key += static_cast<wchar_t>(wxTolower(name[end++]));
+				}
+				key += static_cast<wchar_t>(1 + zeroes);
+				i = end;
+			}
+		}
+		else {
+			for (auto const& c : name) {
+				key += static_cast<wchar_t>(wxTolower(c));
+			}
+		}
+
+		// Names cannot contain null characters, so this sorts
+		// prefixes first and separates the case-sensitive tie-break.
+		key += L'\0';
+		key += name;
+		return key;
+	}
+
+	// Returns the part of a key made by MakeSortKey in case-insensitive or
+	// natural mode that comes before the case-sensitive tie-break. In
+	// natural mode, names that CmpNatural considers equal share it.
+	static std::wstring_view PrimarySortKey(std::wstring_view const& key)
+	{
+		return key.substr(0, key.find(L'\0'));
+	}
+
 	typedef int (* CompareFunction)(std::wstring_view const&, std::wstring_view const&);
 	static CompareFunction GetCmpFunction(NameSortMode mode)
 	{
@@ -175,15 +260,15 @@ inline int DoCmpName(value_type const& data1, value_type const& data2, NameSortM
 	}
 }
 
-template<typename Listing>
+template<typename Listing, typename DataEntry>
 class CFileListCtrlSort : public CFileListCtrlSortBase
 {
 public:
 	typedef Listing List;
 	typedef typename Listing::value_type value_type;
 
-	CFileListCtrlSort(Listing const& listing, DirSortMode dirSortMode, NameSortMode nameSortMode)
-		: m_listing(listing), m_dirSortMode(dirSortMode), m_nameSortMode(nameSortMode)
+	CFileListCtrlSort(Listing const& listing, std::vector<DataEntry>& fileData, DirSortMode dirSortMode, NameSortMode nameSortMode)
+		: m_listing(listing), m_fileData(fileData), m_dirSortMode(dirSortMode), m_nameSortMode(nameSortMode)
 	{
 	}
 
@@ -231,10 +316,15 @@ public:
 		}
 	}
 
-	template<typename value_type>
-	inline int CmpName(value_type const& data1, value_type const& data2) const
+	inline int CmpName(int a, int b) const
 	{
-		return DoCmpName(data1, data2, m_nameSortMode);
+		if (m_nameSortMode != NameSortMode::case_sensitive) {
+			int const res = SortKey(a).compare(SortKey(b));
+			if (res) {
+				return res;
+			}
+		}
+		return DoCmpName(m_listing[a], m_listing[b], m_nameSortMode);
 	}
 
 	inline int CmpSize(const value_type &data1, const value_type &data2) const
@@ -270,7 +360,18 @@ public:
 	}
 
 protected:
+	std::wstring const& SortKey(int index) const
+	{
+		DataEntry & data = m_fileData[index];
+		if (data.sortKey.empty() || data.sortKeyMode != m_nameSortMode) {
+			data.sortKey = MakeSortKey(m_listing[index].name, m_nameSortMode);
+			data.sortKeyMode = m_nameSortMode;
+		}
+		return data.sortKey;
+	}
+
 	Listing const& m_listing;
+	std::vector<DataEntry>& m_fileData;
 
 	DirSortMode const m_dirSortMode;
 	NameSortMode const m_nameSortMode;
@@ -293,11 +394,11 @@ public:
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortName : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortName : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortName(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortName(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -308,16 +409,16 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortSize : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortSize : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortSize(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortSize(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -330,16 +431,16 @@ public:
 
 		CMP(CmpSize, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortType : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortType : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortType(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode), m_pListView(pListView), m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode), m_pListView(pListView)
 	{
 	}
 
@@ -350,8 +451,8 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		DataEntry &type1 = m_fileData[a];
-		DataEntry &type2 = m_fileData[b];
+		DataEntry &type1 = this->m_fileData[a];
+		DataEntry &type2 = this->m_fileData[b];
 		if (type1.fileType.empty()) {
 			type1.fileType = m_pListView->GetType(data1.name, data1.is_dir());
 		}
@@ -361,20 +462,19 @@ public:
 
 		CMP(CmpStringNoCase, type1.fileType, type2.fileType);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 
 protected:
 	CFileListCtrl<DataEntry>* const m_pListView;
-	std::vector<DataEntry>& m_fileData;
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortTime : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortTime : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortTime(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortTime(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -387,16 +487,16 @@ public:
 
 		CMP(CmpTime, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortPermissions : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortPermissions : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortPermissions(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortPermissions(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -409,16 +509,16 @@ public:
 
 		CMP(CmpStringNoCase, *data1.permissions, *data2.permissions);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortOwnerGroup : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortOwnerGroup : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortOwnerGroup(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortOwnerGroup(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -431,17 +531,16 @@ public:
 
 		CMP(CmpStringNoCase, *data1.ownerGroup, *data2.ownerGroup);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortPath : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortPath : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortPath(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
-		, m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -455,18 +554,16 @@ public:
 			return res < 0;
 		}
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
-	std::vector<DataEntry>& m_fileData;
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortNamePath : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortNamePath : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortNamePath(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
-		, m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -476,11 +573,10 @@ public:
 		typename Listing::value_type const& data2 = this->m_listing[b];
 
 		CMP(CmpDir, data1, data2);
-		CMP(CmpName, data1, data2);
+		CMP(CmpName, a, b);
 
 		return data1.path.compare_case(data2.path) < 0;
 	}
-	std::vector<DataEntry>& m_fileData;
 };
 
 namespace genericTypes {
@@ -491,12 +587,12 @@ namespace genericTypes {
 }
 
 class COptionsBase;
-template<class CFileData> class CFileListCtrl : public wxListCtrlEx, public CComparableListing
+template<class CFileData> class CFileListCtrl : public wxListCtrlEx, public CComparableListing, public COptionChangeEventHandler
 {
 	template<typename Listing, typename DataEntry> friend class CFileListCtrlSortType;
 public:
 	CFileListCtrl(wxWindow* pParent, CQueueView *pQueue, COptionsBase & options, bool border = false);
-	virtual ~CFileListCtrl() = default;
+	virtual ~CFileListCtrl();
 
 	void SetFilelistStatusBar(CFilelistStatusBar* pFilelistStatusBar) { m_pFilelistStatusBar = pFilelistStatusBar; }
 	CFilelistStatusBar* GetFilelistStatusBar() { return m_pFilelistStatusBar; }
@@ -535,13 +631,24 @@ protected:
 	// An empty path denotes a virtual file
 	std::wstring GetType(std::wstring const& name, bool dir, std::wstring const& path = std::wstring());
 
+	// Size and time texts of the entries that have been displayed, by index
+	// into m_fileData. Cleared when the formatting options change.
+	wxString const& FormatSize(size_t index, int64_t size);
+	wxString const& FormatTime(size_t index, fz::datetime const& time);
+
+	text_cache<size_t, int64_t, wxString> sizeTexts_;
+	text_cache<size_t, fz::datetime, wxString> timeTexts_;
+
+	virtual void OnOptionsChanged(watched_options const& options) override;
+
 	// Comparison related
 	virtual void ScrollTopItem(int item);
 	virtual void OnPostScroll();
 	virtual void OnExitComparisonMode();
-	virtual void CompareAddFile(t_fileEntryFlags flags);
+	virtual void SetComparisonResult(std::vector<t_fileEntryFlags> const& flags) override;
 
-	int m_comparisonIndex{-1};
+	// Returns the cached sort key of the item with the given index
+	std::wstring_view ComparisonKey(unsigned int index, std::wstring_view const& name, NameSortMode mode);
 
 	// Remembers which non-fill items are selected if enabling/disabling comparison.
 	// Exploit fact that sort order doesn't change -> O(n)
@@ -631,6 +738,45 @@ public:
 	CFileListCtrlSortBase const& p_;
 };
 
+// Sorts the items added to a list on their own and merges them into the
+// sorted index mapping in a single pass. Inserting them one at a time is
+// quadratic. The first skip rows, e.g. the parent directory, stay in front.
+// If addedRows is given, the rows of the added items get appended to it.
+template<typename Compare>
+void MergeAddedItems(std::vector<unsigned int>& indexMapping, size_t skip, std::vector<unsigned int>& added, Compare compare, std::vector<int>* addedRows)
+{
+	std::sort(added.begin(), added.end(), compare);
+
+	auto const start = indexMapping.cbegin() + std::min(skip, indexMapping.size());
+
+	std::vector<unsigned int> merged;
+	merged.reserve(indexMapping.size() + added.size());
+	merged.insert(merged.end(), indexMapping.cbegin(), start);
+
+	if (addedRows) {
+		addedRows->reserve(addedRows->size() + added.size());
+	}
+
+	auto newItem = added.cbegin();
+	auto insertNew = [&]() {
+		if (addedRows) {
+			addedRows->push_back(merged.size());
+		}
+		merged.push_back(*newItem++);
+	};
+	for (auto oldItem = start; oldItem != indexMapping.cend(); ++oldItem) {
+		// Same as std::lower_bound, new items go in front of equal ones
+		while (newItem != added.cend() && !compare(*oldItem, *newItem)) {
+			insertNew();
+		}
+		merged.push_back(*oldItem);
+	}
+	while (newItem != added.cend()) {
+		insertNew();
+	}
+	indexMapping = std::move(merged);
+}
+
 #ifdef FILELISTCTRL_INCLUDE_TEMPLATE_DEFINITION
 #include "filelistctrl.cpp"
 #endif
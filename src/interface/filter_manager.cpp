@@ -18,6 +18,9 @@
 bool CFilterManager::m_loaded = false;
 filter_data CFilterManager::global_filters_;
 bool CFilterManager::m_filters_disabled = false;
+compiled_filters CFilterManager::compiled_local_;
+compiled_filters CFilterManager::compiled_remote_;
+bool CFilterManager::compiled_valid_ = false;
 
 BEGIN_EVENT_TABLE(CFilterDialog, wxDialogEx)
 EVT_BUTTON(XRCID("wxID_OK"), CFilterDialog::OnOkOrApply)
@@ -141,6 +144,7 @@ void CFilterDialog::OnOkOrApply(wxCommandEvent& event)
 	global_filters_.filters = m_filters;
 	global_filters_.filter_sets = m_filterSets;
 	global_filters_.current_filter_set = m_currentFilterSet;
+	compiled_valid_ = false;
 
 	SaveFilters();
 	m_filters_disabled = false;
@@ -488,19 +492,26 @@ bool CFilterManager::FilenameFiltered(std::wstring const& name, std::wstring con
 		return false;
 	}
 
-	CFilterSet const& set = global_filters_.filter_sets[global_filters_.current_filter_set];
-	auto const& active = local ? set.local : set.remote;
+	if (!compiled_valid_) {
+		CFilterSet const& set = global_filters_.filter_sets[global_filters_.current_filter_set];
 
-	// Check active filters
-	for (unsigned int i = 0; i < global_filters_.filters.size(); ++i) {
-		if (active[i]) {
-			if (FilenameFilteredByFilter(global_filters_.filters[i], name, path, dir, size, attributes, date)) {
-				return true;
+		std::vector<CFilter> localFilters;
+		std::vector<CFilter> remoteFilters;
+		for (unsigned int i = 0; i < global_filters_.filters.size(); ++i) {
+			if (set.local[i]) {
+				localFilters.push_back(global_filters_.filters[i]);
+			}
+			if (set.remote[i]) {
+				remoteFilters.push_back(global_filters_.filters[i]);
 			}
 		}
+		compiled_local_ = compiled_filters(localFilters);
+		compiled_remote_ = compiled_filters(remoteFilters);
+		compiled_valid_ = true;
 	}
 
-	return false;
+	auto const& filters = local ? compiled_local_ : compiled_remote_;
+	return filters.filtered(name, path, dir, size, attributes, date);
 }
 
 void CFilterManager::LoadFilters()
@@ -521,6 +532,7 @@ void CFilterManager::LoadFilters()
 	CXmlFile xml(file);
 	auto element = xml.Load();
 	load_filters(element, global_filters_);
+	compiled_valid_ = false;
 
 	if (!element) {
 		wxString msg = xml.GetError() + _T("\n\n") + _("Any changes made to the filters will not be saved.");
@@ -550,6 +562,7 @@ void CFilterManager::Import(pugi::xml_node& element)
 void CFilterManager::LoadFilters(pugi::xml_node& element)
 {
 	load_filters(element, global_filters_);
+	compiled_valid_ = false;
 	if (global_filters_.filter_sets.empty()) {
 		CFilterSet set;
 		set.local.resize(global_filters_.filters.size(), false);
@@ -35,6 +35,12 @@ protected:
 
 	static filter_data global_filters_;
 
+	// The active filters of the current set, prepared for matching.
+	// Rebuilt on first use after the filters have changed.
+	static compiled_filters compiled_local_;
+	static compiled_filters compiled_remote_;
+	static bool compiled_valid_;
+
 	static bool m_filters_disabled;
 };
 
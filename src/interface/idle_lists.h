@@ -0,0 +1,193 @@
+#ifndef FILEZILLA_INTERFACE_IDLE_LISTS_HEADER
+#define FILEZILLA_INTERFACE_IDLE_LISTS_HEADER
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+
+// The idle file items of a server item, from which the scheduler picks the
+// next file to transfer. There is one list per queued or immediate state,
+// per direction and per priority, so finding the next item only needs to
+// look at the fronts of the lists. Active items are not in any list.
+//
+// Items of different lists are picked in the order they have been added.
+// Items remember that order, the accessor gets and sets it and tells the
+// state of an item:
+//   static bool queued(Item const&);
+//   static void set_queued(Item&, bool);
+//   static bool download(Item const&);
+//   static int priority(Item const&);
+//   static uint64_t order(Item const&);
+//   static void set_order(Item&, uint64_t);
+template<typename Item, typename Accessor, int Priorities>
+class idle_lists final
+{
+public:
+	typedef std::deque<Item*> list;
+
+	list& get(Item const& item, int priority)
+	{
+		return lists_[Accessor::queued(item) ? 0 : 1][Accessor::download(item) ? 0 : 1][priority];
+	}
+
+	list const& get(Item const& item, int priority) const
+	{
+		return lists_[Accessor::queued(item) ? 0 : 1][Accessor::download(item) ? 0 : 1][priority];
+	}
+
+	// Assigns the item its place behind all others
+	void add(Item & item, bool idle)
+	{
+		Accessor::set_order(item, next_order_++);
+		if (idle) {
+			get(item, Accessor::priority(item)).push_back(&item);
+		}
+	}
+
+	// An item that had been started became idle again. It keeps its place
+	// ahead of the items that have not been started yet.
+	void add_front(Item & item)
+	{
+		get(item, Accessor::priority(item)).push_front(&item);
+	}
+
+	// Searches from the front or from the back, whichever is expected to be faster
+	bool remove(Item & item, bool forward)
+	{
+		list & l = get(item, Accessor::priority(item));
+		if (forward) {
+			for (auto it = l.begin(); it != l.end(); ++it) {
+				if (*it == &item) {
+					l.erase(it);
+					return true;
+				}
+			}
+		}
+		else {
+			for (auto it = l.rbegin(); it != l.rend(); ++it) {
+				if (*it == &item) {
+					l.erase(std::next(it).base());
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// The item to transfer next, nullptr if there is none
+	Item* front(bool immediate, bool downloads, bool uploads) const
+	{
+		auto const& directions = lists_[immediate ? 1 : 0];
+		for (int i = Priorities - 1; i >= 0; --i) {
+			Item* download = (downloads && !directions[0][i].empty()) ? directions[0][i].front() : nullptr;
+			Item* upload = (uploads && !directions[1][i].empty()) ? directions[1][i].front() : nullptr;
+			if (download && upload) {
+				return Accessor::order(*download) < Accessor::order(*upload) ? download : upload;
+			}
+			if (download) {
+				return download;
+			}
+			if (upload) {
+				return upload;
+			}
+		}
+		return nullptr;
+	}
+
+	// Returns the first of the given item and the ones following it in its
+	// list that matches, looking at no more than lookahead items. If none
+	// matches, returns the given item.
+	template<typename Predicate>
+	Item* find_near(Item & item, size_t lookahead, Predicate const& pred) const
+	{
+		list const& l = get(item, Accessor::priority(item));
+		auto it = std::find(l.begin(), l.end(), &item);
+		for (size_t i = 0; it != l.end() && i < lookahead; ++it, ++i) {
+			if (pred(**it)) {
+				return *it;
+			}
+		}
+		return &item;
+	}
+
+	bool set_priority(Item & item, int oldPriority, int newPriority)
+	{
+		list & oldList = get(item, oldPriority);
+		for (auto it = oldList.begin(); it != oldList.end(); ++it) {
+			if (*it == &item) {
+				oldList.erase(it);
+				get(item, newPriority).push_back(&item);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Moves all items into the lists of the given priority
+	void set_priority(int priority)
+	{
+		for (auto & directions : lists_) {
+			for (auto & priorities : directions) {
+				for (int i = 0; i < Priorities; ++i) {
+					if (i != priority) {
+						std::move(priorities[i].begin(), priorities[i].end(), std::back_inserter(priorities[priority]));
+						priorities[i].clear();
+					}
+				}
+			}
+		}
+	}
+
+	// Immediate items go in front of the queued ones
+	void queue_immediate()
+	{
+		for (int d = 0; d < 2; ++d) {
+			for (int i = 0; i < Priorities; ++i) {
+				list & immediate = lists_[1][d][i];
+				for (auto it = immediate.rbegin(); it != immediate.rend(); ++it) {
+					Accessor::set_queued(**it, true);
+					lists_[0][d][i].push_front(*it);
+				}
+				immediate.clear();
+			}
+		}
+	}
+
+	bool queue_immediate(Item & item)
+	{
+		if (Accessor::queued(item)) {
+			return false;
+		}
+
+		list & immediate = get(item, Accessor::priority(item));
+		for (auto it = immediate.begin(); it != immediate.end(); ++it) {
+			if (*it == &item) {
+				immediate.erase(it);
+				Accessor::set_queued(item, true);
+				get(item, Accessor::priority(item)).push_front(&item);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void clear()
+	{
+		for (auto & directions : lists_) {
+			for (auto & priorities : directions) {
+				for (auto & l : priorities) {
+					l.clear();
+				}
+			}
+		}
+	}
+
+private:
+	// Indexed by immediate, upload and priority
+	list lists_[2][2][Priorities];
+
+	uint64_t next_order_{};
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include "xmlfunctions.h"
 #include "Options.h"
 #include "queue.h"
+#include "xml_stream.h"
 #include "xrc_helper.h"
 
 #include "../commonui/ipcmutex.h"
@@ -35,65 +36,108 @@ void CImportDialog::Run(XmlOptions & options)
 		return;
 	}
 
-	CXmlFile fz3(dlg.GetPath().ToStdWstring());
-	auto fz3Root = fz3.Load();
-	if (fz3Root) {
-		bool settings = fz3Root.child("Settings") != 0;
-		bool queue = fz3Root.child("Queue") != 0;
-		bool sites = fz3Root.child("Servers") != 0;
-		bool filters = fz3Root.child("Filters") != 0;
-
-		if (settings || queue || sites || filters) {
-			if (!Load(m_parent, _T("ID_IMPORT"))) {
-				wxBell();
-				return;
-			}
-			if (!queue) {
-				xrc_call(*this, "ID_QUEUE", &wxCheckBox::Hide);
+	std::wstring const file = dlg.GetPath().ToStdWstring();
+
+	// Only look at the top-level elements here, a file holding a large queue
+	// is never loaded into memory as a whole.
+	xml_stream_reader reader(file);
+	bool validRoot{};
+	bool fromFutureVersion{};
+	reader.read({}, true, [&](pugi::xml_node root) {
+		validRoot = !strcmp(root.name(), "FileZilla3");
+		fromFutureVersion = IsFromFutureVersion(root);
+		return false;
+	});
+
+	bool settings{};
+	bool queue{};
+	bool sites{};
+	bool filters{};
+	if (validRoot) {
+		reader.read({"FileZilla3"}, true, [&](pugi::xml_node element) {
+			std::string_view const name = element.name();
+			if (name == "Settings") {
+				settings = true;
 			}
-			if (!sites) {
-				xrc_call(*this, "ID_SITEMANAGER", &wxCheckBox::Hide);
+			else if (name == "Queue") {
+				queue = true;
 			}
-			if (!settings) {
-				xrc_call(*this, "ID_SETTINGS", &wxCheckBox::Hide);
+			else if (name == "Servers") {
+				sites = true;
 			}
-			if (!filters) {
-				xrc_call(*this, "ID_FILTERS", &wxCheckBox::Hide);
+			else if (name == "Filters") {
+				filters = true;
 			}
-			GetSizer()->Fit(this);
+			return true;
+		});
+	}
+
+	if (settings || queue || sites || filters) {
+		if (!Load(m_parent, _T("ID_IMPORT"))) {
+			wxBell();
+			return;
+		}
+		if (!queue) {
+			xrc_call(*this, "ID_QUEUE", &wxCheckBox::Hide);
+		}
+		if (!sites) {
+			xrc_call(*this, "ID_SITEMANAGER", &wxCheckBox::Hide);
+		}
+		if (!settings) {
+			xrc_call(*this, "ID_SETTINGS", &wxCheckBox::Hide);
+		}
+		if (!filters) {
+			xrc_call(*this, "ID_FILTERS", &wxCheckBox::Hide);
+		}
+		GetSizer()->Fit(this);
+
+		if (ShowModal() != wxID_OK) {
+			return;
+		}
 
-			if (ShowModal() != wxID_OK) {
+		if (fromFutureVersion) {
+			wxString msg = wxString::Format(_("The file '%s' has been created by a more recent version of FileZilla.\nLoading files created by newer versions can result in loss of data.\nDo you want to continue?"), file);
+			if (wxMessageBoxEx(msg, _("Detected newer version of FileZilla"), wxICON_QUESTION | wxYES_NO) != wxYES) {
 				return;
 			}
+		}
 
-			if (fz3.IsFromFutureVersion()) {
-				wxString msg = wxString::Format(_("The file '%s' has been created by a more recent version of FileZilla.\nLoading files created by newer versions can result in loss of data.\nDo you want to continue?"), fz3.GetFileName());
-				if (wxMessageBoxEx(msg, _("Detected newer version of FileZilla"), wxICON_QUESTION | wxYES_NO) != wxYES) {
-					return;
-				}
+		sites = sites && xrc_call(*this, "ID_SITEMANAGER", &wxCheckBox::IsChecked);
+		settings = settings && xrc_call(*this, "ID_SETTINGS", &wxCheckBox::IsChecked);
+		filters = filters && xrc_call(*this, "ID_FILTERS", &wxCheckBox::IsChecked);
+
+		if (queue && xrc_call(*this, "ID_QUEUE", &wxCheckBox::IsChecked)) {
+			if (!m_pQueueView->ImportQueue(reader)) {
+				wxMessageBoxEx(_("The queue could not be imported completely:") + _T("\n") + reader.error(), _("Error importing"), wxICON_ERROR, m_parent);
+				return;
 			}
+		}
 
-			if (queue && xrc_call(*this, "ID_QUEUE", &wxCheckBox::IsChecked)) {
-				m_pQueueView->ImportQueue(fz3Root.child("Queue"), true);
+		if (sites || settings || filters) {
+			CXmlFile fz3(file);
+			auto fz3Root = fz3.Load();
+			if (!fz3Root) {
+				wxMessageBoxEx(fz3.GetError(), _("Error importing"), wxICON_ERROR, m_parent);
+				return;
 			}
 
-			if (sites && xrc_call(*this, "ID_SITEMANAGER", &wxCheckBox::IsChecked)) {
+			if (sites) {
 				CSiteManager::ImportSites(fz3Root.child("Servers"));
 			}
 
-			if (settings && xrc_call(*this, "ID_SETTINGS", &wxCheckBox::IsChecked)) {
+			if (settings) {
 				auto settings = fz3Root.child("Settings");
 				options.Import(settings);
 				wxMessageBoxEx(_("The settings have been imported. You have to restart FileZilla for all settings to have effect."), _("Import successful"), wxOK, this);
 			}
 
-			if (filters && xrc_call(*this, "ID_FILTERS", &wxCheckBox::IsChecked)) {
+			if (filters) {
 				CFilterManager::Import(fz3Root);
 			}
-
-			wxMessageBoxEx(_("The selected categories have been imported."), _("Import successful"), wxOK, this);
-			return;
 		}
+
+		wxMessageBoxEx(_("The selected categories have been imported."), _("Import successful"), wxOK, this);
+		return;
 	}
 
 	wxMessageBoxEx(_("File does not contain any importable data."), _("Error importing"), wxICON_ERROR, m_parent);
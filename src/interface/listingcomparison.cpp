@@ -94,42 +94,74 @@ bool CComparisonManager::CompareListings()
 	m_pLeft->StartComparison();
 	m_pRight->StartComparison();
 
-	std::wstring localPath, remotePath;
-	std::wstring_view localFile, remoteFile;
-	bool localDir = false;
-	bool remoteDir = false;
-	int64_t localSize, remoteSize;
-	fz::datetime localDate, remoteDate;
-
 	int const dirSortMode = options_.get_int(OPTION_FILELIST_DIRSORT);
 	auto const nameSortMode = static_cast<NameSortMode>(options_.get_int(OPTION_FILELIST_NAMESORT));
 
-	bool gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-	bool gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+	// Building the sort keys is the expensive part, prepare one side on a worker
+	std::vector<CComparableListing::comparison_entry> local, remote;
+	{
+		auto task = m_state.pool_.spawn([&] { m_pLeft->get_comparison_entries(nameSortMode, local); });
+		m_pRight->get_comparison_entries(nameSortMode, remote);
+		if (task) {
+			task.join();
+		}
+		else {
+			m_pLeft->get_comparison_entries(nameSortMode, local);
+		}
+	}
+
+	if (nameSortMode == NameSortMode::natural) {
+		// CmpNatural ignores case, names that only differ in case are
+		// compared with each other. Both sides are sorted by the full
+		// keys, which keeps such names next to each other.
+		for (auto* entries : {&local, &remote}) {
+			for (auto & entry : *entries) {
+				entry.key = CFileListCtrlSortBase::PrimarySortKey(entry.key);
+				entry.pathKey.resize(CFileListCtrlSortBase::PrimarySortKey(entry.pathKey).size());
+			}
+		}
+	}
+
+	std::vector<CComparableListing::t_fileEntryFlags> localFlags, remoteFlags;
+	localFlags.reserve(local.size() + remote.size());
+	remoteFlags.reserve(local.size() + remote.size());
+
+	auto add = [&](CComparableListing::t_fileEntryFlags localFlag, CComparableListing::t_fileEntryFlags remoteFlag) {
+		localFlags.push_back(localFlag);
+		remoteFlags.push_back(remoteFlag);
+	};
 
-	while (gotLocal && gotRemote) {
-		int cmp = CompareFiles(dirSortMode, nameSortMode, localPath, localFile, remotePath, remoteFile, localDir, remoteDir);
+	size_t l{};
+	size_t r{};
+	while (l < local.size() && r < remote.size()) {
+		auto const& localEntry = local[l];
+		auto const& remoteEntry = remote[r];
+
+		int cmp = CompareFiles(dirSortMode, localEntry, remoteEntry);
 		if (!cmp) {
 			if (!m_comparisonMode) {
-				const CComparableListing::t_fileEntryFlags flag = (localDir || localSize == remoteSize) ? CComparableListing::normal : CComparableListing::different;
+				const CComparableListing::t_fileEntryFlags flag = (localEntry.dir || localEntry.size == remoteEntry.size) ? CComparableListing::normal : CComparableListing::different;
 
-				if (!m_hideIdentical || flag != CComparableListing::normal || localFile == L"..") {
-					m_pLeft->CompareAddFile(flag);
-					m_pRight->CompareAddFile(flag);
+				if (!m_hideIdentical || flag != CComparableListing::normal || localEntry.parent) {
+					add(flag, flag);
+				}
+				else {
+					add(CComparableListing::hidden, CComparableListing::hidden);
 				}
 			}
 			else {
-				if (localDate.empty() || remoteDate.empty()) {
-					if (!m_hideIdentical || !localDate.empty() || !remoteDate.empty() || localFile == L"..") {
-						const CComparableListing::t_fileEntryFlags flag = CComparableListing::normal;
-						m_pLeft->CompareAddFile(flag);
-						m_pRight->CompareAddFile(flag);
+				if (localEntry.date.empty() || remoteEntry.date.empty()) {
+					if (!m_hideIdentical || !localEntry.date.empty() || !remoteEntry.date.empty() || localEntry.parent) {
+						add(CComparableListing::normal, CComparableListing::normal);
+					}
+					else {
+						add(CComparableListing::hidden, CComparableListing::hidden);
 					}
 				}
 				else {
 					CComparableListing::t_fileEntryFlags localFlag, remoteFlag;
 
-					int const dateCmp = CompareWithThreshold(localDate, remoteDate, threshold);
+					int const dateCmp = CompareWithThreshold(localEntry.date, remoteEntry.date, threshold);
 
 					localFlag = CComparableListing::normal;
 					remoteFlag = CComparableListing::normal;
@@ -139,56 +171,55 @@ bool CComparisonManager::CompareListings()
 					else if (dateCmp > 0) {
 						localFlag = CComparableListing::newer;
 					}
-					if (!m_hideIdentical || localFlag != CComparableListing::normal || remoteFlag != CComparableListing::normal || localFile == L"..") {
-						m_pLeft->CompareAddFile(localFlag);
-						m_pRight->CompareAddFile(remoteFlag);
+					if (!m_hideIdentical || localFlag != CComparableListing::normal || remoteFlag != CComparableListing::normal || localEntry.parent) {
+						add(localFlag, remoteFlag);
+					}
+					else {
+						add(CComparableListing::hidden, CComparableListing::hidden);
 					}
 				}
 			}
-			gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-			gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+			++l;
+			++r;
 			continue;
 		}
 
 		if (cmp < 0) {
-			m_pLeft->CompareAddFile(CComparableListing::lonely);
-			m_pRight->CompareAddFile(CComparableListing::fill);
-			gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
+			add(CComparableListing::lonely, CComparableListing::fill);
+			++l;
 		}
 		else {
-			m_pLeft->CompareAddFile(CComparableListing::fill);
-			m_pRight->CompareAddFile(CComparableListing::lonely);
-			gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+			add(CComparableListing::fill, CComparableListing::lonely);
+			++r;
 		}
 	}
-	while (gotLocal) {
-		m_pLeft->CompareAddFile(CComparableListing::lonely);
-		m_pRight->CompareAddFile(CComparableListing::fill);
-		gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
+	for (; l < local.size(); ++l) {
+		add(CComparableListing::lonely, CComparableListing::fill);
 	}
-	while (gotRemote) {
-		m_pLeft->CompareAddFile(CComparableListing::fill);
-		m_pRight->CompareAddFile(CComparableListing::lonely);
-		gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+	for (; r < remote.size(); ++r) {
+		add(CComparableListing::fill, CComparableListing::lonely);
 	}
 
+	m_pLeft->SetComparisonResult(localFlags);
+	m_pRight->SetComparisonResult(remoteFlags);
+
 	m_pRight->FinishComparison();
 	m_pLeft->FinishComparison();
 
 	return true;
 }
 
-int CComparisonManager::CompareFiles(int const dirSortMode, NameSortMode const nameSortMode, std::wstring_view const& local_path, std::wstring_view const& local, std::wstring_view const& remote_path, std::wstring_view const& remote, bool localDir, bool remoteDir)
+int CComparisonManager::CompareFiles(int const dirSortMode, CComparableListing::comparison_entry const& local, CComparableListing::comparison_entry const& remote)
 {
 	switch (dirSortMode)
 	{
 	default:
-		if (localDir) {
-			if (!remoteDir) {
+		if (local.dir) {
+			if (!remote.dir) {
 				return -1;
 			}
 		}
-		else if (remoteDir) {
+		else if (remote.dir) {
 			return 1;
 		}
 		break;
@@ -197,10 +228,9 @@ int CComparisonManager::CompareFiles(int const dirSortMode, NameSortMode const n
 		break;
 	}
 
-	auto const f = CFileListCtrlSortBase::GetCmpFunction(nameSortMode);
-	auto cmp = f(local, remote);
+	auto cmp = local.key.compare(remote.key);
 	if (!cmp) {
-		return f(local_path, remote_path);
+		return local.pathKey.compare(remote.pathKey);
 	}
 	return cmp;
 }
@@ -22,6 +22,7 @@ public:
 
 	enum t_fileEntryFlags
 	{
+		hidden = 0,
 		normal = 1,
 		fill = 2,
 		different = 4,
@@ -29,10 +30,28 @@ public:
 		lonely = 16
 	};
 
+	// An entry of a listing as it takes part in the comparison
+	struct comparison_entry final
+	{
+		std::wstring_view key; // See CFileListCtrlSortBase::MakeSortKey
+		std::wstring pathKey; // Only set if entries can be in subdirectories
+		fz::datetime date;
+		int64_t size{-1};
+		bool dir{};
+		bool parent{};
+	};
+
 	virtual bool CanStartComparison() = 0;
 	virtual void StartComparison() = 0;
-	virtual bool get_next_file(std::wstring_view & name, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) = 0;
-	virtual void CompareAddFile(t_fileEntryFlags flags) = 0;
+
+	// Returns the entries in the order they are shown, with the sort keys of their names.
+	// Gets called outside the GUI thread, must not touch the control itself.
+	virtual void get_comparison_entries(NameSortMode mode, std::vector<comparison_entry> & entries) = 0;
+
+	// Displays the result of the comparison. One flag per entry passed
+	// to get_comparison_entries, in order, or fill for each filler row.
+	// Entries flagged as hidden are not displayed.
+	virtual void SetComparisonResult(std::vector<t_fileEntryFlags> const& flags) = 0;
 	virtual void FinishComparison() = 0;
 	virtual void ScrollTopItem(int item) = 0;
 	virtual void OnExitComparisonMode() = 0;
@@ -77,7 +96,7 @@ public:
 	void SetHideIdentical(bool hideIdentical) { m_hideIdentical = hideIdentical; }
 
 protected:
-	int CompareFiles(int const dirSortMode, NameSortMode const nameSortMode, std::wstring_view const& local_path, std::wstring_view const& local, std::wstring_view const& remote_path, std::wstring_view const& remote, bool localDir, bool remoteDir);
+	int CompareFiles(int const dirSortMode, CComparableListing::comparison_entry const& local, CComparableListing::comparison_entry const& remote);
 
 	CState& m_state;
 	COptionsBase & options_;
@@ -113,6 +113,7 @@ CMenuBar::CMenuBar(CMainFrame& mainFrame, COptions& options)
 	transfer->AppendSeparator();
 	accel.FromString(L"CTRL+M");
 	transfer->Append(XRCID("ID_MENU_TRANSFER_MANUAL"), _("&Manual transfer..."))->SetAccel(&accel);
+	transfer->Append(XRCID("ID_MENU_TRANSFER_SYNCHRONIZE"), _("S&ynchronize remote directory..."), _("Uploads the local files that are missing or outdated on the server"));
 
 	wxMenu* server = new wxMenu;
 	Append(server, _("&Server"));
@@ -7,6 +7,8 @@
 #include "sizeformatting.h"
 #include "timeformatting.h"
 #include "themeprovider.h"
+#include "xml_stream.h"
+#include "xmlfunctions.h"
 
 #include <wx/filedlg.h>
 
@@ -34,18 +36,27 @@ void CQueueItem::AddChild(CQueueItem* item)
 	wxASSERT(GetType() != QueueItemType::Folder);
 	wxASSERT(GetType() != QueueItemType::Status);
 
+	bool const server = GetType() == QueueItemType::Server;
 	if (m_removed_at_front) {
 		m_children.erase(m_children.begin(), m_children.begin() + m_removed_at_front);
 		m_removed_at_front = 0;
+		if (server) {
+			static_cast<CServerItem*>(this)->m_rowIndex.invalidate();
+		}
 	}
 	m_children.push_back(item);
+	if (server) {
+		static_cast<CServerItem*>(this)->m_rowIndex.push_back(*item);
+	}
 
+	CQueueItem* child = this;
 	CQueueItem* parent = GetParent();
 	while (parent) {
 		if (parent->GetType() == QueueItemType::Server) {
 			static_cast<CServerItem*>(parent)->m_visibleOffspring += 1 + item->GetChildrenCount(true);
-			static_cast<CServerItem*>(parent)->m_maxCachedIndex = -1;
+			static_cast<CServerItem*>(parent)->m_rowIndex.add(child->m_slot, 1 + item->GetChildrenCount(true));
 		}
+		child = parent;
 		parent = parent->GetParent();
 	}
 }
@@ -99,6 +110,8 @@ bool CQueueItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 
 	bool deleted = false;
 
+	CServerItem* const server = (GetType() == QueueItemType::Server) ? static_cast<CServerItem*>(this) : nullptr;
+
 	auto doRemove = [&](std::vector<CQueueItem*>::iterator iter) {
 		if (*iter == pItem) {
 			visibleOffspring -= 1;
@@ -113,9 +126,15 @@ bool CQueueItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 				for (int i = end; i >= m_removed_at_front; --i) {
 					m_children[i] = m_children[i - 1];
 				}
+				if (server) {
+					server->m_rowIndex.update(m_children, m_removed_at_front, m_removed_at_front - 1, end);
+				}
 			}
 			else {
 				m_children.erase(iter);
+				if (server) {
+					server->m_rowIndex.invalidate();
+				}
 			}
 
 			deleted = true;
@@ -135,11 +154,21 @@ bool CQueueItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 					for (int i = end; i >= m_removed_at_front; --i) {
 						m_children[i] = m_children[i - 1];
 					}
+					if (server) {
+						server->m_rowIndex.update(m_children, m_removed_at_front, m_removed_at_front - 1, end);
+					}
 				}
 				else {
 					m_children.erase(iter);
+					if (server) {
+						server->m_rowIndex.invalidate();
+					}
 				}
 			}
+			else if (server) {
+				size_t const slot = iter - m_children.begin();
+				server->m_rowIndex.update(m_children, m_removed_at_front, slot, slot);
+			}
 
 			deleted = true;
 		}
@@ -171,12 +200,14 @@ bool CQueueItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 	}
 
 	// Propagate new children count to parent
+	CQueueItem* child = this;
 	CQueueItem* parent = GetParent();
 	while (parent) {
 		if (parent->GetType() == QueueItemType::Server) {
-			static_cast<CServerItem*>(parent)->m_maxCachedIndex = -1;
+			static_cast<CServerItem*>(parent)->m_rowIndex.add(child->m_slot, visibleOffspring - oldVisibleOffspring);
 			static_cast<CServerItem*>(parent)->m_visibleOffspring -= oldVisibleOffspring - visibleOffspring;
 		}
+		child = parent;
 		parent = parent->GetParent();
 	}
 
@@ -222,6 +253,11 @@ int CQueueItem::GetItemIndex() const
 		return 0;
 	}
 
+	if (pParent->GetType() == QueueItemType::Server) {
+		// Sorting or removals may have left the slot stale, the index refreshes it
+		return 1 + static_cast<CServerItem const*>(pParent)->m_rowIndex.index_of(pParent->m_children, pParent->m_removed_at_front, *this);
+	}
+
 	int index = 1;
 	for (std::vector<CQueueItem*>::const_iterator iter = pParent->m_children.begin() + pParent->m_removed_at_front; iter != pParent->m_children.end(); ++iter) {
 		if (*iter == this) {
@@ -279,16 +315,46 @@ void CFileItem::SetActive(const bool active)
 {
 	if (active && !IsActive()) {
 		wxASSERT(!GetChildrenCount(false));
+		if (m_parent) {
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, true);
+		}
 		AddChild(new CStatusItem);
 		flags_ |= queue_flags::active;
 	}
 	else if (!active && IsActive()) {
 		CQueueItem* pItem = GetChild(0, false);
-		RemoveChild(pItem);
+		if (pItem) {
+			RemoveChild(pItem);
+		}
 		flags_ -= queue_flags::active;
+		if (m_parent) {
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, false);
+		}
 	}
 }
 
+bool CFileItem::IsSmall() const
+{
+	if (GetType() == QueueItemType::Folder) {
+		return true;
+	}
+
+	// Files of unknown size are treated as large
+	return m_size >= 0 && m_size < 1024 * 1024;
+}
+
+void CFileItem::SetBatchActive()
+{
+	if (IsActive()) {
+		return;
+	}
+
+	if (m_parent) {
+		static_cast<CServerItem*>(m_parent)->SetChildActive(this, true);
+	}
+	flags_ |= queue_flags::active;
+}
+
 void CFileItem::SaveItem(pugi::xml_node& element) const
 {
 	if (m_edit != CEditHandler::none || !element) {
@@ -435,11 +501,21 @@ void CFolderItem::SaveItem(pugi::xml_node& element) const
 
 void CFolderItem::SetActive(bool const active)
 {
+	if (active == IsActive()) {
+		return;
+	}
+
 	if (active) {
+		if (m_parent) {
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, true);
+		}
 		flags_ |= queue_flags::active;
 	}
 	else {
 		flags_ -= queue_flags::active;
+		if (m_parent) {
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, false);
+		}
 	}
 }
 
@@ -461,7 +537,6 @@ wxString CServerItem::GetName() const
 void CServerItem::AddChild(CQueueItem* pItem)
 {
 	CQueueItem::AddChild(pItem);
-	m_maxCachedIndex = -1;
 	m_visibleOffspring += 1 + pItem->GetChildrenCount(true);
 	if (pItem->GetType() == QueueItemType::File ||
 		pItem->GetType() == QueueItemType::Folder)
@@ -486,29 +561,19 @@ void CServerItem::AddFileItemToList(CFileItem* pItem)
 		return;
 	}
 
-	m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())].push_back(pItem);
+	m_idleLists.add(*pItem, !pItem->IsActive());
 }
 
 void CServerItem::RemoveFileItemFromList(CFileItem* pItem, bool forward)
 {
-	std::deque<CFileItem*>& fileList = m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())];
-	if (forward) {
-		for (auto iter = fileList.begin(); iter != fileList.end(); ++iter) {
-			if (*iter == pItem) {
-				fileList.erase(iter);
-				return;
-			}
-		}
+	// Active items are not in the lists
+	if (pItem->IsActive()) {
+		return;
 	}
-	else {
-		for (auto iter = fileList.rbegin(); iter != fileList.rend(); ++iter) {
-			if (*iter == pItem) {
-				fileList.erase(iter.base() - 1);
-				return;
-			}
-		}
+
+	if (!m_idleLists.remove(*pItem, forward)) {
+		wxFAIL_MSG(_T("File item not deleted from m_idleLists"));
 	}
-	wxFAIL_MSG(_T("File item not deleted from m_fileList"));
 }
 
 void CServerItem::SetDefaultFileExistsAction(CFileExistsNotification::OverwriteAction action, const TransferDirection direction)
@@ -578,120 +643,101 @@ void CServerItem::Sort(int col, bool reverse)
 
 	std::stable_sort(m_children.begin() + m_removed_at_front, m_children.end(), fn);
 
-	m_lookupCache.clear();
-	m_maxCachedIndex = -1;
+	m_rowIndex.invalidate();
 
-	// Rebuild m_fileList
-	for (size_t i = 0; i < static_cast<size_t>(QueuePriority::count); ++i) {
-		m_fileList[0][i].clear();
-		m_fileList[1][i].clear();
-	}
+	RebuildFileLists();
+}
+
+void CServerItem::RebuildFileLists()
+{
+	m_idleLists.clear();
 
 	for (auto it = m_children.cbegin() + m_removed_at_front; it != m_children.cend(); ++it) {
-		CFileItem *pItem = static_cast<CFileItem*>(*it);
-		m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())].push_back(pItem);
+		AddFileItemToList(static_cast<CFileItem*>(*it));
 	}
 }
 
 CQueueItem* CServerItem::GetChild(unsigned int item, bool recursive)
 {
-	std::vector<CQueueItem*>::iterator iter;
 	if (!recursive) {
 		if (item + m_removed_at_front >= m_children.size()) {
 			return 0;
 		}
-		iter = m_children.begin();
-		iter += item + m_removed_at_front;
-		return *iter;
+		return m_children[item + m_removed_at_front];
 	}
 
-	if ((int)item <= m_maxCachedIndex) {
-		// Index is cached
-		iter = m_children.begin() + m_removed_at_front;
-		iter += m_lookupCache[item].child;
-		item -= m_lookupCache[item].index;
-		if (!item) {
-			return *iter;
-		}
-		else {
-			return (*iter)->GetChild(item - 1);
-		}
+	if (static_cast<int>(item) >= m_visibleOffspring) {
+		return 0;
 	}
 
-	int index;
-	int child;
-	iter = m_children.begin() + m_removed_at_front;
-	if (m_maxCachedIndex == -1) {
-		child = 0;
-		index = 0;
-	}
-	else {
-		// Start with loop with the last cached item index
-		iter += m_lookupCache[m_maxCachedIndex].child + 1;
-		item -= m_maxCachedIndex + 1;
-		index = m_maxCachedIndex + 1;
-		child = m_lookupCache[m_maxCachedIndex].child + 1;
+	int row = static_cast<int>(item);
+	size_t const slot = m_rowIndex.find(m_children, m_removed_at_front, row);
+	if (slot >= m_children.size()) {
+		return 0;
 	}
 
-	for (; iter != m_children.end(); ++iter, ++child) {
-		if (!item) {
-			return *iter;
-		}
-
-		unsigned int count = (*iter)->GetChildrenCount(true);
-		if (item > count) {
-			if (m_maxCachedIndex == -1 && m_lookupCache.size() < (unsigned int)m_visibleOffspring)
-				m_lookupCache.resize(m_visibleOffspring);
-			for (unsigned int k = index; k <= index + count; ++k) {
-				m_lookupCache[k].child = child;
-				m_lookupCache[k].index = index;
-			}
-			m_maxCachedIndex = index + count;
-			item -= count + 1;
-			index += count + 1;
-			continue;
-		}
-
-		return (*iter)->GetChild(item - 1);
+	CQueueItem* child = m_children[slot];
+	if (!row) {
+		return child;
 	}
-	return 0;
+	return child->GetChild(row - 1);
 }
 
 namespace {
-CFileItem* DoGetIdleChild(std::deque<CFileItem*> const* fileList, TransferDirection direction)
-{
-	int i = 0;
-	for (i = static_cast<int>(QueuePriority::count) - 1; i >= 0; --i) {
-		for (auto const& item : fileList[i]) {
-			if (item->IsActive()) {
-				continue;
-			}
+// How far GetIdleChild looks for a file of the preferred size class
+size_t const size_lookahead = 100;
+}
 
-			if (direction == TransferDirection::both) {
-				return item;
-			}
+CFileItem* CServerItem::GetIdleChild(bool immediateOnly, TransferDirection direction, TransferSize preferredSize)
+{
+	bool const downloads = direction != TransferDirection::upload;
+	bool const uploads = direction != TransferDirection::download;
+	CFileItem* item = m_idleLists.front(true, downloads, uploads);
+	if ( !item && !immediateOnly ) {
+		item = m_idleLists.front(false, downloads, uploads);
+	}
 
-			if (direction == TransferDirection::download) {
-				if (item->Download()) {
-					return item;
-				}
-			}
-			else if (!item->Download()) {
-				return item;
-			}
-		}
+	if (item && preferredSize != TransferSize::any) {
+		// Only look a bit ahead, this keeps the order mostly intact
+		bool const small = preferredSize == TransferSize::small;
+		item = m_idleLists.find_near(*item, size_lookahead, [small](CFileItem const& i) { return i.IsSmall() == small; });
 	}
-	return 0;
+
+	return item;
 }
+
+int CServerItem::GetIdlePriority(bool immediateOnly, TransferDirection direction) const
+{
+	bool const downloads = direction != TransferDirection::upload;
+	bool const uploads = direction != TransferDirection::download;
+	CFileItem const* item = m_idleLists.front(true, downloads, uploads);
+	if (!item && !immediateOnly) {
+		item = m_idleLists.front(false, downloads, uploads);
+	}
+	return item ? static_cast<int>(item->GetPriority()) : -1;
 }
 
-CFileItem* CServerItem::GetIdleChild(bool immediateOnly, TransferDirection direction)
+std::vector<CFileItem*> CServerItem::GetIdleSiblings(CFileItem const& item, size_t max, std::function<bool(CFileItem const&)> const& pred)
 {
-	CFileItem* item = DoGetIdleChild(m_fileList[1], direction);
-	if ( !item && !immediateOnly ) {
-		item = DoGetIdleChild(m_fileList[0], direction);
+	std::vector<CFileItem*> ret;
+	if (item.IsActive()) {
+		return ret;
 	}
-	return item;
+
+	auto const& fileList = m_idleLists.get(item, static_cast<int>(item.GetPriority()));
+	auto it = std::find(fileList.cbegin(), fileList.cend(), &item);
+	if (it == fileList.cend()) {
+		return ret;
+	}
+
+	for (++it; it != fileList.cend() && ret.size() < max; ++it) {
+		if (!pred(**it)) {
+			break;
+		}
+		ret.push_back(*it);
+	}
+
+	return ret;
 }
 
 bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
@@ -706,9 +752,6 @@ bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 	}
 
 	bool removed = CQueueItem::RemoveChild(pItem, destroy, forward);
-	if (removed) {
-		m_maxCachedIndex = -1;
-	}
 
 	wxASSERT(m_visibleOffspring >= static_cast<int>(m_children.size()) - m_removed_at_front);
 	wxASSERT(((m_children.size() - m_removed_at_front) != 0) == (m_visibleOffspring != 0));
@@ -718,22 +761,8 @@ bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 
 void CServerItem::QueueImmediateFiles()
 {
-	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
-		std::deque<CFileItem*> activeList;
-		std::deque<CFileItem*>& fileList = m_fileList[1][i];
-		for (auto iter = fileList.rbegin(); iter != fileList.rend(); ++iter) {
-			CFileItem* item = *iter;
-			wxASSERT(!item->queued());
-			if (item->IsActive()) {
-				activeList.push_front(item);
-			}
-			else {
-				item->set_queued(true);
-				m_fileList[0][i].push_front(item);
-			}
-		}
-		std::swap(fileList, activeList);
-	}
+	// Active items stay immediate
+	m_idleLists.queue_immediate();
 }
 
 void CServerItem::QueueImmediateFile(CFileItem* pItem)
@@ -742,18 +771,15 @@ void CServerItem::QueueImmediateFile(CFileItem* pItem)
 		return;
 	}
 
-	std::deque<CFileItem*>& fileList = m_fileList[1][static_cast<int>(pItem->GetPriority())];
-	for (auto iter = fileList.begin(); iter != fileList.end(); ++iter) {
-		if (*iter != pItem) {
-			continue;
-		}
-
+	if (pItem->IsActive()) {
+		// Goes into the queued list once idle again
 		pItem->set_queued(true);
-		fileList.erase(iter);
-		m_fileList[0][static_cast<int>(pItem->GetPriority())].push_front(pItem);
 		return;
 	}
-	wxASSERT(false);
+
+	if (!m_idleLists.queue_immediate(*pItem)) {
+		wxFAIL;
+	}
 }
 
 void CServerItem::SaveItem(pugi::xml_node& element) const
@@ -769,30 +795,51 @@ void CServerItem::SaveItem(pugi::xml_node& element) const
 int64_t CServerItem::GetTotalSize(int& filesWithUnknownSize, int& queuedFiles) const
 {
 	int64_t totalSize = 0;
-	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
-		for (int j = 0; j < 2; ++j) {
-			const std::deque<CFileItem*>& fileList = m_fileList[j][i];
-			for (auto const& item : fileList) {
-				int64_t size = item->GetSize();
-				if (size >= 0) {
-					totalSize += size;
-				}
-				else {
-					filesWithUnknownSize++;
-				}
-			}
-		}
-	}
-
 	for (std::vector<CQueueItem*>::const_iterator iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter) {
 		if ((*iter)->GetType() == QueueItemType::File ||
 			(*iter)->GetType() == QueueItemType::Folder)
+		{
 			queuedFiles++;
+
+			int64_t size = static_cast<CFileItem const*>(*iter)->GetSize();
+			if (size >= 0) {
+				totalSize += size;
+			}
+			else {
+				filesWithUnknownSize++;
+			}
+		}
 	}
 
+	totalSize += m_deferredSize;
+	filesWithUnknownSize += static_cast<int>(m_deferredUnknownSizes);
+	queuedFiles += static_cast<int>(m_deferredCount);
+
 	return totalSize;
 }
 
+void CServerItem::AddDeferred(int64_t count, int64_t size, int64_t unknownSizes)
+{
+	m_deferredCount += count;
+	m_deferredSize += size;
+	m_deferredUnknownSizes += unknownSizes;
+}
+
+void CServerItem::RemoveDeferred(int64_t count, int64_t size, int64_t unknownSizes)
+{
+	wxASSERT(m_deferredCount >= count);
+	m_deferredCount -= count;
+	m_deferredSize -= size;
+	m_deferredUnknownSizes -= unknownSizes;
+}
+
+void CServerItem::ClearDeferred()
+{
+	m_deferredCount = 0;
+	m_deferredSize = 0;
+	m_deferredUnknownSizes = 0;
+}
+
 bool CServerItem::TryRemoveAll()
 {
 	wxASSERT(!GetParent());
@@ -819,7 +866,7 @@ bool CServerItem::TryRemoveAll()
 	std::swap(m_children, keepChildren);
 	m_removed_at_front = 0;
 
-	m_maxCachedIndex = -1;
+	m_rowIndex.invalidate();
 
 	wxASSERT(oldVisibleOffspring >= m_visibleOffspring);
 	wxASSERT(m_visibleOffspring >= static_cast<int>(m_children.size()));
@@ -834,14 +881,33 @@ void CServerItem::DetachChildren()
 
 	m_children.clear();
 	m_visibleOffspring = 0;
-	m_maxCachedIndex = -1;
+	m_rowIndex.invalidate();
 	m_removed_at_front = 0;
 
-	for (int i = 0; i < 2; ++i) {
-		for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
-			m_fileList[i][j].clear();
-		}
+	m_idleLists.clear();
+}
+
+std::vector<CQueueItem*> CServerItem::DetachTail(unsigned int first)
+{
+	std::vector<CQueueItem*> tail;
+	if (first >= GetChildrenCount(false)) {
+		return tail;
+	}
+
+	auto const begin = m_children.begin() + m_removed_at_front + first;
+	tail.assign(begin, m_children.end());
+	m_children.erase(begin, m_children.end());
+
+	for (auto const* item : tail) {
+		wxASSERT(!static_cast<CFileItem const*>(item)->IsActive());
+		m_visibleOffspring -= 1 + item->GetChildrenCount(true);
 	}
+	m_rowIndex.invalidate();
+
+	// Removing each item from its list would be quadratic
+	RebuildFileLists();
+
+	return tail;
 }
 
 void CServerItem::SetPriority(QueuePriority priority)
@@ -856,30 +922,29 @@ void CServerItem::SetPriority(QueuePriority priority)
 		}
 	}
 
-	for (int i = 0; i < 2; ++i)
-		for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
-			if (j != static_cast<int>(priority)) {
-				std::move(m_fileList[i][j].begin(), m_fileList[i][j].end(), std::back_inserter(m_fileList[i][static_cast<int>(priority)]));
-				m_fileList[i][j].clear();
-			}
-		}
+	m_idleLists.set_priority(static_cast<int>(priority));
 }
 
 void CServerItem::SetChildPriority(CFileItem* pItem, QueuePriority oldPriority, QueuePriority newPriority)
 {
-	int i = pItem->queued() ? 0 : 1;
-
-	for (auto iter = m_fileList[i][static_cast<int>(oldPriority)].begin(); iter != m_fileList[i][static_cast<int>(oldPriority)].end(); ++iter) {
-		if (*iter != pItem) {
-			continue;
-		}
-
-		m_fileList[i][static_cast<int>(oldPriority)].erase(iter);
-		m_fileList[i][static_cast<int>(newPriority)].push_back(pItem);
+	if (pItem->IsActive()) {
 		return;
 	}
 
-	wxFAIL;
+	if (!m_idleLists.set_priority(*pItem, static_cast<int>(oldPriority), static_cast<int>(newPriority))) {
+		wxFAIL;
+	}
+}
+
+void CServerItem::SetChildActive(CFileItem* pItem, bool active)
+{
+	// Called before the item becomes active and after it became idle
+	if (active) {
+		RemoveFileItemFromList(pItem, true);
+	}
+	else {
+		m_idleLists.add_front(*pItem);
+	}
 }
 
 // --------------
@@ -905,6 +970,7 @@ namespace {
 
 CQueueViewBase::CQueueViewBase(CQueue* parent, COptionsBase & options, int index, const wxString& title)
 	: wxListCtrlEx(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxCLIP_CHILDREN | wxLC_REPORT | wxLC_VIRTUAL | border | wxTAB_TRAVERSAL)
+	, COptionChangeEventHandler(this)
 	, options_(options)
 	, m_pageIndex(index)
 	, m_title(title)
@@ -922,10 +988,18 @@ CQueueViewBase::CQueueViewBase(CQueue* parent, COptionsBase & options, int index
 	AssignImageList(pImageList, wxIMAGE_LIST_SMALL);
 
 	m_filecount_delay_timer.SetOwner(this);
+
+	options_.watch(OPTION_SIZE_FORMAT, this);
+	options_.watch(OPTION_SIZE_USETHOUSANDSEP, this);
+	options_.watch(OPTION_SIZE_DECIMALPLACES, this);
+	options_.watch(OPTION_DATE_FORMAT, this);
+	options_.watch(OPTION_TIME_FORMAT, this);
 }
 
 CQueueViewBase::~CQueueViewBase()
 {
+	options_.unwatch_all(this);
+
 	for (auto server : m_serverList) {
 		delete server;
 	}
@@ -938,12 +1012,16 @@ CQueueItem* CQueueViewBase::GetQueueItem(unsigned int item) const
 			return *iter;
 		}
 
-		unsigned int count = (*iter)->GetChildrenCount(true);
+		unsigned int const children = (*iter)->GetChildrenCount(true);
+		unsigned int const count = children + static_cast<unsigned int>((*iter)->GetDeferredCount());
 		if (item > count) {
 			item -= count + 1;
 			continue;
 		}
 
+		if (item > children) {
+			return const_cast<CQueueViewBase*>(this)->GetDeferredItem(**iter, item - 1);
+		}
 		return (*iter)->GetChild(item - 1);
 	}
 	return 0;
@@ -959,7 +1037,7 @@ int CQueueViewBase::GetItemIndex(const CQueueItem* item)
 			break;
 		}
 
-		index += (*iter)->GetChildrenCount(true) + 1;
+		index += (*iter)->GetChildrenCount(true) + static_cast<int>((*iter)->GetDeferredCount()) + 1;
 	}
 
 	return index + item->GetItemIndex();
@@ -988,6 +1066,27 @@ wxString CQueueViewBase::OnGetItemText(long item, long column) const
 	return OnGetItemText(pItem, m_columns[column]);
 }
 
+wxString const& CQueueViewBase::FormatSize(CQueueItem const* pItem, int64_t size) const
+{
+	return sizeTexts_.get(pItem, size, [](int64_t size) { return CSizeFormat::Format(size); });
+}
+
+wxString const& CQueueViewBase::FormatTime(CQueueItem const* pItem, fz::datetime const& time) const
+{
+	return timeTexts_.get(pItem, time, [](fz::datetime const& time) { return CTimeFormat::FormatDateTime(time); });
+}
+
+void CQueueViewBase::OnOptionsChanged(watched_options const& options)
+{
+	if (options.test(OPTION_SIZE_FORMAT) || options.test(OPTION_SIZE_USETHOUSANDSEP) || options.test(OPTION_SIZE_DECIMALPLACES) ||
+		options.test(OPTION_DATE_FORMAT) || options.test(OPTION_TIME_FORMAT))
+	{
+		sizeTexts_.clear();
+		timeTexts_.clear();
+		Refresh(false);
+	}
+}
+
 wxString CQueueViewBase::OnGetItemText(CQueueItem* pItem, ColumnId column) const
 {
 	switch (pItem->GetType())
@@ -1031,7 +1130,7 @@ wxString CQueueViewBase::OnGetItemText(CQueueItem* pItem, ColumnId column) const
 				{
 					auto const& size = pFileItem->GetSize();
 					if (size >= 0) {
-						return CSizeFormat::Format(size);
+						return FormatSize(pItem, size);
 					}
 					else {
 						return _T("?");
@@ -1057,7 +1156,7 @@ wxString CQueueViewBase::OnGetItemText(CQueueItem* pItem, ColumnId column) const
 			case colErrorReason:
 				return pFileItem->GetStatusMessage();
 			case colTime:
-				return CTimeFormat::FormatDateTime(pItem->GetTime());
+				return FormatTime(pItem, pItem->GetTime());
 			default:
 				break;
 			}
@@ -1423,21 +1522,30 @@ void CQueueViewBase::InsertItem(CServerItem* pServerItem, CQueueItem* pItem)
 {
 	const int newIndex = GetItemIndex(pServerItem) + pServerItem->GetChildrenCount(true) + 1;
 
+	AddInsertion(newIndex);
+
 	pServerItem->AddChild(pItem);
 	m_itemCount++;
 
-	if (m_insertionStart == -1) {
-		assert(!m_insertionCount);
-		m_insertionStart = newIndex;
-	}
-	++m_insertionCount;
-
 	if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder) {
 		m_fileCount++;
 		m_fileCountChanged = true;
 	}
 }
 
+void CQueueViewBase::AddInsertion(int index, unsigned int count)
+{
+	if (m_insertionStart != -1 && index != m_insertionStart + static_cast<int>(m_insertionCount)) {
+		CommitChanges();
+	}
+
+	if (m_insertionStart == -1) {
+		assert(!m_insertionCount);
+		m_insertionStart = index;
+	}
+	m_insertionCount += count;
+}
+
 bool CQueueViewBase::RemoveItem(CQueueItem* pItem, bool destroy, bool updateItemCount, bool updateSelections, bool forward)
 {
 	if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder) {
@@ -1598,15 +1706,37 @@ void CQueueViewBase::OnKeyDown(wxKeyEvent& event)
 	}
 }
 
-void CQueueViewBase::WriteToFile(pugi::xml_node element) const
+void CQueueViewBase::WriteToFile(xml_stream_writer & writer, unsigned int depth) const
 {
-	auto queue = element.child("Queue");
-	if (!queue) {
-		queue = element.append_child("Queue");
+	pugi::xml_document document;
+	writer.open_element(document.append_child("Queue"), depth);
+
+	for (auto const* serverItem : m_serverList) {
+		document.reset();
+		auto server = document.append_child("Server");
+		SetServer(server, serverItem->GetSite());
+
+		writer.open_element(server, depth + 1);
+		for (auto child = server.first_child(); child; child = child.next_sibling()) {
+			writer.write_element(child, depth + 2);
+		}
+		WriteServerItems(writer, *serverItem, depth + 2);
+		writer.close_element("Server", depth + 1);
 	}
 
-	for (std::vector<CServerItem*>::const_iterator iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		(*iter)->SaveItem(queue);
+	writer.close_element("Queue", depth);
+}
+
+void CQueueViewBase::WriteServerItems(xml_stream_writer & writer, CServerItem const& serverItem, unsigned int depth) const
+{
+	auto const& children = serverItem.GetChildren();
+	for (auto iter = children.cbegin() + serverItem.GetRemovedAtFront(); iter != children.cend(); ++iter) {
+		pugi::xml_document document;
+		pugi::xml_node node = document;
+		(*iter)->SaveItem(node);
+		for (auto child = document.first_child(); child; child = child.next_sibling()) {
+			writer.write_element(child, depth);
+		}
 	}
 }
 
@@ -1620,13 +1750,9 @@ void CQueueViewBase::OnExport(wxCommandEvent&)
 		return;
 	}
 
-	CXmlFile xml(dlg.GetPath().ToStdWstring());
-
-	auto exportRoot = xml.CreateEmpty();
-
-	WriteToFile(exportRoot);
-
-	SaveWithErrorDialog(xml);
+	StreamWithErrorDialog(dlg.GetPath().ToStdWstring(), [this](xml_stream_writer & writer) {
+		WriteToFile(writer, 1);
+	});
 }
 
 // ------
@@ -4,9 +4,15 @@
 #include "aui_notebook_ex.h"
 #include "listctrlex.h"
 #include "edithandler.h"
+#include "idle_lists.h"
+#include "option_change_event_handler.h"
+#include "row_index.h"
+#include "text_cache.h"
 
 #include <libfilezilla/optional.hpp>
 
+#include <functional>
+
 enum class QueuePriority : unsigned char {
 	lowest,
 	low,
@@ -31,6 +37,14 @@ enum class TransferDirection
 	upload
 };
 
+// Size class of files the scheduler should prefer
+enum class TransferSize
+{
+	any,
+	small,
+	large
+};
+
 namespace pugi { class xml_node; }
 class CQueueItem
 {
@@ -60,25 +74,45 @@ public:
 
 	int GetRemovedAtFront() const { return m_removed_at_front; }
 
+	// Row id in the queue database, 0 if not stored
+	int64_t GetStorageId() const { return m_storageId; }
+	void SetStorageId(int64_t id) { m_storageId = id; }
+
 protected:
 	CQueueItem(CQueueItem* parent = 0);
 
 	CQueueItem* m_parent;
 
 	friend class CServerItem;
+	friend struct queue_row_accessor;
 
 	fz::datetime m_time;
 
 private:
 	std::vector<CQueueItem*> m_children;
 
+	int64_t m_storageId{};
+
+	// Position in the parent's children, kept by server items for their row index.
+	// Stale while that index is invalid.
+	int m_slot{};
+
 	// Number of items removed at front of list
 	// Increased instead of calling slow m_children.erase(0),
 	// resetted on insert.
 	int m_removed_at_front{};
 };
 
+// Lets server items keep the row index over their children
+struct queue_row_accessor final
+{
+	static int slot(CQueueItem const& item) { return item.m_slot; }
+	static void set_slot(CQueueItem & item, int slot) { item.m_slot = slot; }
+	static int rows(CQueueItem const& item) { return 1 + static_cast<int>(item.GetChildrenCount(true)); }
+};
+
 class CFileItem;
+struct queue_idle_accessor;
 class CServerItem final : public CQueueItem
 {
 public:
@@ -94,7 +128,16 @@ public:
 	virtual unsigned int GetChildrenCount(bool recursive) const override;
 	virtual CQueueItem* GetChild(unsigned int item, bool recursive = true) override;
 
-	CFileItem* GetIdleChild(bool immadiateOnly, TransferDirection direction);
+	// If a size class is given and the next item does not match, prefers a
+	// matching item of the same priority close to the front.
+	CFileItem* GetIdleChild(bool immadiateOnly, TransferDirection direction, TransferSize preferredSize = TransferSize::any);
+
+	// Priority of the item GetIdleChild would return, -1 if there is none
+	int GetIdlePriority(bool immediateOnly, TransferDirection direction) const;
+
+	// Idle items directly following the given one in its scheduler list,
+	// up to the first one not matching the predicate.
+	std::vector<CFileItem*> GetIdleSiblings(CFileItem const& item, size_t max, std::function<bool(CFileItem const&)> const& pred);
 
 	virtual bool RemoveChild(CQueueItem* pItem, bool destroy = true, bool forward = true) override; // Removes a child item with is somewhere in the tree of children
 	virtual bool TryRemoveAll() override;
@@ -110,9 +153,14 @@ public:
 
 	void DetachChildren();
 
+	// Removes the children from the given one on and returns them without
+	// destroying them. These children must be idle.
+	std::vector<CQueueItem*> DetachTail(unsigned int first);
+
 	virtual void SetPriority(QueuePriority priority) override;
 
 	void SetChildPriority(CFileItem* pItem, QueuePriority oldPriority, QueuePriority newPriority);
+	void SetChildActive(CFileItem* pItem, bool active);
 
 	int m_activeCount;
 
@@ -120,28 +168,39 @@ public:
 
 	void Sort(int col, bool reverse);
 
+	// Files that are only kept in the queue storage and not materialized yet.
+	// In storage, these come after the row given by the storage cursor.
+	// In the list, their rows follow those of the materialized children.
+	int64_t GetDeferredCount() const { return m_deferredCount; }
+	void AddDeferred(int64_t count, int64_t size, int64_t unknownSizes);
+	void RemoveDeferred(int64_t count, int64_t size, int64_t unknownSizes);
+	void ClearDeferred();
+
+	int64_t GetStorageCursor() const { return m_storageCursor; }
+	void SetStorageCursor(int64_t cursor) { m_storageCursor = cursor; }
+
 protected:
 	void AddFileItemToList(CFileItem* pItem);
 	void RemoveFileItemFromList(CFileItem* pItem, bool forward);
+	void RebuildFileLists();
 
 	Site site_;
 
-	// array of item lists, sorted by priority. Used by scheduler to find
-	// next file to transfer
-	// First index specifies whether the item is queued (0) or immediate (1)
-	std::deque<CFileItem*> m_fileList[2][static_cast<int>(QueuePriority::count)];
+	// Used by scheduler to find next file to transfer
+	idle_lists<CFileItem, queue_idle_accessor, static_cast<int>(QueuePriority::count)> m_idleLists;
 
 	friend class CQueueItem;
 
 	int m_visibleOffspring{}; // Visible offspring over all sublevels
-	int m_maxCachedIndex{-1};
 
-	struct t_cacheItem
-	{
-		int index;
-		int child;
-	};
-	std::vector<t_cacheItem> m_lookupCache;
+	// Maps between rows and children in logarithmic time.
+	// Slots of children removed at front have no rows.
+	row_index<CQueueItem, queue_row_accessor> m_rowIndex;
+
+	int64_t m_deferredCount{};
+	int64_t m_deferredSize{};
+	int64_t m_deferredUnknownSizes{};
+	int64_t m_storageCursor{};
 };
 
 struct t_EngineData;
@@ -185,6 +244,9 @@ public:
 	void SetSize(int64_t size) { m_size = size; }
 	inline bool Download() const { return flags_ & transfer_flags::download; }
 
+	// Whether the transfer is latency-bound rather than bandwidth-bound
+	bool IsSmall() const;
+
 	inline transfer_flags flags() const { return flags_; }
 
 	inline bool queued() const { return flags_ & queue_flags::queued; }
@@ -214,6 +276,10 @@ public:
 	bool IsActive() const { return flags_ & queue_flags::active; }
 	virtual void SetActive(bool active);
 
+	// Marks a file active that is transferred along with another one.
+	// It does not get a status line of its own.
+	void SetBatchActive();
+
 	virtual void SaveItem(pugi::xml_node& element) const override;
 
 	// Removes inactive children, queues active children for removal.
@@ -275,6 +341,22 @@ protected:
 	CLocalPath const m_localPath;
 	CServerPath const m_remotePath;
 	int64_t m_size{};
+
+	// Assigned by the server item when added to its file lists
+	uint64_t m_readyOrder{};
+
+	friend struct queue_idle_accessor;
+};
+
+// Lets server items keep the lists of their idle children
+struct queue_idle_accessor final
+{
+	static bool queued(CFileItem const& item) { return item.queued(); }
+	static void set_queued(CFileItem & item, bool queued) { item.set_queued(queued); }
+	static bool download(CFileItem const& item) { return item.Download(); }
+	static int priority(CFileItem const& item) { return static_cast<int>(item.GetPriority()); }
+	static uint64_t order(CFileItem const& item) { return item.m_readyOrder; }
+	static void set_order(CFileItem & item, uint64_t order) { item.m_readyOrder = order; }
 };
 
 class CFolderItem final : public CFileItem
@@ -302,7 +384,8 @@ public:
 };
 
 class CQueue;
-class CQueueViewBase : public wxListCtrlEx
+class xml_stream_writer;
+class CQueueViewBase : public wxListCtrlEx, public COptionChangeEventHandler
 {
 public:
 
@@ -335,9 +418,12 @@ public:
 
 	int GetFileCount() const { return m_fileCount; }
 
-	void WriteToFile(pugi::xml_node element) const;
+	// Writes the queue as Queue element, one item at a time
+	void WriteToFile(xml_stream_writer & writer, unsigned int depth) const;
 
 protected:
+	// Writes the children of the given server item's element
+	virtual void WriteServerItems(xml_stream_writer & writer, CServerItem const& serverItem, unsigned int depth) const;
 
 	void CreateColumns(std::vector<ColumnId> const& extraColumns = std::vector<ColumnId>());
 	void AddQueueColumn(ColumnId id);
@@ -348,6 +434,11 @@ protected:
 	// Gets item with given index
 	CQueueItem* GetQueueItem(unsigned int item) const;
 
+	// Gets the child of the server item at the given index, counting the
+	// rows of all children, if it lies in the rows of the deferred files.
+	// These are materialized on demand.
+	virtual CQueueItem* GetDeferredItem(CServerItem &, unsigned int) { return nullptr; }
+
 	// Get index for given queue item
 	int GetItemIndex(const CQueueItem* item);
 
@@ -355,6 +446,16 @@ protected:
 	virtual wxString OnGetItemText(CQueueItem* pItem, ColumnId column) const;
 	virtual int OnGetItemImage(long item) const;
 
+	// Size and time texts of the items that have been displayed, cleared
+	// when the formatting options change.
+	wxString const& FormatSize(CQueueItem const* pItem, int64_t size) const;
+	wxString const& FormatTime(CQueueItem const* pItem, fz::datetime const& time) const;
+
+	mutable text_cache<CQueueItem const*, int64_t, wxString> sizeTexts_;
+	mutable text_cache<CQueueItem const*, fz::datetime, wxString> timeTexts_;
+
+	virtual void OnOptionsChanged(watched_options const& options) override;
+
 	void RefreshItem(const CQueueItem* pItem);
 
 	void DisplayNumberQueuedFiles();
@@ -365,6 +466,9 @@ protected:
 	int m_insertionStart{-1};
 	unsigned int m_insertionCount{};
 
+	// Pending insertions have to be adjacent, commits them first otherwise
+	void AddInsertion(int index, unsigned int count = 1);
+
 	int m_fileCount{};
 	bool m_fileCountChanged{};
 
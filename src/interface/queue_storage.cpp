@@ -7,6 +7,7 @@
 
 #include <unordered_map>
 
+#include <libfilezilla/format.hpp>
 #include <libfilezilla/uri.hpp>
 
 #define INVALID_DATA -1
@@ -130,6 +131,31 @@ _column path_table_columns[] = {
 	{ "path", Column_type::text, not_null }
 };
 
+namespace update_file_parameters
+{
+	enum type
+	{
+		target_file = 1,
+		size,
+		error_count,
+		priority,
+		flags,
+		default_exists_action,
+		persistent_state,
+		id
+	};
+}
+
+namespace {
+// Stored flags never contain the queue state. The queued bit is reused to
+// remember items that were not queued yet, i.e. pending immediate transfers.
+auto constexpr stored_immediate = queue_flags::queued;
+
+// Number of journaled changes after which the batch is committed
+// even if Commit() has not been called.
+int const journal_batch_size = 500;
+}
+
 class CQueueStorage::Impl final
 {
 public:
@@ -145,6 +171,7 @@ public:
 	sqlite3_stmt* PrepareStatement(std::string const& query);
 	sqlite3_stmt* PrepareInsertStatement(std::string const& name, _column const*, unsigned int count);
 
+	int64_t InsertServer(CServerItem const& item);
 	bool SaveServer(CServerItem const& item);
 	bool SaveFile(CFileItem const& item);
 	bool SaveDirectory(CFolderItem const& item);
@@ -173,13 +200,27 @@ public:
 	int GetColumnInt(sqlite3_stmt* statement, int index, int def = 0);
 
 	int64_t ParseServerFromRow(Site & site);
-	int64_t ParseFileFromRow(CFileItem** pItem);
+	int64_t ParseFileFromRow(sqlite3_stmt* statement, CFileItem** pItem, bool restoreImmediate = false);
+
+	static int64_t StoredFlags(CFileItem const& item);
 
 	bool MigrateSchema();
 
 	bool BeginTransaction();
 	bool EndTransaction(bool roolback);
 
+	bool ClearTables();
+
+	bool Step(sqlite3_stmt* statement);
+
+	// Opens the batch transaction if needed and records the outcome of a journal operation
+	bool BeginJournalChange();
+	bool EndJournalChange(bool success);
+	bool CommitJournal();
+
+	// Runs a statement as journal change
+	bool ExecJournal(std::string const& query);
+
 	void Close();
 
 	sqlite3* db_{};
@@ -191,9 +232,22 @@ public:
 
 	sqlite3_stmt* selectServersQuery_{};
 	sqlite3_stmt* selectFilesQuery_{};
+	sqlite3_stmt* selectFilesPageQuery_{};
+	sqlite3_stmt* selectFileStatsQuery_{};
 	sqlite3_stmt* selectLocalPathQuery_{};
 	sqlite3_stmt* selectRemotePathQuery_{};
 
+	sqlite3_stmt* updateFileQuery_{};
+	sqlite3_stmt* deleteFileQuery_{};
+	sqlite3_stmt* deleteServerQuery_{};
+	sqlite3_stmt* deleteServerFilesQuery_{};
+	sqlite3_stmt* moveServerFilesQuery_{};
+
+	bool journal_{};
+	bool journalIntact_{true};
+	bool journalTransaction_{};
+	int pendingChanges_{};
+
 	// Caches to speed up saving and loading
 	void ClearCaches();
 
@@ -222,6 +276,7 @@ void CQueueStorage::Impl::ReadLocalPaths()
 			CLocalPath localPath;
 			if (id > 0 && !localPathRaw.empty() && localPath.SetPath(localPathRaw)) {
 				reverseLocalPaths_[id] = localPath;
+				localPaths_[localPath.GetPath()] = id;
 			}
 		}
 	}
@@ -246,6 +301,7 @@ void CQueueStorage::Impl::ReadRemotePaths()
 			CServerPath remotePath;
 			if (id > 0 && !remotePathRaw.empty() && remotePath.SetSafePath(remotePathRaw)) {
 				reverseRemotePaths_[id] = remotePath;
+				remotePaths_[remotePath.GetSafePath()] = id;
 			}
 		}
 	}
@@ -391,6 +447,7 @@ int64_t CQueueStorage::Impl::SaveLocalPath(CLocalPath const& path)
 	if (res == SQLITE_DONE) {
 		int64_t id = sqlite3_last_insert_rowid(db_);
 		localPaths_[path.GetPath()] = id;
+		reverseLocalPaths_[id] = path;
 		return id;
 	}
 
@@ -418,6 +475,7 @@ int64_t CQueueStorage::Impl::SaveRemotePath(CServerPath const& path)
 	if (res == SQLITE_DONE) {
 		int64_t id = sqlite3_last_insert_rowid(db_);
 		remotePaths_[safePath] = id;
+		reverseRemotePaths_[id] = path;
 		return id;
 	}
 
@@ -589,9 +647,19 @@ bool CQueueStorage::Impl::PrepareStatements()
 			query += file_table_columns[i].name;
 		}
 
-		query += " FROM files WHERE server=:server ORDER BY id ASC";
+		if (!(selectFilesQuery_ = PrepareStatement(query + " FROM files WHERE server=:server ORDER BY id ASC"))) {
+			return false;
+		}
 
-		if (!(selectFilesQuery_ = PrepareStatement(query))) {
+		if (!(selectFilesPageQuery_ = PrepareStatement(query + " FROM files WHERE server=:server AND id>:id ORDER BY id ASC LIMIT :limit"))) {
+			return false;
+		}
+	}
+
+	{
+		// Folders have no size, only files of unknown size are counted as such
+		std::string query = "SELECT COUNT(*), TOTAL(size), SUM(size IS NULL AND local_path<>-1 AND remote_path<>-1) FROM files WHERE server=:server AND id>:id";
+		if (!(selectFileStatsQuery_ = PrepareStatement(query))) {
 			return false;
 		}
 	}
@@ -609,6 +677,27 @@ bool CQueueStorage::Impl::PrepareStatements()
 			return false;
 		}
 	}
+
+	{
+		std::string query = "UPDATE files SET target_file=:target_file, size=:size, error_count=:error_count, priority=:priority, flags=:flags, default_exists_action=:default_exists_action, persistent_state=:persistent_state WHERE id=:id";
+		if (!(updateFileQuery_ = PrepareStatement(query))) {
+			return false;
+		}
+	}
+
+	if (!(deleteFileQuery_ = PrepareStatement("DELETE FROM files WHERE id=:id"))) {
+		return false;
+	}
+	if (!(deleteServerQuery_ = PrepareStatement("DELETE FROM servers WHERE id=:id"))) {
+		return false;
+	}
+	if (!(deleteServerFilesQuery_ = PrepareStatement("DELETE FROM files WHERE server=:server"))) {
+		return false;
+	}
+	if (!(moveServerFilesQuery_ = PrepareStatement("UPDATE files SET server=:new_server WHERE server=:server"))) {
+		return false;
+	}
+
 	return true;
 }
 
@@ -658,8 +747,17 @@ bool CQueueStorage::Impl::BindBlob(sqlite3_stmt* statement, int index, std::stri
 	return sqlite3_bind_blob(statement, index, value.c_str(), value.size(), SQLITE_TRANSIENT) == SQLITE_OK;
 }
 
+int64_t CQueueStorage::Impl::StoredFlags(CFileItem const& item)
+{
+	transfer_flags flags = item.flags() - queue_flags::mask;
+	if (!item.queued()) {
+		flags |= stored_immediate;
+	}
+	return static_cast<int64_t>(flags);
+}
+
 
-bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
+int64_t CQueueStorage::Impl::InsertServer(CServerItem const& item)
 {
 	bool kiosk_mode = options_.get_int(OPTION_DEFAULT_KIOSKMODE) != 0;
 
@@ -810,10 +908,21 @@ bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
 
 	sqlite3_reset(insertServerQuery_);
 
-	bool ret = res == SQLITE_DONE;
+	if (res != SQLITE_DONE) {
+		return -1;
+	}
+
+	return sqlite3_last_insert_rowid(db_);
+}
+
+
+bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
+{
+	int64_t const serverId = InsertServer(item);
+
+	bool ret = serverId > 0;
 	if (ret) {
-		sqlite3_int64 serverId = sqlite3_last_insert_rowid(db_);
-		Bind(insertFileQuery_, file_table_column_names::server, static_cast<int64_t>(serverId));
+		Bind(insertFileQuery_, file_table_column_names::server, serverId);
 
 		const std::vector<CQueueItem*>& children = item.GetChildren();
 		for (std::vector<CQueueItem*>::const_iterator it = children.begin() + item.GetRemovedAtFront(); it != children.end(); ++it) {
@@ -863,6 +972,7 @@ bool CQueueStorage::Impl::SaveFile(CFileItem const& file)
 	else {
 		BindNull(insertFileQuery_, file_table_column_names::target_file);
 		BindNull(insertFileQuery_, file_table_column_names::extra_flags);
+		BindNull(insertFileQuery_, file_table_column_names::persistent_state);
 	}
 
 	int64_t localPathId = SaveLocalPath(file.GetLocalPath());
@@ -887,7 +997,7 @@ bool CQueueStorage::Impl::SaveFile(CFileItem const& file)
 		BindNull(insertFileQuery_, file_table_column_names::error_count);
 	}
 	Bind(insertFileQuery_, file_table_column_names::priority, static_cast<int>(file.GetPriority()));
-	Bind(insertFileQuery_, file_table_column_names::flags, static_cast<int64_t>(file.flags() - queue_flags::mask));
+	Bind(insertFileQuery_, file_table_column_names::flags, StoredFlags(file));
 
 	if (file.m_defaultFileExistsAction != CFileExistsNotification::unknown) {
 		Bind(insertFileQuery_, file_table_column_names::default_exists_action, file.m_defaultFileExistsAction);
@@ -934,7 +1044,7 @@ bool CQueueStorage::Impl::SaveDirectory(CFolderItem const& directory)
 		BindNull(insertFileQuery_, file_table_column_names::error_count);
 	}
 	Bind(insertFileQuery_, file_table_column_names::priority, static_cast<int>(directory.GetPriority()));
-	Bind(insertFileQuery_, file_table_column_names::flags, static_cast<int>(directory.flags() - queue_flags::mask));
+	Bind(insertFileQuery_, file_table_column_names::flags, StoredFlags(directory));
 
 	BindNull(insertFileQuery_, file_table_column_names::default_exists_action);
 
@@ -1144,18 +1254,20 @@ int64_t CQueueStorage::Impl::ParseServerFromRow(Site & site)
 }
 
 
-int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
+int64_t CQueueStorage::Impl::ParseFileFromRow(sqlite3_stmt* statement, CFileItem** pItem, bool restoreImmediate)
 {
-	std::wstring sourceFile = GetColumnText(selectFilesQuery_, file_table_column_names::source_file);
-	std::wstring targetFile = GetColumnText(selectFilesQuery_, file_table_column_names::target_file);
+	std::wstring sourceFile = GetColumnText(statement, file_table_column_names::source_file);
+	std::wstring targetFile = GetColumnText(statement, file_table_column_names::target_file);
 
-	int64_t localPathId = GetColumnInt64(selectFilesQuery_, file_table_column_names::local_path, false);
-	int64_t remotePathId = GetColumnInt64(selectFilesQuery_, file_table_column_names::remote_path, false);
+	int64_t localPathId = GetColumnInt64(statement, file_table_column_names::local_path, false);
+	int64_t remotePathId = GetColumnInt64(statement, file_table_column_names::remote_path, false);
 
 	CLocalPath const localPath(GetLocalPath(localPathId));
 	CServerPath const remotePath(GetRemotePath(remotePathId));
 
-	auto flags = static_cast<transfer_flags>(GetColumnInt(selectFilesQuery_, file_table_column_names::flags));
+	auto flags = static_cast<transfer_flags>(GetColumnInt(statement, file_table_column_names::flags));
+	bool const immediate = restoreImmediate && (flags & stored_immediate);
+	flags -= queue_flags::mask;
 	bool const download = flags & transfer_flags::download;
 
 	if (localPathId == -1 || remotePathId == -1) {
@@ -1167,21 +1279,21 @@ int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 		}
 
 		if (download) {
-			*pItem = new CFolderItem(0, true, localPath);
+			*pItem = new CFolderItem(0, !immediate, localPath);
 		}
 		else {
-			*pItem = new CFolderItem(0, true, remotePath, sourceFile);
+			*pItem = new CFolderItem(0, !immediate, remotePath, sourceFile);
 		}
 	}
 	else {
-		int64_t size = GetColumnInt64(selectFilesQuery_, file_table_column_names::size);
-		unsigned char errorCount = static_cast<unsigned char>(GetColumnInt(selectFilesQuery_, file_table_column_names::error_count));
-		int priority = GetColumnInt(selectFilesQuery_, file_table_column_names::priority, static_cast<int>(QueuePriority::normal));
+		int64_t size = GetColumnInt64(statement, file_table_column_names::size);
+		unsigned char errorCount = static_cast<unsigned char>(GetColumnInt(statement, file_table_column_names::error_count));
+		int priority = GetColumnInt(statement, file_table_column_names::priority, static_cast<int>(QueuePriority::normal));
 
-		std::wstring extraFlags = GetColumnText(selectFilesQuery_, file_table_column_names::extra_flags);
-		std::string persistentState = GetColumnTextUtf8(selectFilesQuery_, file_table_column_names::persistent_state);
+		std::wstring extraFlags = GetColumnText(statement, file_table_column_names::extra_flags);
+		std::string persistentState = GetColumnTextUtf8(statement, file_table_column_names::persistent_state);
 
-		int overwrite_action = GetColumnInt(selectFilesQuery_, file_table_column_names::default_exists_action, CFileExistsNotification::unknown);
+		int overwrite_action = GetColumnInt(statement, file_table_column_names::default_exists_action, CFileExistsNotification::unknown);
 
 		if (sourceFile.empty() || localPath.empty() ||
 			remotePath.empty() ||
@@ -1191,7 +1303,7 @@ int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 			return INVALID_DATA;
 		}
 
-		CFileItem* fileItem = new CFileItem(0, flags | queue_flags::queued, std::move(sourceFile), std::move(targetFile), std::move(localPath), std::move(remotePath), size, std::move(extraFlags), std::move(persistentState));
+		CFileItem* fileItem = new CFileItem(0, immediate ? flags : (flags | queue_flags::queued), std::move(sourceFile), std::move(targetFile), std::move(localPath), std::move(remotePath), size, std::move(extraFlags), std::move(persistentState));
 		*pItem = fileItem;
 		fileItem->SetPriorityRaw(QueuePriority(priority));
 		fileItem->m_errorCount = errorCount;
@@ -1201,7 +1313,7 @@ int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 		}
 	}
 
-	return GetColumnInt64(selectFilesQuery_, file_table_column_names::id);
+	return GetColumnInt64(statement, file_table_column_names::id);
 }
 
 bool CQueueStorage::Impl::BeginTransaction()
@@ -1219,6 +1331,116 @@ bool CQueueStorage::Impl::EndTransaction(bool rollback)
 	}
 }
 
+bool CQueueStorage::Impl::ClearTables()
+{
+	if (!db_) {
+		return false;
+	}
+
+	if (sqlite3_exec(db_, "DELETE FROM files", 0, 0, 0) != SQLITE_OK) {
+		return false;
+	}
+
+	if (sqlite3_exec(db_, "DELETE FROM servers", 0, 0, 0) != SQLITE_OK) {
+		return false;
+	}
+
+	if (sqlite3_exec(db_, "DELETE FROM local_paths", 0, 0, 0) != SQLITE_OK) {
+		return false;
+	}
+
+	if (sqlite3_exec(db_, "DELETE FROM remote_paths", 0, 0, 0) != SQLITE_OK) {
+		return false;
+	}
+
+	return true;
+}
+
+bool CQueueStorage::Impl::Step(sqlite3_stmt* statement)
+{
+	if (!statement) {
+		return false;
+	}
+
+	int res;
+	do {
+		res = sqlite3_step(statement);
+	} while (res == SQLITE_BUSY);
+
+	sqlite3_reset(statement);
+
+	return res == SQLITE_DONE;
+}
+
+bool CQueueStorage::Impl::BeginJournalChange()
+{
+	if (!db_) {
+		return false;
+	}
+
+	// Don't nest into transactions we did not open, e.g. while loading
+	if (!journalTransaction_ && sqlite3_get_autocommit(db_)) {
+		journalTransaction_ = BeginTransaction();
+	}
+
+	return true;
+}
+
+bool CQueueStorage::Impl::EndJournalChange(bool success)
+{
+	if (!success) {
+		journalIntact_ = false;
+	}
+
+	if (++pendingChanges_ >= journal_batch_size) {
+		CommitJournal();
+	}
+
+	return success;
+}
+
+bool CQueueStorage::Impl::ExecJournal(std::string const& query)
+{
+	if (!journal_) {
+		return true;
+	}
+
+	if (!BeginJournalChange()) {
+		return EndJournalChange(false);
+	}
+
+	int res;
+	do {
+		res = sqlite3_exec(db_, query.c_str(), 0, 0, 0);
+	} while (res == SQLITE_BUSY);
+
+	return EndJournalChange(res == SQLITE_OK);
+}
+
+bool CQueueStorage::Impl::CommitJournal()
+{
+	pendingChanges_ = 0;
+	if (!journalTransaction_) {
+		return true;
+	}
+	journalTransaction_ = false;
+
+	int res;
+	do {
+		res = sqlite3_exec(db_, "END TRANSACTION", 0, 0, 0);
+	} while (res == SQLITE_BUSY);
+
+	if (res != SQLITE_OK) {
+		if (!sqlite3_get_autocommit(db_)) {
+			EndTransaction(true);
+		}
+		journalIntact_ = false;
+		return false;
+	}
+
+	return true;
+}
+
 
 void CQueueStorage::Impl::Close()
 {
@@ -1228,16 +1450,30 @@ void CQueueStorage::Impl::Close()
 	sqlite3_finalize(insertRemotePathQuery_);
 	sqlite3_finalize(selectServersQuery_);
 	sqlite3_finalize(selectFilesQuery_);
+	sqlite3_finalize(selectFilesPageQuery_);
+	sqlite3_finalize(selectFileStatsQuery_);
 	sqlite3_finalize(selectLocalPathQuery_);
 	sqlite3_finalize(selectRemotePathQuery_);
+	sqlite3_finalize(updateFileQuery_);
+	sqlite3_finalize(deleteFileQuery_);
+	sqlite3_finalize(deleteServerQuery_);
+	sqlite3_finalize(deleteServerFilesQuery_);
+	sqlite3_finalize(moveServerFilesQuery_);
 	insertServerQuery_ = 0;
 	insertFileQuery_ = 0;
 	insertLocalPathQuery_ = 0;
 	insertRemotePathQuery_ = 0;
 	selectServersQuery_ = 0;
 	selectFilesQuery_ = 0;
+	selectFilesPageQuery_ = 0;
+	selectFileStatsQuery_ = 0;
 	selectLocalPathQuery_ = 0;
 	selectRemotePathQuery_ = 0;
+	updateFileQuery_ = 0;
+	deleteFileQuery_ = 0;
+	deleteServerQuery_ = 0;
+	deleteServerFilesQuery_ = 0;
+	moveServerFilesQuery_ = 0;
 	sqlite3_close(db_);
 	db_ = 0;
 }
@@ -1251,6 +1487,11 @@ CQueueStorage::CQueueStorage(COptionsBase& options)
 	}
 
 	if (sqlite3_exec(d_->db_, "PRAGMA encoding=\"UTF-16le\"", 0, 0, 0) == SQLITE_OK) {
+		// With write-ahead logging, the many small commits of the journal
+		// are cheap and cannot corrupt the database if we crash midway.
+		sqlite3_exec(d_->db_, "PRAGMA journal_mode=WAL", 0, 0, 0);
+		sqlite3_exec(d_->db_, "PRAGMA synchronous=NORMAL", 0, 0, 0);
+
 		d_->MigrateSchema();
 		d_->CreateTables();
 		d_->PrepareStatements();
@@ -1259,16 +1500,21 @@ CQueueStorage::CQueueStorage(COptionsBase& options)
 
 CQueueStorage::~CQueueStorage()
 {
+	d_->CommitJournal();
 	d_->Close();
 	delete d_;
 }
 
-bool CQueueStorage::SaveQueue(std::vector<CServerItem*> const& queue)
+bool CQueueStorage::SaveQueue(std::vector<CServerItem*> const& queue, bool replace)
 {
+	d_->CommitJournal();
 	d_->ClearCaches();
 
 	bool ret = true;
 	if (sqlite3_exec(d_->db_, "BEGIN TRANSACTION", 0, 0, 0) == SQLITE_OK) {
+		if (replace) {
+			ret &= d_->ClearTables();
+		}
 		for (auto const& serverItem : queue) {
 			ret &= d_->SaveServer(*serverItem);
 		}
@@ -1348,7 +1594,7 @@ int64_t CQueueStorage::GetFile(CFileItem** pItem, int64_t server)
 			while (res == SQLITE_BUSY);
 
 			if (res == SQLITE_ROW) {
-				ret = d_->ParseFileFromRow(pItem);
+				ret = d_->ParseFileFromRow(d_->selectFilesQuery_, pItem);
 				if (ret > 0) {
 					break;
 				}
@@ -1374,28 +1620,29 @@ int64_t CQueueStorage::GetFile(CFileItem** pItem, int64_t server)
 
 bool CQueueStorage::Clear()
 {
-	if (!d_->db_) {
+	if (!d_->ClearTables()) {
 		return false;
 	}
 
-	if (sqlite3_exec(d_->db_, "DELETE FROM files", 0, 0, 0) != SQLITE_OK) {
-		return false;
-	}
+	d_->ClearCaches();
 
-	if (sqlite3_exec(d_->db_, "DELETE FROM servers", 0, 0, 0) != SQLITE_OK) {
+	return true;
+}
+
+bool CQueueStorage::PrunePaths()
+{
+	if (!d_->db_) {
 		return false;
 	}
 
-	if (sqlite3_exec(d_->db_, "DELETE FROM local_paths", 0, 0, 0) != SQLITE_OK) {
+	if (sqlite3_exec(d_->db_, "DELETE FROM local_paths WHERE id NOT IN (SELECT local_path FROM files WHERE local_path IS NOT NULL)", 0, 0, 0) != SQLITE_OK) {
 		return false;
 	}
 
-	if (sqlite3_exec(d_->db_, "DELETE FROM remote_paths", 0, 0, 0) != SQLITE_OK) {
+	if (sqlite3_exec(d_->db_, "DELETE FROM remote_paths WHERE id NOT IN (SELECT remote_path FROM files WHERE remote_path IS NOT NULL)", 0, 0, 0) != SQLITE_OK) {
 		return false;
 	}
 
-	d_->ClearCaches();
-
 	return true;
 }
 
@@ -1418,3 +1665,289 @@ bool CQueueStorage::Vacuum()
 {
 	return sqlite3_exec(d_->db_, "VACUUM", 0, 0, 0) == SQLITE_OK;
 }
+
+void CQueueStorage::EnableJournal(bool enable)
+{
+	if (!enable) {
+		d_->CommitJournal();
+	}
+	else if (!d_->journal_) {
+		d_->journalIntact_ = true;
+	}
+	d_->journal_ = enable && d_->db_;
+}
+
+bool CQueueStorage::JournalEnabled() const
+{
+	return d_->journal_;
+}
+
+bool CQueueStorage::JournalIntact() const
+{
+	return d_->journalIntact_;
+}
+
+bool CQueueStorage::HasPendingChanges() const
+{
+	return d_->journalTransaction_;
+}
+
+bool CQueueStorage::Commit()
+{
+	return d_->CommitJournal();
+}
+
+bool CQueueStorage::AddServer(CServerItem & item)
+{
+	if (!d_->journal_ || item.GetStorageId() > 0) {
+		return true;
+	}
+
+	if (!d_->BeginJournalChange()) {
+		return d_->EndJournalChange(false);
+	}
+
+	int64_t const id = d_->InsertServer(item);
+	item.SetStorageId(id > 0 ? id : 0);
+
+	return d_->EndJournalChange(id > 0);
+}
+
+bool CQueueStorage::RewriteServer(CServerItem & item)
+{
+	int64_t const oldId = item.GetStorageId();
+	if (!d_->journal_ || oldId <= 0) {
+		return true;
+	}
+
+	if (!d_->BeginJournalChange()) {
+		return d_->EndJournalChange(false);
+	}
+
+	int64_t const id = d_->InsertServer(item);
+	if (id <= 0) {
+		return d_->EndJournalChange(false);
+	}
+
+	d_->Bind(d_->moveServerFilesQuery_, 1, id);
+	d_->Bind(d_->moveServerFilesQuery_, 2, oldId);
+	bool ret = d_->Step(d_->moveServerFilesQuery_);
+
+	d_->Bind(d_->deleteServerQuery_, 1, oldId);
+	ret &= d_->Step(d_->deleteServerQuery_);
+
+	item.SetStorageId(id);
+
+	return d_->EndJournalChange(ret);
+}
+
+bool CQueueStorage::AddFile(CFileItem & item, int64_t server)
+{
+	if (!d_->journal_ || item.GetStorageId() > 0 || item.m_edit != CEditHandler::none) {
+		return true;
+	}
+
+	if (server <= 0 || !d_->BeginJournalChange()) {
+		return d_->EndJournalChange(false);
+	}
+
+	d_->Bind(d_->insertFileQuery_, file_table_column_names::server, server);
+
+	bool ret;
+	if (item.GetType() == QueueItemType::Folder) {
+		ret = d_->SaveDirectory(static_cast<CFolderItem const&>(item));
+	}
+	else {
+		ret = d_->SaveFile(item);
+	}
+
+	if (ret) {
+		item.SetStorageId(sqlite3_last_insert_rowid(d_->db_));
+	}
+
+	return d_->EndJournalChange(ret);
+}
+
+bool CQueueStorage::UpdateFile(CFileItem const& item)
+{
+	if (!d_->journal_ || item.GetStorageId() <= 0) {
+		return true;
+	}
+
+	if (!d_->BeginJournalChange()) {
+		return d_->EndJournalChange(false);
+	}
+
+	sqlite3_stmt* const q = d_->updateFileQuery_;
+
+	auto const& extra_data = item.GetExtraData();
+	if (extra_data && !extra_data->targetFile_.empty()) {
+		d_->Bind(q, update_file_parameters::target_file, extra_data->targetFile_);
+	}
+	else {
+		d_->BindNull(q, update_file_parameters::target_file);
+	}
+	if (extra_data && !extra_data->persistentState_.empty()) {
+		d_->Bind(q, update_file_parameters::persistent_state, extra_data->persistentState_);
+	}
+	else {
+		d_->BindNull(q, update_file_parameters::persistent_state);
+	}
+
+	if (item.GetSize() != -1) {
+		d_->Bind(q, update_file_parameters::size, item.GetSize());
+	}
+	else {
+		d_->BindNull(q, update_file_parameters::size);
+	}
+	if (item.m_errorCount) {
+		d_->Bind(q, update_file_parameters::error_count, item.m_errorCount);
+	}
+	else {
+		d_->BindNull(q, update_file_parameters::error_count);
+	}
+	d_->Bind(q, update_file_parameters::priority, static_cast<int>(item.GetPriority()));
+	d_->Bind(q, update_file_parameters::flags, Impl::StoredFlags(item));
+	if (item.m_defaultFileExistsAction != CFileExistsNotification::unknown) {
+		d_->Bind(q, update_file_parameters::default_exists_action, item.m_defaultFileExistsAction);
+	}
+	else {
+		d_->BindNull(q, update_file_parameters::default_exists_action);
+	}
+	d_->Bind(q, update_file_parameters::id, item.GetStorageId());
+
+	return d_->EndJournalChange(d_->Step(q));
+}
+
+bool CQueueStorage::RemoveFile(int64_t id)
+{
+	if (!d_->journal_ || id <= 0) {
+		return true;
+	}
+
+	if (!d_->BeginJournalChange()) {
+		return d_->EndJournalChange(false);
+	}
+
+	d_->Bind(d_->deleteFileQuery_, 1, id);
+	return d_->EndJournalChange(d_->Step(d_->deleteFileQuery_));
+}
+
+bool CQueueStorage::RemoveServer(int64_t id)
+{
+	if (!d_->journal_ || id <= 0) {
+		return true;
+	}
+
+	if (!d_->BeginJournalChange()) {
+		return d_->EndJournalChange(false);
+	}
+
+	d_->Bind(d_->deleteServerFilesQuery_, 1, id);
+	bool ret = d_->Step(d_->deleteServerFilesQuery_);
+
+	d_->Bind(d_->deleteServerQuery_, 1, id);
+	ret &= d_->Step(d_->deleteServerQuery_);
+
+	return d_->EndJournalChange(ret);
+}
+
+int64_t CQueueStorage::GetFiles(std::vector<CFileItem*> & items, int64_t server, int64_t after, size_t limit, bool restoreImmediate) const
+{
+	sqlite3_stmt* const q = d_->selectFilesPageQuery_;
+	if (!q) {
+		return -1;
+	}
+
+	sqlite3_reset(q);
+	d_->Bind(q, 1, server);
+	d_->Bind(q, 2, after);
+	d_->Bind(q, 3, limit ? static_cast<int64_t>(limit) : int64_t(-1));
+
+	int64_t last = 0;
+	for (;;) {
+		int res;
+		do {
+			res = sqlite3_step(q);
+		}
+		while (res == SQLITE_BUSY);
+
+		if (res == SQLITE_ROW) {
+			// Skip over invalid rows, they'd just fail again the next time
+			last = d_->GetColumnInt64(q, file_table_column_names::id);
+
+			CFileItem* item{};
+			int64_t const id = d_->ParseFileFromRow(q, &item, restoreImmediate);
+			if (id > 0 && item) {
+				item->SetStorageId(id);
+				items.push_back(item);
+			}
+			else {
+				delete item;
+			}
+		}
+		else {
+			if (res != SQLITE_DONE) {
+				last = -1;
+			}
+			break;
+		}
+	}
+	sqlite3_reset(q);
+
+	return last;
+}
+
+bool CQueueStorage::GetFileStats(int64_t server, int64_t after, int64_t & count, int64_t & size, int64_t & unknownSizes) const
+{
+	sqlite3_stmt* const q = d_->selectFileStatsQuery_;
+	if (!q) {
+		return false;
+	}
+
+	d_->Bind(q, 1, server);
+	d_->Bind(q, 2, after);
+
+	int res;
+	do {
+		res = sqlite3_step(q);
+	}
+	while (res == SQLITE_BUSY);
+
+	if (res == SQLITE_ROW) {
+		count = d_->GetColumnInt64(q, 0);
+		size = static_cast<int64_t>(sqlite3_column_double(q, 1));
+		unknownSizes = d_->GetColumnInt64(q, 2);
+	}
+	sqlite3_reset(q);
+
+	return res == SQLITE_ROW;
+}
+
+bool CQueueStorage::RemoveFiles(int64_t server, int64_t after)
+{
+	return d_->ExecJournal(fz::sprintf("DELETE FROM files WHERE server=%d AND id>%d", server, after));
+}
+
+bool CQueueStorage::QueueFiles(int64_t server, int64_t after)
+{
+	return d_->ExecJournal(fz::sprintf("UPDATE files SET flags=flags&~%d WHERE server=%d AND id>%d", static_cast<int>(stored_immediate), server, after));
+}
+
+bool CQueueStorage::SetFilesPriority(int64_t server, int64_t after, QueuePriority priority)
+{
+	return d_->ExecJournal(fz::sprintf("UPDATE files SET priority=%d WHERE server=%d AND id>%d", static_cast<int>(priority), server, after));
+}
+
+bool CQueueStorage::SetFilesDefaultFileExistsAction(int64_t server, int64_t after, int action, TransferDirection direction)
+{
+	std::string query = fz::sprintf("UPDATE files SET default_exists_action=%s WHERE server=%d AND id>%d AND local_path<>-1 AND remote_path<>-1",
+		action != CFileExistsNotification::unknown ? fz::to_string(action) : std::string("NULL"), server, after);
+	if (direction == TransferDirection::download) {
+		query += fz::sprintf(" AND flags&%d", static_cast<int>(transfer_flags::download));
+	}
+	else if (direction == TransferDirection::upload) {
+		query += fz::sprintf(" AND NOT flags&%d", static_cast<int>(transfer_flags::download));
+	}
+	return d_->ExecJournal(query);
+}
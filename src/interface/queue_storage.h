@@ -10,6 +10,9 @@ class COptionsBase;
 class CServerItem;
 class Site;
 
+enum class QueuePriority : unsigned char;
+enum class TransferDirection;
+
 class CQueueStorage final
 {
 	class Impl;
@@ -31,7 +34,41 @@ public:
 
 	bool Vacuum();
 
-	bool SaveQueue(std::vector<CServerItem*> const& queue);
+	// Writes the whole queue. If replace is set, existing contents are
+	// removed in the same transaction.
+	bool SaveQueue(std::vector<CServerItem*> const& queue, bool replace = false);
+
+	// Removes path entries no longer referenced by any file.
+	bool PrunePaths();
+
+	// Incremental journal of queue changes. Each change is written to
+	// the database right away, but commits are batched: Changes become
+	// durable on Commit() or once enough of them have accumulated.
+	// While the journal is disabled, these functions do nothing.
+	void EnableJournal(bool enable);
+	bool JournalEnabled() const;
+
+	// Returns false if any journal operation failed since the journal was enabled.
+	bool JournalIntact() const;
+
+	bool HasPendingChanges() const;
+	bool Commit();
+
+	// Item ids are assigned to and read from the items' storage id.
+	bool AddServer(CServerItem & item);
+
+	// Stores the server data anew, e.g. after its credentials got re-encrypted.
+	bool RewriteServer(CServerItem & item);
+	bool AddFile(CFileItem & item, int64_t server);
+	bool UpdateFile(CFileItem const& item);
+	bool RemoveFile(int64_t id);
+	bool RemoveServer(int64_t id);
+
+	// Modify all files of a server with an id greater than after
+	bool RemoveFiles(int64_t server, int64_t after);
+	bool QueueFiles(int64_t server, int64_t after);
+	bool SetFilesPriority(int64_t server, int64_t after, QueuePriority priority);
+	bool SetFilesDefaultFileExistsAction(int64_t server, int64_t after, int action, TransferDirection direction);
 
 	// > 0 = server id
 	//   0 = No server
@@ -40,6 +77,15 @@ public:
 
 	int64_t GetFile(CFileItem** pItem, int64_t server);
 
+	// Reads up to limit files of the server with an id greater than after, 0 for no limit.
+	// Unlike GetFile, items that had not been queued yet are restored as such if
+	// restoreImmediate is set.
+	// Returns the id of the last file read, 0 if there were none, < 0 on failure.
+	int64_t GetFiles(std::vector<CFileItem*> & items, int64_t server, int64_t after, size_t limit, bool restoreImmediate) const;
+
+	// Count and total size of the files of the server with an id greater than after.
+	bool GetFileStats(int64_t server, int64_t after, int64_t & count, int64_t & size, int64_t & unknownSizes) const;
+
 	std::wstring GetDatabaseFilename();
 
 private:
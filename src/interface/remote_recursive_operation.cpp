@@ -1,15 +1,32 @@
 #include "filezilla.h"
 #include "remote_recursive_operation.h"
+#include "asyncrequestqueue.h"
 #include "commandqueue.h"
 #include "chmoddialog.h"
 #include "filter_manager.h"
+#include "Mainfrm.h"
 #include "Options.h"
 #include "queue.h"
+#include "StatusView.h"
 
 #include "../commonui/misc.h"
+#include "../include/FileZillaEngine.h"
 
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/recursive_remove.hpp>
+#include <libfilezilla/glue/wxinvoker.hpp>
+
+class CRecursiveListingHelper final : public wxEvtHandler
+{
+public:
+	CRecursiveListingHelper(CRemoteRecursiveOperation& operation, CFileZillaEngineContext& context)
+		: engine_(context, fz::make_invoker(*this, [&operation, this](CFileZillaEngine*) { operation.OnListingHelperEvent(*this); }))
+	{}
+
+	CFileZillaEngine engine_;
+	bool busy_{};
+	bool failed_{};
+};
 
 CRemoteRecursiveOperation::CRemoteRecursiveOperation(CState &state)
 : CStateEventHandler(state)
@@ -21,6 +38,7 @@ CRemoteRecursiveOperation::CRemoteRecursiveOperation(CState &state)
 
 CRemoteRecursiveOperation::~CRemoteRecursiveOperation()
 {
+	StopListingHelpers();
 }
 
 void CRemoteRecursiveOperation::OnStateChange(t_statechange_notifications notification, std::wstring const&, const void* data)
@@ -64,9 +82,170 @@ void CRemoteRecursiveOperation::do_start_recursive_operation(OperationMode mode,
 	m_state.NotifyHandlers(STATECHANGE_REMOTE_IDLE);
 	m_state.NotifyHandlers(STATECHANGE_REMOTE_RECURSION_STATUS);
 
+	StartListingHelpers();
+
 	remote_recursive_operation::do_start_recursive_operation(mode, filters);
 }
 
+void CRemoteRecursiveOperation::StartListingHelpers()
+{
+	StopListingHelpers();
+	listingHelpersUsed_ = false;
+
+	int count = COptions::Get()->get_int(OPTION_RECURSIVE_LIST_CONNECTIONS);
+
+	// Only take what the browsing connection and running transfers leave over
+	Site const& site = m_state.GetSite();
+	int const limit = site.server.MaximumMultipleConnections();
+	if (limit > 0) {
+		int const transfers = m_pQueue ? m_pQueue->GetActiveTransferCount(site) : 0;
+		count = std::min(count, limit - 1 - transfers);
+	}
+	if (site.credentials.logonType_ == LogonType::interactive) {
+		// Would have to ask the user for each connection
+		count = 0;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		auto helper = std::make_unique<CRecursiveListingHelper>(*this, m_state.GetMainFrame().GetEngineContext());
+		int res = helper->engine_.Execute(CConnectCommand(site.server, site.Handle(), site.credentials, false));
+		if (res != FZ_REPLY_WOULDBLOCK) {
+			break;
+		}
+		helper->busy_ = true;
+		listingHelpers_.emplace_back(std::move(helper));
+	}
+
+	EnablePrefetch(!listingHelpers_.empty());
+}
+
+void CRemoteRecursiveOperation::StopListingHelpers()
+{
+	auto* asyncRequestQueue = m_state.GetMainFrame().GetAsyncRequestQueue();
+	for (auto& helper : listingHelpers_) {
+		if (asyncRequestQueue) {
+			asyncRequestQueue->ClearPending(&helper->engine_);
+		}
+	}
+	listingHelpers_.clear();
+}
+
+void CRemoteRecursiveOperation::ReleaseListingHelpers()
+{
+	// Before the first listing of the walk, there just is no backlog yet
+	if (!listingHelpersUsed_) {
+		return;
+	}
+
+	for (auto& helper : listingHelpers_) {
+		if (helper->busy_) {
+			// Its listing may yield further directories
+			return;
+		}
+	}
+
+	// Give the connections back so the queue can use them. The helpers
+	// themselves stay around until the operation ends.
+	for (auto& helper : listingHelpers_) {
+		if (!helper->failed_) {
+			helper->failed_ = true;
+			helper->engine_.Execute(CDisconnectCommand());
+		}
+	}
+}
+
+int CRemoteRecursiveOperation::GetListingHelperCount() const
+{
+	int count{};
+	for (auto const& helper : listingHelpers_) {
+		if (!helper->failed_) {
+			++count;
+		}
+	}
+	return count;
+}
+
+void CRemoteRecursiveOperation::prefetch_available()
+{
+	for (auto& helper : listingHelpers_) {
+		RunListingHelper(*helper);
+	}
+}
+
+void CRemoteRecursiveOperation::RunListingHelper(CRecursiveListingHelper& helper)
+{
+	if (helper.busy_ || helper.failed_) {
+		return;
+	}
+
+	CServerPath parent;
+	std::wstring subdir;
+	if (!NextPrefetch(parent, subdir)) {
+		ReleaseListingHelpers();
+		return;
+	}
+
+	int res = helper.engine_.Execute(CListCommand(parent, subdir, LIST_FLAG_RECURSIVE));
+	if (res == FZ_REPLY_WOULDBLOCK) {
+		helper.busy_ = true;
+		listingHelpersUsed_ = true;
+	}
+	else {
+		// The walk lists the directory itself when it gets there
+		helper.failed_ = true;
+	}
+}
+
+void CRemoteRecursiveOperation::OnListingHelperEvent(CRecursiveListingHelper& helper)
+{
+	while (auto notification = helper.engine_.GetNextNotification()) {
+		switch (notification->GetID())
+		{
+		case nId_logmsg:
+			if (m_state.GetMainFrame().GetStatusView()) {
+				m_state.GetMainFrame().GetStatusView()->AddToLog(std::move(static_cast<CLogmsgNotification&>(*notification)));
+			}
+			break;
+		case nId_listing:
+			{
+				auto const& listingNotification = static_cast<CDirectoryListingNotification const&>(*notification);
+				CDirectoryListing listing;
+				if (!listingNotification.Failed() && !listingNotification.GetPath().empty() &&
+					helper.engine_.CacheLookup(listingNotification.GetPath(), listing) == FZ_REPLY_OK)
+				{
+					ProcessPrefetchedListing(listing);
+				}
+			}
+			break;
+		case nId_operation:
+			{
+				auto const& operationNotification = static_cast<COperationNotification const&>(*notification);
+				helper.busy_ = false;
+				if (operationNotification.commandId_ == Command::connect) {
+					helper.failed_ = operationNotification.replyCode_ != FZ_REPLY_OK;
+				}
+				else if (operationNotification.replyCode_ & FZ_REPLY_DISCONNECTED) {
+					helper.failed_ = true;
+				}
+			}
+			break;
+		case nId_asyncrequest:
+			{
+				auto asyncRequestNotification = unique_static_cast<CAsyncRequestNotification>(std::move(notification));
+				auto* asyncRequestQueue = m_state.GetMainFrame().GetAsyncRequestQueue();
+				if (asyncRequestQueue && asyncRequestNotification->GetRequestID() != reqId_fileexists) {
+					asyncRequestQueue->AddRequest(&helper.engine_, std::move(asyncRequestNotification));
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	RunListingHelper(helper);
+}
+
 
 void CRemoteRecursiveOperation::process_command(std::unique_ptr<CCommand> pCommand)
 {
@@ -124,6 +303,7 @@ void CRemoteRecursiveOperation::StopRecursiveOperation()
 {
 	bool notify = m_operationMode != recursive_none;
 	remote_recursive_operation::StopRecursiveOperation();
+	StopListingHelpers();
 	if (notify) {
 		m_state.NotifyHandlers(STATECHANGE_REMOTE_IDLE);
 		m_state.NotifyHandlers(STATECHANGE_REMOTE_RECURSION_STATUS);
@@ -6,6 +6,7 @@
 
 class CQueueView;
 class CActionAfterBlocker;
+class CRecursiveListingHelper;
 
 class CRemoteRecursiveOperation final : public remote_recursive_operation, public CStateEventHandler
 {
@@ -20,6 +21,9 @@ public:
 
 	void SetQueue(CQueueView* pQueue) { m_pQueue = pQueue; }
 
+	// Number of additional connections currently used for listing
+	int GetListingHelperCount() const;
+
 protected:
 	void do_start_recursive_operation(OperationMode mode, ActiveFilters const& filters) override;
 	void process_command(std::unique_ptr<CCommand>) override;
@@ -33,6 +37,18 @@ protected:
 
 	void OnStateChange(t_statechange_notifications notification, std::wstring const&, const void* data) override;
 
+	// Additional connections listing directories ahead of the walk
+	void StartListingHelpers();
+	void StopListingHelpers();
+	void ReleaseListingHelpers();
+	void prefetch_available() override;
+	void RunListingHelper(CRecursiveListingHelper& helper);
+	void OnListingHelperEvent(CRecursiveListingHelper& helper);
+	friend class CRecursiveListingHelper;
+
+	std::vector<std::unique_ptr<CRecursiveListingHelper>> listingHelpers_;
+	bool listingHelpersUsed_{};
+
 	bool m_immediate{true};
 	bool added_to_queue_{};
 	CState& m_state;
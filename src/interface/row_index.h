@@ -0,0 +1,143 @@
+#ifndef FILEZILLA_INTERFACE_ROW_INDEX_HEADER
+#define FILEZILLA_INTERFACE_ROW_INDEX_HEADER
+
+#include <cstddef>
+#include <vector>
+
+// Maps between rows and the items of a list in logarithmic time. Each item
+// spans one or more rows. It's a Fenwick tree over the slots of the list,
+// holding the number of rows of the item in each slot.
+//
+// Only the slots starting at the given first one hold items, the ones
+// before it have no rows.
+//
+// Items remember their slot, the accessor gets and sets it and tells the
+// number of rows of an item:
+//   static int slot(Item const&);
+//   static void set_slot(Item&, int);
+//   static int rows(Item const&);
+//
+// After changes that touch all items anyhow, the index gets invalidated and
+// rebuilt on next use. The slots stored in the items are stale until then,
+// only rely on them through the functions taking the list.
+template<typename Item, typename Accessor>
+class row_index final
+{
+public:
+	void invalidate() { valid_ = false; }
+	bool valid() const { return valid_; }
+
+	// Rebuilds the index if it got invalidated
+	void ensure(std::vector<Item*> const& items, size_t first) const
+	{
+		if (valid_) {
+			return;
+		}
+
+		size_t const n = items.size();
+		tree_.assign(n + 1, 0);
+		for (size_t i = first; i < n; ++i) {
+			Accessor::set_slot(*items[i], static_cast<int>(i));
+			tree_[i + 1] += Accessor::rows(*items[i]);
+		}
+		for (size_t i = 1; i <= n; ++i) {
+			size_t const j = i + (i & (~i + 1));
+			if (j <= n) {
+				tree_[j] += tree_[i];
+			}
+		}
+		valid_ = true;
+	}
+
+	// Rows before the given item
+	int index_of(std::vector<Item*> const& items, size_t first, Item const& item) const
+	{
+		ensure(items, first);
+		return rows_before(Accessor::slot(item));
+	}
+
+	// Returns the slot of the item spanning the given row and sets row
+	// to the offset into that item. Returns the number of slots if there
+	// is no such item.
+	size_t find(std::vector<Item*> const& items, size_t first, int & row) const
+	{
+		ensure(items, first);
+
+		// Finds the last slot with fewer rows before it than the requested row
+		size_t const n = tree_.size() - 1;
+		size_t step = 1;
+		while (step * 2 <= n) {
+			step *= 2;
+		}
+
+		size_t pos = 0;
+		for (; step; step /= 2) {
+			if (pos + step <= n && tree_[pos + step] <= row) {
+				pos += step;
+				row -= tree_[pos];
+			}
+		}
+
+		return pos;
+	}
+
+	// Items have been moved into the given slots or changed their number
+	// of rows. A no-op if the index is invalid.
+	void update(std::vector<Item*> const& items, size_t first, size_t from, size_t to)
+	{
+		if (!valid_) {
+			return;
+		}
+
+		for (size_t slot = from; slot <= to && slot < items.size(); ++slot) {
+			int rows = 0;
+			if (slot >= first) {
+				Accessor::set_slot(*items[slot], static_cast<int>(slot));
+				rows = Accessor::rows(*items[slot]);
+			}
+			add(slot, rows - (rows_before(slot + 1) - rows_before(slot)));
+		}
+	}
+
+	// The item in the given slot gained or lost rows. A no-op if the index
+	// is invalid.
+	void add(size_t slot, int delta)
+	{
+		if (!valid_ || !delta) {
+			return;
+		}
+
+		for (size_t i = slot + 1; i < tree_.size(); i += i & (~i + 1)) {
+			tree_[i] += delta;
+		}
+	}
+
+	// The item got appended to the list. A no-op if the index is invalid.
+	void push_back(Item & item)
+	{
+		if (!valid_) {
+			return;
+		}
+
+		// New node covers the range ending at the new slot
+		size_t const i = tree_.size();
+		size_t const lowbit = i & (~i + 1);
+		tree_.push_back(Accessor::rows(item) + rows_before(i - 1) - rows_before(i - lowbit));
+		Accessor::set_slot(item, static_cast<int>(i - 1));
+	}
+
+private:
+	int rows_before(size_t slot) const
+	{
+		int rows = 0;
+		for (size_t i = slot; i > 0; i -= i & (~i + 1)) {
+			rows += tree_[i];
+		}
+		return rows;
+	}
+
+	mutable std::vector<int> tree_;
+	mutable bool valid_{};
+};
+
+#endif
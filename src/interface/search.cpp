@@ -123,13 +123,13 @@ protected:
 private:
 	virtual bool CanStartComparison() { return m_canStartComparison; }
 	virtual void StartComparison() override;
-	virtual bool get_next_file(std::wstring_view& name, std::wstring& path, bool& dir, int64_t& size, fz::datetime& date) override;
+	virtual void get_comparison_entries(NameSortMode mode, std::vector<comparison_entry> & entries) override;
 	virtual void FinishComparison();
 
 	int m_dirIcon;
 
-	bool get_next_file(std::vector<CLocalSearchFileData> const& fileData, const unsigned int index, std::wstring_view& name, std::wstring & path, bool& dir, int64_t& size, fz::datetime& date);
-	bool get_next_file(std::vector<CRemoteSearchFileData> const& fileData, const unsigned int index, std::wstring_view& name, std::wstring & path, bool& dir, int64_t& size, fz::datetime& date);
+	bool get_comparison_entry(std::vector<CLocalSearchFileData> const& fileData, const unsigned int index, std::wstring_view& name, std::wstring & path, bool& dir, int64_t& size, fz::datetime& date);
+	bool get_comparison_entry(std::vector<CRemoteSearchFileData> const& fileData, const unsigned int index, std::wstring_view& name, std::wstring & path, bool& dir, int64_t& size, fz::datetime& date);
 
 	CSearchDialog::search_mode mode_{};
 
@@ -326,7 +326,7 @@ wxString CSearchDialogFileList::GetItemText(int item, unsigned int column)
 				return wxString();
 			}
 			else {
-				return CSizeFormat::Format(entry.size);
+				return FormatSize(index, entry.size);
 			}
 		}
 		else if (column == 3) {
@@ -343,7 +343,7 @@ wxString CSearchDialogFileList::GetItemText(int item, unsigned int column)
 			return data.fileType;
 		}
 		else if (column == 4) {
-			return CTimeFormat::Format(entry.time);
+			return FormatTime(index, entry.time);
 		}
 	}
 	else {
@@ -359,7 +359,7 @@ wxString CSearchDialogFileList::GetItemText(int item, unsigned int column)
 				return wxString();
 			}
 			else {
-				return CSizeFormat::Format(entry.size);
+				return FormatSize(index, entry.size);
 			}
 		}
 		else if (column == 3) {
@@ -381,7 +381,7 @@ wxString CSearchDialogFileList::GetItemText(int item, unsigned int column)
 			return data.fileType;
 		}
 		else if (column == 4) {
-			return CTimeFormat::Format(entry.time);
+			return FormatTime(index, entry.time);
 		}
 		else if (column == 5) {
 			return *entry.permissions;
@@ -460,8 +460,6 @@ void CSearchDialogFileList::StartComparison()
 		m_indexMapping.clear();
 	}
 
-	m_comparisonIndex = -1;
-
 	if (m_fileData.empty() || m_fileData.back().comparison_flags != fill) {
 		CGenericFileData data;
 		data.icon = -1;
@@ -482,7 +480,7 @@ void CSearchDialogFileList::StartComparison()
 	}
 }
 
-bool CSearchDialogFileList::get_next_file(std::vector<CLocalSearchFileData> const& fileData, const unsigned int index, std::wstring_view & name, std::wstring & path, bool& dir, int64_t& size, fz::datetime& date)
+bool CSearchDialogFileList::get_comparison_entry(std::vector<CLocalSearchFileData> const& fileData, const unsigned int index, std::wstring_view & name, std::wstring & path, bool& dir, int64_t& size, fz::datetime& date)
 {
 	if (index >= fileData.size()) {
 		return false;
@@ -516,7 +514,7 @@ bool CSearchDialogFileList::get_next_file(std::vector<CLocalSearchFileData> cons
 	return true;
 }
 
-bool CSearchDialogFileList::get_next_file(std::vector<CRemoteSearchFileData> const& fileData, const unsigned int index, std::wstring_view& name, std::wstring & path, bool& dir, int64_t& size, fz::datetime& date)
+bool CSearchDialogFileList::get_comparison_entry(std::vector<CRemoteSearchFileData> const& fileData, const unsigned int index, std::wstring_view& name, std::wstring & path, bool& dir, int64_t& size, fz::datetime& date)
 {
 	if (index >= fileData.size()) {
 		return false;
@@ -550,18 +548,30 @@ bool CSearchDialogFileList::get_next_file(std::vector<CRemoteSearchFileData> con
 	return true;
 }
 
-bool CSearchDialogFileList::get_next_file(std::wstring_view& name, std::wstring& path, bool& dir, int64_t& size, fz::datetime& date)
+void CSearchDialogFileList::get_comparison_entries(NameSortMode mode, std::vector<comparison_entry> & entries)
 {
-	if (++m_comparisonIndex >= (int)m_originalIndexMapping.size()) {
-		return false;
-	}
-	const unsigned int index = m_originalIndexMapping[m_comparisonIndex];
+	entries.clear();
+	entries.reserve(m_originalIndexMapping.size());
+
+	std::wstring_view name;
+	std::wstring path;
+	for (auto const index : m_originalIndexMapping) {
+		comparison_entry entry;
+		bool found;
+		if (mode_ == CSearchDialog::search_mode::local) {
+			found = get_comparison_entry(localFileData_, index, name, path, entry.dir, entry.size, entry.date);
+		}
+		else {
+			found = get_comparison_entry(remoteFileData_, index, name, path, entry.dir, entry.size, entry.date);
+		}
+		if (!found) {
+			break;
+		}
 
-	if (mode_ == CSearchDialog::search_mode::local) {
-		return get_next_file(localFileData_, index, name, path, dir, size, date);
-	}
-	else {
-		return get_next_file(remoteFileData_, index, name, path, dir, size, date);
+		entry.key = ComparisonKey(index, name, mode);
+		entry.pathKey = CFileListCtrlSortBase::MakeSortKey(path, mode);
+		entry.parent = name == L"..";
+		entries.push_back(std::move(entry));
 	}
 }
 
@@ -831,18 +841,8 @@ void CSearchDialog::OnStateChange(t_statechange_notifications notification, std:
 			if (!m_state.IsRemoteIdle()) {
 				return;
 			}
-
-			if (mode_ == search_mode::comparison) {
-				m_remoteResults->m_canStartComparison = true;
-				m_remoteResults->m_originalIndexMapping.clear();
-				if (!m_state.IsLocalIdle()) {
-					return;
-				}
-				m_pComparisonManager->CompareListings();
-			}
 		}
-		searching_ = false;
-		SetCtrlState();
+		RemoteSearchFinished();
 	}
 	else if (notification == STATECHANGE_LOCAL_RECURSION_LISTING) {
 		if (mode_ != search_mode::remote) {
@@ -872,6 +872,73 @@ void CSearchDialog::OnStateChange(t_statechange_notifications notification, std:
 	}
 }
 
+void CSearchDialog::RemoteSearchFinished()
+{
+	if (mode_ == search_mode::comparison) {
+		m_remoteResults->m_canStartComparison = true;
+		m_remoteResults->m_originalIndexMapping.clear();
+		if (!m_state.IsLocalIdle()) {
+			return;
+		}
+		m_pComparisonManager->CompareListings();
+	}
+	searching_ = false;
+	SetCtrlState();
+}
+
+void CSearchDialog::SearchCache(recursion_root& root)
+{
+	auto lookup = [this](CServerPath const& path) {
+		auto listing = std::make_shared<CDirectoryListing>();
+		bool outdated{};
+		if (!m_state.engine_ || m_state.engine_->CacheLookup(path, *listing, outdated) != FZ_REPLY_OK || outdated || listing->failed()) {
+			listing.reset();
+		}
+		return listing;
+	};
+
+	auto listing = lookup(m_remote_search_root);
+	if (!listing) {
+		root.add_dir_to_visit_restricted(m_remote_search_root, std::wstring(), true);
+		return;
+	}
+
+	std::vector<std::shared_ptr<CDirectoryListing>> listings;
+	listings.push_back(std::move(listing));
+	while (!listings.empty()) {
+		listing = std::move(listings.back());
+		listings.pop_back();
+
+		ProcessDirectoryListing(listing);
+
+		for (size_t i = 0; i < listing->size(); ++i) {
+			CDirentry const& entry = (*listing)[i];
+			if (!entry.is_dir()) {
+				continue;
+			}
+
+			if (entry.is_link()) {
+				// Like the recursive operation, list links but do not recurse into them
+				root.add_dir_to_visit(listing->path, entry.name, CLocalPath(), true, false);
+				continue;
+			}
+
+			CServerPath path = listing->path;
+			if (!path.AddSegment(entry.name) || m_visited.find(path) != m_visited.end()) {
+				continue;
+			}
+
+			auto subdir = lookup(path);
+			if (subdir) {
+				listings.push_back(std::move(subdir));
+			}
+			else {
+				root.add_dir_to_visit(listing->path, entry.name);
+			}
+		}
+	}
+}
+
 void CSearchDialog::ProcessDirectoryListing(std::shared_ptr<CDirectoryListing> const& listing)
 {
 	if (!searching_ || mode_ == search_mode::local) {
@@ -1130,10 +1197,17 @@ void CSearchDialog::OnSearch(wxCommandEvent&)
 
 	if (mode_ != search_mode::local) {
 		recursion_root root(m_remote_search_root, true);
-		root.add_dir_to_visit_restricted(m_remote_search_root, std::wstring(), true);
-		m_state.GetRemoteRecursiveOperation()->AddRecursionRoot(std::move(root));
-		ActiveFilters const filters; // Empty, recurse into everything
-		m_state.GetRemoteRecursiveOperation()->StartRecursiveOperation(recursive_operation::recursive_list, filters);
+
+		// Directories still in the cache are searched right away, only the others need listing
+		SearchCache(root);
+		if (!root.empty()) {
+			m_state.GetRemoteRecursiveOperation()->AddRecursionRoot(std::move(root));
+			ActiveFilters const filters; // Empty, recurse into everything
+			m_state.GetRemoteRecursiveOperation()->StartRecursiveOperation(recursive_operation::recursive_list, filters);
+		}
+		else {
+			RemoteSearchFinished();
+		}
 	}
 
 	SetCtrlState();
@@ -12,6 +12,7 @@ class COptionsBase;
 class CQueueView;
 class CSearchDialogFileList;
 class CWindowStateManager;
+class recursion_root;
 
 class CSearchDialog final : public CFilterConditionsDialog, public CStateEventHandler
 {
@@ -36,6 +37,11 @@ protected:
 	void ProcessDirectoryListing(std::shared_ptr<CDirectoryListing> const& listing);
 	void ProcessDirectoryListing(CLocalRecursiveOperation::listing const& listing);
 
+	// Searches the cached listings below the search root, adds the
+	// directories that are not cached or outdated to the recursion root.
+	void SearchCache(recursion_root& root);
+	void RemoteSearchFinished();
+
 	void SetCtrlState();
 
 	void SaveConditions();
@@ -23,6 +23,7 @@ struct COptionsPageConnectionSFTP::impl
 	wxButton* remove_{};
 
 	wxCheckBox* compression_{};
+	wxCheckBox* verify_{};
 };
 
 COptionsPageConnectionSFTP::COptionsPageConnectionSFTP()
@@ -76,6 +77,9 @@ bool COptionsPageConnectionSFTP::CreateControls(wxWindow* parent)
 
 		impl_->compression_ = new wxCheckBox(box, nullID, _("&Enable compression"));
 		inner->Add(impl_->compression_);
+
+		impl_->verify_ = new wxCheckBox(box, nullID, _("&Verify transferred files using server-side checksums if supported by the server"));
+		inner->Add(impl_->verify_);
 	}
 	return true;
 }
@@ -102,6 +106,7 @@ bool COptionsPageConnectionSFTP::LoadPage()
 	SetCtrlState();
 
 	impl_->compression_->SetValue(m_pOptions->get_int(OPTION_SFTP_COMPRESSION) != 0);
+	impl_->verify_->SetValue(m_pOptions->get_int(OPTION_SFTP_VERIFY_TRANSFERS) != 0);
 
 	return !failure;
 }
@@ -121,6 +126,7 @@ bool COptionsPageConnectionSFTP::SavePage()
 	}
 
 	m_pOptions->set(OPTION_SFTP_COMPRESSION, impl_->compression_->GetValue() ? 1 : 0);
+	m_pOptions->set(OPTION_SFTP_VERIFY_TRANSFERS, impl_->verify_->GetValue() ? 1 : 0);
 
 	return true;
 }
@@ -14,6 +14,8 @@ struct COptionsPageTransfer::impl final
 	wxSpinCtrlEx* transfers_{};
 	wxSpinCtrlEx* downloads_{};
 	wxSpinCtrlEx* uploads_{};
+	wxSpinCtrlEx* small_slots_{};
+	wxSpinCtrlEx* list_connections_{};
 
 	wxChoice* burst_tolerance_{};
 
@@ -65,6 +67,18 @@ bool COptionsPageTransfer::CreateControls(wxWindow* parent)
 		impl_->uploads_->SetMaxLength(2);
 		inner->Add(impl_->uploads_, lay.valign);
 		inner->Add(new wxStaticText(box, nullID, _("(0 for no limit)")), lay.valign);
+		inner->Add(new wxStaticText(box, nullID, _("Transfers reserved for s&mall files:")), lay.valign);
+		impl_->small_slots_ = new wxSpinCtrlEx(box, nullID, wxString(), wxDefaultPosition, wxSize(lay.dlgUnits(26), -1));
+		impl_->small_slots_->SetRange(0, 9);
+		impl_->small_slots_->SetMaxLength(1);
+		inner->Add(impl_->small_slots_, lay.valign);
+		inner->Add(new wxStaticText(box, nullID, _("(0 to disable)")), lay.valign);
+		inner->Add(new wxStaticText(box, nullID, _("Additional &connections for recursive listings:")), lay.valign);
+		impl_->list_connections_ = new wxSpinCtrlEx(box, nullID, wxString(), wxDefaultPosition, wxSize(lay.dlgUnits(26), -1));
+		impl_->list_connections_->SetRange(0, 9);
+		impl_->list_connections_->SetMaxLength(1);
+		inner->Add(impl_->list_connections_, lay.valign);
+		inner->Add(new wxStaticText(box, nullID, _("(0 to disable)")), lay.valign);
 	}
 
 	{
@@ -151,6 +165,8 @@ bool COptionsPageTransfer::LoadPage()
 	impl_->transfers_->SetValue(m_pOptions->get_int(OPTION_NUMTRANSFERS));
 	impl_->downloads_->SetValue(m_pOptions->get_int(OPTION_CONCURRENTDOWNLOADLIMIT));
 	impl_->uploads_->SetValue(m_pOptions->get_int(OPTION_CONCURRENTUPLOADLIMIT));
+	impl_->small_slots_->SetValue(m_pOptions->get_int(OPTION_SMALLFILE_SLOTS));
+	impl_->list_connections_->SetValue(m_pOptions->get_int(OPTION_RECURSIVE_LIST_CONNECTIONS));
 
 	impl_->burst_tolerance_->SetSelection(m_pOptions->get_int(OPTION_SPEEDLIMIT_BURSTTOLERANCE));
 	impl_->burst_tolerance_->Enable(enable_speedlimits);
@@ -170,6 +186,8 @@ bool COptionsPageTransfer::SavePage()
 	m_pOptions->set(OPTION_NUMTRANSFERS, impl_->transfers_->GetValue());
 	m_pOptions->set(OPTION_CONCURRENTDOWNLOADLIMIT,	impl_->downloads_->GetValue());
 	m_pOptions->set(OPTION_CONCURRENTUPLOADLIMIT, impl_->uploads_->GetValue());
+	m_pOptions->set(OPTION_SMALLFILE_SLOTS, impl_->small_slots_->GetValue());
+	m_pOptions->set(OPTION_RECURSIVE_LIST_CONNECTIONS, impl_->list_connections_->GetValue());
 
 	m_pOptions->set(OPTION_SPEEDLIMIT_INBOUND, impl_->dllimit_->GetValue().ToStdWstring());
 	m_pOptions->set(OPTION_SPEEDLIMIT_OUTBOUND, impl_->ullimit_->GetValue().ToStdWstring());
@@ -195,6 +213,14 @@ bool COptionsPageTransfer::Validate()
 		return DisplayError(impl_->uploads_, _("Please enter a number between 0 and 10 for the number of concurrent uploads."));
 	}
 
+	if (impl_->small_slots_->GetValue() < 0 || impl_->small_slots_->GetValue() >= impl_->transfers_->GetValue()) {
+		return DisplayError(impl_->small_slots_, _("The number of transfers reserved for small files has to be less than the number of concurrent transfers."));
+	}
+
+	if (impl_->list_connections_->GetValue() < 0 || impl_->list_connections_->GetValue() > 9) {
+		return DisplayError(impl_->list_connections_, _("Please enter a number between 0 and 9 for the number of additional connections for recursive listings."));
+	}
+
 	if (fz::to_integral<int>(impl_->dllimit_->GetValue().ToStdWstring(), -1) < 0) {
 		const wxString unit = CSizeFormat::GetUnitWithBase(CSizeFormat::kilo, 1024);
 		return DisplayError(impl_->dllimit_, wxString::Format(_("Please enter a download speed limit greater or equal to 0 %s/s."), unit));
@@ -8,6 +8,7 @@
 #include "local_recursive_operation.h"
 #include "remote_recursive_operation.h"
 #include "listingcomparison.h"
+#include "sync_operation.h"
 #include "xrc_helper.h"
 
 #include "../commonui/misc.h"
@@ -230,12 +231,14 @@ CState::CState(CMainFrame &mainFrame)
 
 	m_pLocalRecursiveOperation = new CLocalRecursiveOperation(*this);
 	m_pRemoteRecursiveOperation = new CRemoteRecursiveOperation(*this);
+	m_pSyncOperation = new CSyncOperation(*this);
 
 	m_localDir.SetPath(std::wstring(1, CLocalPath::path_separator));
 }
 
 CState::~CState()
 {
+	delete m_pSyncOperation;
 	delete m_pComparisonManager;
 	delete m_pCommandQueue;
 	engine_.reset();
@@ -370,7 +373,7 @@ bool CState::DoSetLocalDir(CLocalPath & dir, std::wstring *error, bool rememberP
 	return true;
 }
 
-bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, bool primary)
+bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, bool primary, std::shared_ptr<CDirectoryListingDelta const> const& delta)
 {
 	if (!pDirectoryListing) {
 		m_changeDirFlags.compare = false;
@@ -381,6 +384,7 @@ bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryLi
 
 		if (m_pDirectoryListing) {
 			m_pDirectoryListing = 0;
+			m_pDirectoryListingDelta.reset();
 			NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
 		}
 		m_previouslyVisitedRemoteSubdir.clear();
@@ -415,6 +419,15 @@ bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryLi
 		return true;
 	}
 
+	// A delta is only of use if it starts from the listing on display
+	if (delta && m_pDirectoryListing && m_pDirectoryListing->path == pDirectoryListing->path &&
+		delta->from_time == m_pDirectoryListing->m_firstListTime)
+	{
+		m_pDirectoryListingDelta = delta;
+	}
+	else {
+		m_pDirectoryListingDelta.reset();
+	}
 	m_pDirectoryListing = pDirectoryListing;
 
 	NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
@@ -61,6 +61,7 @@ class CStateEventHandler;
 class CRemoteDataObject;
 class CRemoteRecursiveOperation;
 class CComparisonManager;
+class CSyncOperation;
 
 class CStateFilterManager final : public CFilterManager
 {
@@ -145,8 +146,11 @@ public:
 	bool Disconnect();
 
 	bool ChangeRemoteDir(CServerPath const& path, std::wstring const& subdir = std::wstring(), int flags = 0, bool ignore_busy = false, bool compare = false);
-	bool SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, bool primary);
+	bool SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, bool primary, std::shared_ptr<CDirectoryListingDelta const> const& delta = nullptr);
 	std::shared_ptr<CDirectoryListing> GetRemoteDir() const;
+
+	// The changes from the previously displayed remote listing to the current one, if known
+	std::shared_ptr<CDirectoryListingDelta const> const& GetRemoteDirDelta() const { return m_pDirectoryListingDelta; }
 	const CServerPath GetRemotePath() const;
 
 	Site const& GetSite() const;
@@ -164,6 +168,7 @@ public:
 	std::unique_ptr<CFileZillaEngine> engine_;
 	CCommandQueue* m_pCommandQueue{};
 	CComparisonManager* GetComparisonManager() { return m_pComparisonManager; }
+	CSyncOperation* GetSyncOperation() { return m_pSyncOperation; }
 
 	void UploadDroppedFiles(CLocalDataObject const* pLocalDataObject, std::wstring const& subdir, bool queueOnly);
 	void UploadDroppedFiles(wxFileDataObject const* pFileDataObject, std::wstring const& subdir, bool queueOnly);
@@ -217,6 +222,8 @@ public:
 
 	void ChangeServer(CServer const& newServer);
 
+	CMainFrame& GetMainFrame() { return m_mainFrame; }
+
 	fz::thread_pool & pool_;
 
 protected:
@@ -228,6 +235,7 @@ protected:
 
 	CLocalPath m_localDir;
 	std::shared_ptr<CDirectoryListing> m_pDirectoryListing;
+	std::shared_ptr<CDirectoryListingDelta const> m_pDirectoryListingDelta;
 
 	Site m_site;
 
@@ -243,6 +251,7 @@ protected:
 	CRemoteRecursiveOperation* m_pRemoteRecursiveOperation;
 
 	CComparisonManager* m_pComparisonManager;
+	CSyncOperation* m_pSyncOperation;
 
 	CStateFilterManager m_stateFilterManager;
 
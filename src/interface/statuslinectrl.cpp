@@ -73,7 +73,7 @@ CStatusLineCtrl::~CStatusLineCtrl()
 {
 	if (!status_.empty() && status_.totalSize >= 0) {
 		if (m_pEngineData && m_pEngineData->pItem) {
-			m_pEngineData->pItem->SetSize(status_.totalSize);
+			m_pEngineData->GetCurrentItem()->SetSize(status_.totalSize);
 		}
 	}
 
@@ -251,7 +251,7 @@ void CStatusLineCtrl::ClearTransferStatus()
 {
 	if (!status_.empty() && status_.totalSize >= 0) {
 		if (m_pEngineData && m_pEngineData->pItem) {
-			m_pParent->UpdateItemSize(m_pEngineData->pItem, status_.totalSize);
+			m_pParent->UpdateItemSize(m_pEngineData->GetCurrentItem(), status_.totalSize);
 		}
 	}
 	status_.clear();
@@ -317,8 +317,7 @@ void CStatusLineCtrl::OnTimer(wxTimerEvent&)
 		if (status.madeProgress && !status.list &&
 			m_pEngineData->pItem->GetType() == QueueItemType::File)
 		{
-			CFileItem* pItem = (CFileItem*)m_pEngineData->pItem;
-			pItem->set_made_progress(true);
+			m_pEngineData->GetCurrentItem()->set_made_progress(true);
 		}
 		SetTransferStatus(status);
 	}
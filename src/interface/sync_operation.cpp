@@ -0,0 +1,173 @@
+#include "filezilla.h"
+#include "sync_operation.h"
+
+#include "filter_manager.h"
+#include "local_recursive_operation.h"
+#include "Mainfrm.h"
+#include "Options.h"
+#include "QueueView.h"
+#include "remote_recursive_operation.h"
+#include "sizeformatting.h"
+
+CSyncOperation::CSyncOperation(CState& state)
+	: CStateEventHandler(state)
+{
+}
+
+CSyncOperation::~CSyncOperation()
+{
+}
+
+bool CSyncOperation::Start(wxWindow* parent, CQueueView* pQueue)
+{
+	if (IsActive() || !pQueue) {
+		return false;
+	}
+
+	if (!m_state.IsRemoteConnected() || !m_state.IsRemoteIdle() || !m_state.IsLocalIdle()) {
+		return false;
+	}
+
+	site_ = m_state.GetSite();
+	localRoot_ = m_state.GetLocalDir();
+	remoteRoot_ = m_state.GetRemotePath();
+	if (!site_ || localRoot_.empty() || remoteRoot_.empty()) {
+		return false;
+	}
+
+	parent_ = parent;
+	m_pQueue = pQueue;
+
+	CFilterManager filter;
+	ActiveFilters const filters = filter.GetActiveFilters();
+
+	fz::duration const threshold = fz::duration::from_minutes(m_state.GetMainFrame().GetOptions().get_int(OPTION_COMPARISON_THRESHOLD));
+	planner_ = std::make_unique<sync_planner>(remoteRoot_, filters, threshold);
+	localDone_ = false;
+	remoteDone_ = false;
+
+	// Listings need to be seen before the recursive operations act on them
+	m_state.RegisterHandler(this, STATECHANGE_REMOTE_DIR_OTHER, m_state.GetRemoteRecursiveOperation());
+	m_state.RegisterHandler(this, STATECHANGE_REMOTE_IDLE);
+	m_state.RegisterHandler(this, STATECHANGE_LOCAL_RECURSION_LISTING);
+	m_state.RegisterHandler(this, STATECHANGE_LOCAL_RECURSION_STATUS);
+
+	// Local directories map onto remote ones, so that the planner can match them
+	local_recursion_root localRoot;
+	localRoot.add_dir_to_visit(localRoot_, remoteRoot_);
+	m_state.GetLocalRecursiveOperation()->AddRecursionRoot(std::move(localRoot));
+	m_state.GetLocalRecursiveOperation()->StartRecursiveOperation(recursive_operation::recursive_list, filters);
+
+	recursion_root remoteRoot(remoteRoot_, true);
+	remoteRoot.add_dir_to_visit_restricted(remoteRoot_, std::wstring(), true);
+	m_state.GetRemoteRecursiveOperation()->AddRecursionRoot(std::move(remoteRoot));
+	m_state.GetRemoteRecursiveOperation()->StartRecursiveOperation(recursive_operation::recursive_list, filters);
+
+	// In case an operation did not start at all
+	localDone_ = m_state.IsLocalIdle();
+	remoteDone_ = m_state.IsRemoteIdle();
+	if (localDone_ && remoteDone_) {
+		Finish();
+	}
+
+	return true;
+}
+
+void CSyncOperation::Stop()
+{
+	if (!IsActive()) {
+		return;
+	}
+
+	m_state.UnregisterHandler(this, STATECHANGE_LOCAL_RECURSION_STATUS);
+	m_state.UnregisterHandler(this, STATECHANGE_LOCAL_RECURSION_LISTING);
+	m_state.UnregisterHandler(this, STATECHANGE_REMOTE_IDLE);
+	m_state.UnregisterHandler(this, STATECHANGE_REMOTE_DIR_OTHER);
+
+	planner_.reset();
+}
+
+void CSyncOperation::OnStateChange(t_statechange_notifications notification, std::wstring const&, const void* data2)
+{
+	if (!IsActive()) {
+		return;
+	}
+
+	if (notification == STATECHANGE_REMOTE_DIR_OTHER && data2) {
+		auto recursiveOperation = m_state.GetRemoteRecursiveOperation();
+		if (recursiveOperation && recursiveOperation->GetOperationMode() == recursive_operation::recursive_list) {
+			std::shared_ptr<CDirectoryListing> const& listing = *reinterpret_cast<std::shared_ptr<CDirectoryListing> const*>(data2);
+			if (listing) {
+				planner_->add_remote(*listing);
+			}
+		}
+	}
+	else if (notification == STATECHANGE_LOCAL_RECURSION_LISTING && data2) {
+		planner_->add_local(*reinterpret_cast<CLocalRecursiveOperation::listing const*>(data2));
+	}
+	else if (notification == STATECHANGE_REMOTE_IDLE) {
+		if (m_state.IsRemoteIdle()) {
+			remoteDone_ = true;
+		}
+	}
+	else if (notification == STATECHANGE_LOCAL_RECURSION_STATUS) {
+		if (m_state.IsLocalIdle()) {
+			localDone_ = true;
+		}
+	}
+
+	if (localDone_ && remoteDone_) {
+		Finish();
+	}
+}
+
+void CSyncOperation::Finish()
+{
+	sync_plan const plan = planner_->plan();
+	Stop();
+
+	if (!m_state.IsRemoteConnected() || m_state.GetSite() != site_) {
+		return;
+	}
+
+	wxString msg;
+	if (plan.uploads.empty()) {
+		msg = wxString::Format(_("The remote directory '%s' is up to date with the local directory '%s'."), remoteRoot_.GetPath(), localRoot_.GetPath());
+	}
+	else {
+		msg = wxString::Format(wxPLURAL("%d file totalling %s would be uploaded from '%s' to '%s'.", "%d files totalling %s would be uploaded from '%s' to '%s'.", plan.upload_files),
+			static_cast<int>(plan.upload_files), CSizeFormat::Format(plan.upload_bytes, true), localRoot_.GetPath(), remoteRoot_.GetPath());
+	}
+	if (!plan.remote_only.empty()) {
+		msg += _T("\n\n");
+		msg += wxString::Format(wxPLURAL("%d file or directory only exists on the server, it will be kept.", "%d files and directories only exist on the server, they will be kept.", plan.remote_only.size()), static_cast<int>(plan.remote_only.size()));
+	}
+	if (!plan.conflicts.empty()) {
+		msg += _T("\n\n");
+		msg += wxString::Format(wxPLURAL("%d name is a file on one side and a directory on the other, it will be skipped.", "%d names are files on one side and directories on the other, they will be skipped.", plan.conflicts.size()), static_cast<int>(plan.conflicts.size()));
+	}
+	if (!plan.links.empty()) {
+		msg += _T("\n\n");
+		msg += wxString::Format(wxPLURAL("%d remote directory is a symbolic link, it will be skipped.", "%d remote directories are symbolic links, they will be skipped.", plan.links.size()), static_cast<int>(plan.links.size()));
+	}
+	if (!plan.unknown.empty()) {
+		msg += _T("\n\n");
+		msg += wxString::Format(wxPLURAL("%d remote directory could not be listed, it will be skipped.", "%d remote directories could not be listed, they will be skipped.", plan.unknown.size()), static_cast<int>(plan.unknown.size()));
+	}
+
+	if (plan.uploads.empty()) {
+		wxMessageBoxEx(msg, _("Synchronize remote directory"), wxICON_INFORMATION, parent_);
+		return;
+	}
+
+	msg += _T("\n\n");
+	msg += _("Add the files to the queue?");
+	if (wxMessageBoxEx(msg, _("Synchronize remote directory"), wxICON_QUESTION | wxYES_NO, parent_) != wxYES) {
+		return;
+	}
+
+	for (auto const& listing : plan.uploads) {
+		m_pQueue->QueueFiles(false, site_, listing);
+	}
+	m_pQueue->QueueFile_Finish(true);
+}
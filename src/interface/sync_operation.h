@@ -0,0 +1,41 @@
+#ifndef FILEZILLA_INTERFACE_SYNC_OPERATION_HEADER
+#define FILEZILLA_INTERFACE_SYNC_OPERATION_HEADER
+
+#include "state.h"
+#include "../commonui/sync_planner.h"
+
+#include <memory>
+
+class CQueueView;
+
+// Mirrors the current local directory tree to the current remote directory.
+// Both trees get listed recursively at the same time, then the planned uploads
+// are shown to the user and, once confirmed, added to the queue.
+class CSyncOperation final : public CStateEventHandler
+{
+public:
+	CSyncOperation(CState& state);
+	virtual ~CSyncOperation();
+
+	bool Start(wxWindow* parent, CQueueView* pQueue);
+	void Stop();
+
+	bool IsActive() const { return planner_ != nullptr; }
+
+protected:
+	virtual void OnStateChange(t_statechange_notifications notification, std::wstring const& data, const void* data2) override;
+
+	void Finish();
+
+	wxWindow* parent_{};
+	CQueueView* m_pQueue{};
+	Site site_;
+	CLocalPath localRoot_;
+	CServerPath remoteRoot_;
+
+	std::unique_ptr<sync_planner> planner_;
+	bool localDone_{};
+	bool remoteDone_{};
+};
+
+#endif
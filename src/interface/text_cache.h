@@ -0,0 +1,58 @@
+#ifndef FILEZILLA_INTERFACE_TEXT_CACHE_HEADER
+#define FILEZILLA_INTERFACE_TEXT_CACHE_HEADER
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+
+// Formatted texts of the rows that have been displayed, so that repainting
+// a list doesn't format the same sizes and times over and over again.
+//
+// Each entry remembers the value its text was formatted from and gets
+// reformatted if asked for a different one. Entries of rows whose contents
+// changed or that went away are therefore harmless, the cache never needs
+// to be told about changes to the list. Once it holds more entries than
+// ever fit on screen, it starts over.
+template<typename Key, typename Value, typename Text>
+class text_cache final
+{
+public:
+	explicit text_cache(size_t limit = 1000)
+		: limit_(limit)
+	{}
+
+	// Returns the text for the value, formatting it if needed
+	template<typename Format>
+	Text const& get(Key const& key, Value const& value, Format && format)
+	{
+		auto it = entries_.find(key);
+		if (it == entries_.end()) {
+			if (entries_.size() >= limit_) {
+				entries_.clear();
+			}
+			it = entries_.emplace(key, entry{value, format(value)}).first;
+		}
+		else if (!(it->second.value == value)) {
+			it->second.value = value;
+			it->second.text = format(value);
+		}
+		return it->second.text;
+	}
+
+	// Has to be called if the formatting itself changes
+	void clear() { entries_.clear(); }
+
+	size_t size() const { return entries_.size(); }
+
+private:
+	struct entry final
+	{
+		Value value;
+		Text text;
+	};
+
+	std::unordered_map<Key, entry> entries_;
+	size_t const limit_;
+};
+
+#endif
@@ -0,0 +1,365 @@
+#include "filezilla.h"
+#include "xml_stream.h"
+
+#include "../include/xml_string_writer.h"
+
+#include <libfilezilla/local_filesys.hpp>
+
+#include <cstdio>
+#include <string.h>
+
+namespace {
+bool replace_file(std::wstring const& source, std::wstring const& dest)
+{
+#ifdef FZ_WINDOWS
+	return MoveFileExW(source.c_str(), dest.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return std::rename(fz::to_native(source).c_str(), fz::to_native(dest).c_str()) == 0;
+#endif
+}
+}
+
+xml_stream_writer::xml_stream_writer(std::wstring const& file)
+	: target_(file)
+	, temp_(file + L".tmp")
+	, file_(fz::to_native(temp_), fz::file::writing, fz::file::empty)
+{
+}
+
+xml_stream_writer::~xml_stream_writer()
+{
+	if (!finished_) {
+		file_.close();
+		fz::remove_file(fz::to_native(temp_), false);
+	}
+}
+
+void xml_stream_writer::write(void const* data, size_t size)
+{
+	auto p = reinterpret_cast<uint8_t const*>(data);
+	while (size && file_.opened()) {
+		auto res = file_.write2(p, size);
+		if (res) {
+			size -= res.value_;
+			p += res.value_;
+		}
+		else {
+			file_.close();
+		}
+	}
+}
+
+void xml_stream_writer::write_declaration()
+{
+	write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+}
+
+void xml_stream_writer::open_element(pugi::xml_node element, unsigned int depth)
+{
+	// Let pugixml take care of escaping the attributes by printing
+	// an empty copy of the element, then turn it into a start tag.
+	pugi::xml_document document;
+	auto copy = document.append_child(element.name());
+	for (auto const& attribute : element.attributes()) {
+		copy.append_copy(attribute);
+	}
+
+	xml_string_writer tag;
+	copy.print(tag, "", pugi::format_raw, pugi::encoding_utf8);
+	auto & s = tag.result_;
+	if (s.size() >= 2 && s[s.size() - 2] == '/') {
+		s.erase(s.size() - 2);
+		while (!s.empty() && s.back() == ' ') {
+			s.pop_back();
+		}
+		s += '>';
+	}
+
+	write(std::string(depth, '\t') + s + '\n');
+}
+
+void xml_stream_writer::close_element(char const* name, unsigned int depth)
+{
+	write(std::string(depth, '\t') + "</" + name + ">\n");
+}
+
+void xml_stream_writer::write_element(pugi::xml_node element, unsigned int depth)
+{
+	element.print(*this, "\t", pugi::format_indent, pugi::encoding_utf8, depth);
+}
+
+bool xml_stream_writer::finish()
+{
+	if (finished_) {
+		return false;
+	}
+
+	bool const written = file_.opened() && file_.fsync();
+	file_.close();
+	if (!written || !replace_file(temp_, target_)) {
+		fz::remove_file(fz::to_native(temp_), false);
+		return false;
+	}
+
+	finished_ = true;
+	return true;
+}
+
+namespace {
+size_t const read_chunk_size = 256 * 1024;
+}
+
+xml_stream_reader::xml_stream_reader(std::wstring const& file)
+	: fileName_(file)
+{
+	fz::result r = file_.open(fz::to_native(file), fz::file::reading);
+	if (!r) {
+		error_ = fz::sprintf(fztranslate("Error %d opening '%s'"), r.error_, file);
+	}
+	else {
+		size_ = file_.size();
+	}
+}
+
+bool xml_stream_reader::fill()
+{
+	size_t const old = buffer_.size();
+	buffer_.resize(old + read_chunk_size);
+	auto read = file_.read2(buffer_.data() + old, read_chunk_size);
+	if (!read) {
+		buffer_.resize(old);
+		error_ = fz::sprintf(fztranslate("Reading from '%s' failed."), fileName_);
+		return false;
+	}
+	buffer_.resize(old + read.value_);
+
+	return read.value_ != 0;
+}
+
+bool xml_stream_reader::deliver(size_t start, size_t end, bool shallow, std::function<bool(pugi::xml_node)> const& on_element)
+{
+	pugi::xml_document document;
+	pugi::xml_parse_result result;
+	if (shallow) {
+		// Only the start tag, turned into an empty element
+		std::string const tag = buffer_.substr(start, end - start - 1) + "/>";
+		result = document.load_buffer(tag.c_str(), tag.size(), pugi::parse_default, pugi::encoding_utf8);
+	}
+	else {
+		result = document.load_buffer(buffer_.c_str() + start, end - start, pugi::parse_default, pugi::encoding_utf8);
+	}
+	if (!result) {
+		error_ = fz::sprintf(L"%s at offset %d.", result.description(), consumed_ + static_cast<int64_t>(start) + result.offset);
+		return false;
+	}
+
+	return on_element(document.first_child());
+}
+
+bool xml_stream_reader::read(std::vector<std::string> const& path, bool shallow,
+	std::function<bool(pugi::xml_node)> const& on_element,
+	std::function<bool()> const& on_end)
+{
+	if (!file_.opened()) {
+		return false;
+	}
+
+	error_.clear();
+	buffer_.clear();
+	pos_ = 0;
+	consumed_ = 0;
+	if (file_.seek(0, fz::file::begin) != 0) {
+		error_ = fz::sprintf(fztranslate("Reading from '%s' failed."), fileName_);
+		return false;
+	}
+
+	enum class state {
+		scanning,
+		capturing, // Inside an element to deliver, its data has to be kept
+		skipping // Inside an element delivered shallowly
+	} st = state::scanning;
+
+	std::vector<std::string> stack;
+	bool hasRoot{};
+	size_t captureStart{};
+	size_t captureDepth{};
+
+	// Drops processed data from the buffer and reads more.
+	// Returns false at the end of the file or on error.
+	bool eof{};
+	auto more = [&]() {
+		if (eof) {
+			return false;
+		}
+		size_t const discard = (st == state::capturing) ? captureStart : pos_;
+		if (discard) {
+			buffer_.erase(0, discard);
+			pos_ -= discard;
+			consumed_ += discard;
+			if (st == state::capturing) {
+				captureStart = 0;
+			}
+		}
+		if (!fill()) {
+			eof = true;
+			return false;
+		}
+		return true;
+	};
+
+	auto malformed = [&]() {
+		if (error_.empty()) {
+			error_ = fz::sprintf(fztranslate("Malformed XML at offset %d."), position());
+		}
+		return false;
+	};
+
+	while (true) {
+		size_t const lt = buffer_.find('<', pos_);
+		if (lt == std::string::npos) {
+			pos_ = buffer_.size();
+			if (!more()) {
+				if (!error_.empty() || !stack.empty() || !hasRoot) {
+					return malformed();
+				}
+				return true;
+			}
+			continue;
+		}
+		pos_ = lt;
+
+		// Make sure markup can be told apart from tags
+		if (buffer_.size() - pos_ < 9 && more()) {
+			continue;
+		}
+		if (!error_.empty()) {
+			return false;
+		}
+
+		auto starts = [&](char const* s) {
+			return buffer_.compare(pos_, strlen(s), s) == 0;
+		};
+
+		size_t end = std::string::npos;
+		bool markup = true;
+		if (starts("<!--")) {
+			end = buffer_.find("-->", pos_ + 4);
+			if (end != std::string::npos) {
+				end += 3;
+			}
+		}
+		else if (starts("<![CDATA[")) {
+			end = buffer_.find("]]>", pos_ + 9);
+			if (end != std::string::npos) {
+				end += 3;
+			}
+		}
+		else if (starts("<?")) {
+			end = buffer_.find("?>", pos_ + 2);
+			if (end != std::string::npos) {
+				end += 2;
+			}
+		}
+		else if (starts("<!")) {
+			end = buffer_.find('>', pos_ + 2);
+			if (end != std::string::npos) {
+				end += 1;
+			}
+		}
+		else {
+			markup = false;
+			char quote{};
+			for (size_t i = pos_ + 1; i < buffer_.size(); ++i) {
+				char const c = buffer_[i];
+				if (quote) {
+					if (c == quote) {
+						quote = 0;
+					}
+				}
+				else if (c == '"' || c == '\'') {
+					quote = c;
+				}
+				else if (c == '>') {
+					end = i + 1;
+					break;
+				}
+			}
+		}
+
+		if (end == std::string::npos) {
+			if (!more()) {
+				return malformed();
+			}
+			continue;
+		}
+
+		if (markup) {
+			pos_ = end;
+			continue;
+		}
+
+		if (buffer_[pos_ + 1] == '/') {
+			size_t nameEnd = pos_ + 2;
+			while (nameEnd < end && !strchr(" \t\r\n>", buffer_[nameEnd])) {
+				++nameEnd;
+			}
+			if (stack.empty() || buffer_.compare(pos_ + 2, nameEnd - pos_ - 2, stack.back()) != 0) {
+				return malformed();
+			}
+
+			bool const pathEnds = st == state::scanning && on_end && stack == path;
+			stack.pop_back();
+			pos_ = end;
+
+			if (pathEnds) {
+				if (!on_end()) {
+					return true;
+				}
+			}
+			else if (st != state::scanning && stack.size() == captureDepth) {
+				bool const capturing = st == state::capturing;
+				st = state::scanning;
+				if (capturing && !deliver(captureStart, end, false, on_element)) {
+					return error_.empty();
+				}
+			}
+			continue;
+		}
+
+		bool const selfClosing = buffer_[end - 2] == '/';
+
+		size_t nameEnd = pos_ + 1;
+		while (nameEnd < end && !strchr(" \t\r\n/>", buffer_[nameEnd])) {
+			++nameEnd;
+		}
+		std::string name = buffer_.substr(pos_ + 1, nameEnd - pos_ - 1);
+		if (name.empty()) {
+			return malformed();
+		}
+
+		size_t const start = pos_;
+		pos_ = end;
+
+		if (st == state::scanning && stack == path) {
+			if (shallow || selfClosing) {
+				if (!selfClosing) {
+					st = state::skipping;
+					captureDepth = stack.size();
+				}
+				if (!deliver(start, end, !selfClosing, on_element)) {
+					return error_.empty();
+				}
+			}
+			else {
+				st = state::capturing;
+				captureStart = start;
+				captureDepth = stack.size();
+			}
+		}
+
+		hasRoot = true;
+		if (!selfClosing) {
+			stack.push_back(std::move(name));
+		}
+	}
+}
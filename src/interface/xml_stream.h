@@ -0,0 +1,89 @@
+#ifndef FILEZILLA_INTERFACE_XML_STREAM_HEADER
+#define FILEZILLA_INTERFACE_XML_STREAM_HEADER
+
+/*
+ * Sequential reading and writing of large XML files, such as exported
+ * queues, without holding the whole document in memory.
+ */
+
+#include "../include/xmlutils.h"
+
+#include <libfilezilla/file.hpp>
+
+#include <functional>
+
+// Writes to a temporary file next to the target, which only replaces the
+// target once finished successfully.
+class xml_stream_writer final : public pugi::xml_writer
+{
+public:
+	explicit xml_stream_writer(std::wstring const& file);
+	virtual ~xml_stream_writer();
+
+	// Writes the XML declaration
+	void write_declaration();
+
+	// Writes the start tag of the given element, including its attributes
+	// but none of its children.
+	void open_element(pugi::xml_node element, unsigned int depth);
+	void close_element(char const* name, unsigned int depth);
+
+	// Writes the given element with all its children
+	void write_element(pugi::xml_node element, unsigned int depth);
+
+	// Flushes the file to disk and moves it in place of the target.
+	// Returns false if any write has failed, the target is left untouched then.
+	bool finish();
+
+	bool failed() const { return !file_.opened(); }
+
+	virtual void write(void const* data, size_t size) override;
+
+private:
+	void write(std::string const& data) { write(data.c_str(), data.size()); }
+
+	std::wstring const target_;
+	std::wstring const temp_;
+	fz::file file_;
+	bool finished_{};
+};
+
+class xml_stream_reader final
+{
+public:
+	explicit xml_stream_reader(std::wstring const& file);
+
+	// Hands the elements whose ancestors are exactly the given path to on_element,
+	// one at a time, each parsed into a document of its own. If shallow is set,
+	// only the start tag of these elements gets parsed and their content is skipped.
+	// on_end is called whenever the innermost element of the path is closed.
+	// Both callbacks can return false to stop reading.
+	// Returns false if the file could not be read or is malformed, e.g. if
+	// a closing tag does not match the open element or the file is truncated.
+	bool read(std::vector<std::string> const& path, bool shallow,
+		std::function<bool(pugi::xml_node)> const& on_element,
+		std::function<bool()> const& on_end = nullptr);
+
+	int64_t size() const { return size_; }
+
+	// Number of bytes processed so far
+	int64_t position() const { return consumed_ + static_cast<int64_t>(pos_); }
+
+	std::wstring const& error() const { return error_; }
+
+private:
+	bool fill();
+	bool deliver(size_t start, size_t end, bool shallow, std::function<bool(pugi::xml_node)> const& on_element);
+
+	std::wstring const fileName_;
+	fz::file file_;
+	int64_t size_{-1};
+
+	std::string buffer_;
+	size_t pos_{};
+	int64_t consumed_{};
+
+	std::wstring error_;
+};
+
+#endif
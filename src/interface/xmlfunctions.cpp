@@ -1,6 +1,7 @@
 #include "xmlfunctions.h"
 #include "loginmanager.h"
 #include "Options.h"
+#include "xml_stream.h"
 
 #include "../commonui/protect.h"
 #include "../commonui/xmlfunctions.h"
@@ -22,6 +23,26 @@ bool SaveWithErrorDialog(CXmlFile& file, bool updateMetadata)
 	return res;
 }
 
+bool StreamWithErrorDialog(std::wstring const& file, std::function<void(xml_stream_writer&)> const& write_children)
+{
+	CXmlFile xml;
+	auto root = xml.CreateEmpty();
+	xml.UpdateMetadata();
+
+	xml_stream_writer writer(file);
+	writer.write_declaration();
+	writer.open_element(root, 0);
+	write_children(writer);
+	writer.close_element(root.name(), 0);
+
+	bool res = writer.finish();
+	if (!res) {
+		wxString msg = wxString::Format(_("Could not write \"%s\":"), file);
+		wxMessageBoxEx(msg + _T("\n") + _("Failed to write xml file"), _("Error writing xml file"), wxICON_ERROR);
+	}
+	return res;
+}
+
 void SetServer(pugi::xml_node node, Site const& site)
 {
 	SetServer(node, site, CLoginManager::Get(), *COptions::Get());
@@ -8,8 +8,15 @@
 
 #include "../commonui/xml_file.h"
 
+#include <functional>
+
 bool SaveWithErrorDialog(CXmlFile& file, bool updateMetadata = true);
 
+// Writes a new XML file element by element, without building the document in
+// memory first. write_children writes the children of the root element.
+class xml_stream_writer;
+bool StreamWithErrorDialog(std::wstring const& file, std::function<void(xml_stream_writer&)> const& write_children);
+
 // Function to save CServer objects to the XML file
 void SetServer(pugi::xml_node node, Site const& site);
 
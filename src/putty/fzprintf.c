@@ -64,16 +64,9 @@ int fzprintf(sftpEventTypes type, const char* fmt, ...)
     return 0;
 }
 
-int fzprintf_raw_untrusted(sftpEventTypes type, const char* fmt, ...)
+static void write_untrusted(sftpEventTypes type, char* str)
 {
-    if (type == sftpDone || type == sftpReply) {
-        pending_reply = false;
-    }
-
-    va_list ap;
-    char* str, *p, *s;
-    va_start(ap, fmt);
-    str = dupvprintf(fmt, ap);
+    char *p, *s;
     p = str;
     s = str;
     while (*p) {
@@ -97,6 +90,20 @@ int fzprintf_raw_untrusted(sftpEventTypes type, const char* fmt, ...)
     }
     fputs(str, stdout);
     fputc('\n', stdout);
+}
+
+int fzprintf_raw_untrusted(sftpEventTypes type, const char* fmt, ...)
+{
+    if (type == sftpDone || type == sftpReply) {
+        pending_reply = false;
+    }
+
+    va_list ap;
+    char* str;
+    va_start(ap, fmt);
+    str = dupvprintf(fmt, ap);
+
+    write_untrusted(type, str);
     fflush(stdout);
 
     sfree(str);
@@ -106,6 +113,28 @@ int fzprintf_raw_untrusted(sftpEventTypes type, const char* fmt, ...)
     return 0;
 }
 
+int fzprintf_listentry(const char* longname, unsigned long mtime, const char* filename)
+{
+    char* str;
+
+    str = dupstr(longname);
+    write_untrusted(sftpListentry, str);
+    sfree(str);
+
+    fprintf(stdout, "%lu\n", mtime);
+
+    str = dupstr(filename);
+    write_untrusted(sftpUnknown, str);
+    sfree(str);
+
+    return 0;
+}
+
+void fzflush(void)
+{
+    fflush(stdout);
+}
+
 int fzprintf_raw(sftpEventTypes type, const char* fmt, ...)
 {
     if (type == sftpDone || type == sftpReply) {
@@ -1,4 +1,4 @@
-#define FZSFTP_PROTOCOL_VERSION 11
+#define FZSFTP_PROTOCOL_VERSION 13
 
 typedef enum
 {
@@ -33,6 +33,8 @@ typedef enum
     sftp_io_open,
     sftp_io_nextbuf,
     sftp_io_finalize,
+    sftp_item_result, /* payload: index and success of an item in a batch command */
+    sftp_extensions, /* payload: space-separated list of supported optional operations */
 } sftpEventTypes;
 
 extern bool pending_reply;
@@ -48,3 +50,8 @@ int fzprintf_raw(sftpEventTypes type, const char* p, ...);
 // Format the string, then print the type (if not sftpUnknown) and the string with linebreaks replaced by spaces.
 int fzprintf_raw_untrusted(sftpEventTypes type, const char* p, ...);
 int fznotify1(sftpEventTypes type, int data);
+
+// Print a complete directory listing entry, unlike the other functions output is not flushed.
+// Call fzflush once a batch of entries has been written.
+int fzprintf_listentry(const char* longname, unsigned long mtime, const char* filename);
+void fzflush(void);
@@ -645,6 +645,9 @@ int sftp_cmd_close(struct sftp_command *cmd)
  * List a directory. If no arguments are given, list pwd; otherwise
  * list the directory given in words[1].
  */
+#define LS_WINDOW_INITIAL 4
+#define LS_WINDOW_MAX 64
+
 int sftp_cmd_ls(struct sftp_command *cmd)
 {
     struct fxp_handle *dirh;
@@ -653,7 +656,7 @@ int sftp_cmd_ls(struct sftp_command *cmd)
     char *cdir;
     struct sftp_packet *pktin;
     struct sftp_request *req;
-    struct sftp_request *reqs[4];
+    struct sftp_request *reqs[LS_WINDOW_MAX];
     int i;
 
     if (!backend) {
@@ -684,26 +687,46 @@ int sftp_cmd_ls(struct sftp_command *cmd)
         return 0;
     }
 
-    reqs[0] = fxp_readdir_send(dirh);
-    reqs[1] = fxp_readdir_send(dirh);
-    reqs[2] = fxp_readdir_send(dirh);
-    reqs[3] = fxp_readdir_send(dirh);
-    int ri = 0;
-    while (1) {
+    /*
+     * Keep a window of FXP_READDIR requests in flight. Replies to
+     * requests on the same handle arrive in order, so the window is a
+     * simple ring. It starts small and grows by one request for each
+     * non-empty reply, up to LS_WINDOW_MAX, so that small directories
+     * don't cost extra requests while large directories on high-latency
+     * links quickly saturate the link.
+     */
+    int window = LS_WINDOW_INITIAL;
+    int first = 0, outstanding = 0;
+    bool done = false;
+    while (!done || outstanding) {
+        while (!done && outstanding < window) {
+            reqs[(first + outstanding++) % LS_WINDOW_MAX] = fxp_readdir_send(dirh);
+        }
+
+        req = reqs[first];
+        reqs[first] = NULL;
+        first = (first + 1) % LS_WINDOW_MAX;
+        --outstanding;
 
-        pktin = sftp_wait_for_reply(reqs[ri]);
-        names = fxp_readdir_recv(pktin, reqs[ri]);
-        reqs[ri] = NULL;
+        pktin = sftp_wait_for_reply(req);
+        if (done) {
+            /* Reply to a request sent before the end of the listing was seen */
+            sfree(req);
+            sfree(pktin);
+            continue;
+        }
 
+        names = fxp_readdir_recv(pktin, req);
         if (names == NULL) {
-            if (fxp_error_type() == SSH_FX_EOF)
-                break;
-            fzprintf(sftpError, "Reading directory %s: %s", dir, fxp_error());
-            break;
+            if (fxp_error_type() != SSH_FX_EOF)
+                fzprintf(sftpError, "Reading directory %s: %s", dir, fxp_error());
+            done = true;
+            continue;
         }
         if (names->nnames == 0) {
             fxp_free_names(names);
-            break;
+            done = true;
+            continue;
         }
 
         for (i = 0; i < names->nnames; i++) {
@@ -711,23 +734,15 @@ int sftp_cmd_ls(struct sftp_command *cmd)
             if (names->names[i].attrs.flags & SSH_FILEXFER_ATTR_ACMODTIME) {
                 mtime = names->names[i].attrs.mtime;
             }
-            fzprintf_raw_untrusted(sftpListentry, "%s", names->names[i].longname);
-            fzprintf_raw_untrusted(sftpUnknown, "%lu", mtime);
-            fzprintf_raw_untrusted(sftpUnknown, "%s", names->names[i].filename);
+            fzprintf_listentry(names->names[i].longname, mtime, names->names[i].filename);
         }
+        /* Hand the whole batch to the engine at once */
+        fzflush();
 
         fxp_free_names(names);
-        reqs[ri++] = fxp_readdir_send(dirh);
-        ri %= 4;
-    }
-    for (i = 0; i < 4; ++i) {
-        if (reqs[ri]) {
-            pktin = sftp_wait_for_reply(reqs[ri]);
-            sfree(reqs[ri]);
-            sfree(pktin);
-        }
-        ++ri;
-        ri %= 4;
+
+        if (window < LS_WINDOW_MAX)
+            ++window;
     }
     req = fxp_close_send(dirh);
     pktin = sftp_wait_for_reply(req);
@@ -1025,6 +1040,84 @@ int sftp_cmd_rm(struct sftp_command *cmd)
     return ret;
 }
 
+/*
+ * Delete many files in the same directory: mrm <dir> <name>...
+ *
+ * Unlike rm, the directory is canonified only once and up to
+ * MRM_WINDOW FXP_REMOVE requests are kept in flight, so deleting many
+ * files doesn't cost a round trip each. The result of each file is
+ * reported with sftp_item_result, giving its index in the name list.
+ */
+#define MRM_WINDOW 64
+
+int sftp_cmd_mrm(struct sftp_command *cmd)
+{
+    struct sftp_packet *pktin;
+    struct sftp_request *req;
+    char *cdir;
+    const char *slash;
+    size_t next, outstanding = 0;
+    int ret = 1;
+
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords < 3) {
+        fzprintf(sftpError, "mrm: expects a directory and at least one filename");
+        return 0;
+    }
+
+    cdir = canonify(cmd->words[1], false);
+    if (!cdir) {
+        fzprintf(sftpError, "%s: canonify: %s", cmd->words[1], fxp_error());
+        return 0;
+    }
+    slash = (*cdir && cdir[strlen(cdir) - 1] == '/') ? "" : "/";
+
+    next = 2;
+    while (next < cmd->nwords || outstanding) {
+        while (next < cmd->nwords && outstanding < MRM_WINDOW) {
+            char *fname = dupcat(cdir, slash, cmd->words[next]);
+            req = fxp_remove_send(fname);
+            sfree(fname);
+            fxp_set_userdata(req, (void *)(uintptr_t)next);
+            sftp_register(req);
+            ++next;
+            ++outstanding;
+        }
+
+        pktin = sftp_recv();
+        if (pktin == NULL) {
+            seat_connection_fatal(
+                psftp_seat, "did not receive SFTP response packet from server");
+        }
+        req = sftp_find_request(pktin);
+        if (!req || !fxp_get_userdata(req)) {
+            seat_connection_fatal(
+                psftp_seat,
+                "unable to understand SFTP response packet from server: %s",
+                fxp_error());
+        }
+        size_t i = (uintptr_t)fxp_get_userdata(req);
+        --outstanding;
+
+        if (!fxp_remove_recv(pktin, req)) {
+            fzprintf(sftpError, "rm %s%s%s: %s", cdir, slash, cmd->words[i], fxp_error());
+            fzprintf(sftp_item_result, "%d 0", (int)(i - 2));
+            ret = 0;
+        }
+        else {
+            fzprintf(sftp_item_result, "%d 1", (int)(i - 2));
+        }
+    }
+
+    sfree(cdir);
+
+    return ret;
+}
+
 static int sftp_action_mv(char* source, char* target)
 {
     struct sftp_packet *pktin;
@@ -1085,6 +1178,199 @@ int sftp_cmd_mv(struct sftp_command *cmd)
     return ret;
 }
 
+/*
+ * Hash a file on the server: chkfile <algorithms> <filename>
+ *
+ * Replies with the algorithm the server picked, followed by the hash
+ * in hex.
+ */
+int sftp_cmd_chkfile(struct sftp_command *cmd)
+{
+    struct sftp_packet *pktin;
+    struct sftp_request *req;
+    char *cname, *algorithm;
+    unsigned char *hash;
+    size_t hashlen, i;
+    strbuf *hex;
+
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords != 3) {
+        fzprintf(sftpError, "chkfile: expects a list of hash algorithms and a filename");
+        return 0;
+    }
+
+    if (!(fxp_supported_extensions() & FXP_EXT_CHECK_FILE)) {
+        fzprintf(sftpError, "chkfile: server does not support the check-file extension");
+        return 0;
+    }
+
+    cname = canonify(cmd->words[2], true);
+    if (!cname) {
+        fzprintf(sftpError, "%s: canonify: %s", cmd->words[2], fxp_error());
+        return 0;
+    }
+
+    req = fxp_check_file_name_send(cname, cmd->words[1]);
+    pktin = sftp_wait_for_reply(req);
+    if (!fxp_check_file_recv(pktin, req, &algorithm, &hash, &hashlen)) {
+        fzprintf(sftpError, "chkfile %s: %s", cname, fxp_error());
+        sfree(cname);
+        return 0;
+    }
+    sfree(cname);
+
+    hex = strbuf_new();
+    for (i = 0; i < hashlen; ++i)
+        strbuf_catf(hex, "%02x", hash[i]);
+    fzprintf(sftpReply, "%s %s", algorithm, hex->s);
+
+    strbuf_free(hex);
+    sfree(hash);
+    sfree(algorithm);
+
+    return 1;
+}
+
+/*
+ * Copy a file on the server: cp <source> <target>
+ *
+ * Uses copy-file if available. Otherwise the data is copied with
+ * copy-data in chunks of COPY_DATA_CHUNK bytes, each chunk being
+ * a separate request so the server doesn't fall silent for the
+ * whole duration of copying large files.
+ */
+#define COPY_DATA_CHUNK (64 * 1024 * 1024)
+
+static bool sftp_copy_data(char *source, char *target)
+{
+    struct sftp_packet *pktin;
+    struct sftp_request *req;
+    struct fxp_handle *from, *to;
+    struct fxp_attrs attrs, newattrs;
+    uint64_t offset, size;
+    bool ret = true;
+
+    req = fxp_open_send(source, SSH_FXF_READ, NULL);
+    pktin = sftp_wait_for_reply(req);
+    from = fxp_open_recv(pktin, req);
+    if (!from) {
+        fzprintf(sftpError, "%s: open for read: %s", source, fxp_error());
+        return false;
+    }
+
+    req = fxp_fstat_send(from);
+    pktin = sftp_wait_for_reply(req);
+    if (!fxp_fstat_recv(pktin, req, &attrs))
+        attrs.flags = 0;
+
+    newattrs.flags = 0;
+    if (attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) {
+        newattrs.flags = SSH_FILEXFER_ATTR_PERMISSIONS;
+        newattrs.permissions = attrs.permissions;
+    }
+    req = fxp_open_send(target, SSH_FXF_WRITE | SSH_FXF_CREAT | SSH_FXF_TRUNC,
+                        &newattrs);
+    pktin = sftp_wait_for_reply(req);
+    to = fxp_open_recv(pktin, req);
+    if (!to) {
+        fzprintf(sftpError, "%s: open for write: %s", target, fxp_error());
+        req = fxp_close_send(from);
+        pktin = sftp_wait_for_reply(req);
+        fxp_close_recv(pktin, req);
+        return false;
+    }
+
+    size = (attrs.flags & SSH_FILEXFER_ATTR_SIZE) ? attrs.size : 0;
+    offset = 0;
+    do {
+        /* The last chunk copies up to EOF, in case the file grew. */
+        uint64_t len = (size - offset > COPY_DATA_CHUNK) ? COPY_DATA_CHUNK : 0;
+        req = fxp_copy_data_send(from, offset, len, to, offset);
+        pktin = sftp_wait_for_reply(req);
+        if (!fxp_copy_data_recv(pktin, req)) {
+            fzprintf(sftpError, "cp %s %s: %s", source, target, fxp_error());
+            ret = false;
+            break;
+        }
+        if (!len)
+            break;
+        offset += len;
+        fzprintf(sftpVerbose, "Copied %"PRIu64" of %"PRIu64" bytes",
+                 offset, size);
+    } while (offset < size);
+
+    req = fxp_close_send(to);
+    pktin = sftp_wait_for_reply(req);
+    if (!fxp_close_recv(pktin, req) && ret) {
+        fzprintf(sftpError, "%s: close: %s", target, fxp_error());
+        ret = false;
+    }
+    req = fxp_close_send(from);
+    pktin = sftp_wait_for_reply(req);
+    fxp_close_recv(pktin, req);
+
+    return ret;
+}
+
+int sftp_cmd_cp(struct sftp_command *cmd)
+{
+    struct sftp_packet *pktin;
+    struct sftp_request *req;
+    char *source, *target;
+    unsigned extensions = fxp_supported_extensions();
+    int ret;
+
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords != 3) {
+        fzprintf(sftpError, "cp: expects two filenames");
+        return 0;
+    }
+
+    if (!(extensions & (FXP_EXT_COPY_FILE | FXP_EXT_COPY_DATA))) {
+        fzprintf(sftpError, "cp: server does not support copying files");
+        return 0;
+    }
+
+    source = canonify(cmd->words[1], true);
+    if (!source) {
+        fzprintf(sftpError, "%s: canonify: %s", cmd->words[1], fxp_error());
+        return 0;
+    }
+
+    target = canonify(cmd->words[2], true);
+    if (!target) {
+        fzprintf(sftpError, "%s: canonify: %s", cmd->words[2], fxp_error());
+        sfree(source);
+        return 0;
+    }
+
+    if (extensions & FXP_EXT_COPY_FILE) {
+        req = fxp_copy_file_send(source, target, true);
+        pktin = sftp_wait_for_reply(req);
+        ret = fxp_copy_file_recv(pktin, req);
+        if (!ret)
+            fzprintf(sftpError, "cp %s %s: %s", source, target, fxp_error());
+    } else {
+        ret = sftp_copy_data(source, target);
+    }
+
+    if (ret)
+        fzprintf(sftpReply, "cp %s %s: OK", source, target);
+
+    sfree(source);
+    sfree(target);
+
+    return ret;
+}
+
 struct sftp_context_chmod {
     unsigned attrs_clr, attrs_xor;
 };
@@ -1443,6 +1729,9 @@ static struct sftp_cmd_lookup {
     {
         "cd", sftp_cmd_cd
     },
+    {
+        "chkfile", sftp_cmd_chkfile
+    },
     {
         "chmod", sftp_cmd_chmod
     },
@@ -1452,6 +1741,9 @@ static struct sftp_cmd_lookup {
     {
         "close", sftp_cmd_close
     },
+    {
+        "cp", sftp_cmd_cp
+    },
     {
         "del", sftp_cmd_rm
     },
@@ -1474,6 +1766,9 @@ static struct sftp_cmd_lookup {
     {
         "mkdir", sftp_cmd_mkdir
     },
+    {
+        "mrm", sftp_cmd_mrm
+    },
     {
         "mtime", sftp_cmd_mtime
     },
@@ -1663,6 +1958,16 @@ static int do_sftp_init(void)
         return 1;                      /* failure */
     }
 
+    /*
+     * Tell the engine which of the optional operations it can use.
+     */
+    {
+        unsigned extensions = fxp_supported_extensions();
+        fzprintf(sftp_extensions, "%s%s",
+                 (extensions & FXP_EXT_CHECK_FILE) ? " check-file" : "",
+                 (extensions & (FXP_EXT_COPY_FILE | FXP_EXT_COPY_DATA)) ? " copy" : "");
+    }
+
     /*
      * Find out where our home directory is.
      */
@@ -2205,6 +2510,12 @@ int psftp_main(int argc, char *argv[])
             /* We have our own verbosity in addition to `flags'. */
             if (cmdline_verbose())
                 verbose = true;
+        } else if (strcmp(argv[i], "-Z") == 0 && i + 1 < argc) {
+            /* FZ: Compression level, only used with the system zlib */
+            i++;
+#ifdef FZ_SYSTEM_ZLIB
+            ssh_zlib_system_set_level(atoi(argv[i]));
+#endif
         } else if (strcmp(argv[i], "-V") == 0 ||
                    strcmp(argv[i], "--version") == 0) {
             version();
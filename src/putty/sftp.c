@@ -19,6 +19,7 @@ static char *fxp_error_message;
 static int fxp_errtype;
 
 static void fxp_internal_error(const char *msg);
+static unsigned fxp_extensions;
 
 /* ----------------------------------------------------------------------
  * Client-specific parts of the send- and receive-packet system.
@@ -309,16 +310,34 @@ bool fxp_init(void)
         return false;
     }
     /*
-     * In principle, this packet might also contain extension-
-     * string pairs. We should work through them and look for any
-     * we recognise. In practice we don't currently do so because
-     * we know we don't recognise _any_.
+     * The rest of the packet consists of extension-name/data string
+     * pairs. Remember the ones we know how to use.
      */
+    fxp_extensions = 0;
+    while (get_avail(pktin)) {
+        ptrlen name = get_string(pktin);
+        get_string(pktin); /* extension data, unused */
+        if (get_err(pktin))
+            break;
+
+        if (ptrlen_eq_string(name, "check-file") ||
+            ptrlen_eq_string(name, "check-file-name"))
+            fxp_extensions |= FXP_EXT_CHECK_FILE;
+        else if (ptrlen_eq_string(name, "copy-data"))
+            fxp_extensions |= FXP_EXT_COPY_DATA;
+        else if (ptrlen_eq_string(name, "copy-file"))
+            fxp_extensions |= FXP_EXT_COPY_FILE;
+    }
     sftp_pkt_free(pktin);
 
     return true;
 }
 
+unsigned fxp_supported_extensions(void)
+{
+    return fxp_extensions;
+}
+
 /*
  * Canonify a pathname.
  */
@@ -843,6 +862,127 @@ bool fxp_write_recv(struct sftp_packet *pktin, struct sftp_request *req)
     return fxp_errtype == SSH_FX_OK;
 }
 
+/*
+ * Ask the server for the hash of a whole file (check-file-name
+ * extension). 'algorithms' is a comma-separated list in order of
+ * preference.
+ */
+struct sftp_request *fxp_check_file_name_send(const char *fname,
+                                              const char *algorithms)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "check-file-name");
+    put_stringz(pktout, fname);
+    put_stringz(pktout, algorithms);
+    put_uint64(pktout, 0);             /* start offset */
+    put_uint64(pktout, 0);             /* length, 0 is up to EOF */
+    put_uint32(pktout, 0);             /* block size, 0 is a single hash */
+    sftp_send(pktout);
+
+    return req;
+}
+
+/*
+ * Returns the algorithm the server picked in 'algorithm' and the
+ * hash in 'hash', both to be freed by the caller.
+ */
+bool fxp_check_file_recv(struct sftp_packet *pktin, struct sftp_request *req,
+                         char **algorithm, unsigned char **hash,
+                         size_t *hashlen)
+{
+    sfree(req);
+
+    if (pktin->type == SSH_FXP_EXTENDED_REPLY) {
+        ptrlen name, alg, data;
+
+        name = get_string(pktin);
+        alg = get_string(pktin);
+        data = get_data(pktin, get_avail(pktin));
+        if (get_err(pktin) || !ptrlen_eq_string(name, "check-file") ||
+            !alg.len || !data.len) {
+            fxp_internal_error("malformed check-file reply");
+            sftp_pkt_free(pktin);
+            return false;
+        }
+        *algorithm = mkstr(alg);
+        *hash = snewn(data.len, unsigned char);
+        memcpy(*hash, data.ptr, data.len);
+        *hashlen = data.len;
+        sftp_pkt_free(pktin);
+        return true;
+    } else {
+        fxp_got_status(pktin);
+        sftp_pkt_free(pktin);
+        return false;
+    }
+}
+
+/*
+ * Copy data between two open files on the server (copy-data
+ * extension). A length of 0 copies up to the end of the source.
+ */
+struct sftp_request *fxp_copy_data_send(struct fxp_handle *from,
+                                        uint64_t from_offset, uint64_t len,
+                                        struct fxp_handle *to,
+                                        uint64_t to_offset)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "copy-data");
+    put_string(pktout, from->hstring, from->hlen);
+    put_uint64(pktout, from_offset);
+    put_uint64(pktout, len);
+    put_string(pktout, to->hstring, to->hlen);
+    put_uint64(pktout, to_offset);
+    sftp_send(pktout);
+
+    return req;
+}
+
+bool fxp_copy_data_recv(struct sftp_packet *pktin, struct sftp_request *req)
+{
+    sfree(req);
+    fxp_got_status(pktin);
+    sftp_pkt_free(pktin);
+    return fxp_errtype == SSH_FX_OK;
+}
+
+/*
+ * Copy a whole file on the server (copy-file extension).
+ */
+struct sftp_request *fxp_copy_file_send(const char *srcfname,
+                                        const char *dstfname,
+                                        bool overwrite)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "copy-file");
+    put_stringz(pktout, srcfname);
+    put_stringz(pktout, dstfname);
+    put_bool(pktout, overwrite);
+    sftp_send(pktout);
+
+    return req;
+}
+
+bool fxp_copy_file_recv(struct sftp_packet *pktin, struct sftp_request *req)
+{
+    sfree(req);
+    fxp_got_status(pktin);
+    sftp_pkt_free(pktin);
+    return fxp_errtype == SSH_FX_OK;
+}
+
 /*
  * Free up an fxp_names structure.
  */
@@ -168,6 +168,14 @@ int fxp_error_type(void);
  */
 bool fxp_init(void);
 
+/*
+ * Extensions announced by the server that we know how to use.
+ */
+#define FXP_EXT_CHECK_FILE                        0x1
+#define FXP_EXT_COPY_DATA                         0x2
+#define FXP_EXT_COPY_FILE                         0x4
+unsigned fxp_supported_extensions(void);
+
 /*
  * Canonify a pathname. Concatenate the two given path elements
  * with a separating slash, unless the second is NULL.
@@ -258,6 +266,26 @@ struct sftp_request *fxp_write_send(struct fxp_handle *handle,
                                     void *buffer, uint64_t offset, int len);
 bool fxp_write_recv(struct sftp_packet *pktin, struct sftp_request *req);
 
+/*
+ * Server-side hashing and copying. Only usable if the server
+ * announced the corresponding extension in its FXP_VERSION, see
+ * fxp_supported_extensions().
+ */
+struct sftp_request *fxp_check_file_name_send(const char *fname,
+                                              const char *algorithms);
+bool fxp_check_file_recv(struct sftp_packet *pktin, struct sftp_request *req,
+                         char **algorithm, unsigned char **hash,
+                         size_t *hashlen);
+struct sftp_request *fxp_copy_data_send(struct fxp_handle *from,
+                                        uint64_t from_offset, uint64_t len,
+                                        struct fxp_handle *to,
+                                        uint64_t to_offset);
+bool fxp_copy_data_recv(struct sftp_packet *pktin, struct sftp_request *req);
+struct sftp_request *fxp_copy_file_send(const char *srcfname,
+                                        const char *dstfname,
+                                        bool overwrite);
+bool fxp_copy_file_recv(struct sftp_packet *pktin, struct sftp_request *req);
+
 /*
  * Read from a directory.
  */
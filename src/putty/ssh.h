@@ -1028,6 +1028,10 @@ extern const ssh2_macalg ssh_hmac_sha1_96_buggy;
 extern const ssh2_macalg ssh_hmac_sha256;
 extern const ssh2_macalg ssh2_poly1305;
 extern const ssh_compression_alg ssh_zlib;
+#ifdef FZ_SYSTEM_ZLIB
+extern const ssh_compression_alg ssh_zlib_system;
+void ssh_zlib_system_set_level(int level);
+#endif
 
 /* Special constructor: BLAKE2b can be instantiated with any hash
  * length up to 128 bytes */
@@ -70,8 +70,16 @@ static const ssh_compression_alg ssh_comp_none = {
     .decompress = ssh_decomp_none_block,
     .text_name = NULL,
 };
+
+/* FZ: Prefer the system zlib, if available, over our own deflate */
+#ifdef FZ_SYSTEM_ZLIB
+#define ssh_zlib_preferred ssh_zlib_system
+#else
+#define ssh_zlib_preferred ssh_zlib
+#endif
+
 const static ssh_compression_alg *const compressions[] = {
-    &ssh_zlib, &ssh_comp_none
+    &ssh_zlib_preferred, &ssh_comp_none
 };
 
 static void ssh2_transport_free(PacketProtocolLayer *);
@@ -632,7 +640,7 @@ static void ssh2_write_kexinit_lists(
      * Set up preferred compression.
      */
     if (conf_get_bool(conf, CONF_compression))
-        preferred_comp = &ssh_zlib;
+        preferred_comp = &ssh_zlib_preferred;
     else
         preferred_comp = &ssh_comp_none;
 
@@ -0,0 +1,191 @@
+/*
+ * sshsyszlib.c: SSH compression using the system zlib.
+ *
+ * Produces and consumes the same zlib@openssh.com stream as
+ * sshzlib.c, but uses zlib's own deflate, which is considerably
+ * faster and, unlike our static-trees-only compressor, supports
+ * dynamic Huffman trees and a configurable compression level.
+ *
+ * Each packet is terminated with a partial flush, which is what
+ * OpenSSH does as well.
+ */
+
+#ifdef FZ_SYSTEM_ZLIB
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <zlib.h>
+
+#include "ssh.h"
+
+static int compression_level = Z_DEFAULT_COMPRESSION;
+
+void ssh_zlib_system_set_level(int level)
+{
+    if (level < 1 || level > 9)
+        level = Z_DEFAULT_COMPRESSION;
+    compression_level = level;
+}
+
+/* ----------------------------------------------------------------------
+ * Compression.
+ */
+
+struct ssh_syszlib_compressor {
+    z_stream zs;
+    ssh_compressor sc;
+};
+
+static ssh_compressor *syszlib_compress_init(void)
+{
+    struct ssh_syszlib_compressor *comp =
+        snew(struct ssh_syszlib_compressor);
+    memset(&comp->zs, 0, sizeof(comp->zs));
+
+    if (deflateInit(&comp->zs, compression_level) != Z_OK)
+        out_of_memory();
+
+    comp->sc.vt = &ssh_zlib_system;
+    return &comp->sc;
+}
+
+static void syszlib_compress_cleanup(ssh_compressor *sc)
+{
+    struct ssh_syszlib_compressor *comp =
+        container_of(sc, struct ssh_syszlib_compressor, sc);
+    deflateEnd(&comp->zs);
+    smemclr(comp, sizeof(*comp));
+    sfree(comp);
+}
+
+/*
+ * Run deflate with the given flush mode until it has consumed all
+ * input and emitted everything it has, appending to outbuf.
+ */
+static void syszlib_deflate(struct ssh_syszlib_compressor *comp,
+                            strbuf *outbuf, int flush)
+{
+    do {
+        size_t space = deflateBound(&comp->zs, comp->zs.avail_in) + 16;
+        comp->zs.next_out = strbuf_append(outbuf, space);
+        comp->zs.avail_out = space;
+
+        int ret = deflate(&comp->zs, flush);
+        assert(ret == Z_OK || ret == Z_BUF_ERROR);
+        (void)ret;
+
+        strbuf_shrink_by(outbuf, comp->zs.avail_out);
+    } while (comp->zs.avail_in || !comp->zs.avail_out);
+}
+
+static void syszlib_compress_block(ssh_compressor *sc,
+                                   const unsigned char *block, int len,
+                                   unsigned char **outblock, int *outlen,
+                                   int minlen)
+{
+    struct ssh_syszlib_compressor *comp =
+        container_of(sc, struct ssh_syszlib_compressor, sc);
+    strbuf *outbuf = strbuf_new_nm();
+
+    comp->zs.next_in = (Bytef *)block;
+    comp->zs.avail_in = len;
+    syszlib_deflate(comp, outbuf, Z_PARTIAL_FLUSH);
+
+    if (outbuf->len < (size_t)minlen) {
+        /*
+         * We've been asked to pad the compressed data to a minimum
+         * length. A sync flush gets us to a byte boundary, after
+         * which we can append empty stored blocks (BFINAL=0,
+         * BTYPE=00, LEN=0, NLEN=0xFFFF) without disturbing
+         * deflate's state.
+         */
+        syszlib_deflate(comp, outbuf, Z_SYNC_FLUSH);
+        while (outbuf->len < (size_t)minlen) {
+            static const unsigned char empty_stored[5] = {
+                0x00, 0x00, 0x00, 0xFF, 0xFF };
+            put_data(outbuf, empty_stored, sizeof(empty_stored));
+        }
+    }
+
+    *outlen = outbuf->len;
+    *outblock = (unsigned char *)strbuf_to_str(outbuf);
+}
+
+/* ----------------------------------------------------------------------
+ * Decompression.
+ */
+
+struct ssh_syszlib_decompressor {
+    z_stream zs;
+    ssh_decompressor dc;
+};
+
+static ssh_decompressor *syszlib_decompress_init(void)
+{
+    struct ssh_syszlib_decompressor *decomp =
+        snew(struct ssh_syszlib_decompressor);
+    memset(&decomp->zs, 0, sizeof(decomp->zs));
+
+    if (inflateInit(&decomp->zs) != Z_OK)
+        out_of_memory();
+
+    decomp->dc.vt = &ssh_zlib_system;
+    return &decomp->dc;
+}
+
+static void syszlib_decompress_cleanup(ssh_decompressor *dc)
+{
+    struct ssh_syszlib_decompressor *decomp =
+        container_of(dc, struct ssh_syszlib_decompressor, dc);
+    inflateEnd(&decomp->zs);
+    smemclr(decomp, sizeof(*decomp));
+    sfree(decomp);
+}
+
+static bool syszlib_decompress_block(ssh_decompressor *dc,
+                                     const unsigned char *block, int len,
+                                     unsigned char **outblock, int *outlen)
+{
+    struct ssh_syszlib_decompressor *decomp =
+        container_of(dc, struct ssh_syszlib_decompressor, dc);
+    strbuf *outbuf = strbuf_new_nm();
+
+    decomp->zs.next_in = (Bytef *)block;
+    decomp->zs.avail_in = len;
+
+    do {
+        size_t space = (size_t)len * 4 + 256;
+        decomp->zs.next_out = strbuf_append(outbuf, space);
+        decomp->zs.avail_out = space;
+
+        int ret = inflate(&decomp->zs, Z_SYNC_FLUSH);
+        strbuf_shrink_by(outbuf, decomp->zs.avail_out);
+
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            /* Z_STREAM_END is an error too, the stream never ends */
+            strbuf_free(outbuf);
+            *outblock = NULL;
+            *outlen = 0;
+            return false;
+        }
+    } while (decomp->zs.avail_in || !decomp->zs.avail_out);
+
+    *outlen = outbuf->len;
+    *outblock = (unsigned char *)strbuf_to_str(outbuf);
+    return true;
+}
+
+const ssh_compression_alg ssh_zlib_system = {
+    .name = "zlib",
+    .delayed_name = "zlib@openssh.com", /* delayed version */
+    .compress_new = syszlib_compress_init,
+    .compress_free = syszlib_compress_cleanup,
+    .compress = syszlib_compress_block,
+    .decompress_new = syszlib_decompress_init,
+    .decompress_free = syszlib_decompress_cleanup,
+    .decompress = syszlib_decompress_block,
+    .text_name = "zlib (RFC1950, system library)",
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "fakeftpserver.h"
+
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <iostream>
+
+/*
+ * Measures small uploads against the in-process FTP server with a delay
+ * on each reply, standing in for the round trip to a remote server. The
+ * files are uploaded one transfer command at a time and as a single batch.
+ * For each, the time and the number of commands per file are reported.
+ * The commands per file times the delay is the lower bound, as every one
+ * of them waits for its reply.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/batchtransferbench [files] [delay in ms]
+ */
+
+namespace {
+void report(std::string const& what, fz::duration const& d, size_t files, size_t commands)
+{
+	std::cout << fz::sprintf("%s: %d ms, %d ms/file, %d commands/file", what, d.get_milliseconds(), d.get_milliseconds() / static_cast<int64_t>(files), commands / files) << std::endl;
+}
+
+std::vector<CFileTransferCommand> make_transfers(std::wstring const& prefix, size_t count)
+{
+	std::vector<CFileTransferCommand> transfers;
+	for (size_t i = 0; i < count; ++i) {
+		transfers.emplace_back(fz::view_reader_factory(L"f", std::string_view("data")), CServerPath(L"/"), fz::sprintf(L"%s%d.txt", prefix, i), transfer_flags());
+	}
+	return transfers;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t files = 50;
+	int64_t delay = 10;
+	if (argc > 1) {
+		files = fz::to_integral<size_t>(std::string_view(argv[1]));
+	}
+	if (argc > 2) {
+		delay = fz::to_integral<int64_t>(std::string_view(argv[2]), -1);
+	}
+	if (!files || delay < 0) {
+		std::cerr << "Usage: " << argv[0] << " [files] [delay in ms]" << std::endl;
+		return 1;
+	}
+
+	std::cout << fz::sprintf("%d files, %d ms per reply", files, delay) << std::endl;
+
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	fake_ftp_server server(loop);
+	if (server.port() <= 0) {
+		std::cerr << "Could not start the server" << std::endl;
+		return 1;
+	}
+
+	test_client client;
+
+	CServer server_info(INSECURE_FTP, DEFAULT, L"127.0.0.1", server.port());
+	Credentials credentials;
+	credentials.logonType_ = LogonType::anonymous;
+	if (client.Execute(CConnectCommand(server_info, std::make_shared<ServerHandleData>(), credentials, false)) != FZ_REPLY_OK) {
+		std::cerr << "Could not connect" << std::endl;
+		return 1;
+	}
+
+	// Lists the directory, so that neither run below has to
+	client.Execute(CListCommand(CServerPath(L"/")));
+
+	server.set_reply_delay(fz::duration::from_milliseconds(delay));
+
+	size_t before = server.commands().size();
+	auto start = fz::monotonic_clock::now();
+	for (auto const& transfer : make_transfers(L"single", files)) {
+		if (client.Execute(transfer) != FZ_REPLY_OK) {
+			std::cerr << "Upload failed" << std::endl;
+			return 1;
+		}
+	}
+	report("One at a time", fz::monotonic_clock::now() - start, files, server.commands().size() - before);
+
+	before = server.commands().size();
+	start = fz::monotonic_clock::now();
+	if (client.Execute(CBatchTransferCommand(make_transfers(L"batch", files))) != FZ_REPLY_OK) {
+		std::cerr << "Batch failed" << std::endl;
+		return 1;
+	}
+	report("Batch", fz::monotonic_clock::now() - start, files, server.commands().size() - before);
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+#include "fakeftpserver.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <algorithm>
+
+/*
+ * Runs batched transfers against a minimal in-process FTP server and checks
+ * that the engine treats each member of the batch like a standalone
+ * transfer, e.g. that uploads end up in the directory cache, and that only
+ * the commands of the transfer itself are sent for each file.
+ */
+
+class CBatchTransferTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CBatchTransferTest);
+	CPPUNIT_TEST(testUploadUpdatesCache);
+	CPPUNIT_TEST(testCommandsPerFile);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testUploadUpdatesCache();
+	void testCommandsPerFile();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CBatchTransferTest);
+
+void CBatchTransferTest::testUploadUpdatesCache()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	fake_ftp_server server(loop);
+	CPPUNIT_ASSERT(server.port() > 0);
+
+	test_client client;
+
+	CServer server_info(INSECURE_FTP, DEFAULT, L"127.0.0.1", server.port());
+	Credentials credentials;
+	credentials.logonType_ = LogonType::anonymous;
+
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(CConnectCommand(server_info, std::make_shared<ServerHandleData>(), credentials, false)));
+
+	CServerPath const path(L"/");
+
+	std::vector<CFileTransferCommand> transfers;
+	transfers.emplace_back(fz::view_reader_factory(L"a", std::string_view("first")), path, L"a.txt", transfer_flags());
+	transfers.emplace_back(fz::view_reader_factory(L"b", std::string_view("second")), path, L"b.txt", transfer_flags());
+
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(CBatchTransferCommand(std::move(transfers))));
+
+	auto const files = server.files();
+	CPPUNIT_ASSERT_EQUAL(size_t(2), files.size());
+
+	// Only the directory listing done before the first upload has hit the
+	// server, both uploaded files have to come from the cache updates.
+	CDirectoryListing listing;
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.engine().CacheLookup(path, listing));
+
+	auto const a = listing.FindFile_CmpCase(L"a.txt");
+	CPPUNIT_ASSERT(a != std::wstring::npos);
+	CPPUNIT_ASSERT_EQUAL(int64_t(5), listing[a].size);
+
+	auto const b = listing.FindFile_CmpCase(L"b.txt");
+	CPPUNIT_ASSERT(b != std::wstring::npos);
+	CPPUNIT_ASSERT_EQUAL(int64_t(6), listing[b].size);
+}
+
+void CBatchTransferTest::testCommandsPerFile()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	fake_ftp_server server(loop);
+	CPPUNIT_ASSERT(server.port() > 0);
+
+	test_client client;
+
+	CServer server_info(INSECURE_FTP, DEFAULT, L"127.0.0.1", server.port());
+	Credentials credentials;
+	credentials.logonType_ = LogonType::anonymous;
+
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(CConnectCommand(server_info, std::make_shared<ServerHandleData>(), credentials, false)));
+	size_t const logon = server.commands().size();
+
+	CServerPath const path(L"/");
+
+	size_t const count = 10;
+	std::vector<CFileTransferCommand> transfers;
+	for (size_t i = 0; i < count; ++i) {
+		transfers.emplace_back(fz::view_reader_factory(L"f", std::string_view("data")), path, fz::sprintf(L"%d.txt", i), transfer_flags());
+	}
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(CBatchTransferCommand(std::move(transfers))));
+
+	auto commands = server.commands();
+	commands.erase(commands.begin(), commands.begin() + logon);
+	auto occurrences = [&commands](char const* cmd) { return static_cast<size_t>(std::count(commands.begin(), commands.end(), cmd)); };
+
+	// Once for the whole batch at most
+	CPPUNIT_ASSERT(occurrences("CWD") <= 1);
+	CPPUNIT_ASSERT(occurrences("TYPE") <= 1);
+	CPPUNIT_ASSERT(occurrences("LIST") <= 1);
+
+	// The listing answers for the files, no metadata gets queried per file
+	CPPUNIT_ASSERT_EQUAL(size_t(0), occurrences("SIZE"));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), occurrences("MDTM"));
+
+	// Each file needs a data connection and the transfer command itself
+	CPPUNIT_ASSERT_EQUAL(count, occurrences("PASV") + occurrences("EPSV"));
+	CPPUNIT_ASSERT_EQUAL(count, occurrences("STOR"));
+	CPPUNIT_ASSERT_EQUAL(count * 2 + occurrences("CWD") + occurrences("TYPE") + occurrences("LIST"), commands.size());
+}
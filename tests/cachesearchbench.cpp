@@ -0,0 +1,192 @@
+#include "../src/engine/directorycache.h"
+#include "../src/commonui/filter.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+/*
+ * Measures a remote search over a directory tree that is entirely in the
+ * directory cache. Like CSearchDialog::SearchCache, the tree is walked
+ * by looking up every directory in the cache, and each entry is matched
+ * against the search filter as ProcessDirectoryListing does. Without the
+ * cache, every directory would have to be listed again, which takes at
+ * least a round trip each.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/cachesearchbench [directories] [files per directory]
+ */
+
+namespace {
+void report(std::string const& what, fz::duration const& d, size_t entries)
+{
+	int64_t const us = d.get_microseconds();
+	std::cout << fz::sprintf("%s: %d us", what, us);
+	if (entries) {
+		std::cout << fz::sprintf(", %d ns/entry", us * 1000 / static_cast<int64_t>(entries));
+	}
+	std::cout << std::endl;
+}
+
+CDirectoryListing make_listing(CServerPath const& path, size_t dirs, size_t files, size_t seed)
+{
+	std::vector<fz::shared_value<CDirentry>> entries;
+	entries.reserve(dirs + files);
+	for (size_t i = 0; i < dirs; ++i) {
+		CDirentry entry;
+		entry.name = fz::sprintf(L"dir%d", i);
+		entry.flags = CDirentry::flag_dir;
+		entry.size = -1;
+		entries.emplace_back(std::move(entry));
+	}
+	for (size_t i = 0; i < files; ++i) {
+		CDirentry entry;
+		size_t const n = seed * files + i;
+		switch (n % 4) {
+		case 0:
+			entry.name = fz::sprintf(L"IMG_%05d.JPG", n);
+			break;
+		case 1:
+			entry.name = fz::sprintf(L"Report %d (final).pdf", n);
+			break;
+		case 2:
+			entry.name = fz::sprintf(L"backup-2020-%d.tar.gz", n);
+			break;
+		default:
+			entry.name = fz::sprintf(L"src_%d.cpp", n);
+			break;
+		}
+		entry.size = static_cast<int64_t>((n * 7919) % (4 * 1024 * 1024));
+		entries.emplace_back(std::move(entry));
+	}
+
+	CDirectoryListing listing;
+	listing.path = path;
+	listing.Assign(std::move(entries));
+	listing.m_firstListTime = fz::monotonic_clock::now();
+	return listing;
+}
+
+struct result final
+{
+	size_t dirs{};
+	size_t entries{};
+	size_t matches{};
+};
+
+result search(CDirectoryCache & cache, CServer const& server, CServerPath const& root, CFilter const& filter)
+{
+	result r;
+
+	std::vector<CDirectoryListing> listings(1);
+	bool outdated{};
+	if (!cache.Lookup(listings.back(), server, root, true, outdated) || outdated) {
+		return r;
+	}
+
+	while (!listings.empty()) {
+		CDirectoryListing const listing = std::move(listings.back());
+		listings.pop_back();
+		++r.dirs;
+
+		std::wstring const path = listing.path.GetPath();
+		for (size_t i = 0; i < listing.size(); ++i) {
+			CDirentry const& entry = listing[i];
+			++r.entries;
+			if (filter_manager::FilenameFilteredByFilter(filter, entry.name, path, entry.is_dir(), entry.size, 0, entry.time)) {
+				++r.matches;
+			}
+
+			if (!entry.is_dir() || entry.is_link()) {
+				continue;
+			}
+			CServerPath subdir = listing.path;
+			if (!subdir.AddSegment(entry.name)) {
+				continue;
+			}
+			CDirectoryListing sub;
+			if (cache.Lookup(sub, server, subdir, true, outdated) && !outdated) {
+				listings.push_back(std::move(sub));
+			}
+		}
+	}
+
+	return r;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t dirs = 2000;
+	size_t files = 250;
+	if (argc > 1) {
+		dirs = fz::to_integral<size_t>(std::string_view(argv[1]));
+	}
+	if (argc > 2) {
+		files = fz::to_integral<size_t>(std::string_view(argv[2]));
+	}
+	if (!dirs || !files) {
+		std::cerr << "Usage: " << argv[0] << " [directories] [files per directory]" << std::endl;
+		return 1;
+	}
+
+	CServer const server(FTP, DEFAULT, L"127.0.0.1", 21);
+	CServerPath const root(L"/data");
+
+	// Two levels of directories below the root, the files in the lower one
+	size_t const top = std::max(size_t(1), static_cast<size_t>(std::sqrt(static_cast<double>(dirs))));
+	size_t const perTop = (dirs + top - 1) / top;
+
+	CDirectoryCache cache;
+	auto start = fz::monotonic_clock::now();
+	cache.Store(make_listing(root, top, 0, 0), server);
+	size_t seed{};
+	for (size_t t = 0; t < top; ++t) {
+		CServerPath topPath = root;
+		topPath.AddSegment(fz::sprintf(L"dir%d", t));
+		cache.Store(make_listing(topPath, perTop, 0, 0), server);
+		for (size_t d = 0; d < perTop; ++d) {
+			CServerPath path = topPath;
+			path.AddSegment(fz::sprintf(L"dir%d", d));
+			cache.Store(make_listing(path, 0, files, seed++), server);
+		}
+	}
+	report("Filling the cache", fz::monotonic_clock::now() - start, 0);
+
+	// Name contains "report", case-insensitively, and larger than 1 MiB
+	CFilter filter;
+	filter.matchType = CFilter::all;
+	filter.matchCase = false;
+	filter.filterDirs = false;
+	CFilterCondition name;
+	name.set(filter_name, L"report", 0, false);
+	filter.filters.push_back(name);
+	CFilterCondition size;
+	size.set(filter_size, L"1048576", 0, false);
+	filter.filters.push_back(size);
+
+	size_t checksum{};
+	for (int i = 0; i < 2; ++i) {
+		start = fz::monotonic_clock::now();
+		result const r = search(cache, server, root, filter);
+		auto const stop = fz::monotonic_clock::now();
+		if (!r.dirs) {
+			std::cerr << "The tree does not fit into the cache" << std::endl;
+			return 1;
+		}
+		if (!i) {
+			std::cout << fz::sprintf("%d directories, %d entries, %d matches", r.dirs, r.entries, r.matches) << std::endl;
+			std::cout << fz::sprintf("Listing them again takes at least %d s at 50 ms per round trip", r.dirs / 20) << std::endl;
+		}
+		report(fz::sprintf("Search %d", i + 1), stop - start, r.entries);
+		checksum += r.matches;
+	}
+
+	std::cout << fz::sprintf("Checksum: %d", checksum) << std::endl;
+
+	return 0;
+}
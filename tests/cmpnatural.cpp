@@ -24,6 +24,7 @@ class CNaturalSortTest final : public CppUnit::TestFixture
 	CPPUNIT_TEST(testSeq);
 	CPPUNIT_TEST(testPair);
 	CPPUNIT_TEST(testFractional);
+	CPPUNIT_TEST(testSortKey);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -38,6 +39,7 @@ public:
 	void testSeq();
 	void testPair();
 	void testFractional();
+	void testSortKey();
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(CNaturalSortTest);
@@ -141,3 +143,66 @@ void CNaturalSortTest::testFractional()
 	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("1.1"), _T("1.3")) < 0);
 	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("1.3"), _T("1.15")) < 0);
 }
+
+namespace {
+int sign(int v)
+{
+	return (v > 0) - (v < 0);
+}
+}
+
+void CNaturalSortTest::testSortKey()
+{
+	// Comparing sort keys has to give the same order as the comparison functions,
+	// names these consider equal are ordered case-sensitively.
+	std::vector<std::wstring> const names{
+		L"", L"a", L"A", L"b", L"B", L"ab", L"aB", L"a0", L"a1", L"a1a", L"a1b", L"a2", L"a10", L"a20",
+		L"0", L"00", L"1", L"2", L"02", L"002", L"10", L"15", L"17", L"021", L"25", L"2100", L"02005",
+		L"1abc", L"1def", L"10abc", L"10abc2", L"10abc3", L"x2-g8", L"x2-y7", L"x2-y08", L"x8-y8",
+		L"1.001", L"1.002", L"1.010", L"1.1", L"1.3", L"1.15", L"abc1xx", L"abc2xx", L"abc1bb", L"abc2aa", L"-", L"_", L"a_b", L"a.b",
+		L"3", L"3a", L"3B", L"03a", L"03B", L"003a", L"3a2", L"03a1", L"x3", L"x3b", L"x03a"
+	};
+
+	for (auto const mode : {NameSortMode::case_insensitive, NameSortMode::case_sensitive, NameSortMode::natural}) {
+		auto const f = CFileListCtrlSortBase::GetCmpFunction(mode);
+		for (auto const& a : names) {
+			std::wstring const keyA = CFileListCtrlSortBase::MakeSortKey(a, mode);
+			for (auto const& b : names) {
+				std::wstring const keyB = CFileListCtrlSortBase::MakeSortKey(b, mode);
+
+				int expected = sign(f(a, b));
+				if (!expected) {
+					expected = sign(a.compare(b));
+				}
+				CPPUNIT_ASSERT_EQUAL(expected, sign(keyA.compare(keyB)));
+
+				// Directory comparison pairs names with equal primary keys in natural mode
+				if (mode == NameSortMode::natural) {
+					bool const equal = CFileListCtrlSortBase::PrimarySortKey(keyA) == CFileListCtrlSortBase::PrimarySortKey(keyB);
+					CPPUNIT_ASSERT_EQUAL(!f(a, b), equal);
+				}
+			}
+		}
+	}
+
+	// Case-sensitive keys are the names themselves
+	CPPUNIT_ASSERT(CFileListCtrlSortBase::MakeSortKey(L"B", NameSortMode::case_sensitive) == L"B");
+	CPPUNIT_ASSERT(CFileListCtrlSortBase::MakeSortKey(L"B", NameSortMode::case_sensitive) < CFileListCtrlSortBase::MakeSortKey(L"a", NameSortMode::case_sensitive));
+
+	// Leading zeroes decide after the character following the number
+	auto const key = [](std::wstring_view const& name) {
+		return CFileListCtrlSortBase::MakeSortKey(name, NameSortMode::natural);
+	};
+	CPPUNIT_ASSERT(key(L"03a") < key(L"3B"));
+	CPPUNIT_ASSERT(key(L"3a") < key(L"03a"));
+	CPPUNIT_ASSERT(key(L"3a2") < key(L"03a1"));
+	CPPUNIT_ASSERT(key(L"x03a") < key(L"x3b"));
+
+	// Here CmpNatural is not transitive, e.g. 03 > 3B > 03a > 03.
+	// Names ending right after the number come first.
+	CPPUNIT_ASSERT(key(L"03") < key(L"03a"));
+	CPPUNIT_ASSERT(key(L"03") < key(L"3B"));
+	CPPUNIT_ASSERT(key(L"01") < key(L"1abc"));
+	CPPUNIT_ASSERT(key(L"001") < key(L"1.1"));
+	CPPUNIT_ASSERT(key(L"010") < key(L"10abc"));
+}
@@ -0,0 +1,181 @@
+#include "../src/include/directorylisting.h"
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts the correctness of the name lookups of the
+ * CDirectoryListing class and of the deltas between two listings.
+ */
+
+class CDirectoryListingTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDirectoryListingTest);
+	CPPUNIT_TEST(testFindFile);
+	CPPUNIT_TEST(testFindFileDuplicates);
+	CPPUNIT_TEST(testFindFileAfterChange);
+	CPPUNIT_TEST(testDelta);
+	CPPUNIT_TEST(testDeltaOrder);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testFindFile();
+	void testFindFileDuplicates();
+	void testFindFileAfterChange();
+	void testDelta();
+	void testDeltaOrder();
+
+protected:
+	static void append(CDirectoryListing& listing, std::wstring const& name, int64_t size = -1)
+	{
+		CDirentry entry;
+		entry.name = name;
+		entry.size = size;
+		listing.Append(std::move(entry));
+	}
+
+	static CDirectoryListing make_listing(std::vector<std::wstring> const& names)
+	{
+		CDirectoryListing listing;
+		for (auto const& name : names) {
+			append(listing, name);
+		}
+		return listing;
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDirectoryListingTest);
+
+void CDirectoryListingTest::testFindFile()
+{
+	CDirectoryListing listing;
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpCase(L"foo"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpNoCase(L"foo"));
+
+	for (int i = 0; i < 1000; ++i) {
+		append(listing, L"File" + std::to_wstring(i));
+	}
+
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpCase(L"File0"));
+	CPPUNIT_ASSERT_EQUAL(size_t(999), listing.FindFile_CmpCase(L"File999"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpCase(L"file999"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpCase(L"File1000"));
+
+	CPPUNIT_ASSERT_EQUAL(size_t(999), listing.FindFile_CmpNoCase(L"file999"));
+	CPPUNIT_ASSERT_EQUAL(size_t(500), listing.FindFile_CmpNoCase(L"FILE500"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpNoCase(L"file1000"));
+}
+
+void CDirectoryListingTest::testFindFileDuplicates()
+{
+	CDirectoryListing listing;
+	append(listing, L"foo");
+	append(listing, L"Foo");
+	append(listing, L"bar");
+	append(listing, L"foo");
+	append(listing, L"FOO");
+
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpCase(L"foo"));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), listing.FindFile_CmpCase(L"Foo"));
+	CPPUNIT_ASSERT_EQUAL(size_t(4), listing.FindFile_CmpCase(L"FOO"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpCase(L"fOO"));
+
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpNoCase(L"fOO"));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), listing.FindFile_CmpNoCase(L"BAR"));
+}
+
+void CDirectoryListingTest::testFindFileAfterChange()
+{
+	CDirectoryListing listing;
+	append(listing, L"foo");
+	append(listing, L"bar");
+	CPPUNIT_ASSERT_EQUAL(size_t(1), listing.FindFile_CmpCase(L"bar"));
+
+	// Copies share the index, changes must not leak into them
+	CDirectoryListing const copy = listing;
+
+	append(listing, L"baz");
+	CPPUNIT_ASSERT_EQUAL(size_t(2), listing.FindFile_CmpCase(L"baz"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, copy.FindFile_CmpCase(L"baz"));
+
+	CPPUNIT_ASSERT(listing.RemoveEntry(0));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpCase(L"bar"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpNoCase(L"FOO"));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), copy.FindFile_CmpNoCase(L"FOO"));
+
+	listing.get(0).name = L"qux";
+	listing.ClearFindMap();
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpCase(L"qux"));
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, listing.FindFile_CmpCase(L"bar"));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), copy.FindFile_CmpCase(L"bar"));
+}
+
+void CDirectoryListingTest::testDelta()
+{
+	CDirectoryListing const from = make_listing({L"a", L"b", L"c", L"d"});
+
+	CDirectoryListingDelta delta(from, make_listing({L"a", L"b", L"c", L"d"}));
+	CPPUNIT_ASSERT(delta.empty());
+	CPPUNIT_ASSERT(delta.ordered);
+
+	CDirectoryListing to = make_listing({L"a", L"b"});
+	append(to, L"c", 10);
+	append(to, L"d");
+	delta = CDirectoryListingDelta(from, to);
+	CPPUNIT_ASSERT(delta.added.empty() && delta.removed.empty());
+	CPPUNIT_ASSERT(delta.changed == std::vector<size_t>{2});
+	CPPUNIT_ASSERT(delta.ordered);
+
+	delta = CDirectoryListingDelta(from, make_listing({L"a", L"b", L"c", L"d", L"e", L"f"}));
+	CPPUNIT_ASSERT((delta.added == std::vector<size_t>{4, 5}));
+	CPPUNIT_ASSERT(delta.removed.empty() && delta.changed.empty());
+	CPPUNIT_ASSERT(delta.ordered);
+
+	delta = CDirectoryListingDelta(from, make_listing({L"b", L"d"}));
+	CPPUNIT_ASSERT((delta.removed == std::vector<size_t>{0, 2}));
+	CPPUNIT_ASSERT(delta.added.empty() && delta.changed.empty());
+	CPPUNIT_ASSERT(delta.ordered);
+
+	// Renamed entries are removed and added
+	delta = CDirectoryListingDelta(from, make_listing({L"a", L"x", L"c", L"d"}));
+	CPPUNIT_ASSERT(delta.added == std::vector<size_t>{1});
+	CPPUNIT_ASSERT(delta.removed == std::vector<size_t>{1});
+	CPPUNIT_ASSERT(!delta.ordered);
+
+	delta = CDirectoryListingDelta(from, CDirectoryListing());
+	CPPUNIT_ASSERT_EQUAL(size_t(4), delta.removed.size());
+	delta = CDirectoryListingDelta(CDirectoryListing(), from);
+	CPPUNIT_ASSERT_EQUAL(size_t(4), delta.added.size());
+}
+
+void CDirectoryListingTest::testDeltaOrder()
+{
+	CDirectoryListing const from = make_listing({L"a", L"b", L"c", L"d"});
+
+	// Moved entries are neither added nor removed
+	CDirectoryListingDelta delta(from, make_listing({L"a", L"c", L"d", L"b"}));
+	CPPUNIT_ASSERT(delta.empty());
+	CPPUNIT_ASSERT(!delta.ordered);
+
+	delta = CDirectoryListingDelta(from, make_listing({L"d", L"c", L"b", L"a"}));
+	CPPUNIT_ASSERT(delta.empty());
+	CPPUNIT_ASSERT(!delta.ordered);
+
+	// Entries inserted in between
+	delta = CDirectoryListingDelta(from, make_listing({L"a", L"x", L"b", L"c", L"y", L"d"}));
+	CPPUNIT_ASSERT((delta.added == std::vector<size_t>{1, 4}));
+	CPPUNIT_ASSERT(delta.removed.empty());
+	CPPUNIT_ASSERT(!delta.ordered);
+
+	// Each old entry matches at most one new entry with its name
+	CDirectoryListing const duplicates = make_listing({L"a", L"b", L"a"});
+	delta = CDirectoryListingDelta(duplicates, make_listing({L"a", L"b", L"a"}));
+	CPPUNIT_ASSERT(delta.empty());
+	delta = CDirectoryListingDelta(duplicates, make_listing({L"a", L"b", L"a", L"a"}));
+	CPPUNIT_ASSERT(delta.added == std::vector<size_t>{3});
+	CPPUNIT_ASSERT(delta.removed.empty());
+	delta = CDirectoryListingDelta(from, make_listing({L"a", L"b", L"c", L"d", L"b"}));
+	CPPUNIT_ASSERT(delta.added == std::vector<size_t>{4});
+	CPPUNIT_ASSERT(delta.ordered);
+}
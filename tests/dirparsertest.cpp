@@ -31,6 +31,7 @@ class CDirectoryListingParserTest final : public CppUnit::TestFixture
 	}
 	CPPUNIT_TEST(testAll);
 	CPPUNIT_TEST(testSpecial);
+	CPPUNIT_TEST(testRecursive);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -40,6 +41,7 @@ public:
 	void testIndividual();
 	void testAll();
 	void testSpecial();
+	void testRecursive();
 
 	static std::vector<t_entry> m_entries;
 
@@ -1545,6 +1547,109 @@ void CDirectoryListingParserTest::testSpecial()
 	}
 }
 
+namespace {
+RecursiveListingResult ParseRecursive(std::string const& data, std::vector<CDirectoryListing>& listings, size_t limit = size_t(-1))
+{
+	CServer server;
+	CDirectoryListingParser parser(0, server);
+	parser.SetItemLimit(limit);
+	parser.SetRecursive(CServerPath(L"/base"));
+
+	char* p = new char[data.size()];
+	memcpy(p, data.c_str(), data.size());
+	parser.AddData(p, data.size());
+
+	return parser.ParseRecursive(CServerPath(L"/base"), listings);
+}
+}
+
+void CDirectoryListingParserTest::testRecursive()
+{
+	std::vector<CDirectoryListing> listings;
+
+	// Relative section headers, a file name looking like a header
+	CPPUNIT_ASSERT(RecursiveListingResult::ok == ParseRecursive(
+		"-rw-r--r--   1 user group  123 Jan  1 12:00 file\r\n"
+		"drwxr-xr-x   2 user group 4096 Jan  1 12:00 sub\r\n"
+		"drwxr-xr-x   2 user group 4096 Jan  1 12:00 empty\r\n"
+		"\r\n"
+		"./sub:\r\n"
+		"-rw-r--r--   1 user group    5 Jan  1 12:00 inner:\r\n"
+		"drwxr-xr-x   2 user group 4096 Jan  1 12:00 deeper\r\n"
+		"\r\n"
+		"./sub/deeper:\r\n"
+		"\r\n"
+		"./empty:\r\n", listings));
+	CPPUNIT_ASSERT_EQUAL(size_t(4), listings.size());
+	CPPUNIT_ASSERT(listings[0].path == CServerPath(L"/base"));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), listings[0].size());
+	CPPUNIT_ASSERT(listings[1].path == CServerPath(L"/base/sub"));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), listings[1].size());
+	CPPUNIT_ASSERT(listings[1][0].name == L"inner:");
+	CPPUNIT_ASSERT(listings[2].path == CServerPath(L"/base/sub/deeper"));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listings[2].size());
+	CPPUNIT_ASSERT(listings[3].path == CServerPath(L"/base/empty"));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listings[3].size());
+
+	// Header for the listed directory itself, absolute section headers
+	CPPUNIT_ASSERT(RecursiveListingResult::ok == ParseRecursive(
+		".:\r\n"
+		"drwxr-xr-x   2 user group 4096 Jan  1 12:00 sub\r\n"
+		"\r\n"
+		"/base/sub:\r\n"
+		"-rw-r--r--   1 user group    5 Jan  1 12:00 inner\r\n", listings));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), listings.size());
+	CPPUNIT_ASSERT(listings[1].path == CServerPath(L"/base/sub"));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), listings[1].size());
+
+	// Server ignoring -R
+	CPPUNIT_ASSERT(RecursiveListingResult::ambiguous == ParseRecursive(
+		"-rw-r--r--   1 user group  123 Jan  1 12:00 file\r\n"
+		"drwxr-xr-x   2 user group 4096 Jan  1 12:00 sub\r\n", listings));
+
+	// Section of an unknown directory
+	CPPUNIT_ASSERT(RecursiveListingResult::ambiguous == ParseRecursive(
+		"drwxr-xr-x   2 user group 4096 Jan  1 12:00 sub\r\n"
+		"\r\n"
+		"./sub:\r\n"
+		"\r\n"
+		"./other:\r\n"
+		"-rw-r--r--   1 user group    5 Jan  1 12:00 inner\r\n", listings));
+
+	// Files only, or nothing at all, look the same with or without -R
+	CPPUNIT_ASSERT(RecursiveListingResult::ok == ParseRecursive(
+		"-rw-r--r--   1 user group  123 Jan  1 12:00 file\r\n", listings));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), listings.size());
+	CPPUNIT_ASSERT_EQUAL(size_t(1), listings[0].size());
+
+	CPPUNIT_ASSERT(RecursiveListingResult::ok == ParseRecursive("", listings));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), listings.size());
+	CPPUNIT_ASSERT(listings[0].path == CServerPath(L"/base"));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listings[0].size());
+
+	CPPUNIT_ASSERT(RecursiveListingResult::ok == ParseRecursive(".:\r\n", listings));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), listings.size());
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listings[0].size());
+
+	// The item limit counts the entries of all sections together
+	std::string const twoSections =
+		"-rw-r--r--   1 user group  123 Jan  1 12:00 file\r\n"
+		"drwxr-xr-x   2 user group 4096 Jan  1 12:00 sub\r\n"
+		"\r\n"
+		"./sub:\r\n"
+		"-rw-r--r--   1 user group    5 Jan  1 12:00 inner\r\n";
+	CPPUNIT_ASSERT(RecursiveListingResult::ok == ParseRecursive(twoSections, listings, 3));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), listings.size());
+	CPPUNIT_ASSERT(RecursiveListingResult::truncated == ParseRecursive(twoSections, listings, 2));
+	CPPUNIT_ASSERT(listings.empty());
+
+	// Truncation takes precedence, a cut off listing says nothing about the server
+	CPPUNIT_ASSERT(RecursiveListingResult::truncated == ParseRecursive(
+		"-rw-r--r--   1 user group  123 Jan  1 12:00 file\r\n"
+		"drwxr-xr-x   2 user group 4096 Jan  1 12:00 sub\r\n"
+		"-rw-r--r--   1 user group  123 Jan  1 12:00 other\r\n", listings, 2));
+}
+
 void CDirectoryListingParserTest::setUp()
 {
 }
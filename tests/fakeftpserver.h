@@ -0,0 +1,417 @@
+#ifndef FILEZILLA_TESTS_FAKEFTPSERVER_HEADER
+#define FILEZILLA_TESTS_FAKEFTPSERVER_HEADER
+
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/include/engine_context.h"
+#include "../src/include/optionsbase.h"
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/event_loop.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/socket.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/util.hpp>
+
+#include <functional>
+#include <map>
+
+/*
+ * Helpers for testing the engine against a minimal in-process FTP server.
+ */
+
+class test_options final : public COptionsBase
+{
+protected:
+	virtual void notify_changed() override {}
+};
+
+class test_converter final : public CustomEncodingConverterBase
+{
+public:
+	virtual std::wstring toLocal(std::wstring const&, char const* buffer, size_t len) const override
+	{
+		return fz::to_wstring(std::string_view(buffer, len));
+	}
+
+	virtual std::string toServer(std::wstring const&, wchar_t const* buffer, size_t len) const override
+	{
+		return fz::to_string(std::wstring_view(buffer, len));
+	}
+};
+
+// An engine whose commands can be executed synchronously
+class test_client final
+{
+public:
+	test_client()
+		: context_(options_, converter_)
+		, engine_(context_, [this](CFileZillaEngine*) {
+			fz::scoped_lock l(mutex_);
+			signalled_ = true;
+			cond_.signal(l);
+		})
+	{}
+
+	// Returns the reply code of the operation
+	int Execute(CCommand const& command)
+	{
+		int res = engine_.Execute(command);
+		if (res == FZ_REPLY_WOULDBLOCK) {
+			res = Wait();
+		}
+		return res;
+	}
+
+	CFileZillaEngine& engine() { return engine_; }
+	test_options& options() { return options_; }
+
+private:
+	int Wait()
+	{
+		while (true) {
+			while (auto notification = engine_.GetNextNotification()) {
+				if (notification->GetID() == nId_operation) {
+					return static_cast<COperationNotification&>(*notification).replyCode_;
+				}
+				else if (notification->GetID() == nId_asyncrequest) {
+					auto request = unique_static_cast<CAsyncRequestNotification>(std::move(notification));
+					if (request->GetRequestID() == reqId_insecure_connection) {
+						static_cast<CInsecureConnectionNotification&>(*request).allow_ = true;
+					}
+					engine_.SetAsyncRequestReply(std::move(request));
+				}
+			}
+
+			fz::scoped_lock l(mutex_);
+			if (!signalled_ && !cond_.wait(l, fz::duration::from_seconds(30))) {
+				return FZ_REPLY_TIMEOUT;
+			}
+			signalled_ = false;
+		}
+	}
+
+	test_options options_;
+	test_converter converter_;
+	CFileZillaEngineContext context_;
+
+	fz::mutex mutex_;
+	fz::condition cond_;
+	bool signalled_{};
+
+	CFileZillaEngine engine_;
+};
+
+// Just enough FTP to log on, list a directory and store files over passive
+// mode data connections. Everything runs on its own event loop.
+//
+// By default LIST shows the stored files. A listing handler can instead
+// produce the output for any LIST command, it gets passed the arguments.
+class fake_ftp_server final : public fz::event_handler
+{
+public:
+	explicit fake_ftp_server(fz::event_loop & loop)
+		: fz::event_handler(loop)
+		, listen_(loop.thread_pool_, this)
+	{
+		listen_.listen(fz::address_type::ipv4, 0);
+		int error{};
+		port_ = listen_.local_port(error);
+	}
+
+	virtual ~fake_ftp_server()
+	{
+		remove_handler();
+	}
+
+	int port() const { return port_; }
+
+	std::map<std::string, int64_t> files() const
+	{
+		fz::scoped_lock l(mtx_);
+		return files_;
+	}
+
+	void set_listing_handler(std::function<std::string(std::string const&)> const& handler)
+	{
+		fz::scoped_lock l(mtx_);
+		listing_handler_ = handler;
+	}
+
+	// The arguments of all LIST commands received so far
+	std::vector<std::string> list_commands() const
+	{
+		fz::scoped_lock l(mtx_);
+		return list_commands_;
+	}
+
+	// The verbs of all commands received so far
+	std::vector<std::string> commands() const
+	{
+		fz::scoped_lock l(mtx_);
+		return commands_;
+	}
+
+	// Holds back the reply to each command, like the round trip to a remote
+	// server would. Blocks the server's event loop meanwhile.
+	void set_reply_delay(fz::duration const& delay)
+	{
+		fz::scoped_lock l(mtx_);
+		reply_delay_ = delay;
+	}
+
+private:
+	virtual void operator()(fz::event_base const& ev) override
+	{
+		fz::dispatch<fz::socket_event>(ev, this, &fake_ftp_server::on_socket_event);
+	}
+
+	void on_socket_event(fz::socket_event_source* source, fz::socket_event_flag t, int error)
+	{
+		if (error) {
+			if (source == data_.get()) {
+				on_data_closed();
+			}
+			return;
+		}
+
+		if (source == &listen_) {
+			if (t == fz::socket_event_flag::connection && !control_) {
+				control_ = listen_.accept(error, this);
+				if (control_) {
+					send(L"220 Fake server ready");
+				}
+			}
+		}
+		else if (pasv_ && source == pasv_.get()) {
+			if (t == fz::socket_event_flag::connection) {
+				data_ = pasv_->accept(error, this);
+				pasv_.reset();
+				process_data();
+			}
+		}
+		else if (control_ && source == control_.get()) {
+			if (t == fz::socket_event_flag::read) {
+				on_control_read();
+			}
+			else if (t == fz::socket_event_flag::write) {
+				flush();
+			}
+		}
+		else if (data_ && source == data_.get()) {
+			if (t == fz::socket_event_flag::read) {
+				on_data_read();
+			}
+		}
+	}
+
+	void send(std::wstring_view const& line)
+	{
+		out_ += fz::to_string(line) + "\r\n";
+		flush();
+	}
+
+	void flush()
+	{
+		while (!out_.empty()) {
+			int error{};
+			int written = control_->write(out_.c_str(), static_cast<unsigned int>(out_.size()), error);
+			if (written <= 0) {
+				return;
+			}
+			out_.erase(0, written);
+		}
+	}
+
+	void on_control_read()
+	{
+		char buffer[1024];
+		while (true) {
+			int error{};
+			int read = control_->read(buffer, sizeof(buffer), error);
+			if (read <= 0) {
+				return;
+			}
+			in_.append(buffer, read);
+
+			size_t pos;
+			while ((pos = in_.find("\r\n")) != std::string::npos) {
+				std::string line = in_.substr(0, pos);
+				in_.erase(0, pos + 2);
+				on_command(line);
+			}
+		}
+	}
+
+	void on_command(std::string const& line)
+	{
+		auto const sep = line.find(' ');
+		std::string const cmd = fz::str_toupper_ascii(line.substr(0, sep));
+		std::string const arg = (sep == std::string::npos) ? std::string() : line.substr(sep + 1);
+
+		fz::duration delay;
+		{
+			fz::scoped_lock l(mtx_);
+			commands_.push_back(cmd);
+			delay = reply_delay_;
+		}
+		if (delay) {
+			fz::sleep(delay);
+		}
+
+		if (cmd == "USER") {
+			send(L"331 Password required");
+		}
+		else if (cmd == "PASS") {
+			send(L"230 Logged on");
+		}
+		else if (cmd == "SYST") {
+			send(L"215 UNIX Type: L8");
+		}
+		else if (cmd == "FEAT") {
+			send(L"211-Features:");
+			send(L"211 End");
+		}
+		else if (cmd == "PWD") {
+			send(L"257 \"/\" is current directory");
+		}
+		else if (cmd == "CWD") {
+			send(L"250 Directory changed");
+		}
+		else if (cmd == "TYPE") {
+			send(L"200 Type set");
+		}
+		else if (cmd == "PASV" || cmd == "EPSV") {
+			pasv_ = std::make_unique<fz::listen_socket>(event_loop_.thread_pool_, this);
+			int error{};
+			pasv_->listen(fz::address_type::ipv4, 0);
+			int const port = pasv_->local_port(error);
+			if (cmd == "PASV") {
+				send(fz::sprintf(L"227 Entering Passive Mode (127,0,0,1,%d,%d)", port / 256, port % 256));
+			}
+			else {
+				send(fz::sprintf(L"229 Entering Extended Passive Mode (|||%d|)", port));
+			}
+		}
+		else if (cmd == "LIST") {
+			{
+				fz::scoped_lock l(mtx_);
+				list_commands_.push_back(arg);
+			}
+			pending_ = pending::list;
+			list_args_ = arg;
+			send(L"150 Opening data connection");
+			process_data();
+		}
+		else if (cmd == "STOR") {
+			pending_ = pending::stor;
+			stor_name_ = arg;
+			stor_size_ = 0;
+			send(L"150 Opening data connection");
+			process_data();
+		}
+		else if (cmd == "SIZE" || cmd == "MDTM") {
+			send(L"550 File not found");
+		}
+		else if (cmd == "QUIT") {
+			send(L"221 Goodbye");
+		}
+		else {
+			send(L"502 Command not implemented");
+		}
+	}
+
+	void process_data()
+	{
+		if (!data_) {
+			return;
+		}
+		if (pending_ == pending::list) {
+			std::string listing;
+			{
+				fz::scoped_lock l(mtx_);
+				if (listing_handler_) {
+					listing = listing_handler_(list_args_);
+				}
+				else {
+					for (auto const& file : files_) {
+						listing += fz::sprintf("-rw-r--r-- 1 user group %d Jan 01 12:00 %s\r\n", file.second, file.first);
+					}
+				}
+			}
+			int error{};
+			if (!listing.empty()) {
+				data_->write(listing.c_str(), static_cast<unsigned int>(listing.size()), error);
+			}
+			data_.reset();
+			pending_ = pending::none;
+			send(L"226 Transfer complete");
+		}
+		else if (pending_ == pending::stor) {
+			on_data_read();
+		}
+	}
+
+	void on_data_read()
+	{
+		if (pending_ != pending::stor) {
+			return;
+		}
+
+		char buffer[1024];
+		while (data_) {
+			int error{};
+			int read = data_->read(buffer, sizeof(buffer), error);
+			if (read > 0) {
+				stor_size_ += read;
+			}
+			else if (!read || error != EAGAIN) {
+				on_data_closed();
+			}
+			else {
+				return;
+			}
+		}
+	}
+
+	void on_data_closed()
+	{
+		data_.reset();
+		if (pending_ == pending::stor) {
+			{
+				fz::scoped_lock l(mtx_);
+				files_[stor_name_] = stor_size_;
+			}
+			pending_ = pending::none;
+			send(L"226 Transfer complete");
+		}
+	}
+
+	fz::listen_socket listen_;
+	std::unique_ptr<fz::socket> control_;
+	std::unique_ptr<fz::listen_socket> pasv_;
+	std::unique_ptr<fz::socket> data_;
+	int port_{};
+
+	std::string in_;
+	std::string out_;
+
+	enum class pending {
+		none,
+		list,
+		stor
+	};
+	pending pending_{pending::none};
+	std::string list_args_;
+	std::string stor_name_;
+	int64_t stor_size_{};
+
+	mutable fz::mutex mtx_;
+	std::map<std::string, int64_t> files_;
+	std::function<std::string(std::string const&)> listing_handler_;
+	std::vector<std::string> list_commands_;
+	std::vector<std::string> commands_;
+	fz::duration reply_delay_;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "../src/commonui/filter.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <iostream>
+#include <random>
+
+/*
+ * Measures matching entries against a set of filters with many literal
+ * name and path conditions, as recursive operations and the file lists do
+ * for every entry. filter_manager::FilenameFiltered evaluates condition by
+ * condition, compiled_filters scans each subject once for all literals.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/filterbench [filters] [entries]
+ */
+
+namespace {
+void report(std::string const& what, fz::duration const& d, size_t operations)
+{
+	int64_t const us = d.get_microseconds();
+	std::cout << fz::sprintf("%s: %d us", what, us);
+	if (operations) {
+		std::cout << fz::sprintf(", %d ns/operation", us * 1000 / static_cast<int64_t>(operations));
+	}
+	std::cout << std::endl;
+}
+
+// Mostly like the predefined filters: temporary and backup files, version
+// control directories, configuration files and so on
+std::vector<CFilter> make_filters(size_t count, std::mt19937 & gen)
+{
+	std::vector<std::wstring> const words = {L"tmp", L"bak", L"cache", L"swp", L"log", L"old", L"thumbs", L"node_modules", L"build", L"git", L"svn", L"obj"};
+
+	std::vector<CFilter> filters(count);
+	for (size_t i = 0; i < count; ++i) {
+		auto & filter = filters[i];
+		filter.matchType = CFilter::any;
+		filter.matchCase = (i % 2) != 0;
+		filter.filterDirs = (i % 3) != 0;
+
+		for (int j = 0; j < 4; ++j) {
+			std::wstring value = words[gen() % words.size()] + fz::to_wstring(i);
+			int const condition = static_cast<int>(gen() % 4);
+			if (condition == 2) {
+				value = L"." + value;
+			}
+			else if (condition == 3) {
+				value = L"~" + value;
+			}
+			CFilterCondition c;
+			c.set(j == 3 ? filter_path : filter_name, value, condition, filter.matchCase);
+			filter.filters.push_back(c);
+		}
+	}
+	return filters;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t filterCount = 50;
+	size_t entryCount = 100000;
+	if (argc > 1) {
+		filterCount = fz::to_integral<size_t>(std::string_view(argv[1]));
+	}
+	if (argc > 2) {
+		entryCount = fz::to_integral<size_t>(std::string_view(argv[2]));
+	}
+	if (!filterCount || !entryCount) {
+		std::cerr << "Usage: " << argv[0] << " [filters] [entries]" << std::endl;
+		return 1;
+	}
+
+	std::cout << fz::sprintf("%d filters with 4 literal conditions each, %d entries", filterCount, entryCount) << std::endl;
+
+	std::mt19937 gen(42);
+	auto const filters = make_filters(filterCount, gen);
+
+	std::vector<std::wstring> names;
+	names.reserve(entryCount);
+	for (size_t i = 0; i < entryCount; ++i) {
+		names.emplace_back(fz::sprintf(L"Document_%d (final version).pdf", gen() % 1000000));
+	}
+	std::wstring const path = L"/home/user/projects/filezilla/src/interface";
+	fz::datetime const date = fz::datetime::now();
+
+	size_t filtered{};
+
+	auto start = fz::monotonic_clock::now();
+	for (auto const& name : names) {
+		filtered += filter_manager::FilenameFiltered(filters, name, path, false, 1000, 0644, date) ? 1 : 0;
+	}
+	report("Condition by condition", fz::monotonic_clock::now() - start, names.size());
+
+	start = fz::monotonic_clock::now();
+	compiled_filters const compiled(filters);
+	report("Compiling", fz::monotonic_clock::now() - start, 0);
+
+	start = fz::monotonic_clock::now();
+	for (auto const& name : names) {
+		filtered += compiled.filtered(name, path, false, 1000, 0644, date) ? 1 : 0;
+	}
+	report("Compiled", fz::monotonic_clock::now() - start, names.size());
+
+	std::cout << fz::sprintf("Checksum: %d", filtered) << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,231 @@
+#include "../src/commonui/filter.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <random>
+
+/*
+ * This testsuite asserts that compiled_filters, which reorders the
+ * conditions of each filter, shares the lowercased subjects between
+ * filters and matches all literal conditions in a single pass, gives the
+ * same results as filter_manager::FilenameFiltered.
+ */
+
+class CFilterTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CFilterTest);
+	CPPUNIT_TEST(testSingleCondition);
+	CPPUNIT_TEST(testCombined);
+	CPPUNIT_TEST(testEmpty);
+	CPPUNIT_TEST(testOverlappingLiterals);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown() {}
+
+	void testSingleCondition();
+	void testCombined();
+	void testEmpty();
+	void testOverlappingLiterals();
+
+protected:
+	struct entry final
+	{
+		std::wstring name;
+		std::wstring path;
+		int64_t size{};
+		int attributes{};
+		fz::datetime date;
+	};
+
+	void Compare(std::vector<CFilter> const& filters);
+
+	// Every valid condition, once for each case sensitivity
+	std::vector<CFilterCondition> conditions_[2];
+
+	std::vector<entry> entries_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CFilterTest);
+
+void CFilterTest::setUp()
+{
+	struct condition_values final
+	{
+		t_filterType type;
+		std::vector<int> conditions;
+		std::vector<std::wstring> values;
+	};
+	std::vector<condition_values> const all = {
+		{filter_name, {0, 1, 2, 3, 5}, {L"foo", L"FOO", L".txt", L"\u00e4rger"}},
+		{filter_name, {4}, {L"^f.*\\.txt$", L"^F"}},
+		{filter_path, {0, 1, 2, 3, 5}, {L"/home", L"/HOME/Bar", L"bar"}},
+		{filter_path, {4}, {L"bar$"}},
+		{filter_size, {0, 1, 2, 3}, {L"0", L"100"}},
+		{filter_attributes, {0, 1, 2, 3, 4, 5}, {L"0", L"1"}},
+		{filter_permissions, {0, 1, 2, 3, 4, 5, 6, 7, 8}, {L"0", L"1"}},
+		{filter_date, {0, 1, 2, 3}, {L"2020-06-15"}}
+	};
+
+	for (int matchCase = 0; matchCase < 2; ++matchCase) {
+		conditions_[matchCase].clear();
+		for (auto const& cv : all) {
+			for (auto const c : cv.conditions) {
+				for (auto const& v : cv.values) {
+					CFilterCondition condition;
+					CPPUNIT_ASSERT(condition.set(cv.type, v, c, matchCase != 0));
+					conditions_[matchCase].push_back(condition);
+				}
+			}
+		}
+	}
+
+	std::vector<std::wstring> const names = {L"foo.txt", L"FOO.TXT", L"Foo.Txt.bak", L"\u00c4rger.txt"};
+	std::vector<std::wstring> const paths = {L"/home/foo", L"/HOME/Bar"};
+	std::vector<int64_t> const sizes = {-1, 0, 100, 5000};
+	std::vector<int> const attributes = {-1, 0, 0x21, 0755};
+	std::vector<fz::datetime> const dates = {
+		fz::datetime(),
+		fz::datetime(L"2020-06-15", fz::datetime::local),
+		fz::datetime(L"2021-01-01 12:00", fz::datetime::local)
+	};
+
+	entries_.clear();
+	for (auto const& name : names) {
+		for (auto const& path : paths) {
+			for (auto const size : sizes) {
+				for (auto const attribute : attributes) {
+					for (auto const& date : dates) {
+						entries_.push_back({name, path, size, attribute, date});
+					}
+				}
+			}
+		}
+	}
+}
+
+void CFilterTest::Compare(std::vector<CFilter> const& filters)
+{
+	compiled_filters const compiled(filters);
+
+	for (auto const& e : entries_) {
+		for (int dir = 0; dir < 2; ++dir) {
+			bool const expected = filter_manager::FilenameFiltered(filters, e.name, e.path, dir != 0, e.size, e.attributes, e.date);
+			bool const actual = compiled.filtered(e.name, e.path, dir != 0, e.size, e.attributes, e.date);
+			if (expected != actual) {
+				std::wstring description;
+				for (auto const& filter : filters) {
+					description += fz::sprintf(L"[match type %d, case %d, files %d, dirs %d:", static_cast<int>(filter.matchType), int(filter.matchCase), int(filter.filterFiles), int(filter.filterDirs));
+					for (auto const& condition : filter.filters) {
+						description += fz::sprintf(L" (%d %d %s)", static_cast<int>(condition.type), condition.condition, condition.strValue);
+					}
+					description += L"] ";
+				}
+				description += fz::sprintf(L"on %s in %s, dir %d, size %d, attributes %d, date %s", e.name, e.path, dir, e.size, e.attributes, e.date.empty() ? std::wstring() : e.date.format(L"%Y-%m-%d %H:%M", fz::datetime::utc));
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(fz::to_utf8(description), expected, actual);
+			}
+		}
+	}
+}
+
+void CFilterTest::testSingleCondition()
+{
+	// Every condition on its own, under each match type and any combination
+	// of applying to files and directories
+	for (int matchCase = 0; matchCase < 2; ++matchCase) {
+		for (auto const& condition : conditions_[matchCase]) {
+			for (int matchType = CFilter::all; matchType <= CFilter::not_all; ++matchType) {
+				for (int applies = 0; applies < 4; ++applies) {
+					CFilter filter;
+					filter.filters.push_back(condition);
+					filter.matchType = static_cast<CFilter::t_matchType>(matchType);
+					filter.matchCase = matchCase != 0;
+					filter.filterFiles = (applies & 1) != 0;
+					filter.filterDirs = (applies & 2) != 0;
+
+					Compare({filter});
+				}
+			}
+		}
+	}
+}
+
+void CFilterTest::testCombined()
+{
+	// Sets of filters with several conditions each, mixing expensive and
+	// cheap condition types so that the compiled order differs from the
+	// given one. Fixed seed, the sets are the same on each run.
+	std::mt19937 gen(42);
+	auto pick = [&gen](size_t n) { return static_cast<size_t>(gen() % n); };
+
+	for (int i = 0; i < 1000; ++i) {
+		std::vector<CFilter> filters(1 + pick(3));
+		for (auto & filter : filters) {
+			bool const matchCase = pick(2) != 0;
+			auto const& conditions = conditions_[matchCase ? 1 : 0];
+
+			filter.matchType = static_cast<CFilter::t_matchType>(pick(4));
+			filter.matchCase = matchCase;
+			filter.filterFiles = pick(4) != 0;
+			filter.filterDirs = pick(4) != 0;
+
+			size_t const count = 2 + pick(4);
+			for (size_t j = 0; j < count; ++j) {
+				filter.filters.push_back(conditions[pick(conditions.size())]);
+			}
+		}
+
+		Compare(filters);
+	}
+}
+
+void CFilterTest::testEmpty()
+{
+	Compare({});
+
+	// Filters without any conditions
+	for (int matchType = CFilter::all; matchType <= CFilter::not_all; ++matchType) {
+		CFilter filter;
+		filter.matchType = static_cast<CFilter::t_matchType>(matchType);
+		filter.filterDirs = false;
+		Compare({filter});
+	}
+}
+
+void CFilterTest::testOverlappingLiterals()
+{
+	// Literals that are prefixes, suffixes or substrings of each other, or
+	// overlap within the subjects, across several filters
+	std::vector<std::wstring> const literals = {L"a", L"aa", L"aab", L"ab", L"b", L"ba", L"bab", L"abab", L"A", L"Ab"};
+	std::vector<std::wstring> const names = {L"a", L"aa", L"aaa", L"aab", L"aaab", L"abab", L"babab", L"ba", L"b", L"AAB", L"xabx", L"x", L"Abab"};
+
+	entries_.clear();
+	for (auto const& name : names) {
+		entries_.push_back({name, L"/" + name, -1, -1, fz::datetime()});
+	}
+
+	std::mt19937 gen(42);
+	auto pick = [&gen](size_t n) { return static_cast<size_t>(gen() % n); };
+	int const literalConditions[] = {0, 1, 2, 3, 5};
+
+	for (int i = 0; i < 1000; ++i) {
+		std::vector<CFilter> filters(1 + pick(4));
+		for (auto & filter : filters) {
+			filter.matchType = static_cast<CFilter::t_matchType>(pick(4));
+			filter.matchCase = pick(2) != 0;
+
+			size_t const count = 1 + pick(4);
+			for (size_t j = 0; j < count; ++j) {
+				CFilterCondition condition;
+				CPPUNIT_ASSERT(condition.set(pick(2) ? filter_name : filter_path, literals[pick(literals.size())], literalConditions[pick(5)], filter.matchCase));
+				filter.filters.push_back(condition);
+			}
+		}
+
+		Compare(filters);
+	}
+}
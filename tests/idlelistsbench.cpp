@@ -0,0 +1,238 @@
+#include "../src/interface/idle_lists.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+/*
+ * Runs a queue of transfers over several servers through the scheduler
+ * against a mock engine that finishes the oldest transfer whenever all
+ * slots are taken. As TryStartNextTransfer does, each time a slot is
+ * free, the next transfer is picked from the servers that have room for
+ * another connection, only downloads while the upload limit is reached.
+ *
+ * Each server has a folder of uploads queued in front of a folder of
+ * downloads. The lists of idle items used by the server items are timed
+ * against the lists of all items per priority used before, which had to
+ * skip active items and items of the wrong direction.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/idlelistsbench [transfers] [servers]
+ */
+
+namespace {
+int const priorities = 5;
+
+struct item final
+{
+	bool download{};
+	bool queued{true};
+	bool active{};
+	int priority{2};
+	uint64_t order{};
+	size_t server{};
+};
+
+struct item_accessor final
+{
+	static bool queued(item const& i) { return i.queued; }
+	static void set_queued(item & i, bool queued) { i.queued = queued; }
+	static bool download(item const& i) { return i.download; }
+	static int priority(item const& i) { return i.priority; }
+	static uint64_t order(item const& i) { return i.order; }
+	static void set_order(item & i, uint64_t order) { i.order = order; }
+};
+
+struct limits final
+{
+	size_t total{10};
+	size_t uploads{3};
+	size_t per_server{2};
+};
+
+// All items of a server per priority, active ones included
+class scan_server final
+{
+public:
+	void add(item & i) { lists_[i.priority].push_back(&i); }
+
+	item* idle(bool downloads, bool uploads) const
+	{
+		for (int p = priorities - 1; p >= 0; --p) {
+			for (auto * i : lists_[p]) {
+				if (i->active) {
+					continue;
+				}
+				if (i->download ? downloads : uploads) {
+					return i;
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	void start(item & i) { i.active = true; }
+
+	void finish(item & i)
+	{
+		auto & list = lists_[i.priority];
+		list.erase(std::find(list.begin(), list.end(), &i));
+	}
+
+private:
+	std::deque<item*> lists_[priorities];
+};
+
+class indexed_server final
+{
+public:
+	void add(item & i) { lists_.add(i, true); }
+
+	item* idle(bool downloads, bool uploads) const
+	{
+		item* i = lists_.front(true, downloads, uploads);
+		return i ? i : lists_.front(false, downloads, uploads);
+	}
+
+	void start(item & i)
+	{
+		lists_.remove(i, true);
+		i.active = true;
+	}
+
+	void finish(item &) {}
+
+private:
+	idle_lists<item, item_accessor, priorities> lists_;
+};
+
+// Returns the number of transfers run
+template<typename Server>
+size_t run(std::vector<std::unique_ptr<item>> & items, size_t serverCount, limits const& l)
+{
+	std::vector<Server> servers(serverCount);
+	for (auto & i : items) {
+		i->active = false;
+		servers[i->server].add(*i);
+	}
+
+	std::vector<size_t> serverActive(serverCount);
+	std::deque<item*> active;
+	size_t activeUploads{};
+	size_t transfers{};
+
+	while (true) {
+		bool const uploads = activeUploads < l.uploads;
+
+		item* next{};
+		for (size_t s = 0; s < serverCount; ++s) {
+			if (serverActive[s] >= l.per_server) {
+				continue;
+			}
+			item* candidate = servers[s].idle(true, uploads);
+			if (candidate && (!next || candidate->priority > next->priority)) {
+				next = candidate;
+			}
+		}
+
+		if (next && active.size() < l.total) {
+			servers[next->server].start(*next);
+			++serverActive[next->server];
+			if (!next->download) {
+				++activeUploads;
+			}
+			active.push_back(next);
+			++transfers;
+			continue;
+		}
+
+		if (active.empty()) {
+			break;
+		}
+
+		// The engine finishes the oldest transfer
+		item* done = active.front();
+		active.pop_front();
+		servers[done->server].finish(*done);
+		--serverActive[done->server];
+		if (!done->download) {
+			--activeUploads;
+		}
+	}
+
+	return transfers;
+}
+
+// Each server has a folder of uploads queued before a folder of downloads
+std::vector<std::unique_ptr<item>> make_items(size_t count, size_t serverCount)
+{
+	std::vector<std::unique_ptr<item>> items;
+	items.reserve(count);
+	size_t const perServer = (count + serverCount - 1) / serverCount;
+	for (size_t i = 0; i < count; ++i) {
+		auto it = std::make_unique<item>();
+		it->server = i / perServer;
+		it->download = (i % perServer) >= perServer / 2;
+		items.push_back(std::move(it));
+	}
+	return items;
+}
+
+void report(std::string const& what, fz::duration const& d, size_t operations)
+{
+	int64_t const us = d.get_microseconds();
+	std::cout << fz::sprintf("%s: %d us", what, us);
+	if (operations) {
+		std::cout << fz::sprintf(", %d ns/operation", us * 1000 / static_cast<int64_t>(operations));
+	}
+	std::cout << std::endl;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t count = 1000000;
+	size_t serverCount = 10;
+	if (argc > 1) {
+		count = fz::to_integral<size_t>(std::string_view(argv[1]));
+	}
+	if (argc > 2) {
+		serverCount = fz::to_integral<size_t>(std::string_view(argv[2]));
+	}
+	if (!count || !serverCount) {
+		std::cerr << "Usage: " << argv[0] << " [transfers] [servers]" << std::endl;
+		return 1;
+	}
+
+	limits const l;
+	std::cout << fz::sprintf("%d transfers on %d servers, at most %d at once, %d uploads and %d per server", count, serverCount, l.total, l.uploads, l.per_server) << std::endl;
+
+	auto items = make_items(count, serverCount);
+	auto start = fz::monotonic_clock::now();
+	size_t const indexed = run<indexed_server>(items, serverCount, l);
+	report(fz::sprintf("Idle lists, %d transfers", count), fz::monotonic_clock::now() - start, indexed);
+
+	// Quadratic, would take ages for large queues
+	size_t const scanCount = std::min(count, size_t(100000));
+	size_t scanned{};
+	if (scanCount < count) {
+		items = make_items(scanCount, serverCount);
+		start = fz::monotonic_clock::now();
+		scanned = run<indexed_server>(items, serverCount, l);
+		report(fz::sprintf("Idle lists, %d transfers", scanCount), fz::monotonic_clock::now() - start, scanned);
+	}
+
+	start = fz::monotonic_clock::now();
+	scanned += run<scan_server>(items, serverCount, l);
+	report(fz::sprintf("Scanning all items, %d transfers", scanCount), fz::monotonic_clock::now() - start, scanCount);
+
+	std::cout << fz::sprintf("Checksum: %d", indexed + scanned) << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+#include "../src/interface/idle_lists.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <vector>
+
+/*
+ * This testsuite asserts that the lists of idle items the queue picks the
+ * next transfer from keep priority, immediate and insertion order across
+ * both directions.
+ */
+
+class CIdleListsTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CIdleListsTest);
+	CPPUNIT_TEST(testOrder);
+	CPPUNIT_TEST(testActive);
+	CPPUNIT_TEST(testPriority);
+	CPPUNIT_TEST(testImmediate);
+	CPPUNIT_TEST(testFindNear);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testOrder();
+	void testActive();
+	void testPriority();
+	void testImmediate();
+	void testFindNear();
+
+protected:
+	struct item final
+	{
+		bool download{};
+		bool queued{true};
+		int priority{2};
+		uint64_t order{};
+	};
+
+	struct accessor final
+	{
+		static bool queued(item const& i) { return i.queued; }
+		static void set_queued(item & i, bool queued) { i.queued = queued; }
+		static bool download(item const& i) { return i.download; }
+		static int priority(item const& i) { return i.priority; }
+		static uint64_t order(item const& i) { return i.order; }
+		static void set_order(item & i, uint64_t order) { i.order = order; }
+	};
+
+	typedef idle_lists<item, accessor, 5> lists;
+
+	// Takes the items in the order they would get transferred
+	static std::vector<item*> drain(lists & l, bool downloads = true, bool uploads = true)
+	{
+		std::vector<item*> ret;
+		while (true) {
+			item* i = l.front(true, downloads, uploads);
+			if (!i) {
+				i = l.front(false, downloads, uploads);
+			}
+			if (!i) {
+				break;
+			}
+			CPPUNIT_ASSERT(l.remove(*i, true));
+			ret.push_back(i);
+		}
+		return ret;
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CIdleListsTest);
+
+void CIdleListsTest::testOrder()
+{
+	std::vector<item> items(6);
+	lists l;
+	for (size_t i = 0; i < items.size(); ++i) {
+		items[i].download = (i % 3) != 0;
+		l.add(items[i], true);
+	}
+
+	auto order = drain(l);
+	CPPUNIT_ASSERT_EQUAL(items.size(), order.size());
+	for (size_t i = 0; i < items.size(); ++i) {
+		CPPUNIT_ASSERT(order[i] == &items[i]);
+	}
+	CPPUNIT_ASSERT(!l.front(false, true, true));
+
+	// Only the wanted direction
+	for (auto & i : items) {
+		l.add(i, true);
+	}
+	order = drain(l, false, true);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), order.size());
+	CPPUNIT_ASSERT(order[0] == &items[0]);
+	CPPUNIT_ASSERT(order[1] == &items[3]);
+	CPPUNIT_ASSERT(l.front(false, true, false) == &items[1]);
+}
+
+void CIdleListsTest::testActive()
+{
+	std::vector<item> items(3);
+	lists l;
+	l.add(items[0], true);
+	l.add(items[1], false);
+	l.add(items[2], true);
+
+	// Items that are active when added are not in the lists
+	CPPUNIT_ASSERT(!l.remove(items[1], true));
+
+	// A started item that became idle again goes first
+	CPPUNIT_ASSERT(l.remove(items[2], false));
+	l.add_front(items[2]);
+	l.add_front(items[1]);
+
+	auto const order = drain(l);
+	CPPUNIT_ASSERT_EQUAL(size_t(3), order.size());
+	CPPUNIT_ASSERT(order[0] == &items[1]);
+	CPPUNIT_ASSERT(order[1] == &items[2]);
+	CPPUNIT_ASSERT(order[2] == &items[0]);
+}
+
+void CIdleListsTest::testPriority()
+{
+	std::vector<item> items(4);
+	lists l;
+	for (auto & i : items) {
+		l.add(i, true);
+	}
+
+	// Higher priority goes first, even if added later
+	items[3].priority = 4;
+	CPPUNIT_ASSERT(l.set_priority(items[3], 2, 4));
+	CPPUNIT_ASSERT(l.front(false, true, true) == &items[3]);
+
+	items[0].priority = 0;
+	CPPUNIT_ASSERT(l.set_priority(items[0], 2, 0));
+	CPPUNIT_ASSERT(!l.set_priority(items[0], 2, 0));
+	auto order = drain(l);
+	CPPUNIT_ASSERT_EQUAL(size_t(4), order.size());
+	CPPUNIT_ASSERT(order[0] == &items[3]);
+	CPPUNIT_ASSERT(order[1] == &items[1]);
+	CPPUNIT_ASSERT(order[2] == &items[2]);
+	CPPUNIT_ASSERT(order[3] == &items[0]);
+
+	// Setting the priority of all items keeps them grouped by their old one
+	for (auto & i : items) {
+		l.add(i, true);
+	}
+	l.set_priority(1);
+	for (auto & i : items) {
+		i.priority = 1;
+	}
+	order = drain(l);
+	CPPUNIT_ASSERT_EQUAL(size_t(4), order.size());
+	CPPUNIT_ASSERT(order[0] == &items[0]);
+	CPPUNIT_ASSERT(order[1] == &items[1]);
+	CPPUNIT_ASSERT(order[2] == &items[2]);
+	CPPUNIT_ASSERT(order[3] == &items[3]);
+}
+
+void CIdleListsTest::testImmediate()
+{
+	std::vector<item> items(4);
+	items[2].queued = false;
+	items[3].queued = false;
+	lists l;
+	for (auto & i : items) {
+		l.add(i, true);
+	}
+
+	// Immediate items go first
+	CPPUNIT_ASSERT(l.front(true, true, true) == &items[2]);
+	CPPUNIT_ASSERT(l.front(false, true, true) == &items[0]);
+
+	CPPUNIT_ASSERT(l.queue_immediate(items[3]));
+	CPPUNIT_ASSERT(items[3].queued);
+	CPPUNIT_ASSERT(!l.queue_immediate(items[3]));
+
+	// And stay ahead of the others when queued
+	l.queue_immediate();
+	CPPUNIT_ASSERT(items[2].queued);
+	CPPUNIT_ASSERT(!l.front(true, true, true));
+
+	auto const order = drain(l);
+	CPPUNIT_ASSERT_EQUAL(size_t(4), order.size());
+	CPPUNIT_ASSERT(order[0] == &items[2]);
+	CPPUNIT_ASSERT(order[1] == &items[3]);
+	CPPUNIT_ASSERT(order[2] == &items[0]);
+	CPPUNIT_ASSERT(order[3] == &items[1]);
+}
+
+void CIdleListsTest::testFindNear()
+{
+	std::vector<item> items(5);
+	items[3].download = true;
+	items[4].priority = 3;
+	lists l;
+	for (auto & i : items) {
+		l.add(i, true);
+	}
+
+	auto const is = [](item const* wanted) {
+		return [wanted](item const& i) { return &i == wanted; };
+	};
+
+	// Only looks within the list of the given item
+	CPPUNIT_ASSERT(l.find_near(items[0], 10, is(&items[2])) == &items[2]);
+	CPPUNIT_ASSERT(l.find_near(items[0], 10, is(&items[3])) == &items[0]);
+	CPPUNIT_ASSERT(l.find_near(items[0], 10, is(&items[4])) == &items[0]);
+	CPPUNIT_ASSERT(l.find_near(items[1], 10, is(&items[0])) == &items[1]);
+
+	// And not further than asked to
+	CPPUNIT_ASSERT(l.find_near(items[0], 2, is(&items[1])) == &items[1]);
+	CPPUNIT_ASSERT(l.find_near(items[0], 2, is(&items[2])) == &items[0]);
+	CPPUNIT_ASSERT(l.find_near(items[1], 2, is(&items[2])) == &items[2]);
+}
@@ -0,0 +1,188 @@
+#include "../src/include/directorylisting.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+/*
+ * Measures the name lookups of CDirectoryListing: building the index on
+ * the first lookup, exact and case-insensitive hits, misses and lookups
+ * from several threads sharing one listing. A linear scan over the
+ * entries is timed alongside for reference.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/listingbench [entries]
+ */
+
+namespace {
+std::vector<std::wstring> make_names(size_t count)
+{
+	std::vector<std::wstring> names;
+	names.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		switch (i % 4) {
+		case 0:
+			names.emplace_back(fz::sprintf(L"IMG_%05d.JPG", i));
+			break;
+		case 1:
+			names.emplace_back(fz::sprintf(L"Document %d (final).pdf", i));
+			break;
+		case 2:
+			names.emplace_back(fz::sprintf(L"backup-2020-%d.tar.gz", i));
+			break;
+		default:
+			names.emplace_back(fz::sprintf(L"src_%d", i));
+			break;
+		}
+	}
+	return names;
+}
+
+CDirectoryListing make_listing(std::vector<std::wstring> const& names)
+{
+	std::vector<fz::shared_value<CDirentry>> entries;
+	entries.reserve(names.size());
+	for (auto const& name : names) {
+		CDirentry entry;
+		entry.name = name;
+		entry.size = 100;
+		entries.emplace_back(std::move(entry));
+	}
+
+	CDirectoryListing listing;
+	listing.path.SetPath(L"/bench");
+	listing.Assign(std::move(entries));
+	return listing;
+}
+
+void report(std::string const& what, fz::duration const& d, size_t lookups)
+{
+	int64_t const us = d.get_microseconds();
+	std::cout << fz::sprintf("%s: %d us", what, us);
+	if (lookups) {
+		std::cout << fz::sprintf(", %d ns/lookup", us * 1000 / static_cast<int64_t>(lookups));
+	}
+	std::cout << std::endl;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t count = 100000;
+	if (argc > 1) {
+		count = fz::to_integral<size_t>(std::string_view(argv[1]));
+		if (!count) {
+			std::cerr << "Usage: " << argv[0] << " [entries]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::cout << fz::sprintf("Listing with %d entries", count) << std::endl;
+
+	auto const names = make_names(count);
+
+	// Look the names up in an order unrelated to the one in the listing
+	std::vector<std::wstring> hits = names;
+	std::shuffle(hits.begin(), hits.end(), std::mt19937(42));
+
+	std::vector<std::wstring> upper;
+	upper.reserve(hits.size());
+	for (auto const& name : hits) {
+		upper.emplace_back(fz::str_toupper_ascii(name));
+	}
+
+	std::vector<std::wstring> misses;
+	misses.reserve(hits.size());
+	for (auto const& name : hits) {
+		misses.emplace_back(name + L"~");
+	}
+
+	// Sum of all found indexes, keeps the compiler from dropping lookups
+	size_t sum{};
+
+	CDirectoryListing const listing = make_listing(names);
+
+	auto start = fz::monotonic_clock::now();
+	sum += listing.FindFile_CmpCase(hits.front());
+	report("First lookup, builds the index", fz::monotonic_clock::now() - start, 0);
+
+	start = fz::monotonic_clock::now();
+	for (auto const& name : hits) {
+		sum += listing.FindFile_CmpCase(name);
+	}
+	report("Exact, hits", fz::monotonic_clock::now() - start, hits.size());
+
+	start = fz::monotonic_clock::now();
+	for (auto const& name : misses) {
+		sum += listing.FindFile_CmpCase(name);
+	}
+	report("Exact, misses", fz::monotonic_clock::now() - start, misses.size());
+
+	start = fz::monotonic_clock::now();
+	for (auto const& name : upper) {
+		sum += listing.FindFile_CmpNoCase(name);
+	}
+	report("Case-insensitive, hits", fz::monotonic_clock::now() - start, upper.size());
+
+	start = fz::monotonic_clock::now();
+	for (auto const& name : misses) {
+		sum += listing.FindFile_CmpNoCase(name);
+	}
+	report("Case-insensitive, misses", fz::monotonic_clock::now() - start, misses.size());
+
+	// Copies share the index of the listing they were copied from
+	start = fz::monotonic_clock::now();
+	{
+		CDirectoryListing const copy = listing;
+		sum += copy.FindFile_CmpCase(hits.back());
+	}
+	report("Copy, first lookup", fz::monotonic_clock::now() - start, 0);
+
+	// Each thread looks up every name in the same const listing
+	{
+		size_t const threads = 4;
+		fz::thread_pool pool;
+		std::vector<size_t> sums(threads);
+		std::vector<fz::async_task> tasks;
+
+		start = fz::monotonic_clock::now();
+		for (size_t i = 0; i < threads; ++i) {
+			tasks.emplace_back(pool.spawn([&, i] {
+				for (auto const& name : hits) {
+					sums[i] += listing.FindFile_CmpNoCase(name);
+				}
+			}));
+		}
+		for (auto & task : tasks) {
+			task.join();
+		}
+		report(fz::sprintf("Case-insensitive, %d threads", threads), fz::monotonic_clock::now() - start, hits.size() * threads);
+
+		for (auto const s : sums) {
+			sum += s;
+		}
+	}
+
+	// For reference, compare every name in turn. Quadratic, so only
+	// a bounded number of lookups.
+	size_t const linear = std::min(hits.size(), size_t(1000));
+	start = fz::monotonic_clock::now();
+	for (size_t i = 0; i < linear; ++i) {
+		for (size_t j = 0; j < listing.size(); ++j) {
+			if (listing[j].name == hits[i]) {
+				sum += j;
+				break;
+			}
+		}
+	}
+	report("Linear scan, hits", fz::monotonic_clock::now() - start, linear);
+
+	std::cout << fz::sprintf("Checksum: %d", sum) << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,213 @@
+#include "../src/include/directorylisting.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+/*
+ * Measures CDirectoryListingDelta between two listings of a large
+ * directory as the directory cache computes it on a refresh, with a small
+ * share of the entries changed, appended, removed, inserted in between or
+ * all of these. The new listing is built separately from the old one, like
+ * a freshly parsed listing, so the entries are not shared between the two.
+ *
+ * Entries are compared in step as long as both listings agree on the
+ * order. Once they do not, the old listing builds its name index for the
+ * lookups, which is timed separately as well. The cache shares that index
+ * with the views, which need it for their own lookups.
+ *
+ * For reference, sorting the names of the new listing is timed as well,
+ * which is the least a full update of the file list does without a delta.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/listingdeltabench [entries] [changed per mille]
+ */
+
+namespace {
+struct entry final
+{
+	std::wstring name;
+	int64_t size{};
+};
+
+std::vector<entry> make_entries(size_t count)
+{
+	std::vector<entry> entries;
+	entries.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		entry e;
+		switch (i % 4) {
+		case 0:
+			e.name = fz::sprintf(L"IMG_%05d.JPG", i);
+			break;
+		case 1:
+			e.name = fz::sprintf(L"Document %d (final).pdf", i);
+			break;
+		case 2:
+			e.name = fz::sprintf(L"backup-2020-%d.tar.gz", i);
+			break;
+		default:
+			e.name = fz::sprintf(L"src_%d", i);
+			break;
+		}
+		e.size = static_cast<int64_t>(i) * 100;
+		entries.push_back(std::move(e));
+	}
+	return entries;
+}
+
+CDirectoryListing make_listing(std::vector<entry> const& entries)
+{
+	std::vector<fz::shared_value<CDirentry>> listingEntries;
+	listingEntries.reserve(entries.size());
+	for (auto const& e : entries) {
+		CDirentry entry;
+		entry.name = e.name;
+		entry.size = e.size;
+		listingEntries.emplace_back(std::move(entry));
+	}
+
+	CDirectoryListing listing;
+	listing.path.SetPath(L"/bench");
+	listing.Assign(std::move(listingEntries));
+	return listing;
+}
+
+void report(std::string const& what, fz::duration const& d, size_t entries)
+{
+	int64_t const us = d.get_microseconds();
+	std::cout << fz::sprintf("%s: %d us", what, us);
+	if (entries) {
+		std::cout << fz::sprintf(", %d ns/entry", us * 1000 / static_cast<int64_t>(entries));
+	}
+	std::cout << std::endl;
+}
+
+// Returns false if the delta does not have the expected counts
+bool run(std::string const& what, std::vector<entry> const& from, std::vector<entry> const& to, size_t added, size_t removed, size_t changed, size_t & sum, bool index = false)
+{
+	CDirectoryListing const fromListing = make_listing(from);
+	CDirectoryListing const toListing = make_listing(to);
+
+	if (index) {
+		sum += fromListing.FindFile_CmpCase(from.front().name);
+	}
+
+	auto start = fz::monotonic_clock::now();
+	CDirectoryListingDelta const delta(fromListing, toListing);
+	report(fz::sprintf("Delta, %s%s", what, index ? ", index already built" : ""), fz::monotonic_clock::now() - start, toListing.size());
+
+	sum += delta.added.size() + delta.removed.size() + delta.changed.size() + (delta.ordered ? 1 : 0);
+	if (delta.added.size() != added || delta.removed.size() != removed || delta.changed.size() != changed) {
+		std::cerr << fz::sprintf("Unexpected delta for %s: %d added, %d removed, %d changed", what, delta.added.size(), delta.removed.size(), delta.changed.size()) << std::endl;
+		return false;
+	}
+	return true;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t count = 500000;
+	size_t perMille = 1;
+	if (argc > 1) {
+		count = fz::to_integral<size_t>(std::string_view(argv[1]));
+	}
+	if (argc > 2) {
+		perMille = fz::to_integral<size_t>(std::string_view(argv[2]), 1001);
+	}
+	if (!count || perMille > 1000) {
+		std::cerr << "Usage: " << argv[0] << " [entries] [changed per mille]" << std::endl;
+		return 1;
+	}
+
+	size_t const modified = count * perMille / 1000;
+	std::cout << fz::sprintf("Listing with %d entries, %d of them modified", count, modified) << std::endl;
+
+	auto const entries = make_entries(count);
+
+	// The modified entries are spread over the whole listing
+	std::vector<size_t> picked(count);
+	for (size_t i = 0; i < count; ++i) {
+		picked[i] = i;
+	}
+	std::shuffle(picked.begin(), picked.end(), std::mt19937(42));
+	picked.resize(modified);
+	std::sort(picked.begin(), picked.end());
+
+	// Sum of the delta sizes, keeps the compiler from dropping anything
+	size_t sum{};
+	bool ok = true;
+
+	ok &= run("unchanged", entries, entries, 0, 0, 0, sum);
+
+	auto to = entries;
+	for (auto const i : picked) {
+		to[i].size += 1;
+	}
+	ok &= run("changed", entries, to, 0, 0, modified, sum);
+
+	to = entries;
+	for (size_t i = 0; i < modified; ++i) {
+		to.push_back({fz::sprintf(L"new_%d", i), 1});
+	}
+	ok &= run("appended", entries, to, modified, 0, 0, sum);
+
+	to.clear();
+	for (size_t i = 0, j = 0; i < count; ++i) {
+		if (j < picked.size() && picked[j] == i) {
+			++j;
+		}
+		else {
+			to.push_back(entries[i]);
+		}
+	}
+	ok &= run("removed", entries, to, 0, modified, 0, sum);
+	ok &= run("removed", entries, to, 0, modified, 0, sum, true);
+
+	to.clear();
+	for (size_t i = 0, j = 0; i < count; ++i) {
+		to.push_back(entries[i]);
+		if (j < picked.size() && picked[j] == i) {
+			to.push_back({fz::sprintf(L"new_%d", j++), 1});
+		}
+	}
+	ok &= run("inserted in between", entries, to, modified, 0, 0, sum);
+
+	// A third each changed, removed and replaced by new names elsewhere in the listing
+	to = entries;
+	size_t const third = modified / 3;
+	for (size_t i = 0; i < third; ++i) {
+		to[picked[i]].size += 1;
+		to[picked[third + i]].name = fz::sprintf(L"new_%d", i);
+	}
+	for (size_t i = 2 * third; i < modified; ++i) {
+		to[picked[i]].name.clear();
+	}
+	to.erase(std::remove_if(to.begin(), to.end(), [](entry const& e) { return e.name.empty(); }), to.end());
+	ok &= run("mixed", entries, to, third, modified - third, third, sum);
+
+	// For reference
+	std::vector<std::wstring> names;
+	names.reserve(to.size());
+	for (auto const& e : to) {
+		names.push_back(e.name);
+	}
+	auto start = fz::monotonic_clock::now();
+	std::sort(names.begin(), names.end());
+	report("Sorting the names of the new listing", fz::monotonic_clock::now() - start, names.size());
+	sum += names.front().size();
+
+	CDirectoryListing const listing = make_listing(entries);
+	start = fz::monotonic_clock::now();
+	sum += listing.FindFile_CmpCase(entries.back().name);
+	report("Building the name index of the old listing", fz::monotonic_clock::now() - start, listing.size());
+
+	std::cout << fz::sprintf("Checksum: %d", sum) << std::endl;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,266 @@
+#include "../src/interface/filezilla.h"
+#include <wx/imaglist.h>
+#include <wx/scrolwin.h>
+#include <wx/listctrl.h>
+#include <wx/init.h>
+
+#include "../src/interface/filelistctrl.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <locale.h>
+
+/*
+ * Measures opening a large local directory in the local file list. Like
+ * DisplayDir did before, the directory is read and sorted in one go on
+ * the thread that shows it. Like CLocalDirLoader does now, a worker on
+ * the thread pool reads the directory and builds the sort keys, handing
+ * the entries over in batches of up to 5000 or every 200 ms. For each
+ * batch, the GUI thread sorts it and merges it into the index mapping
+ * with MergeAddedItems.
+ *
+ * Reported are the time until all entries are shown, until the first
+ * ones are shown, and the longest the GUI thread is busy at once.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/localloadbench <directory> [entries]
+ * If the directory does not exist, it gets created and filled with that
+ * many empty files and some directories first. It is left in place for
+ * further runs.
+ */
+
+namespace {
+struct entry final
+{
+	std::wstring name;
+	std::wstring sortKey;
+	int64_t size{};
+	bool dir{};
+};
+
+NameSortMode const mode = NameSortMode::natural;
+
+// Directories on top, then by name
+class compare final
+{
+public:
+	explicit compare(std::vector<entry> const& entries)
+		: entries_(entries)
+	{}
+
+	bool operator()(unsigned int a, unsigned int b) const
+	{
+		entry const& lhs = entries_[a];
+		entry const& rhs = entries_[b];
+		if (lhs.dir != rhs.dir) {
+			return lhs.dir;
+		}
+		return lhs.sortKey < rhs.sortKey;
+	}
+
+private:
+	std::vector<entry> const& entries_;
+};
+
+bool fill(fz::native_string const& dir, size_t count)
+{
+	if (!fz::mkdir(dir, false)) {
+		return false;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		fz::native_string const path = dir + fz::native_string(1, fz::local_filesys::path_separator) + fz::to_native(fz::sprintf(L"file %d.txt", i));
+		if (i % 50) {
+			fz::file f(path, fz::file::writing, fz::file::empty);
+			if (!f.opened()) {
+				return false;
+			}
+		}
+		else if (!fz::mkdir(path, false)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Returns false if reading the directory failed
+template<typename Callback>
+bool read(fz::native_string const& dir, Callback const& cb)
+{
+	fz::local_filesys fs;
+	if (!fs.begin_find_files(dir, false)) {
+		return false;
+	}
+
+	entry e;
+	fz::native_string name;
+	bool wasLink{};
+	fz::local_filesys::type t{};
+	fz::datetime time;
+	int attributes{};
+	while (fs.get_next_file(name, wasLink, t, &e.size, &time, &attributes)) {
+		e.name = fz::to_wstring(name);
+		e.dir = t == fz::local_filesys::dir;
+		e.sortKey = CFileListCtrlSortBase::MakeSortKey(e.name, mode);
+		cb(e);
+	}
+	return true;
+}
+
+void report(std::string const& what, fz::duration const& d)
+{
+	std::cout << fz::sprintf("%s: %d ms", what, d.get_milliseconds()) << std::endl;
+}
+
+struct shared final
+{
+	fz::mutex mutex_;
+	fz::condition cond_;
+	std::vector<entry> entries_;
+	bool done_{};
+	bool ok_{};
+};
+}
+
+int main(int argc, char* argv[])
+{
+	setlocale(LC_ALL, "");
+
+	size_t count = 400000;
+	if (argc > 2) {
+		count = fz::to_integral<size_t>(std::string_view(argv[2]));
+	}
+	if (argc < 2 || !count) {
+		std::cerr << "Usage: " << argv[0] << " <directory> [entries]" << std::endl;
+		return 1;
+	}
+
+	if (!wxInitialize()) {
+		std::cerr << "Failed to initialize wxWidgets" << std::endl;
+		return 1;
+	}
+
+	fz::native_string const dir = fz::to_native(fz::to_wstring(std::string_view(argv[1])));
+	if (fz::local_filesys::get_file_type(dir) == fz::local_filesys::unknown) {
+		auto const start = fz::monotonic_clock::now();
+		if (!fill(dir, count)) {
+			std::cerr << "Could not fill the directory" << std::endl;
+			return 1;
+		}
+		report(fz::sprintf("Creating %d entries", count), fz::monotonic_clock::now() - start);
+	}
+
+	size_t checksum{};
+
+	// In one go
+	{
+		auto const start = fz::monotonic_clock::now();
+		std::vector<entry> entries;
+		if (!read(dir, [&](entry const& e) { entries.push_back(e); })) {
+			std::cerr << "Could not read the directory" << std::endl;
+			return 1;
+		}
+		std::vector<unsigned int> indexMapping(entries.size());
+		for (size_t i = 0; i < entries.size(); ++i) {
+			indexMapping[i] = static_cast<unsigned int>(i);
+		}
+		std::sort(indexMapping.begin(), indexMapping.end(), compare(entries));
+		auto const d = fz::monotonic_clock::now() - start;
+		std::cout << fz::sprintf("%d entries", entries.size()) << std::endl;
+		report("In one go, until shown, GUI thread blocked all along", d);
+		checksum += indexMapping.front();
+	}
+
+	// In batches
+	{
+		fz::thread_pool pool;
+		shared s;
+
+		auto const start = fz::monotonic_clock::now();
+		fz::async_task task = pool.spawn([&s, &dir] {
+			std::vector<entry> batch;
+			fz::monotonic_clock last = fz::monotonic_clock::now();
+			auto deliver = [&](bool done, bool ok) {
+				fz::scoped_lock l(s.mutex_);
+				std::move(batch.begin(), batch.end(), std::back_inserter(s.entries_));
+				batch.clear();
+				s.done_ = done;
+				s.ok_ = ok;
+				s.cond_.signal(l);
+			};
+			bool const ok = read(dir, [&](entry const& e) {
+				batch.push_back(e);
+				if (batch.size() >= 5000 || (fz::monotonic_clock::now() - last) >= fz::duration::from_milliseconds(200)) {
+					deliver(false, true);
+					last = fz::monotonic_clock::now();
+				}
+			});
+			deliver(true, ok);
+		});
+
+		std::vector<entry> fileData;
+		std::vector<unsigned int> indexMapping;
+		fz::duration first;
+		fz::duration busy;
+		fz::duration longest;
+		size_t batches{};
+		bool done{};
+		bool ok{};
+		while (!done) {
+			std::vector<entry> entries;
+			{
+				fz::scoped_lock l(s.mutex_);
+				if (s.entries_.empty() && !s.done_) {
+					s.cond_.wait(l);
+				}
+				entries = std::move(s.entries_);
+				s.entries_.clear();
+				done = s.done_;
+				ok = s.ok_;
+			}
+
+			// What AddLoadedEntries does, short of filtering
+			auto const batchStart = fz::monotonic_clock::now();
+			std::vector<unsigned int> added;
+			added.reserve(entries.size());
+			for (auto & e : entries) {
+				added.push_back(static_cast<unsigned int>(fileData.size()));
+				fileData.push_back(std::move(e));
+			}
+			MergeAddedItems(indexMapping, 0, added, compare(fileData), nullptr);
+			auto const batchEnd = fz::monotonic_clock::now();
+
+			if (!added.empty()) {
+				if (!batches++) {
+					first = batchEnd - start;
+				}
+				busy = busy + (batchEnd - batchStart);
+				longest = std::max(longest, batchEnd - batchStart);
+			}
+		}
+		auto const d = fz::monotonic_clock::now() - start;
+		task.join();
+
+		if (!ok) {
+			std::cerr << "Could not read the directory" << std::endl;
+			return 1;
+		}
+		report(fz::sprintf("In %d batches, until shown", batches), d);
+		report("In batches, until the first entries are shown", first);
+		report("In batches, GUI thread busy", busy);
+		report("In batches, GUI thread busy at once, at most", longest);
+		checksum += indexMapping.front();
+	}
+
+	std::cout << fz::sprintf("Checksum: %d", checksum) << std::endl;
+
+	wxUninitialize();
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include "fakeftpserver.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <atomic>
+
+/*
+ * Lists directories recursively against a minimal in-process FTP server and
+ * checks how the engine falls back to plain listings if the output of
+ * LIST -R cannot be used.
+ */
+
+class CRecursiveListTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CRecursiveListTest);
+	CPPUNIT_TEST(testFallbackKeepsSupport);
+	CPPUNIT_TEST(testFallbackDisablesSupport);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testFallbackKeepsSupport();
+	void testFallbackDisablesSupport();
+
+protected:
+	void Connect(test_client & client, fake_ftp_server & server);
+	std::string Listing(std::string const& args);
+
+	std::atomic<bool> ambiguous_{};
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CRecursiveListTest);
+
+void CRecursiveListTest::Connect(test_client & client, fake_ftp_server & server)
+{
+	server.set_listing_handler([this](std::string const& args) { return Listing(args); });
+
+	CServer server_info(INSECURE_FTP, DEFAULT, L"127.0.0.1", server.port());
+	Credentials credentials;
+	credentials.logonType_ = LogonType::anonymous;
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(CConnectCommand(server_info, std::make_shared<ServerHandleData>(), credentials, false)));
+
+	// Recursive listings need the timezone offset, which the first plain listing settles
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(CListCommand(CServerPath(L"/"))));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), server.list_commands().size());
+}
+
+std::string CRecursiveListTest::Listing(std::string const& args)
+{
+	std::string ret =
+		"-rw-r--r-- 1 user group 5 Jan 01 12:00 file\r\n"
+		"drwxr-xr-x 2 user group 4096 Jan 01 12:00 sub\r\n";
+
+	if (args.find('R') != std::string::npos) {
+		ret += "\r\n";
+		if (ambiguous_) {
+			// Not a subdirectory of the listed one
+			ret += "./other:\r\n";
+		}
+		else {
+			ret += "./sub:\r\n";
+		}
+		ret += "-rw-r--r-- 1 user group 6 Jan 01 12:00 inner\r\n";
+	}
+
+	return ret;
+}
+
+void CRecursiveListTest::testFallbackKeepsSupport()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	fake_ftp_server server(loop);
+	CPPUNIT_ASSERT(server.port() > 0);
+
+	test_client client;
+	Connect(client, server);
+
+	CListCommand const recursive(CServerPath(L"/"), std::wstring(), LIST_FLAG_RECURSIVE | LIST_FLAG_REFRESH);
+
+	// Usable output establishes support and fills the cache for the subdirectory
+	ambiguous_ = false;
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(recursive));
+	auto commands = server.list_commands();
+	CPPUNIT_ASSERT_EQUAL(size_t(2), commands.size());
+	CPPUNIT_ASSERT_EQUAL(std::string("-R"), commands[1]);
+
+	CDirectoryListing listing;
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.engine().CacheLookup(CServerPath(L"/sub"), listing));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), listing.size());
+
+	// A single unusable listing falls back to a plain listing, exactly once
+	ambiguous_ = true;
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(recursive));
+	commands = server.list_commands();
+	CPPUNIT_ASSERT_EQUAL(size_t(4), commands.size());
+	CPPUNIT_ASSERT_EQUAL(std::string("-R"), commands[2]);
+	CPPUNIT_ASSERT_EQUAL(std::string(), commands[3]);
+
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.engine().CacheLookup(CServerPath(L"/"), listing));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), listing.size());
+
+	// The server is still known to support LIST -R
+	ambiguous_ = false;
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(recursive));
+	commands = server.list_commands();
+	CPPUNIT_ASSERT_EQUAL(size_t(5), commands.size());
+	CPPUNIT_ASSERT_EQUAL(std::string("-R"), commands[4]);
+}
+
+void CRecursiveListTest::testFallbackDisablesSupport()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop(pool);
+	fake_ftp_server server(loop);
+	CPPUNIT_ASSERT(server.port() > 0);
+
+	test_client client;
+	Connect(client, server);
+
+	CListCommand const recursive(CServerPath(L"/"), std::wstring(), LIST_FLAG_RECURSIVE | LIST_FLAG_REFRESH);
+
+	// Unusable output from a server not yet known to support LIST -R
+	ambiguous_ = true;
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(recursive));
+	auto commands = server.list_commands();
+	CPPUNIT_ASSERT_EQUAL(size_t(3), commands.size());
+	CPPUNIT_ASSERT_EQUAL(std::string("-R"), commands[1]);
+	CPPUNIT_ASSERT_EQUAL(std::string(), commands[2]);
+
+	// From now on plain listings are used right away
+	ambiguous_ = false;
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_OK, client.Execute(recursive));
+	commands = server.list_commands();
+	CPPUNIT_ASSERT_EQUAL(size_t(4), commands.size());
+	CPPUNIT_ASSERT_EQUAL(std::string(), commands[3]);
+}
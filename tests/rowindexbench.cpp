@@ -0,0 +1,147 @@
+#include "../src/interface/row_index.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+
+/*
+ * Measures the row index the queue uses to map between rows and items of
+ * a server: building it, looking up rows as the list control does while
+ * drawing, looking up items as GetItemIndex does and removing items from
+ * the front as finished transfers do. A linear walk over the items, as
+ * done before the index, is timed alongside for reference.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/rowindexbench [items]
+ */
+
+namespace {
+struct item final
+{
+	int slot{};
+	int rows{1};
+};
+
+struct item_accessor final
+{
+	static int slot(item const& i) { return i.slot; }
+	static void set_slot(item & i, int slot) { i.slot = slot; }
+	static int rows(item const& i) { return i.rows; }
+};
+
+using index_type = row_index<item, item_accessor>;
+
+void report(std::string const& what, fz::duration const& d, size_t operations)
+{
+	int64_t const us = d.get_microseconds();
+	std::cout << fz::sprintf("%s: %d us", what, us);
+	if (operations) {
+		std::cout << fz::sprintf(", %d ns/operation", us * 1000 / static_cast<int64_t>(operations));
+	}
+	std::cout << std::endl;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t count = 100000;
+	if (argc > 1) {
+		count = fz::to_integral<size_t>(std::string_view(argv[1]));
+		if (!count) {
+			std::cerr << "Usage: " << argv[0] << " [items]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::cout << fz::sprintf("Queue with %d items", count) << std::endl;
+
+	// Mostly files, every 100th item is an active transfer with a status row
+	std::vector<std::unique_ptr<item>> owned;
+	std::vector<item*> items;
+	int total_rows{};
+	for (size_t i = 0; i < count; ++i) {
+		owned.emplace_back(std::make_unique<item>());
+		owned.back()->rows = (i % 100) ? 1 : 2;
+		items.push_back(owned.back().get());
+		total_rows += owned.back()->rows;
+	}
+
+	std::mt19937 gen(42);
+	size_t const lookups = std::min(count, size_t(100000));
+	std::vector<int> rows;
+	std::vector<item const*> targets;
+	for (size_t i = 0; i < lookups; ++i) {
+		rows.push_back(static_cast<int>(gen() % static_cast<unsigned>(total_rows)));
+		targets.push_back(items[gen() % count]);
+	}
+
+	// Sum of all results, keeps the compiler from dropping lookups
+	int64_t sum{};
+
+	index_type index;
+
+	auto start = fz::monotonic_clock::now();
+	index.ensure(items, 0);
+	report("Build", fz::monotonic_clock::now() - start, 0);
+
+	start = fz::monotonic_clock::now();
+	for (int row : rows) {
+		sum += index.find(items, 0, row);
+		sum += row;
+	}
+	report("Row to item", fz::monotonic_clock::now() - start, rows.size());
+
+	start = fz::monotonic_clock::now();
+	for (auto const* target : targets) {
+		sum += index.index_of(items, 0, *target);
+	}
+	report("Item to row", fz::monotonic_clock::now() - start, targets.size());
+
+	// Sorting invalidates the index, the next lookup rebuilds it
+	std::reverse(items.begin(), items.end());
+	index.invalidate();
+	start = fz::monotonic_clock::now();
+	sum += index.index_of(items, 0, *targets.front());
+	report("Item to row after sorting, rebuilds", fz::monotonic_clock::now() - start, 0);
+
+	// Finished transfers get removed from the front, the slots before the
+	// removed item shift by one
+	size_t const removals = std::min(count / 2, size_t(100000));
+	size_t first{};
+	start = fz::monotonic_clock::now();
+	for (size_t i = 0; i < removals; ++i) {
+		size_t const slot = first + (i % 5);
+		++first;
+		for (size_t j = slot; j >= first; --j) {
+			items[j] = items[j - 1];
+		}
+		index.update(items, first, first - 1, slot);
+		sum += index.index_of(items, first, *items[first]);
+	}
+	report("Remove near front, then item to row", fz::monotonic_clock::now() - start, removals);
+
+	// For reference, walk the items up to the wanted one. Linear, so
+	// only a bounded number of lookups.
+	size_t const linear = std::min(targets.size(), size_t(1000));
+	start = fz::monotonic_clock::now();
+	for (size_t i = 0; i < linear; ++i) {
+		int row = 0;
+		for (size_t j = first; j < items.size(); ++j) {
+			if (items[j] == targets[i]) {
+				break;
+			}
+			row += items[j]->rows;
+		}
+		sum += row;
+	}
+	report("Linear walk, item to row", fz::monotonic_clock::now() - start, linear);
+
+	std::cout << fz::sprintf("Checksum: %d", sum) << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,261 @@
+#include "../src/interface/row_index.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+
+/*
+ * This testsuite asserts that the row index used by the queue maps rows to
+ * items and back the same way a linear walk over the items does, in
+ * particular after the items got sorted or removed.
+ */
+
+namespace {
+struct item final
+{
+	int slot{};
+	int rows{1};
+};
+
+struct item_accessor final
+{
+	static int slot(item const& i) { return i.slot; }
+	static void set_slot(item & i, int slot) { i.slot = slot; }
+	static int rows(item const& i) { return i.rows; }
+};
+
+// Keeps its items like CQueueItem keeps its children, including the
+// slots at the front left empty by cheap removals.
+class item_list final
+{
+public:
+	void push_back(int rows)
+	{
+		owned_.emplace_back(std::make_unique<item>());
+		owned_.back()->rows = rows;
+		items_.push_back(owned_.back().get());
+		index_.push_back(*items_.back());
+	}
+
+	// Like CQueueItem::RemoveChild, shifts the items before the removed one
+	// into its slot if near the front, erases it otherwise.
+	void remove(size_t i)
+	{
+		size_t const slot = first_ + i;
+		if (i <= 10) {
+			++first_;
+			for (size_t j = slot; j >= first_; --j) {
+				items_[j] = items_[j - 1];
+			}
+			index_.update(items_, first_, first_ - 1, slot);
+		}
+		else {
+			items_.erase(items_.begin() + slot);
+			index_.invalidate();
+		}
+	}
+
+	void set_rows(size_t i, int rows)
+	{
+		item & it = *items_[first_ + i];
+		int const delta = rows - it.rows;
+		it.rows = rows;
+		index_.add(it.slot, delta);
+	}
+
+	template<typename Cmp>
+	void sort(Cmp const& cmp)
+	{
+		std::stable_sort(items_.begin() + first_, items_.end(), cmp);
+		index_.invalidate();
+	}
+
+	size_t size() const { return items_.size() - first_; }
+	item const& operator[](size_t i) const { return *items_[first_ + i]; }
+
+	int index_of(item const& it) const { return index_.index_of(items_, first_, it); }
+
+	item const* find(int row, int & offset) const
+	{
+		offset = row;
+		size_t const slot = index_.find(items_, first_, offset);
+		if (slot >= items_.size()) {
+			return nullptr;
+		}
+		return items_[slot];
+	}
+
+	// Compares the index against a linear walk over all items and rows
+	void check() const
+	{
+		int row = 0;
+		for (size_t i = 0; i < size(); ++i) {
+			item const& it = (*this)[i];
+			CPPUNIT_ASSERT_EQUAL(row, index_of(it));
+			for (int r = 0; r < it.rows; ++r) {
+				int offset{};
+				CPPUNIT_ASSERT(find(row + r, offset) == &it);
+				CPPUNIT_ASSERT_EQUAL(r, offset);
+			}
+			row += it.rows;
+		}
+
+		int offset{};
+		CPPUNIT_ASSERT(!find(row, offset));
+	}
+
+private:
+	std::vector<std::unique_ptr<item>> owned_;
+	std::vector<item*> items_;
+	size_t first_{};
+	row_index<item, item_accessor> index_;
+};
+}
+
+class CRowIndexTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CRowIndexTest);
+	CPPUNIT_TEST(testEmpty);
+	CPPUNIT_TEST(testAppend);
+	CPPUNIT_TEST(testSort);
+	CPPUNIT_TEST(testRemove);
+	CPPUNIT_TEST(testRandom);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testEmpty();
+	void testAppend();
+	void testSort();
+	void testRemove();
+	void testRandom();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CRowIndexTest);
+
+void CRowIndexTest::testEmpty()
+{
+	item_list list;
+	list.check();
+}
+
+void CRowIndexTest::testAppend()
+{
+	item_list list;
+	for (int i = 0; i < 100; ++i) {
+		list.push_back(1 + i % 3);
+		list.check();
+	}
+
+	list.set_rows(50, 10);
+	list.check();
+	list.set_rows(0, 1);
+	list.check();
+}
+
+void CRowIndexTest::testSort()
+{
+	item_list list;
+	for (int i = 0; i < 50; ++i) {
+		list.push_back(1 + i % 4);
+	}
+
+	// Look up every item so that the index is built before sorting
+	list.check();
+
+	// After sorting, the first lookup by item must not use its old slot
+	list.sort([](item const* l, item const* r) { return l->rows > r->rows; });
+	for (size_t i = list.size(); i-- > 0;) {
+		int row = 0;
+		for (size_t j = 0; j < i; ++j) {
+			row += list[j].rows;
+		}
+		CPPUNIT_ASSERT_EQUAL(row, list.index_of(list[i]));
+	}
+	list.check();
+
+	// Appending after sorting, before any lookup
+	list.sort([](item const* l, item const* r) { return l->rows < r->rows; });
+	list.push_back(5);
+	list.check();
+}
+
+void CRowIndexTest::testRemove()
+{
+	item_list list;
+	for (int i = 0; i < 50; ++i) {
+		list.push_back(1 + i % 3);
+	}
+	list.check();
+
+	// Near the front, the index gets updated in place
+	list.remove(0);
+	list.check();
+	list.remove(5);
+	list.check();
+	list.remove(10);
+	list.check();
+
+	// Further back, the index gets rebuilt. The last item is looked up
+	// first, its old slot is past the end of the list.
+	list.remove(20);
+	CPPUNIT_ASSERT_EQUAL(size_t(46), list.size());
+	int row = 0;
+	for (size_t i = 0; i + 1 < list.size(); ++i) {
+		row += list[i].rows;
+	}
+	CPPUNIT_ASSERT_EQUAL(row, list.index_of(list[list.size() - 1]));
+	list.check();
+
+	// Removal after sorting, the shifted items have stale slots
+	list.sort([](item const* l, item const* r) { return l->rows > r->rows; });
+	list.remove(3);
+	list.check();
+
+	while (list.size()) {
+		list.remove(0);
+		list.check();
+	}
+}
+
+void CRowIndexTest::testRandom()
+{
+	// Fixed seed, the operations are the same on each run
+	std::mt19937 gen(42);
+	auto pick = [&gen](size_t n) { return static_cast<size_t>(gen() % n); };
+
+	item_list list;
+	for (int i = 0; i < 2000; ++i) {
+		size_t const op = pick(10);
+		if (op < 4 || !list.size()) {
+			list.push_back(1 + static_cast<int>(pick(5)));
+		}
+		else if (op < 6) {
+			list.remove(pick(list.size()));
+		}
+		else if (op < 8) {
+			list.set_rows(pick(list.size()), 1 + static_cast<int>(pick(5)));
+		}
+		else if (op == 8) {
+			list.sort([](item const* l, item const* r) { return l->rows < r->rows; });
+		}
+		else {
+			// Only look up a single item, as GetItemIndex would
+			item const& it = list[pick(list.size())];
+			int row = 0;
+			for (size_t j = 0; &list[j] != &it; ++j) {
+				row += list[j].rows;
+			}
+			CPPUNIT_ASSERT_EQUAL(row, list.index_of(it));
+		}
+
+		if (!(i % 50)) {
+			list.check();
+		}
+	}
+	list.check();
+}
@@ -0,0 +1,202 @@
+#include "../src/interface/idle_lists.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+/*
+ * Simulates a queue of downloads from one server over a shared link with
+ * and without transfers reserved for small files. Each file first spends
+ * a few round trips on commands, during which it uses no bandwidth, and
+ * then gets an equal share of the link, at most what a single connection
+ * can do with its window over the round trip time.
+ *
+ * Files are picked as TryStartNextTransfer and GetIdleChild do: as long
+ * as fewer transfers than reserved are busy with small files, a small
+ * file is preferred, otherwise a large one, looking at no more than 100
+ * files ahead in the queue.
+ *
+ * The queue holds folders as they get added recursively: most of them with
+ * many small files, some with a few large ones. Sizes are log-normally
+ * distributed around their folder's typical size.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/smallslotsbench [folders] [transfers]
+ */
+
+namespace {
+struct item final
+{
+	int64_t size{};
+	uint64_t order{};
+	bool queued{true};
+
+	bool small() const { return size < 1024 * 1024; }
+};
+
+struct item_accessor final
+{
+	static bool queued(item const& i) { return i.queued; }
+	static void set_queued(item & i, bool queued) { i.queued = queued; }
+	static bool download(item const&) { return true; }
+	static int priority(item const&) { return 0; }
+	static uint64_t order(item const& i) { return i.order; }
+	static void set_order(item & i, uint64_t order) { i.order = order; }
+};
+
+struct link final
+{
+	double bandwidth{12.5 * 1024 * 1024}; // Bytes per second, 100 Mbit/s
+	double connection{4 * 1024 * 1024}; // Bytes per second a single connection reaches
+	double overhead{4 * 0.05}; // Seconds, four round trips of 50 ms per file
+};
+
+struct result final
+{
+	double seconds{};
+	int64_t bytes{};
+	size_t files{};
+};
+
+std::vector<item> make_items(size_t folders)
+{
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> kind(0, 1);
+	std::normal_distribution<double> spread(0, 1);
+
+	std::vector<item> items;
+	for (size_t f = 0; f < folders; ++f) {
+		bool const large = kind(gen) < 0.1;
+		size_t const count = large ? 3 : 40;
+		double const typical = large ? 200.0 * 1024 * 1024 : 30.0 * 1024;
+		for (size_t i = 0; i < count; ++i) {
+			item it;
+			it.size = static_cast<int64_t>(typical * std::exp(spread(gen)));
+			items.push_back(it);
+		}
+	}
+	return items;
+}
+
+result run(std::vector<item> items, int transfers, int reserved, link const& l)
+{
+	idle_lists<item, item_accessor, 1> lists;
+	for (auto & i : items) {
+		lists.add(i, true);
+	}
+
+	struct active final
+	{
+		item* i{};
+		double overhead{};
+		double remaining{};
+	};
+	std::vector<active> running;
+	int activeSmall{};
+
+	result r;
+	while (true) {
+		while (static_cast<int>(running.size()) < transfers) {
+			item* next = lists.front(false, true, true);
+			if (!next) {
+				break;
+			}
+			int const smallSlots = std::min(reserved, transfers - 1);
+			if (smallSlots > 0) {
+				bool const small = activeSmall < smallSlots;
+				next = lists.find_near(*next, 100, [small](item const& i) { return i.small() == small; });
+			}
+			lists.remove(*next, true);
+			if (next->small()) {
+				++activeSmall;
+			}
+			running.push_back({next, l.overhead, static_cast<double>(next->size)});
+		}
+		if (running.empty()) {
+			break;
+		}
+
+		size_t const sending = std::count_if(running.begin(), running.end(), [](active const& a) { return a.overhead <= 0; });
+		double const rate = sending ? std::min(l.connection, l.bandwidth / sending) : 0;
+
+		// Until the next transfer is done with its commands or its data
+		double step = -1;
+		for (auto const& a : running) {
+			double const t = (a.overhead > 0) ? a.overhead : a.remaining / rate;
+			if (step < 0 || t < step) {
+				step = t;
+			}
+		}
+
+		r.seconds += step;
+		for (auto & a : running) {
+			if (a.overhead > 0) {
+				a.overhead -= step;
+			}
+			else {
+				a.remaining -= rate * step;
+			}
+		}
+
+		for (size_t i = 0; i < running.size();) {
+			active const& a = running[i];
+			if (a.overhead <= 1e-9 && a.remaining <= 1e-3) {
+				r.bytes += a.i->size;
+				++r.files;
+				if (a.i->small()) {
+					--activeSmall;
+				}
+				running.erase(running.begin() + i);
+			}
+			else {
+				++i;
+			}
+		}
+	}
+
+	return r;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t folders = 500;
+	int transfers = 4;
+	if (argc > 1) {
+		folders = fz::to_integral<size_t>(std::string_view(argv[1]));
+	}
+	if (argc > 2) {
+		transfers = fz::to_integral<int>(std::string_view(argv[2]), 0);
+	}
+	if (!folders || transfers < 1 || transfers > 10) {
+		std::cerr << "Usage: " << argv[0] << " [folders] [transfers]" << std::endl;
+		return 1;
+	}
+
+	link const l;
+	auto const items = make_items(folders);
+	int64_t total{};
+	size_t small{};
+	for (auto const& i : items) {
+		total += i.size;
+		small += i.small() ? 1 : 0;
+	}
+	std::cout << fz::sprintf("%d files, %d of them small, %d MiB in %d folders, %d transfers", items.size(), small, total / 1024 / 1024, folders, transfers) << std::endl;
+
+	size_t checksum{};
+	for (int reserved = 0; reserved < transfers; ++reserved) {
+		result const r = run(items, transfers, reserved, l);
+		std::cout << fz::sprintf("%d reserved for small files: %d s, %d KiB/s, %d files/min",
+			reserved, static_cast<int64_t>(r.seconds), static_cast<int64_t>(r.bytes / r.seconds / 1024), static_cast<int64_t>(r.files * 60 / r.seconds)) << std::endl;
+		checksum += r.files;
+	}
+
+	std::cout << fz::sprintf("Checksum: %d", checksum) << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+#include "../src/interface/filezilla.h"
+#include <wx/imaglist.h>
+#include <wx/scrolwin.h>
+#include <wx/listctrl.h>
+#include <wx/init.h>
+
+#include "../src/interface/filelistctrl.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <locale.h>
+#include <numeric>
+#include <random>
+
+/*
+ * Sorts a listing of names the way the file lists sort by name, in
+ * case-insensitive and in natural mode. Sorting with the comparison
+ * functions, which fold case and parse numbers in every comparison, as
+ * done before the sort keys, is timed against building a key per name
+ * and sorting by comparing the keys.
+ *
+ * The names mix camera-style names with zero-padded numbers, names with
+ * numbers of varying length and random names. Equal numbers never differ
+ * in their leading zeroes, as CmpNatural does not give a strict weak
+ * ordering for those and both sorts have to agree.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/sortbench [names]
+ */
+
+namespace {
+std::vector<std::wstring> make_names(size_t count)
+{
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> number(1, 99999);
+	std::uniform_int_distribution<int> length(4, 16);
+	std::uniform_int_distribution<int> letter(0, 52);
+
+	std::vector<std::wstring> names;
+	names.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		switch (i % 4) {
+		case 0:
+			names.push_back(fz::sprintf(L"IMG_%05d.JPG", number(gen)));
+			break;
+		case 1:
+			names.push_back(fz::sprintf(L"Photo %d.jpg", number(gen)));
+			break;
+		case 2:
+			names.push_back(fz::sprintf(L"report-%d-v%d.pdf", number(gen) % 3000, number(gen) % 20));
+			break;
+		default: {
+			std::wstring name;
+			int const len = length(gen);
+			for (int j = 0; j < len; ++j) {
+				int const c = letter(gen);
+				name += (c == 52) ? L'_' : static_cast<wchar_t>((c < 26) ? (L'a' + c) : (L'A' + c - 26));
+			}
+			names.push_back(std::move(name));
+			break;
+		}
+		}
+	}
+	return names;
+}
+
+void report(std::string const& what, fz::duration const& d, size_t operations)
+{
+	int64_t const us = d.get_microseconds();
+	std::cout << fz::sprintf("%s: %d us", what, us);
+	if (operations) {
+		std::cout << fz::sprintf(", %d ns/operation", us * 1000 / static_cast<int64_t>(operations));
+	}
+	std::cout << std::endl;
+}
+
+std::vector<int> indexes(size_t count)
+{
+	std::vector<int> ret(count);
+	std::iota(ret.begin(), ret.end(), 0);
+	return ret;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	setlocale(LC_ALL, "");
+
+	size_t count = 1000000;
+	if (argc > 1) {
+		count = fz::to_integral<size_t>(std::string_view(argv[1]));
+		if (!count) {
+			std::cerr << "Usage: " << argv[0] << " [names]" << std::endl;
+			return 1;
+		}
+	}
+
+	if (!wxInitialize()) {
+		std::cerr << "Failed to initialize wxWidgets" << std::endl;
+		return 1;
+	}
+
+	std::cout << fz::sprintf("%d names", count) << std::endl;
+	auto const names = make_names(count);
+
+	size_t checksum{};
+	int ret = 0;
+	for (auto const mode : {NameSortMode::case_insensitive, NameSortMode::natural}) {
+		std::string const modeName = (mode == NameSortMode::natural) ? "natural" : "case-insensitive";
+		auto const cmp = CFileListCtrlSortBase::GetCmpFunction(mode);
+
+		// Names the comparison function considers equal are ordered case-sensitively, as the keys do
+		auto byFunction = indexes(count);
+		auto start = fz::monotonic_clock::now();
+		std::sort(byFunction.begin(), byFunction.end(), [&](int a, int b) {
+			int const res = cmp(names[a], names[b]);
+			return res ? (res < 0) : (names[a] < names[b]);
+		});
+		report(fz::sprintf("Sorting, %s, comparison function", modeName), fz::monotonic_clock::now() - start, count);
+
+		start = fz::monotonic_clock::now();
+		std::vector<std::wstring> keys;
+		keys.reserve(count);
+		for (auto const& name : names) {
+			keys.push_back(CFileListCtrlSortBase::MakeSortKey(name, mode));
+		}
+		auto const built = fz::monotonic_clock::now();
+		report(fz::sprintf("Building keys, %s", modeName), built - start, count);
+
+		auto byKey = indexes(count);
+		std::sort(byKey.begin(), byKey.end(), [&](int a, int b) {
+			return keys[a] < keys[b];
+		});
+		auto const stop = fz::monotonic_clock::now();
+		report(fz::sprintf("Sorting, %s, keys", modeName), stop - built, count);
+		report(fz::sprintf("Sorting, %s, keys including building them", modeName), stop - start, count);
+
+		if (byFunction != byKey) {
+			std::cerr << fz::sprintf("Orders differ in %s mode", modeName) << std::endl;
+			ret = 1;
+		}
+		checksum += byKey.front() + byKey.back();
+	}
+
+	std::cout << fz::sprintf("Checksum: %d", checksum) << std::endl;
+
+	wxUninitialize();
+	return ret;
+}
@@ -0,0 +1,298 @@
+#include "../src/commonui/sync_planner.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <algorithm>
+
+/*
+ * This testsuite asserts that the sync planner uploads exactly the local
+ * files that are missing on the server or differ from the remote ones, and
+ * that it reports the entries it does not act upon.
+ */
+
+class CSyncPlannerTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CSyncPlannerTest);
+	CPPUNIT_TEST(testMissing);
+	CPPUNIT_TEST(testSizeDiffers);
+	CPPUNIT_TEST(testNewer);
+	CPPUNIT_TEST(testConflict);
+	CPPUNIT_TEST(testUnlisted);
+	CPPUNIT_TEST(testRemoteOnly);
+	CPPUNIT_TEST(testLink);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testMissing();
+	void testSizeDiffers();
+	void testNewer();
+	void testConflict();
+	void testUnlisted();
+	void testRemoteOnly();
+	void testLink();
+
+protected:
+	typedef local_recursive_operation::listing local_listing;
+
+	static fz::datetime const& now()
+	{
+		static fz::datetime const time(fz::datetime::utc, 2020, 6, 1, 12, 0, 0);
+		return time;
+	}
+
+	static local_listing local(std::wstring const& remotePath)
+	{
+		local_listing listing;
+		listing.localPath = CLocalPath(L"/local" + remotePath + (remotePath == L"/" ? L"" : L"/"));
+		listing.remotePath = CServerPath(remotePath);
+		return listing;
+	}
+
+	static void add_file(local_listing & listing, std::wstring const& name, int64_t size, fz::datetime const& time = now())
+	{
+		local_listing::entry entry;
+		entry.name = name;
+		entry.size = size;
+		entry.time = time;
+		listing.files.push_back(entry);
+	}
+
+	static void add_dir(local_listing & listing, std::wstring const& name)
+	{
+		local_listing::entry entry;
+		entry.name = name;
+		entry.size = -1;
+		listing.dirs.push_back(entry);
+	}
+
+	static CDirectoryListing remote(std::wstring const& path)
+	{
+		CDirectoryListing listing;
+		listing.path = CServerPath(path);
+		return listing;
+	}
+
+	static void add_entry(CDirectoryListing & listing, std::wstring const& name, int64_t size, int flags = 0, fz::datetime const& time = now())
+	{
+		CDirentry entry;
+		entry.name = name;
+		entry.size = size;
+		entry.flags = flags;
+		entry.time = time;
+		listing.Append(std::move(entry));
+	}
+
+	static sync_plan plan(std::vector<local_listing> const& locals, std::vector<CDirectoryListing> const& remotes, ActiveFilters const& filters = ActiveFilters())
+	{
+		sync_planner planner(CServerPath(L"/"), filters, fz::duration::from_minutes(1));
+		for (auto const& listing : locals) {
+			planner.add_local(listing);
+		}
+		for (auto const& listing : remotes) {
+			planner.add_remote(listing);
+		}
+		return planner.plan();
+	}
+
+	static std::vector<std::wstring> uploaded(sync_plan const& plan, std::wstring const& remotePath)
+	{
+		std::vector<std::wstring> names;
+		for (auto const& listing : plan.uploads) {
+			if (listing.remotePath == CServerPath(remotePath)) {
+				for (auto const& entry : listing.files) {
+					names.push_back(entry.name);
+				}
+			}
+		}
+		std::sort(names.begin(), names.end());
+		return names;
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CSyncPlannerTest);
+
+void CSyncPlannerTest::testMissing()
+{
+	auto root = local(L"/");
+	add_file(root, L"a", 10);
+	add_file(root, L"b", 20);
+	add_dir(root, L"sub");
+	add_dir(root, L"empty");
+
+	auto sub = local(L"/sub");
+	add_file(sub, L"c", 30);
+
+	auto empty = local(L"/empty");
+
+	auto remoteRoot = remote(L"/");
+	add_entry(remoteRoot, L"b", 20);
+
+	sync_plan const p = plan({root, sub, empty}, {remoteRoot});
+
+	CPPUNIT_ASSERT(uploaded(p, L"/") == std::vector<std::wstring>{L"a"});
+	CPPUNIT_ASSERT(uploaded(p, L"/sub") == std::vector<std::wstring>{L"c"});
+	CPPUNIT_ASSERT_EQUAL(int64_t(2), p.upload_files);
+	CPPUNIT_ASSERT_EQUAL(int64_t(40), p.upload_bytes);
+
+	// The missing empty directory gets created
+	auto const it = std::find_if(p.uploads.cbegin(), p.uploads.cend(), [](local_listing const& listing) { return listing.remotePath == CServerPath(L"/empty"); });
+	CPPUNIT_ASSERT(it != p.uploads.cend());
+	CPPUNIT_ASSERT(it->files.empty());
+
+	CPPUNIT_ASSERT(p.remote_only.empty());
+	CPPUNIT_ASSERT(p.conflicts.empty());
+	CPPUNIT_ASSERT(p.unknown.empty());
+}
+
+void CSyncPlannerTest::testSizeDiffers()
+{
+	auto root = local(L"/");
+	add_file(root, L"same", 10);
+	add_file(root, L"larger", 11);
+	add_file(root, L"smaller", 9);
+	add_file(root, L"unknownsize", 10);
+
+	auto remoteRoot = remote(L"/");
+	add_entry(remoteRoot, L"same", 10);
+	add_entry(remoteRoot, L"larger", 10);
+	add_entry(remoteRoot, L"smaller", 10);
+	add_entry(remoteRoot, L"unknownsize", -1);
+
+	sync_plan const p = plan({root}, {remoteRoot});
+
+	CPPUNIT_ASSERT((uploaded(p, L"/") == std::vector<std::wstring>{L"larger", L"smaller"}));
+	CPPUNIT_ASSERT_EQUAL(int64_t(20), p.upload_bytes);
+}
+
+void CSyncPlannerTest::testNewer()
+{
+	auto root = local(L"/");
+	add_file(root, L"newer", 10, now() + fz::duration::from_minutes(2));
+	add_file(root, L"withinthreshold", 10, now() + fz::duration::from_seconds(30));
+	add_file(root, L"older", 10, now() - fz::duration::from_minutes(2));
+	add_file(root, L"nodate", 10, fz::datetime());
+
+	auto remoteRoot = remote(L"/");
+	add_entry(remoteRoot, L"newer", 10);
+	add_entry(remoteRoot, L"withinthreshold", 10);
+	add_entry(remoteRoot, L"older", 10);
+	add_entry(remoteRoot, L"nodate", 10);
+
+	sync_plan const p = plan({root}, {remoteRoot});
+
+	CPPUNIT_ASSERT(uploaded(p, L"/") == std::vector<std::wstring>{L"newer"});
+}
+
+void CSyncPlannerTest::testConflict()
+{
+	auto root = local(L"/");
+	add_file(root, L"file", 10);
+	add_dir(root, L"dir");
+
+	auto dir = local(L"/dir");
+	add_file(dir, L"inner", 10);
+
+	auto remoteRoot = remote(L"/");
+	add_entry(remoteRoot, L"file", -1, CDirentry::flag_dir);
+	add_entry(remoteRoot, L"dir", 10);
+
+	sync_plan const p = plan({root, dir}, {remoteRoot});
+
+	CPPUNIT_ASSERT(p.uploads.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(2), p.conflicts.size());
+	for (auto const& conflict : p.conflicts) {
+		CPPUNIT_ASSERT(conflict.path == CServerPath(L"/"));
+		CPPUNIT_ASSERT_EQUAL(conflict.name == L"file", conflict.dir);
+	}
+}
+
+void CSyncPlannerTest::testUnlisted()
+{
+	auto root = local(L"/");
+	add_dir(root, L"listed");
+	add_dir(root, L"unlisted");
+
+	auto listed = local(L"/listed");
+	add_file(listed, L"a", 10);
+
+	auto unlisted = local(L"/unlisted");
+	add_file(unlisted, L"b", 10);
+
+	auto remoteRoot = remote(L"/");
+	add_entry(remoteRoot, L"listed", -1, CDirentry::flag_dir);
+	add_entry(remoteRoot, L"unlisted", -1, CDirentry::flag_dir);
+
+	// E.g. listing it failed
+	auto remoteListed = remote(L"/listed");
+
+	sync_plan const p = plan({root, listed, unlisted}, {remoteRoot, remoteListed});
+
+	CPPUNIT_ASSERT(uploaded(p, L"/listed") == std::vector<std::wstring>{L"a"});
+	CPPUNIT_ASSERT(uploaded(p, L"/unlisted").empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(1), p.unknown.size());
+	CPPUNIT_ASSERT(p.unknown[0] == CServerPath(L"/unlisted"));
+
+	// Without any remote listing, nothing is known
+	sync_plan const p2 = plan({root, listed, unlisted}, {});
+	CPPUNIT_ASSERT(p2.uploads.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(1), p2.unknown.size());
+	CPPUNIT_ASSERT(p2.unknown[0] == CServerPath(L"/"));
+}
+
+void CSyncPlannerTest::testRemoteOnly()
+{
+	auto root = local(L"/");
+	add_file(root, L"both", 10);
+
+	auto remoteRoot = remote(L"/");
+	add_entry(remoteRoot, L"both", 10);
+	add_entry(remoteRoot, L"file", 10);
+	add_entry(remoteRoot, L"dir", -1, CDirentry::flag_dir);
+	add_entry(remoteRoot, L"file.tmp", 10);
+
+	// Remote entries hidden by the filters are not reported
+	CFilter filter;
+	filter.matchType = CFilter::any;
+	CFilterCondition condition;
+	condition.set(filter_name, L".tmp", 3, false);
+	filter.filters.push_back(condition);
+	ActiveFilters filters;
+	filters.second.push_back(filter);
+
+	sync_plan const p = plan({root}, {remoteRoot}, filters);
+
+	CPPUNIT_ASSERT(p.uploads.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(2), p.remote_only.size());
+	for (auto const& entry : p.remote_only) {
+		CPPUNIT_ASSERT(entry.path == CServerPath(L"/"));
+		CPPUNIT_ASSERT(entry.name == L"file" || entry.name == L"dir");
+		CPPUNIT_ASSERT_EQUAL(entry.name == L"dir", entry.dir);
+	}
+}
+
+void CSyncPlannerTest::testLink()
+{
+	auto root = local(L"/");
+	add_dir(root, L"link");
+
+	auto link = local(L"/link");
+	add_file(link, L"a", 10);
+
+	auto remoteRoot = remote(L"/");
+	add_entry(remoteRoot, L"link", -1, CDirentry::flag_dir | CDirentry::flag_link);
+
+	// The recursive listing resolves the link to its target
+	auto target = remote(L"/elsewhere");
+	add_entry(target, L"b", 10);
+
+	sync_plan const p = plan({root, link}, {remoteRoot, target});
+
+	CPPUNIT_ASSERT(p.uploads.empty());
+	CPPUNIT_ASSERT(p.unknown.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(1), p.links.size());
+	CPPUNIT_ASSERT(p.links[0].path == CServerPath(L"/"));
+	CPPUNIT_ASSERT(p.links[0].name == L"link");
+}
@@ -0,0 +1,145 @@
+#include "../src/interface/text_cache.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Measures fetching the size and time texts of a file list while scrolling
+ * through it, as the list control does through GetItemText on each repaint.
+ * The texts are formatted each time, as done before the cache, and fetched
+ * through the text cache used by the file lists and the queue.
+ *
+ * The formatting mimics the default size format with thousands separators
+ * and the default date and time format, without wx.
+ *
+ * Not part of the test suite, run it by hand after make check:
+ *   tests/textcachebench [entries]
+ */
+
+namespace {
+struct entry final
+{
+	int64_t size{};
+	fz::datetime time;
+};
+
+std::wstring format_size(int64_t size)
+{
+	std::wstring digits = fz::to_wstring(size);
+	std::wstring ret;
+	ret.reserve(digits.size() + digits.size() / 3);
+	for (size_t i = 0; i < digits.size(); ++i) {
+		if (i && !((digits.size() - i) % 3)) {
+			ret += L',';
+		}
+		ret += digits[i];
+	}
+	return ret;
+}
+
+std::wstring format_time(fz::datetime const& time)
+{
+	return time.format(L"%Y-%m-%d %H:%M:%S", fz::datetime::local);
+}
+
+void report(std::string const& what, fz::duration const& d, size_t operations)
+{
+	int64_t const us = d.get_microseconds();
+	std::cout << fz::sprintf("%s: %d us", what, us);
+	if (operations) {
+		std::cout << fz::sprintf(", %d ns/operation", us * 1000 / static_cast<int64_t>(operations));
+	}
+	std::cout << std::endl;
+}
+
+// Scrolls from top to bottom by the given number of rows, repainting all
+// visible rows each time. Calls fetch for the size and time of each row.
+template<typename Fetch>
+size_t scroll(std::vector<entry> const& entries, size_t visible, size_t step, Fetch && fetch)
+{
+	size_t operations{};
+	for (size_t top = 0; top + visible <= entries.size(); top += step) {
+		for (size_t row = top; row < top + visible; ++row) {
+			fetch(row);
+			operations += 2;
+		}
+	}
+	return operations;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t count = 100000;
+	if (argc > 1) {
+		count = fz::to_integral<size_t>(std::string_view(argv[1]));
+		if (!count) {
+			std::cerr << "Usage: " << argv[0] << " [entries]" << std::endl;
+			return 1;
+		}
+	}
+
+	size_t const visible = 40;
+	size_t const wheel = 3;
+
+	std::cout << fz::sprintf("Listing with %d entries, %d visible rows", count, visible) << std::endl;
+
+	std::mt19937_64 gen(42);
+	std::vector<entry> entries(count);
+	for (auto & e : entries) {
+		e.size = static_cast<int64_t>(gen() % 10000000000ull);
+		e.time = fz::datetime(static_cast<time_t>(1000000000 + gen() % 700000000), fz::datetime::seconds);
+	}
+
+	// Sum of all text lengths, keeps the compiler from dropping lookups
+	size_t sum{};
+
+	auto start = fz::monotonic_clock::now();
+	size_t operations = scroll(entries, visible, wheel, [&](size_t row) {
+		sum += format_size(entries[row].size).size();
+		sum += format_time(entries[row].time).size();
+	});
+	report("Scroll by wheel, format each time", fz::monotonic_clock::now() - start, operations);
+
+	text_cache<size_t, int64_t, std::wstring> sizeTexts;
+	text_cache<size_t, fz::datetime, std::wstring> timeTexts;
+
+	start = fz::monotonic_clock::now();
+	operations = scroll(entries, visible, wheel, [&](size_t row) {
+		sum += sizeTexts.get(row, entries[row].size, format_size).size();
+		sum += timeTexts.get(row, entries[row].time, format_time).size();
+	});
+	report("Scroll by wheel, cached", fz::monotonic_clock::now() - start, operations);
+
+	// Paging shows each row once, the worst case for the cache
+	sizeTexts.clear();
+	timeTexts.clear();
+	start = fz::monotonic_clock::now();
+	operations = scroll(entries, visible, visible, [&](size_t row) {
+		sum += sizeTexts.get(row, entries[row].size, format_size).size();
+		sum += timeTexts.get(row, entries[row].time, format_time).size();
+	});
+	report("Scroll by page, cached", fz::monotonic_clock::now() - start, operations);
+
+	// Repainting a screen that doesn't scroll, e.g. while hovering
+	size_t const repaints = 10000;
+	start = fz::monotonic_clock::now();
+	for (size_t i = 0; i < repaints; ++i) {
+		for (size_t row = 0; row < visible && row < count; ++row) {
+			sum += sizeTexts.get(row, entries[row].size, format_size).size();
+			sum += timeTexts.get(row, entries[row].time, format_time).size();
+		}
+	}
+	report("Repaint same rows, cached", fz::monotonic_clock::now() - start, repaints * std::min(visible, count) * 2);
+
+	std::cout << fz::sprintf("Checksum: %d", sum) << std::endl;
+
+	return 0;
+}
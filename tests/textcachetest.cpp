@@ -0,0 +1,86 @@
+#include "../src/interface/text_cache.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <string>
+
+/*
+ * This testsuite asserts that the text cache used by the file lists and the
+ * queue formats each value only once per key, picks up changed values and
+ * stays within its limit.
+ */
+
+class CTextCacheTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CTextCacheTest);
+	CPPUNIT_TEST(testCached);
+	CPPUNIT_TEST(testChangedValue);
+	CPPUNIT_TEST(testLimit);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testCached();
+	void testChangedValue();
+	void testLimit();
+
+protected:
+	std::string Format(int value)
+	{
+		++formatted_;
+		return std::to_string(value);
+	}
+
+	int formatted_{};
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CTextCacheTest);
+
+void CTextCacheTest::testCached()
+{
+	text_cache<size_t, int, std::string> cache;
+	auto format = [this](int value) { return Format(value); };
+
+	CPPUNIT_ASSERT_EQUAL(std::string("5"), cache.get(0, 5, format));
+	CPPUNIT_ASSERT_EQUAL(std::string("5"), cache.get(0, 5, format));
+	CPPUNIT_ASSERT_EQUAL(1, formatted_);
+
+	// Same value under another key is another entry
+	CPPUNIT_ASSERT_EQUAL(std::string("5"), cache.get(1, 5, format));
+	CPPUNIT_ASSERT_EQUAL(2, formatted_);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), cache.size());
+
+	// Formatting changed
+	cache.clear();
+	CPPUNIT_ASSERT_EQUAL(std::string("5"), cache.get(0, 5, format));
+	CPPUNIT_ASSERT_EQUAL(3, formatted_);
+}
+
+void CTextCacheTest::testChangedValue()
+{
+	text_cache<size_t, int, std::string> cache;
+	auto format = [this](int value) { return Format(value); };
+
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), cache.get(0, 0, format));
+
+	// E.g. the key now refers to another entry, or the size became known
+	CPPUNIT_ASSERT_EQUAL(std::string("42"), cache.get(0, 42, format));
+	CPPUNIT_ASSERT_EQUAL(std::string("42"), cache.get(0, 42, format));
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), cache.get(0, 0, format));
+	CPPUNIT_ASSERT_EQUAL(3, formatted_);
+	CPPUNIT_ASSERT_EQUAL(size_t(1), cache.size());
+}
+
+void CTextCacheTest::testLimit()
+{
+	text_cache<size_t, int, std::string> cache(10);
+	auto format = [this](int value) { return Format(value); };
+
+	for (size_t i = 0; i < 100; ++i) {
+		CPPUNIT_ASSERT_EQUAL(std::to_string(i * 2), cache.get(i, static_cast<int>(i * 2), format));
+		CPPUNIT_ASSERT(cache.size() <= 10);
+	}
+	CPPUNIT_ASSERT_EQUAL(100, formatted_);
+}
@@ -0,0 +1,263 @@
+#include "../src/interface/filezilla.h"
+#include "../src/interface/xml_stream.h"
+
+#include <libfilezilla/local_filesys.hpp>
+
+#include <wx/filename.h>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts that the streaming XML writer and reader used
+ * for queue export and import round-trip documents, refuse malformed or
+ * truncated input and never leave a partially written file behind.
+ */
+
+class CXmlStreamTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CXmlStreamTest);
+	CPPUNIT_TEST(testRoundTrip);
+	CPPUNIT_TEST(testShallow);
+	CPPUNIT_TEST(testSafeSave);
+	CPPUNIT_TEST(testMalformed);
+	CPPUNIT_TEST(testTruncated);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void testRoundTrip();
+	void testShallow();
+	void testSafeSave();
+	void testMalformed();
+	void testTruncated();
+
+protected:
+	bool WriteDocument(std::wstring const& file);
+	void WriteRaw(std::wstring const& file, std::string const& data);
+	std::string ReadRaw(std::wstring const& file);
+	bool Read(std::string const& data, std::vector<std::string> & names);
+
+	std::wstring file_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CXmlStreamTest);
+
+void CXmlStreamTest::setUp()
+{
+	file_ = wxFileName::CreateTempFileName(_T("fzxmltest")).ToStdWstring();
+	CPPUNIT_ASSERT(!file_.empty());
+}
+
+void CXmlStreamTest::tearDown()
+{
+	fz::remove_file(fz::to_native(file_), false);
+	fz::remove_file(fz::to_native(file_ + L".tmp"), false);
+}
+
+bool CXmlStreamTest::WriteDocument(std::wstring const& file)
+{
+	pugi::xml_document document;
+	auto root = document.append_child("FileZilla3");
+	root.append_attribute("version") = "3.0 <test> & \"quotes\"";
+
+	auto queue = root.append_child("Queue");
+
+	xml_stream_writer writer(file);
+	writer.write_declaration();
+	writer.open_element(root, 0);
+	writer.open_element(queue, 1);
+	for (int i = 0; i < 3; ++i) {
+		pugi::xml_document server;
+		auto element = server.append_child("Server");
+		element.append_child("Host").text() = fz::sprintf("host%d.example.com", i).c_str();
+		for (int j = 0; j <= i; ++j) {
+			auto file = element.append_child("File");
+			file.append_child("LocalFile").text() = fz::sprintf("/tmp/%d&%d<>.txt", i, j).c_str();
+		}
+		writer.write_element(element, 2);
+	}
+	writer.close_element("Queue", 1);
+	writer.close_element(root.name(), 0);
+
+	return writer.finish();
+}
+
+void CXmlStreamTest::WriteRaw(std::wstring const& file, std::string const& data)
+{
+	fz::file f(fz::to_native(file), fz::file::writing, fz::file::empty);
+	CPPUNIT_ASSERT(f.opened());
+	auto res = f.write2(data.c_str(), data.size());
+	CPPUNIT_ASSERT(res && res.value_ == data.size());
+}
+
+std::string CXmlStreamTest::ReadRaw(std::wstring const& file)
+{
+	std::string ret;
+	fz::file f(fz::to_native(file), fz::file::reading);
+	if (f.opened()) {
+		ret.resize(static_cast<size_t>(f.size()));
+		auto res = f.read2(ret.data(), ret.size());
+		CPPUNIT_ASSERT(res && res.value_ == ret.size());
+	}
+	return ret;
+}
+
+bool CXmlStreamTest::Read(std::string const& data, std::vector<std::string> & names)
+{
+	WriteRaw(file_, data);
+
+	names.clear();
+	xml_stream_reader reader(file_);
+	return reader.read({"a"}, false, [&](pugi::xml_node element) {
+		names.emplace_back(element.name());
+		return true;
+	});
+}
+
+void CXmlStreamTest::testRoundTrip()
+{
+	CPPUNIT_ASSERT(WriteDocument(file_));
+
+	xml_stream_reader reader(file_);
+	CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(ReadRaw(file_).size()), reader.size());
+
+	std::vector<std::string> hosts;
+	std::vector<std::string> files;
+	int ends{};
+	bool res = reader.read({"FileZilla3", "Queue"}, false, [&](pugi::xml_node element) {
+		CPPUNIT_ASSERT_EQUAL(std::string("Server"), std::string(element.name()));
+		hosts.emplace_back(element.child("Host").child_value());
+		for (auto file = element.child("File"); file; file = file.next_sibling("File")) {
+			files.emplace_back(file.child("LocalFile").child_value());
+		}
+		return true;
+	}, [&]() {
+		++ends;
+		return true;
+	});
+	CPPUNIT_ASSERT(res);
+	CPPUNIT_ASSERT(reader.error().empty());
+	CPPUNIT_ASSERT_EQUAL(1, ends);
+
+	CPPUNIT_ASSERT_EQUAL(size_t(3), hosts.size());
+	CPPUNIT_ASSERT_EQUAL(std::string("host0.example.com"), hosts[0]);
+	CPPUNIT_ASSERT_EQUAL(std::string("host2.example.com"), hosts[2]);
+
+	CPPUNIT_ASSERT_EQUAL(size_t(6), files.size());
+	CPPUNIT_ASSERT_EQUAL(std::string("/tmp/0&0<>.txt"), files[0]);
+	CPPUNIT_ASSERT_EQUAL(std::string("/tmp/2&2<>.txt"), files[5]);
+
+	// The root's attributes survive as well
+	std::string version;
+	res = reader.read({}, true, [&](pugi::xml_node element) {
+		version = element.attribute("version").value();
+		return true;
+	});
+	CPPUNIT_ASSERT(res);
+	CPPUNIT_ASSERT_EQUAL(std::string("3.0 <test> & \"quotes\""), version);
+}
+
+void CXmlStreamTest::testShallow()
+{
+	CPPUNIT_ASSERT(WriteDocument(file_));
+
+	xml_stream_reader reader(file_);
+
+	// Shallow elements come without their children
+	int servers{};
+	bool res = reader.read({"FileZilla3", "Queue"}, true, [&](pugi::xml_node element) {
+		CPPUNIT_ASSERT(!element.first_child());
+		++servers;
+		return true;
+	});
+	CPPUNIT_ASSERT(res);
+	CPPUNIT_ASSERT_EQUAL(3, servers);
+
+	// Stopping early is not an error
+	servers = 0;
+	res = reader.read({"FileZilla3", "Queue"}, false, [&](pugi::xml_node) {
+		return ++servers < 2;
+	});
+	CPPUNIT_ASSERT(res);
+	CPPUNIT_ASSERT(reader.error().empty());
+	CPPUNIT_ASSERT_EQUAL(2, servers);
+}
+
+void CXmlStreamTest::testSafeSave()
+{
+	std::string const old = "<FileZilla3><Queue/></FileZilla3>";
+	WriteRaw(file_, old);
+
+	// Abandoned writers leave the target alone and clean up after themselves
+	{
+		pugi::xml_document document;
+		auto root = document.append_child("FileZilla3");
+
+		xml_stream_writer writer(file_);
+		CPPUNIT_ASSERT(!writer.failed());
+		writer.write_declaration();
+		writer.open_element(root, 0);
+	}
+	CPPUNIT_ASSERT_EQUAL(old, ReadRaw(file_));
+	CPPUNIT_ASSERT(fz::local_filesys::get_file_type(fz::to_native(file_ + L".tmp")) == fz::local_filesys::unknown);
+
+	// Finished writers replace it
+	CPPUNIT_ASSERT(WriteDocument(file_));
+	CPPUNIT_ASSERT(ReadRaw(file_) != old);
+	CPPUNIT_ASSERT(fz::local_filesys::get_file_type(fz::to_native(file_ + L".tmp")) == fz::local_filesys::unknown);
+}
+
+void CXmlStreamTest::testMalformed()
+{
+	std::vector<std::string> names;
+
+	CPPUNIT_ASSERT(Read("<a><b/><c>x</c></a>", names));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), names.size());
+	CPPUNIT_ASSERT(Read("<a ><b></b ></a\n>", names));
+
+	// Closing tags have to match the open element
+	CPPUNIT_ASSERT(!Read("<a><b></c></a>", names));
+	CPPUNIT_ASSERT(!Read("<a><b></a></b>", names));
+	CPPUNIT_ASSERT(!Read("<a><b></bb></a>", names));
+	CPPUNIT_ASSERT(!Read("<a><bb></b></a>", names));
+	CPPUNIT_ASSERT(!Read("<a><b><c></b></a>", names));
+	CPPUNIT_ASSERT(!Read("<a></a></a>", names));
+	CPPUNIT_ASSERT(!Read("</a>", names));
+
+	// Neither an element nor a document is allowed to be empty
+	CPPUNIT_ASSERT(!Read("", names));
+	CPPUNIT_ASSERT(!Read("<?xml version=\"1.0\"?>", names));
+	CPPUNIT_ASSERT(!Read("<a><></a>", names));
+
+	// Delivered elements get parsed in full
+	CPPUNIT_ASSERT(!Read("<a><b x=1/></a>", names));
+
+	xml_stream_reader reader(file_);
+	CPPUNIT_ASSERT(!reader.read({"a"}, false, [](pugi::xml_node) { return true; }));
+	CPPUNIT_ASSERT(!reader.error().empty());
+}
+
+void CXmlStreamTest::testTruncated()
+{
+	CPPUNIT_ASSERT(WriteDocument(file_));
+	std::string const data = ReadRaw(file_);
+
+	size_t const end = data.rfind('>') + 1;
+	CPPUNIT_ASSERT(end > 0);
+
+	// Every proper prefix of the document lacks at least the end of the root element
+	for (size_t size = 0; size < end; ++size) {
+		WriteRaw(file_, data.substr(0, size));
+
+		xml_stream_reader reader(file_);
+		bool const res = reader.read({"FileZilla3", "Queue"}, false, [](pugi::xml_node) { return true; });
+		CPPUNIT_ASSERT_MESSAGE(fz::sprintf("Prefix of %d bytes accepted", size), !res);
+		CPPUNIT_ASSERT(!reader.error().empty());
+	}
+
+	WriteRaw(file_, data.substr(0, end));
+	xml_stream_reader reader(file_);
+	CPPUNIT_ASSERT(reader.read({"FileZilla3", "Queue"}, false, [](pugi::xml_node) { return true; }));
+}